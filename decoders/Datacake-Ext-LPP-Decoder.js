@@ -39,6 +39,8 @@
  *                                                          Longitude : 0.000001 ° Signed MSB
  *                                                          Altitude  : 0.01 meter Signed MSB
  *  VOC index           3338    138     8A      1           VOC index
+ *  Batch of samples    -       139     8B      var         LPP type, count, then per sample
+ *                                                          time delta (s) and value delta as varints
  * 
  */
 
@@ -74,6 +76,7 @@ function lppDecode(bytes) {
 		136: { 'size': 9, 'name': 'gps', 'signed': true, 'divisor': [10000, 10000, 100] },
 		137: { 'size': 11, 'name': 'gps', 'signed': true, 'divisor': [1000000, 1000000, 100] },
 		138: { 'size': 2, 'name': 'voc', 'signed': false, 'divisor': 1 },
+		139: { 'size': 0, 'name': 'batch', 'signed': true, 'divisor': 1 },
 		142: { 'size': 1, 'name': 'switch', 'signed': false, 'divisor': 1 },
 	};
 
@@ -98,6 +101,24 @@ function lppDecode(bytes) {
 
 	}
 
+	// Read an unsigned LEB128 varint at position i
+	function readVarint() {
+		var value = 0;
+		var factor = 1;
+		var b;
+		do {
+			b = bytes[i++];
+			value += (b & 0x7F) * factor;
+			factor *= 128;
+		} while (b & 0x80);
+		return value;
+	}
+
+	// Convert a zigzag encoded value back into a signed value
+	function zigzag(value) {
+		return (value % 2) ? -(value + 1) / 2 : value / 2;
+	}
+
 	var sensors = [];
 	var i = 0;
 	while (i < bytes.length) {
@@ -182,6 +203,23 @@ function lppDecode(bytes) {
 					'value': s_value.longitude
 				});
 				break;
+			case 139:   // Batch of samples
+				var b_type = sensor_types[bytes[i++]];
+				var b_count = bytes[i++];
+				if (typeof b_type == 'undefined') {
+					throw 'Batch sensor type error!';
+				}
+				// Time of the first sample in seconds before the uplink
+				var b_time = -readVarint();
+				var b_value = zigzag(readVarint());
+				s_value = [{ 'time': b_time, 'value': b_value / b_type.divisor }];
+				for (var n = 1; n < b_count; n++) {
+					b_time += readVarint();
+					b_value += zigzag(readVarint());
+					s_value.push({ 'time': b_time, 'value': b_value / b_type.divisor });
+				}
+				type = { 'size': 0, 'name': b_type.name + '_batch' };
+				break;
 			case 135:   // Colour
 				s_value = {
 					'r': arrayToDecimal(bytes.slice(i + 0, i + 1), type.signed, type.divisor),
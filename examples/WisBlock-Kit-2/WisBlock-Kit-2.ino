@@ -11,14 +11,8 @@
 
 #include "app.h"
 
-#ifdef NRF52_SERIES
-/** Timer to wakeup task frequently and send message */
-SoftwareTimer delayed_sending;
-#endif
-#ifdef ARDUINO_ARCH_RP2040
-/** Timer for periodic sending */
-TimerEvent_t delayed_sending;
-#endif
+/** Scheduler job for delayed sending */
+uint8_t delayed_sending = 0;
 
 /** Set the device name, max length is 10 characters */
 char g_ble_dev_name[10] = "RAK-GNSS";
@@ -42,31 +36,6 @@ time_t min_delay = 45000;
 /** Flag if BME680 was found */
 bool has_env = false;
 
-#ifdef NRF52_SERIES
-/**
- * @brief Timer function used to avoid sending packages too often.
- *       Delays the next package by 10 seconds
- * 
- * @param unused 
- *      Timer handle, not used
- */
-void send_delayed(TimerHandle_t unused)
-{
-	api_wake_loop(STATUS);
-}
-#endif
-#ifdef ARDUINO_ARCH_RP2040
-/**
- * @brief Timer function used to avoid sending packages too often.
- *      Delays the next package by 10 seconds
- * 
- */
-void send_delayed(void)
-{
-	api_wake_loop(STATUS);
-}
-#endif
-
 /**
  * @brief Application specific setup functions
  * 
@@ -146,17 +115,6 @@ bool init_app(void)
 		// Send repeat time is 0, set delay to 30 seconds
 		min_delay = 30000;
 	}
-	// Set to 1/2 of programmed send interval or 30 seconds
-#ifdef NRF52_SERIES
-	delayed_sending.begin(g_lorawan_settings.send_repeat_time, send_delayed);
-#endif
-#ifdef ARDUINO_ARCH_RP2040
-	delayed_sending.oneShot = false;
-	delayed_sending.ReloadValue = g_lorawan_settings.send_repeat_time;
-	TimerInit(&delayed_sending, send_delayed);
-	TimerSetValue(&delayed_sending, g_lorawan_settings.send_repeat_time);
-#endif
-
 	// Power down GNSS module
 	// pinMode(WB_IO2, OUTPUT);
 	// digitalWrite(WB_IO2, LOW);
@@ -281,13 +239,7 @@ void app_event_handler(void)
 				send_now = false;
 				if (!delayed_active)
 				{
-					// delayed_sending.stop();
-#ifdef NRF52_SERIES
-					delayed_sending.stop();
-#endif
-#ifdef ARDUINO_ARCH_RP2040
-					TimerStop(&delayed_sending);
-#endif
+					api_schedule_cancel(delayed_sending);
 					MYLOG("APP", "Expired time %d", (int)(millis() - last_pos_send));
 					MYLOG("APP", "Max delay time %d", (int)min_delay);
 
@@ -296,14 +248,8 @@ void app_event_handler(void)
 
 					MYLOG("APP", "Only %lds since last position message, send delayed in %lds", (long)((millis() - last_pos_send) / 1000), (long)(wait_time / 1000));
 
-#ifdef NRF52_SERIES
-					delayed_sending.setPeriod(wait_time);
-					delayed_sending.start();
-#endif
-#ifdef ARDUINO_ARCH_RP2040
-					TimerSetValue(&delayed_sending, wait_time);
-					TimerStart(&delayed_sending);
-#endif
+					// Wake up once with a STATUS event when the minimum delay is over
+					delayed_sending = api_schedule_event(STATUS, wait_time);
 
 					delayed_active = true;
 				}
@@ -342,11 +288,7 @@ void ble_data_handler(void)
 			/** BLE UART data arrived */
 			g_task_event_type &= N_BLE_DATA;
 
-			while (g_ble_uart.available() > 0)
-			{
-				at_serial_input(uint8_t(g_ble_uart.read()));
-				delay(5);
-			}
+			at_serial_read(g_ble_uart);
 			at_serial_input(uint8_t('\n'));
 		}
 	}
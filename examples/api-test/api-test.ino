@@ -243,11 +243,7 @@ void ble_data_handler(void)
 			// in this example we forward it to the AT command interpreter
 			g_task_event_type &= N_BLE_DATA;
 
-			while (g_ble_uart.available() > 0)
-			{
-				at_serial_input(uint8_t(g_ble_uart.read()));
-				delay(5);
-			}
+			at_serial_read(g_ble_uart);
 			at_serial_input(uint8_t('\n'));
 		}
 	}
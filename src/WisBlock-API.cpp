@@ -17,6 +17,9 @@ bool init_flash_done;
 /** Semaphore used by events to wake up loop task */
 SemaphoreHandle_t g_task_sem = NULL;
 
+/** Loop task handle */
+TaskHandle_t g_loop_task = NULL;
+
 /** Timer to wakeup task frequently and send message */
 TimerHandle_t g_task_wakeup_timer;
 
@@ -33,9 +36,11 @@ bool g_enable_ble = false;
  */
 void periodic_wakeup(TimerHandle_t unused)
 {
+	(void)unused;
 	// Switch on LED to show we are awake
 	digitalWrite(LED_GREEN, HIGH);
-	api_wake_loop(STATUS);
+	// Let the loop task run the scheduled jobs
+	api_wake_loop(SCHED_TICK);
 }
 #endif
 
@@ -58,7 +63,8 @@ void periodic_wakeup(void)
 {
 	// Switch on LED to show we are awake
 	digitalWrite(LED_GREEN, HIGH);
-	api_wake_loop(STATUS);
+	// Let the loop task run the scheduled jobs
+	api_wake_loop(SCHED_TICK);
 }
 #endif
 
@@ -66,6 +72,9 @@ void periodic_wakeup(void)
 /** Semaphore used by events to wake up loop task */
 SemaphoreHandle_t g_task_sem = NULL;
 
+/** Loop task handle */
+TaskHandle_t g_loop_task = NULL;
+
 /** Timer to wakeup task frequently and send message */
 Ticker g_task_wakeup_timer;
 
@@ -84,7 +93,8 @@ void periodic_wakeup(void)
 {
 	// Switch on LED to show we are awake
 	digitalWrite(LED_GREEN, HIGH);
-	api_wake_loop(STATUS);
+	// Let the loop task run the scheduled jobs
+	api_wake_loop(SCHED_TICK);
 }
 #endif
 
@@ -94,6 +104,10 @@ void periodic_wakeup(void)
  */
 void setup()
 {
+	// Prepare the event queue before any event source is started
+	api_event_init();
+	// Prepare the scheduler timer
+	api_schedule_init();
 
 #if defined NRF52_SERIES || defined ESP32
 	// Create the task event semaphore
@@ -251,14 +265,59 @@ void loop()
 {
 #ifdef ARDUINO_ARCH_RP2040
 	loop_thread = osThreadGetId();
+#else
+	g_loop_task = xTaskGetCurrentTaskHandle();
 #endif
 	// Sleep until we are woken up by an event
 	api_wait_wake();
 	{
 		// Switch on green LED to show we are awake
 		digitalWrite(LED_GREEN, HIGH);
-		while (g_task_event_type != NO_EVENT)
+		// Handle queued events one by one in the order they arrived
+		while (true)
 		{
+			if (g_task_event_type == NO_EVENT)
+			{
+				if (!api_event_pop(&g_last_event))
+				{
+					break;
+				}
+				g_task_event_type = g_last_event.type;
+
+				// Hand the oldest received packet to the application
+				if (((g_task_event_type & LORA_DATA) == LORA_DATA) && !api_rx_deliver())
+				{
+					// Packet was already handled by the application
+					g_task_event_type &= N_LORA_DATA;
+				}
+
+				// Report the result of a queued uplink
+				if ((g_task_event_type & LORA_TX_FIN) == LORA_TX_FIN)
+				{
+					tx_queue_finish();
+				}
+
+				// Start the frequent wakeup after the device joined the network
+				if (((g_task_event_type & LORA_JOIN_FIN) == LORA_JOIN_FIN) && (g_last_event.data == 1) && (g_lorawan_settings.send_repeat_time != 0))
+				{
+					API_LOG("API", "Start timer");
+					api_timer_start();
+				}
+
+				// Run the scheduled jobs
+				if ((g_task_event_type & SCHED_TICK) == SCHED_TICK)
+				{
+					g_task_event_type &= N_SCHED_TICK;
+					api_schedule_run();
+				}
+			}
+
+			// Downlinks on a port with a handler don't go to the application event handlers
+			if (((g_task_event_type & LORA_DATA) == LORA_DATA) && api_rx_dispatch())
+			{
+				g_task_event_type &= N_LORA_DATA;
+			}
+
 			// Application specific event handler (timer event or others)
 			app_event_handler();
 
@@ -277,14 +336,22 @@ void loop()
 			{
 				g_task_event_type &= N_BLE_CONFIG;
 				API_LOG("API", "Config received over BLE");
-				delay(100);
+
+				// Save new settings, deferred from the BLE callback
+				save_settings();
 
 				// Inform connected device about new settings
 				g_lora_data.write((void *)&g_lorawan_settings, sizeof(s_lorawan_settings));
 				g_lora_data.notify((void *)&g_lorawan_settings, sizeof(s_lorawan_settings));
 
+				if (g_lorawan_settings.resetRequest)
+				{
+					// Give the BLE stack time to send the notification
+					API_LOG("API", "Initiate reset");
+					api_schedule_callback(api_reset, 1000);
+				}
 				// Check if auto connect is enabled
-				if ((g_lorawan_settings.auto_join) && !g_lorawan_initialized)
+				else if ((g_lorawan_settings.auto_join) && !g_lorawan_initialized)
 				{
 					if (g_lorawan_settings.lorawan_enable)
 					{
@@ -302,28 +369,33 @@ void loop()
 			if ((g_task_event_type & AT_CMD) == AT_CMD)
 			{
 				g_task_event_type &= N_AT_CMD;
-				while (Serial.available() > 0)
+				at_serial_read(Serial);
+			}
+
+			// Return the received packet to the RX ring and continue with the next one
+			if ((g_rx_packet != NULL) && ((g_task_event_type & LORA_DATA) != LORA_DATA))
+			{
+				api_rx_release(g_rx_packet);
+				if (api_rx_deliver())
 				{
-					at_serial_input(uint8_t(Serial.read()));
-					delay(5);
+					g_task_event_type |= LORA_DATA;
 				}
 			}
 		}
+		// Send the next queued uplink
+		tx_queue_pump();
+		// Replay the uplink journal
+		lorawan_journal_pump();
+
 		// Skip this log message when USB data is received
-		if ((g_task_event_type & AT_CMD) == AT_CMD)
+		if (g_last_event.type != AT_CMD)
 		{
 			API_LOG("API", "Loop goes to sleep");
 		}
 		Serial.flush();
-		g_task_event_type = 0;
 		// Switch off blue LED to show we go to sleep
 		digitalWrite(LED_GREEN, LOW);
-		delay(10);
 		// Go back to sleep
-#if defined NRF52_SERIES || defined ESP32
-
-		xSemaphoreTake(g_task_sem, 10);
-#endif
 #ifdef ARDUINO_ARCH_RP2040
 		yield();
 #endif
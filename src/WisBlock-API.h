@@ -49,6 +49,7 @@
 #include <Arduino.h>
 #include <LoRaWan-Arduino.h>
 #include "wisblock_cayenne.h"
+#include "lora_airtime.h"
 
 #ifdef NRF52_SERIES
 #include <nrf_nvic.h>
@@ -79,6 +80,7 @@ using namespace std::chrono;
 #if defined NRF52_SERIES
 void periodic_wakeup(TimerHandle_t unused);
 extern SemaphoreHandle_t g_task_sem;
+extern TaskHandle_t g_loop_task;
 // extern SoftwareTimer g_task_wakeup_timer;
 extern TimerHandle_t g_task_wakeup_timer;
 #endif
@@ -90,6 +92,7 @@ extern TimerEvent_t g_task_wakeup_timer;
 #if defined ESP32
 void periodic_wakeup(void);
 extern SemaphoreHandle_t g_task_sem;
+extern TaskHandle_t g_loop_task;
 // extern SoftwareTimer g_task_wakeup_timer;
 extern Ticker g_task_wakeup_timer;
 #endif
@@ -111,10 +114,35 @@ extern volatile uint16_t g_task_event_type;
 #define N_AT_CMD 0b1111111111011111
 #define LORA_JOIN_FIN 0b0000000001000000
 #define N_LORA_JOIN_FIN 0b1111111110111111
+#define SCHED_TICK 0b0000000010000000
+#define N_SCHED_TICK 0b1111111101111111
 
 /** Wake signal for RAK11310 */
 #define SIGNAL_WAKE 0x001
 
+// Event queue
+/** Number of events that can be queued, must be a power of 2 */
+#ifndef API_EVENT_QUEUE_SIZE
+#define API_EVENT_QUEUE_SIZE 32
+#endif
+/** Event record queued by api_wake_loop() */
+struct s_api_event
+{
+	// Event type, same bits as used in g_task_event_type
+	uint16_t type;
+	// millis() when the event was queued
+	uint32_t timestamp;
+	// Event specific payload, e.g. packet size or TX result
+	uint32_t data;
+};
+void api_event_init(void);
+bool api_event_push(uint16_t type, uint32_t data = 0);
+bool api_event_pop(s_api_event *event);
+bool api_event_pending(void);
+extern s_api_event g_last_event;
+extern volatile uint32_t g_event_dropped;
+extern volatile uint32_t g_event_coalesced;
+
 #if defined NRF52_SERIES
 // BLE
 #include <bluefruit.h>
@@ -142,6 +170,11 @@ void restart_advertising(uint16_t timeout);
 extern BLECharacteristic *lora_characteristic;
 extern BLECharacteristic *uart_tx_characteristic;
 extern bool g_ble_uart_is_connected;
+/** Min time in ms between two BLE UART lines */
+#ifndef API_BLE_NOTIFY_GAP
+#define API_BLE_NOTIFY_GAP 50
+#endif
+void ble_uart_notify(uint8_t *data, size_t len);
 extern bool g_enable_ble;
 
 // WiFi
@@ -235,22 +268,382 @@ struct s_lorawan_settings
 
 // int size = sizeof(s_lorawan_settings);
 extern s_lorawan_settings g_lorawan_settings;
-extern uint8_t g_rx_lora_data[];
+// Since 1.2.0 a pointer into the RX packet ring instead of an array
+extern uint8_t *g_rx_lora_data;
 extern uint8_t g_rx_data_len;
 extern uint8_t g_tx_lora_data[];
 extern uint8_t g_tx_data_len;
 extern bool g_lorawan_initialized;
 extern int16_t g_last_rssi;
 extern int8_t g_last_snr;
+extern uint8_t g_last_fport;
+
+// RX packet ring
+/** Number of received packets that can be buffered, must be a power of 2 (max 128) */
+#ifndef API_RX_SLOTS
+#define API_RX_SLOTS 4
+#endif
+/** Received packet */
+struct s_rx_packet
+{
+	uint8_t data[256];
+	uint16_t len;
+	int16_t rssi;
+	int8_t snr;
+	uint8_t fport;
+	uint32_t timestamp;
+	// Time of the radio callback in us, for latency measurement
+	uint32_t timestamp_us;
+};
+bool api_rx_put(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr, uint8_t fport);
+s_rx_packet *api_rx_borrow(void);
+void api_rx_release(s_rx_packet *packet);
+uint8_t api_rx_count(void);
+bool api_rx_deliver(void);
+extern s_rx_packet *g_rx_packet;
+extern volatile uint32_t g_rx_dropped;
+
+// Downlink port handlers
+#ifndef API_PORT_HANDLERS
+#define API_PORT_HANDLERS 8
+#endif
+typedef void (*port_handler_t)(s_rx_packet *packet);
+/** Time from the radio callback to the port handler in us */
+struct s_rx_latency
+{
+	uint32_t count;
+	uint32_t last_us;
+	uint32_t avg_us;
+	uint32_t max_us;
+};
+bool api_register_port_handler(uint8_t port, port_handler_t handler);
+bool api_register_port_range(uint8_t first, uint8_t last, port_handler_t handler);
+bool api_rx_dispatch(void);
+void api_rx_latency(s_rx_latency *latency);
+void api_rx_latency_reset(void);
+
+// TX buffer lease
+uint8_t *api_tx_acquire(void);
+void api_tx_release(void);
+lmh_error_status api_tx_submit(uint8_t size, uint8_t fport = 0);
+bool api_tx_start(uint8_t *data, uint8_t size);
+void api_tx_finished(void);
+
+// TX queue
+#ifndef API_TX_QUEUE_SIZE
+#define API_TX_QUEUE_SIZE 8
+#endif
+#ifndef API_TX_QUEUE_PAYLOAD
+#define API_TX_QUEUE_PAYLOAD 64
+#endif
+/** Min wait time in ms before a busy or failed uplink is tried again, a random time up to the same value is added */
+#ifndef API_TX_QUEUE_BACKOFF
+#define API_TX_QUEUE_BACKOFF 1000
+#endif
+/** Result of a queued uplink */
+enum TX_RESULT
+{
+	TX_RESULT_SENT = 0,	   // Unconfirmed uplink or LoRa P2P packet was sent
+	TX_RESULT_ACKED = 1,   // Confirmed uplink was acknowledged
+	TX_RESULT_NACKED = 2,  // Confirmed uplink was not acknowledged
+	TX_RESULT_TIMEOUT = 3, // TX timeout
+	TX_RESULT_FAILED = 4   // Request was rejected or the channel was busy
+};
+typedef void (*tx_done_cb_t)(uint16_t handle, uint8_t result);
+uint16_t api_tx_enqueue(uint8_t *data, uint8_t size, uint8_t fport = 0, uint8_t priority = 0, uint8_t retries = 0, tx_done_cb_t callback = NULL);
+bool api_tx_cancel(uint16_t handle);
+uint8_t api_tx_pending(void);
+void tx_queue_result(uint8_t result);
+void tx_queue_finish(void);
+void tx_queue_pump(void);
+
+// Max payload and fragmentation
+#ifndef API_FRAG_MAX_SIZE
+#define API_FRAG_MAX_SIZE 512
+#endif
+#define FRAG_HEADER_SIZE 2
+#define FRAG_INDEX_MASK 0x3F
+#define FRAG_LAST 0x80
+#define FRAG_MAX_FRAGMENTS 64
+uint8_t api_region_max_payload(uint8_t region, uint8_t datarate);
+uint8_t api_max_payload(void);
+uint8_t api_tx_fragment(uint8_t *data, uint16_t size, uint8_t fport = 0, uint8_t priority = 0, uint8_t retries = 0, tx_done_cb_t callback = NULL);
+uint16_t api_frag_receive(uint8_t *data, uint8_t size, uint8_t **message);
 enum P2P_RX_MODE
 {
 	RX_MODE_NONE = 0,
 	RX_MODE_RX = 1,
 	RX_MODE_RX_TIMED = 2,
-	RX_MODE_RX_WAIT = 3
+	RX_MODE_RX_WAIT = 3,
+	RX_MODE_RX_SNIFF = 4
 };
+#define P2P_RX_MODES 5
 extern uint8_t g_lora_p2p_rx_mode;
 extern uint32_t g_lora_p2p_rx_time;
+extern uint32_t g_lora_p2p_sniff_period;
+// Length of the listen window in sniff mode in symbols
+#ifndef API_P2P_SNIFF_SYMBOLS
+#define API_P2P_SNIFF_SYMBOLS 8
+#endif
+uint32_t api_p2p_symbol_time(void);
+bool api_p2p_sniff(uint32_t period_ms);
+void p2p_radio_config(void);
+
+// Time on air
+uint32_t api_p2p_airtime(uint8_t size);
+bool api_lorawan_dr_params(uint8_t region, uint8_t datarate, uint8_t *sf, uint8_t *bw);
+uint32_t api_lorawan_airtime(uint8_t region, uint8_t datarate, uint8_t size);
+void api_airtime_add(uint32_t airtime_us);
+uint32_t api_airtime_hour(void);
+uint32_t api_airtime_total(void);
+uint32_t api_airtime_packets(void);
+void api_airtime_reset(void);
+
+// Link quality statistics
+#ifndef API_LINK_EWMA_SHIFT
+#define API_LINK_EWMA_SHIFT 3
+#endif
+#define LINK_AVG_SCALE 16
+#define LINK_HIST_BUCKETS 8
+#define LINK_RSSI_START -130
+#define LINK_RSSI_STEP 10
+#define LINK_SNR_START -20
+#define LINK_SNR_STEP 4
+#define LINK_DUMP_VERSION 1
+#define LINK_DUMP_SIZE 55
+struct s_link_stats
+{
+	uint32_t rx_ok;
+	uint32_t rx_crc_error;
+	uint32_t rx_timeout;
+	int16_t rssi_avg;
+	int16_t snr_avg;
+	int16_t rssi_min;
+	int16_t rssi_max;
+	int8_t snr_min;
+	int8_t snr_max;
+	uint16_t rssi_hist[LINK_HIST_BUCKETS];
+	uint16_t snr_hist[LINK_HIST_BUCKETS];
+};
+void api_link_rx(int16_t rssi, int8_t snr);
+void api_link_error(bool timeout);
+uint16_t api_link_per(void);
+const s_link_stats *api_link_stats(void);
+void api_link_reset(void);
+uint16_t api_link_dump(uint8_t *buffer, uint16_t size);
+
+// LoRa P2P listen before talk
+#ifndef API_CAD_MAX_ATTEMPTS
+#define API_CAD_MAX_ATTEMPTS 4
+#endif
+#ifndef API_CAD_BACKOFF
+#define API_CAD_BACKOFF 50
+#endif
+#ifndef API_CAD_CHANNELS
+#define API_CAD_CHANNELS 8
+#endif
+struct s_cad_stats
+{
+	uint32_t frequency;
+	uint32_t busy;
+	uint32_t clear;
+};
+void api_p2p_lbt(uint8_t max_attempts, uint16_t backoff_ms);
+void api_p2p_lbt_get(uint8_t *max_attempts, uint16_t *backoff_ms);
+uint8_t api_p2p_cad_stats(s_cad_stats *stats, uint8_t max);
+void api_p2p_cad_stats_reset(void);
+void p2p_lbt_start(void);
+bool p2p_lbt_result(bool busy);
+
+// LoRa P2P frequency hopping
+#ifndef API_P2P_HOP_CHANNELS
+#define API_P2P_HOP_CHANNELS 16
+#endif
+bool api_p2p_hop(uint8_t channels, uint32_t spacing, uint32_t key);
+void api_p2p_hop_get(uint8_t *channels, uint32_t *spacing, uint32_t *key);
+uint8_t api_p2p_hop_channel(uint32_t index);
+uint32_t api_p2p_hop_index(void);
+void api_p2p_hop_sync(uint32_t index);
+uint32_t api_p2p_frequency(void);
+void p2p_hop_next(void);
+void p2p_hop_tune(bool force);
+
+// LoRa P2P time slots (TDMA)
+#ifndef API_TDMA_GUARD
+#define API_TDMA_GUARD 20
+#endif
+#ifndef API_TDMA_BEACON_SLOT
+#define API_TDMA_BEACON_SLOT 250
+#endif
+#ifndef API_TDMA_MAX_MISSED
+#define API_TDMA_MAX_MISSED 3
+#endif
+#define TDMA_BEACON_SIZE 11
+#define TDMA_AUTO_SLOT 0xFF
+enum TDMA_ROLE
+{
+	TDMA_OFF = 0,
+	TDMA_COORDINATOR = 1,
+	TDMA_NODE = 2
+};
+struct s_tdma_status
+{
+	uint8_t role;
+	bool synced;
+	uint8_t slots;
+	uint8_t slot;
+	uint16_t frame;
+	uint32_t frame_ms;
+};
+bool api_p2p_tdma(uint8_t role, uint32_t frame_ms = 0, uint8_t slots = 0);
+void api_p2p_tdma_slot(uint8_t slot);
+void api_p2p_tdma_status(s_tdma_status *status);
+bool p2p_tdma_rx(uint8_t *payload, uint16_t size);
+bool p2p_tdma_tx_done(void);
+bool p2p_tdma_defer(void);
+
+// LoRa P2P duty cycle limit
+#ifndef API_DUTY_WINDOW
+#define API_DUTY_WINDOW 3600000
+#endif
+bool api_p2p_duty_cycle(uint16_t limit_permille, bool queue = true);
+void api_p2p_duty_cycle_get(uint16_t *limit_permille, bool *queue);
+uint32_t api_p2p_duty_wait(uint8_t size);
+uint32_t api_p2p_duty_credit(void);
+bool p2p_duty_check(uint8_t size, uint32_t *wait_ms);
+bool p2p_duty_queue(void);
+void p2p_duty_used(uint32_t frequency, uint32_t airtime_us);
+
+// LoRa P2P frames of the API, not passed to the application
+typedef void (*p2p_frame_cb_t)(bool result);
+bool p2p_send_frame(uint8_t *data, uint8_t size, p2p_frame_cb_t done);
+
+// LoRa P2P adaptive SF and TX power
+#ifndef API_ADAPT_MARGIN
+#define API_ADAPT_MARGIN 10
+#endif
+#ifndef API_ADAPT_HYST
+#define API_ADAPT_HYST 3
+#endif
+#ifndef API_ADAPT_SAMPLES
+#define API_ADAPT_SAMPLES 4
+#endif
+#ifndef API_ADAPT_LOSSES
+#define API_ADAPT_LOSSES 3
+#endif
+#ifndef API_ADAPT_MIN_POWER
+#define API_ADAPT_MIN_POWER 2
+#endif
+#ifndef API_ADAPT_POWER_STEP
+#define API_ADAPT_POWER_STEP 3
+#endif
+#ifndef API_ADAPT_RETRIES
+#define API_ADAPT_RETRIES 2
+#endif
+#ifndef API_ADAPT_ACK_WAIT
+#define API_ADAPT_ACK_WAIT 1000
+#endif
+#ifndef API_ADAPT_TIMEOUT
+#define API_ADAPT_TIMEOUT 120000
+#endif
+#ifndef API_ADAPT_RETRY
+#define API_ADAPT_RETRY 50
+#endif
+#define ADAPT_FRAME_SIZE 5
+struct s_adapt_status
+{
+	bool enabled;
+	uint8_t sf;
+	uint8_t tx_power;
+	uint8_t samples;
+	int8_t snr;
+	int8_t margin;
+};
+bool api_p2p_adapt(bool enable);
+void api_p2p_adapt_status(s_adapt_status *status);
+uint8_t api_p2p_sf(void);
+uint8_t api_p2p_tx_power(void);
+bool p2p_adapt_rx(uint8_t *payload, uint16_t size, int8_t snr);
+void p2p_adapt_loss(void);
+
+// LoRa P2P reliable delivery
+#ifndef API_REL_WINDOW
+#define API_REL_WINDOW 4
+#endif
+#ifndef API_REL_PAYLOAD
+#define API_REL_PAYLOAD 64
+#endif
+#ifndef API_REL_PEERS
+#define API_REL_PEERS 8
+#endif
+#ifndef API_REL_RETRIES
+#define API_REL_RETRIES 3
+#endif
+#ifndef API_REL_ACK_WAIT
+#define API_REL_ACK_WAIT 1000
+#endif
+#ifndef API_REL_BUSY_RETRY
+#define API_REL_BUSY_RETRY 50
+#endif
+#define REL_HEADER_SIZE 6
+#define REL_ACK_SIZE 7
+#define REL_BROADCAST 0xFF
+struct s_rel_stats
+{
+	uint32_t sent;
+	uint32_t retransmits;
+	uint32_t acked;
+	uint32_t failed;
+	uint32_t received;
+	uint32_t duplicates;
+};
+bool api_p2p_reliable(uint8_t address, uint8_t window = 1);
+void api_p2p_reliable_get(uint8_t *address, uint8_t *window);
+uint16_t api_p2p_send_reliable(uint8_t dst, uint8_t *data, uint8_t size, uint8_t retries = API_REL_RETRIES, tx_done_cb_t callback = NULL);
+uint8_t api_p2p_reliable_pending(void);
+const s_rel_stats *api_p2p_reliable_stats(void);
+void api_p2p_reliable_stats_reset(void);
+bool p2p_reliable_rx(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr);
+
+// LoRa P2P radio state machine
+enum P2P_STATE
+{
+	P2P_STATE_SLEEP = 0,
+	P2P_STATE_RX,
+	P2P_STATE_CAD,
+	P2P_STATE_TX,
+	P2P_STATE_SNIFF,
+	P2P_STATE_NUM
+};
+enum P2P_EVENT
+{
+	P2P_EV_MODE = 0, // RX mode changed or radio initialized
+	P2P_EV_TX_START,
+	P2P_EV_CAD_FREE,
+	P2P_EV_CAD_BUSY,
+	P2P_EV_TX_DONE,
+	P2P_EV_TX_TIMEOUT,
+	P2P_EV_RX_DONE,
+	P2P_EV_RX_TIMEOUT,
+	P2P_EV_RX_ERROR,
+	P2P_EV_NUM
+};
+struct s_p2p_transition
+{
+	uint32_t time;
+	uint8_t from;
+	uint8_t event;
+	uint8_t to;
+};
+#ifndef API_P2P_LOG_SIZE
+#define API_P2P_LOG_SIZE 16
+#endif
+extern const char *p2p_state_names[];
+void api_p2p_event(uint8_t event);
+uint8_t api_p2p_state(void);
+uint32_t api_p2p_state_time(uint8_t state);
+void api_p2p_state_reset(void);
+uint8_t api_p2p_log(s_p2p_transition *log, uint8_t max);
 
 #define LORAWAN_COMPAT_MARKER 0x57
 struct s_loracompat_settings
@@ -302,11 +695,133 @@ struct s_loracompat_settings
 	uint8_t lora_region = 0;
 };
 
+// LoRaWAN session
+/** Uplinks between two frame counter checkpoints in flash */
+#ifndef API_SESSION_FCNT_STEP
+#define API_SESSION_FCNT_STEP 100
+#endif
+#define LORAWAN_SESSION_MARKER 0x5A
+#define LORAWAN_SESSION_VERSION 2
+#define LORAWAN_SESSION_MASK_SIZE 6
+struct s_lorawan_session
+{
+	uint8_t valid_mark_1 = 0xAA;
+	uint8_t valid_mark_2 = LORAWAN_SESSION_MARKER;
+	uint8_t version = LORAWAN_SESSION_VERSION;
+	// Region and join mode the session belongs to
+	uint8_t region = 0;
+	bool otaa = true;
+	uint8_t reserved = 0;
+	// Credentials the session belongs to
+	uint8_t dev_eui[8] = {0};
+	uint8_t app_eui[8] = {0};
+	// FNV-1a hash of the AppKey, an OTAA session is not used after the key was changed
+	uint32_t app_key_hash = 0;
+	// Session from the join
+	uint32_t dev_addr = 0;
+	uint8_t nwk_skey[16] = {0};
+	uint8_t app_skey[16] = {0};
+	// Frame counter checkpoints, the uplink counter is saved ahead of the real counter, the downlink counter after each downlink
+	uint32_t fcnt_up = 0;
+	uint32_t fcnt_down = 0;
+	// Channel mask, RX2 and data rate from the network
+	uint16_t channel_mask[LORAWAN_SESSION_MASK_SIZE] = {0};
+	uint32_t rx2_frequency = 0;
+	uint8_t rx2_datarate = 0;
+	int8_t datarate = 0;
+	// Checksum over all fields above
+	uint16_t checksum = 0;
+};
+bool api_lorawan_session_get(s_lorawan_session *session);
+void api_lorawan_session_clear(void);
+bool lorawan_session_restore(void);
+void lorawan_session_joined(void);
+void lorawan_session_uplink(void);
+void lorawan_session_downlink(void);
+
+// LoRaWAN join back-off
+/** Retry interval after the first failed join in ms, doubled after each failed join */
+#ifndef API_JOIN_BACKOFF_MIN
+#define API_JOIN_BACKOFF_MIN 15000
+#endif
+/** Max retry interval in ms, the join duty cycle of the LoRaWAN specification can require longer intervals */
+#ifndef API_JOIN_BACKOFF_MAX
+#define API_JOIN_BACKOFF_MAX 3600000
+#endif
+/** Number of data rates below the configured data rate that are used for join retries */
+#ifndef API_JOIN_DR_SPAN
+#define API_JOIN_DR_SPAN 2
+#endif
+#define JOIN_STATE_MARKER 0x4A
+struct s_join_state
+{
+	uint8_t valid_mark_1 = 0xAA;
+	uint8_t valid_mark_2 = JOIN_STATE_MARKER;
+	// Failed joins since the last successful join
+	uint16_t attempts = 0;
+};
+struct s_join_status
+{
+	bool enabled;
+	bool pending;
+	uint16_t attempts;
+	uint32_t next_attempt;
+	uint32_t interval;
+	uint8_t datarate;
+};
+void api_join_retry(bool enable);
+void api_join_status(s_join_status *status);
+void lorawan_join_start(void);
+void lorawan_join_failed(void);
+void lorawan_join_done(void);
+
+// LoRaWAN uplink journal
+/** Number of journal segment files, the oldest segment is dropped when all are full */
+#ifndef API_JOURNAL_SEGMENTS
+#define API_JOURNAL_SEGMENTS 8
+#endif
+/** Records per journal segment file */
+#ifndef API_JOURNAL_SEGMENT_RECORDS
+#define API_JOURNAL_SEGMENT_RECORDS 16
+#endif
+/** Wait time in ms before a journal record that was not sent is tried again */
+#ifndef API_JOURNAL_RETRY
+#define API_JOURNAL_RETRY 30000
+#endif
+/** Max payload of a journal record, leaves room for the appended age. Larger uplinks are rejected and counted as dropped,
+ *  raise API_TX_QUEUE_PAYLOAD (max 246) to journal the max payload of the region */
+#define API_JOURNAL_PAYLOAD (API_TX_QUEUE_PAYLOAD - 4)
+#define JOURNAL_MARKER 'J'
+#define JOURNAL_VERSION 1
+struct s_journal_status
+{
+	bool enabled;
+	bool send_age;
+	uint32_t max_age;
+	uint32_t records;
+	uint32_t stored;
+	uint32_t sent;
+	uint32_t dropped;
+};
+bool api_journal(bool enable, uint32_t max_age = 0, bool send_age = false);
+bool api_journal_add(uint8_t *data, uint8_t size, uint8_t fport = 0);
+void api_journal_clear(void);
+void api_journal_status(s_journal_status *status);
+uint32_t api_journal_time(void);
+void api_journal_set_time(uint32_t seconds);
+bool lorawan_journal_capture(uint8_t *data, uint8_t size, uint8_t fport);
+void lorawan_journal_pump(void);
+
 // Flash
 void init_flash(void);
 bool save_settings(void);
 void log_settings(void);
 void flash_reset(void);
+bool read_session(s_lorawan_session *session);
+bool save_session(s_lorawan_session *session);
+void delete_session(void);
+bool read_join_state(s_join_state *state);
+bool save_join_state(s_join_state *state);
 extern bool init_flash_done;
 
 // Battery
@@ -326,6 +841,8 @@ typedef struct atcmd_s
 	int (*exec_cmd_no_para)(void); // AT+CMD
 } atcmd_t;
 void at_serial_input(uint8_t cmd);
+void at_serial_input(uint8_t *data, uint16_t len);
+void at_serial_read(Stream &port);
 extern char *region_names[];
 extern char g_at_query_buf[];
 bool user_at_handler(char *user_cmd, uint8_t cmd_size) __attribute__((weak));
@@ -335,6 +852,13 @@ extern uint8_t g_user_at_cmd_num __attribute__((weak));
 extern bool has_custom_at;
 
 void at_settings(void);
+
+// Remote configuration with AT commands in LoRaWAN downlinks
+#ifndef API_CONFIG_PORT
+#define API_CONFIG_PORT 199
+#endif
+bool api_remote_config(bool enable, uint8_t port = API_CONFIG_PORT);
+uint8_t api_remote_config_port(void);
 #ifdef ARDUINO_ARCH_RP2040
 bool init_serial_task(void);
 #endif
@@ -355,23 +879,44 @@ void api_set_version(uint16_t sw_1 = 1, uint16_t sw_2 = 0, uint16_t sw_3 = 0);
 void api_read_credentials(void);
 void api_set_credentials(void);
 void api_reset(void);
+// Set to 1 to assert that blocking delays are only used in the loop task
+#ifndef API_CHECK_BLOCKING
+#define API_CHECK_BLOCKING 0
+#endif
+void api_delay(uint32_t ms);
+bool api_blocking_allowed(void);
 void api_wait_wake(void);
-void api_wake_loop(uint16_t reason);
+void api_wake_loop(uint16_t reason, uint32_t data = 0);
 uint32_t api_init_lora(void);
 void api_timer_init(void);
 void api_timer_start(void);
 void api_timer_stop(void);
 void api_timer_restart(uint32_t new_time);
+
+// Scheduler
+#ifndef API_SCHEDULE_JOBS
+#define API_SCHEDULE_JOBS 8
+#endif
+typedef void (*schedule_cb_t)(void);
+void api_schedule_init(void);
+uint8_t api_schedule_event(uint16_t event, uint32_t delay_ms, uint32_t period_ms = 0);
+uint8_t api_schedule_callback(schedule_cb_t callback, uint32_t delay_ms, uint32_t period_ms = 0);
+bool api_schedule_change(uint8_t id, uint32_t delay_ms, uint32_t period_ms = 0);
+bool api_schedule_cancel(uint8_t id);
+uint32_t api_schedule_next(void);
+void api_schedule_run(void);
 void api_log_settings(void);
 
 bool api_fs_init(void);
 void api_fs_format(const char *filename);
 bool api_file_open_read(const char *filename);
 bool api_file_open_write(const char *filename);
-void api_file_read(uint8_t *destination, uint16_t size);
+uint16_t api_file_read(uint8_t *destination, uint16_t size);
 void api_file_write(uint8_t *source, uint32_t size);
 void api_file_remove(const char *filename);
 void api_file_close(const char *filename);
+typedef void (*file_list_cb_t)(const char *filename);
+void api_file_list(file_list_cb_t callback);
 extern const char settings_name[];
 
 #ifdef NRF52_SERIES
@@ -382,13 +927,15 @@ extern const char settings_name[];
 	}
 #endif
 #ifdef ESP32
-#define api_ble_printf(...)                                             \
-	if (g_ble_uart_is_connected)                                        \
-	{                                                                   \
-		char buff[255];                                                 \
-		int len = sprintf(buff, __VA_ARGS__);                           \
-		uart_tx_characteristic->setValue((uint8_t *)buff, (size_t)len); \
-		uart_tx_characteristic->notify(true);                           \
+#define api_ble_printf(...)                                                                             \
+	if (g_ble_uart_is_connected)                                                                        \
+	{                                                                                                   \
+		char buff[255];                                                                                 \
+		int len = snprintf(buff, sizeof(buff), __VA_ARGS__);                                            \
+		if (len > 0)                                                                                    \
+		{                                                                                               \
+			ble_uart_notify((uint8_t *)buff, len < (int)sizeof(buff) ? (size_t)len : sizeof(buff) - 1); \
+		}                                                                                               \
 	}
 #endif
 #ifdef ARDUINO_ARCH_RP2040
@@ -0,0 +1,184 @@
+/**
+ * @file api_events.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Lock-free event queue between callbacks/ISR's and the loop task
+ * @version 0.1
+ * @date 2022-03-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/**
+ * Bounded multi-producer/single-consumer ring (D. Vyukov).
+ * Every slot carries a sequence number. A producer owns a slot after a
+ * successful CAS on the enqueue position and publishes it by advancing the
+ * slot sequence. The loop task is the only consumer, so the dequeue position
+ * needs no CAS.
+ * Event types that don't fit into the full ring are ORed into one overflow event.
+ * It is delivered when the ring is empty, after the events that were queued later.
+ */
+#if (API_EVENT_QUEUE_SIZE & (API_EVENT_QUEUE_SIZE - 1)) != 0
+#error "API_EVENT_QUEUE_SIZE must be a power of 2"
+#endif
+#define EVENT_QUEUE_MASK (API_EVENT_QUEUE_SIZE - 1)
+
+#ifdef ARDUINO_ARCH_RP2040
+// Cortex-M0+ has no exclusive access instructions, use the mbed atomics
+#define EVT_LOAD(ptr) core_util_atomic_load_u16(ptr)
+#define EVT_STORE(ptr, val) core_util_atomic_store_u16(ptr, val)
+#define EVT_CAS(ptr, exp, val) core_util_atomic_cas_u16(ptr, exp, val)
+#define EVT_OR(ptr, val) core_util_atomic_fetch_or_u16(ptr, val)
+#define EVT_XCHG(ptr, val) core_util_atomic_exchange_u16(ptr, val)
+#define EVT_INC(ptr) core_util_atomic_incr_u32(ptr, 1)
+#else
+#define EVT_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define EVT_STORE(ptr, val) __atomic_store_n(ptr, val, __ATOMIC_RELEASE)
+#define EVT_CAS(ptr, exp, val) __atomic_compare_exchange_n(ptr, exp, val, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#define EVT_OR(ptr, val) __atomic_fetch_or(ptr, val, __ATOMIC_ACQ_REL)
+#define EVT_XCHG(ptr, val) __atomic_exchange_n(ptr, val, __ATOMIC_ACQ_REL)
+#define EVT_INC(ptr) __atomic_add_fetch(ptr, 1, __ATOMIC_RELAXED)
+#endif
+
+/** Slot of the event ring */
+struct s_event_slot
+{
+	volatile uint16_t sequence;
+	s_api_event event;
+};
+
+/** The event ring */
+static s_event_slot event_ring[API_EVENT_QUEUE_SIZE];
+/** Next position to write, shared by all producers */
+static volatile uint16_t enqueue_pos = 0;
+/** Next position to read, only used by the loop task */
+static uint16_t dequeue_pos = 0;
+/** Event types that could not be queued because the ring was full */
+static volatile uint16_t overflow_events = 0;
+
+/** Number of event payloads lost because the ring was full, the event type is still delivered */
+volatile uint32_t g_event_dropped = 0;
+/** Number of events without payload merged into an already pending event of the same type */
+volatile uint32_t g_event_coalesced = 0;
+/** Event that is currently handled by the loop task */
+s_api_event g_last_event = {NO_EVENT, 0, 0};
+
+/**
+ * @brief Initialize the event queue
+ *    Must be called before any event source is enabled
+ *
+ */
+void api_event_init(void)
+{
+	for (uint16_t idx = 0; idx < API_EVENT_QUEUE_SIZE; idx++)
+	{
+		event_ring[idx].sequence = idx;
+	}
+	enqueue_pos = 0;
+	dequeue_pos = 0;
+	overflow_events = 0;
+}
+
+/**
+ * @brief Queue an event without waking up the loop task
+ *    Safe to be called from ISR's, callbacks and other tasks
+ *
+ * @param type event type, same bits as used in g_task_event_type
+ * @param data small inline payload of the event
+ * @return true if the event record was queued
+ * @return false if the ring was full, the event type is still forwarded
+ */
+bool api_event_push(uint16_t type, uint32_t data)
+{
+	s_event_slot *slot;
+	uint16_t pos = EVT_LOAD(&enqueue_pos);
+
+	while (true)
+	{
+		slot = &event_ring[pos & EVENT_QUEUE_MASK];
+		int16_t diff = (int16_t)(EVT_LOAD(&slot->sequence) - pos);
+		if (diff == 0)
+		{
+			// Slot is free, try to claim it
+			if (EVT_CAS(&enqueue_pos, &pos, (uint16_t)(pos + 1)))
+			{
+				break;
+			}
+			// CAS failed, pos holds the new enqueue position
+		}
+		else if (diff < 0)
+		{
+			// Ring is full, remember only the event type
+			uint16_t pending = EVT_OR(&overflow_events, type);
+			if (data != 0)
+			{
+				// Type is still delivered, only the payload is lost, even if the type was already pending
+				EVT_INC(&g_event_dropped);
+			}
+			else if ((pending & type) == type)
+			{
+				EVT_INC(&g_event_coalesced);
+			}
+			return false;
+		}
+		else
+		{
+			// Another producer was faster
+			pos = EVT_LOAD(&enqueue_pos);
+		}
+	}
+
+	slot->event.type = type;
+	slot->event.timestamp = millis();
+	slot->event.data = data;
+	// Publish the slot to the consumer
+	EVT_STORE(&slot->sequence, (uint16_t)(pos + 1));
+	return true;
+}
+
+/**
+ * @brief Get the oldest event from the queue
+ *    Must only be called from the loop task
+ *    Event types that did not fit into the ring come last, after events that were queued later
+ *
+ * @param event pointer to the structure that receives the event
+ * @return true if an event was available
+ * @return false if the queue is empty
+ */
+bool api_event_pop(s_api_event *event)
+{
+	s_event_slot *slot = &event_ring[dequeue_pos & EVENT_QUEUE_MASK];
+	int16_t diff = (int16_t)(EVT_LOAD(&slot->sequence) - (uint16_t)(dequeue_pos + 1));
+
+	if (diff == 0)
+	{
+		*event = slot->event;
+		// Hand the slot back to the producers
+		EVT_STORE(&slot->sequence, (uint16_t)(dequeue_pos + API_EVENT_QUEUE_SIZE));
+		dequeue_pos++;
+		return true;
+	}
+
+	// Ring is empty, deliver event types that did not fit into the ring
+	uint16_t overflow = EVT_XCHG(&overflow_events, (uint16_t)0);
+	if (overflow != NO_EVENT)
+	{
+		event->type = overflow;
+		event->timestamp = millis();
+		event->data = 0;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Check if events are waiting to be handled
+ *
+ * @return true if at least one event is queued
+ */
+bool api_event_pending(void)
+{
+	s_event_slot *slot = &event_ring[dequeue_pos & EVENT_QUEUE_MASK];
+	return ((EVT_LOAD(&slot->sequence) == (uint16_t)(dequeue_pos + 1)) || (EVT_LOAD(&overflow_events) != NO_EVENT));
+}
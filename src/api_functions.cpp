@@ -9,9 +9,7 @@
  *
  */
 #include "WisBlock-API.h"
-
-// Define alternate pdMS_TO_TICKS that casts uint64_t for long intervals due to limitation in nrf52840 BSP
-#define mypdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((uint64_t)(xTimeInMs)*configTICK_RATE_HZ) / 1000))
+#include <assert.h>
 
 #ifdef SW_VERSION_1
 uint16_t g_sw_ver_1 = SW_VERSION_1; // major version increase on API change / not backwards compatible
@@ -78,6 +76,61 @@ void api_reset(void)
 #endif
 }
 
+#ifdef ARDUINO_ARCH_RP2040
+extern osThreadId _serial_task_thread;
+#endif
+
+/**
+ * @brief Check if the caller is allowed to block
+ *    Blocking is allowed in setup(), the loop task and the RP2040 serial task.
+ *    It is not allowed in interrupts or in callbacks of the LoRa and BLE tasks.
+ *
+ * @return true if blocking is allowed
+ */
+bool api_blocking_allowed(void)
+{
+#ifdef NRF52_SERIES
+	if ((SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) != 0)
+	{
+		return false;
+	}
+	return (g_loop_task == NULL) || (xTaskGetCurrentTaskHandle() == g_loop_task);
+#endif
+#ifdef ARDUINO_ARCH_RP2040
+	if (core_util_is_isr_active())
+	{
+		return false;
+	}
+	osThreadId current = osThreadGetId();
+	return (loop_thread == NULL) || (current == loop_thread) || (current == _serial_task_thread);
+#endif
+#ifdef ESP32
+	if (xPortInIsrContext())
+	{
+		return false;
+	}
+	return (g_loop_task == NULL) || (xTaskGetCurrentTaskHandle() == g_loop_task);
+#endif
+}
+
+/**
+ * @brief Blocking delay
+ *    With API_CHECK_BLOCKING set to 1 it asserts if called from an interrupt or a callback
+ *
+ * @param ms time to wait in milliseconds
+ */
+void api_delay(uint32_t ms)
+{
+#if API_CHECK_BLOCKING > 0
+	if (!api_blocking_allowed())
+	{
+		API_LOG("API", "Blocking delay of %ldms outside of the loop task", ms);
+		assert(false);
+	}
+#endif
+	delay(ms);
+}
+
 /**
  * @brief Waits for a trigger to wake up
  *    On FreeRTOS the trigger is release of a semaphore
@@ -86,6 +139,11 @@ void api_reset(void)
  */
 void api_wait_wake(void)
 {
+	// Do not sleep if events arrived after the loop emptied the queue
+	if (api_event_pending())
+	{
+		return;
+	}
 #if defined NRF52_SERIES || defined ESP32
 	// Wait until semaphore is released (FreeRTOS)
 	xSemaphoreTake(g_task_sem, portMAX_DELAY);
@@ -106,12 +164,14 @@ void api_wait_wake(void)
 
 /**
  * @brief Wake up loop task
+ *    The event is queued and handled in order by the loop task
  *
  * @param reason for wakeup
+ * @param data event specific payload, available in g_last_event.data
  */
-void api_wake_loop(uint16_t reason)
+void api_wake_loop(uint16_t reason, uint32_t data)
 {
-	g_task_event_type |= reason;
+	api_event_push(reason, data);
 	API_LOG("API", "Waking up loop task");
 
 #if defined NRF52_SERIES || defined ESP32
@@ -151,24 +211,16 @@ uint32_t api_init_lora(void)
 #endif
 }
 
+/** Scheduler job of the frequent wakeup */
+static uint8_t wakeup_job = 0;
+
 /**
  * @brief Initialize the timer for frequent sending
  *
  */
 void api_timer_init(void)
 {
-#if defined NRF52_SERIES
-	g_task_wakeup_timer = xTimerCreate(NULL, mypdMS_TO_TICKS(g_lorawan_settings.send_repeat_time), true, NULL, periodic_wakeup);
-#endif
-#ifdef ARDUINO_ARCH_RP2040
-	g_task_wakeup_timer.oneShot = false;
-	g_task_wakeup_timer.ReloadValue = g_lorawan_settings.send_repeat_time;
-	TimerInit(&g_task_wakeup_timer, periodic_wakeup);
-	TimerSetValue(&g_task_wakeup_timer, g_lorawan_settings.send_repeat_time);
-#endif
-#if defined ESP32
-	// Nothing to do for ESP32
-#endif
+	api_schedule_init();
 }
 
 /**
@@ -177,27 +229,12 @@ void api_timer_init(void)
  */
 void api_timer_start(void)
 {
-#if defined NRF52_SERIES
-	// g_task_wakeup_timer.start();
-	if (isInISR())
-	{
-		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-		xTimerChangePeriodFromISR(g_task_wakeup_timer, mypdMS_TO_TICKS(g_lorawan_settings.send_repeat_time), &xHigherPriorityTaskWoken);
-		xTimerStartFromISR(g_task_wakeup_timer, &xHigherPriorityTaskWoken);
-		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
-	}
-	else
+	api_schedule_cancel(wakeup_job);
+	wakeup_job = 0;
+	if (g_lorawan_settings.send_repeat_time != 0)
 	{
-		xTimerChangePeriod(g_task_wakeup_timer, mypdMS_TO_TICKS(g_lorawan_settings.send_repeat_time), 0);
-		xTimerStart(g_task_wakeup_timer, 0);
+		wakeup_job = api_schedule_event(STATUS, g_lorawan_settings.send_repeat_time, g_lorawan_settings.send_repeat_time);
 	}
-#endif
-#if defined ARDUINO_ARCH_RP2040
-	TimerStart(&g_task_wakeup_timer);
-#endif
-#if defined ESP32
-	g_task_wakeup_timer.attach_ms(g_lorawan_settings.send_repeat_time, periodic_wakeup);
-#endif
 }
 
 /**
@@ -206,26 +243,8 @@ void api_timer_start(void)
  */
 void api_timer_stop(void)
 {
-#if defined NRF52_SERIES
-	// g_task_wakeup_timer.stop();
-	if (isInISR())
-	{
-		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-		xTimerStopFromISR(g_task_wakeup_timer, &xHigherPriorityTaskWoken);
-		portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
-	}
-	else
-	{
-		xTimerStop(g_task_wakeup_timer, 0);
-	}
-
-#endif
-#if defined ARDUINO_ARCH_RP2040
-	TimerStop(&g_task_wakeup_timer);
-#endif
-#if defined ESP32
-	g_task_wakeup_timer.detach();
-#endif
+	api_schedule_cancel(wakeup_job);
+	wakeup_job = 0;
 }
 
 /**
@@ -235,41 +254,11 @@ void api_timer_stop(void)
  */
 void api_timer_restart(uint32_t new_time)
 {
-#if defined NRF52_SERIES || defined ESP32
-	// g_task_wakeup_timer.stop();
 	api_timer_stop();
-#endif
-#ifdef ARDUINO_ARCH_RP2040
-	TimerStop(&g_task_wakeup_timer);
-#endif
-#if defined ESP32
-	g_task_wakeup_timer.detach();
-#endif
 
-	if ((g_lorawan_settings.send_repeat_time != 0) && (g_lorawan_settings.auto_join))
+	if ((new_time != 0) && (g_lorawan_settings.auto_join))
 	{
-#if defined NRF52_SERIES
-		// g_task_wakeup_timer.setPeriod(new_time);
-		// g_task_wakeup_timer.start();
-
-		if (isInISR())
-		{
-			BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-			xTimerChangePeriodFromISR(g_task_wakeup_timer, mypdMS_TO_TICKS(new_time), &xHigherPriorityTaskWoken);
-			portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
-		}
-		else
-		{
-			xTimerChangePeriod(g_task_wakeup_timer, mypdMS_TO_TICKS(new_time), 0);
-		}
-#endif
-#if defined ARDUINO_ARCH_RP2040
-		TimerSetValue(&g_task_wakeup_timer, new_time);
-		TimerStart(&g_task_wakeup_timer);
-#endif
-#if defined ESP32
-		g_task_wakeup_timer.attach_ms(g_lorawan_settings.send_repeat_time, periodic_wakeup);
-#endif
+		wakeup_job = api_schedule_event(STATUS, new_time, new_time);
 	}
 }
 
@@ -307,7 +296,7 @@ void log_settings(void)
 			g_lorawan_settings.node_app_key[10], g_lorawan_settings.node_app_key[11],
 			g_lorawan_settings.node_app_key[12], g_lorawan_settings.node_app_key[13],
 			g_lorawan_settings.node_app_key[14], g_lorawan_settings.node_app_key[15]);
-	API_LOG("FLASH", "034 Dev Addr %08lX", g_lorawan_settings.node_dev_addr);
+	API_LOG("FLASH", "034 Dev Addr %08lX", (unsigned long)g_lorawan_settings.node_dev_addr);
 	API_LOG("FLASH", "038 NWS Key %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
 			g_lorawan_settings.node_nws_key[0], g_lorawan_settings.node_nws_key[1],
 			g_lorawan_settings.node_nws_key[2], g_lorawan_settings.node_nws_key[3],
@@ -330,7 +319,7 @@ void log_settings(void)
 	API_LOG("FLASH", "071 ADR %s", g_lorawan_settings.adr_enabled ? "enabled" : "disabled");
 	API_LOG("FLASH", "072 %s Network", g_lorawan_settings.public_network ? "Public" : "Private");
 	API_LOG("FLASH", "073 Dutycycle %s", g_lorawan_settings.duty_cycle_enabled ? "enabled" : "disabled");
-	API_LOG("FLASH", "074 Repeat time %ld", g_lorawan_settings.send_repeat_time);
+	API_LOG("FLASH", "074 Repeat time %ld", (long)g_lorawan_settings.send_repeat_time);
 	API_LOG("FLASH", "078 Join trials %d", g_lorawan_settings.join_trials);
 	API_LOG("FLASH", "079 TX Power %d", g_lorawan_settings.tx_power);
 	API_LOG("FLASH", "080 DR %d", g_lorawan_settings.data_rate);
@@ -341,7 +330,7 @@ void log_settings(void)
 	API_LOG("FLASH", "085 %s Message", g_lorawan_settings.confirmed_msg_enabled ? "Confirmed" : "Unconfirmed");
 	API_LOG("FLASH", "086 Region %s", region_names[g_lorawan_settings.lora_region]);
 	API_LOG("FLASH", "087 Mode %s", g_lorawan_settings.lorawan_enable ? "LPWAN" : "P2P");
-	API_LOG("FLASH", "088 P2P frequency %ld", g_lorawan_settings.p2p_frequency);
+	API_LOG("FLASH", "088 P2P frequency %ld", (long)g_lorawan_settings.p2p_frequency);
 	API_LOG("FLASH", "092 P2P TX Power %d", g_lorawan_settings.p2p_tx_power);
 	API_LOG("FLASH", "093 P2P BW %d", g_lorawan_settings.p2p_bandwidth);
 	API_LOG("FLASH", "094 P2P SF %d", g_lorawan_settings.p2p_sf);
@@ -0,0 +1,424 @@
+/**
+ * @file api_scheduler.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Deadline scheduler, one hardware timer for all timed jobs
+ * @version 0.1
+ * @date 2022-03-09
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/**
+ * Jobs are kept in a binary min-heap ordered by their absolute deadline in ms.
+ * Only the nearest deadline is programmed into the platform timer
+ * (g_task_wakeup_timer). When it expires, the timer callback queues a
+ * SCHED_TICK event and the loop task runs all due jobs.
+ */
+
+#if defined NRF52_SERIES
+// Define alternate pdMS_TO_TICKS that casts uint64_t for long intervals due to limitation in nrf52840 BSP
+#define mypdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((uint64_t)(xTimeInMs)*configTICK_RATE_HZ) / 1000))
+#endif
+
+// Protect the heap, jobs can be changed from the loop task and from other tasks (e.g. AT commands)
+#if defined NRF52_SERIES
+#define SCHED_LOCK() taskENTER_CRITICAL()
+#define SCHED_UNLOCK() taskEXIT_CRITICAL()
+#endif
+#if defined ARDUINO_ARCH_RP2040
+#define SCHED_LOCK() core_util_critical_section_enter()
+#define SCHED_UNLOCK() core_util_critical_section_exit()
+#endif
+#if defined ESP32
+static portMUX_TYPE sched_mux = portMUX_INITIALIZER_UNLOCKED;
+#define SCHED_LOCK() portENTER_CRITICAL(&sched_mux)
+#define SCHED_UNLOCK() portEXIT_CRITICAL(&sched_mux)
+#endif
+
+/** Scheduled job */
+struct s_sched_job
+{
+	uint32_t deadline;
+	uint32_t period;
+	schedule_cb_t callback;
+	uint16_t event;
+	uint8_t id;
+};
+
+/** Heap of the scheduled jobs */
+static s_sched_job sched_heap[API_SCHEDULE_JOBS];
+/** Number of scheduled jobs */
+static uint8_t sched_count = 0;
+/** Last ID given out */
+static uint8_t sched_last_id = 0;
+/** Deadline the timer is programmed for */
+static uint32_t sched_armed_deadline = 0;
+/** Flag if the timer is programmed */
+static bool sched_armed = false;
+/** Incremented each time the timer is programmed, detects two tasks programming it at the same time */
+static uint16_t sched_arm_sequence = 0;
+/** Flag if the platform timer was created */
+static bool sched_initialized = false;
+
+/**
+ * @brief Compare two deadlines, handles the wrap around of millis()
+ *
+ * @return true if deadline a is before deadline b
+ */
+static inline bool sched_before(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) < 0;
+}
+
+static void sched_swap(uint8_t a, uint8_t b)
+{
+	s_sched_job temp = sched_heap[a];
+	sched_heap[a] = sched_heap[b];
+	sched_heap[b] = temp;
+}
+
+static void sched_sift_up(uint8_t idx)
+{
+	while (idx > 0)
+	{
+		uint8_t parent = (idx - 1) / 2;
+		if (!sched_before(sched_heap[idx].deadline, sched_heap[parent].deadline))
+		{
+			break;
+		}
+		sched_swap(idx, parent);
+		idx = parent;
+	}
+}
+
+static void sched_sift_down(uint8_t idx)
+{
+	while (true)
+	{
+		uint8_t smallest = idx;
+		uint8_t left = 2 * idx + 1;
+		uint8_t right = left + 1;
+		if ((left < sched_count) && sched_before(sched_heap[left].deadline, sched_heap[smallest].deadline))
+		{
+			smallest = left;
+		}
+		if ((right < sched_count) && sched_before(sched_heap[right].deadline, sched_heap[smallest].deadline))
+		{
+			smallest = right;
+		}
+		if (smallest == idx)
+		{
+			break;
+		}
+		sched_swap(idx, smallest);
+		idx = smallest;
+	}
+}
+
+static void sched_remove_at(uint8_t idx)
+{
+	sched_count--;
+	if (idx == sched_count)
+	{
+		return;
+	}
+	sched_heap[idx] = sched_heap[sched_count];
+	sched_sift_down(idx);
+	sched_sift_up(idx);
+}
+
+static int8_t sched_find(uint8_t id)
+{
+	for (uint8_t idx = 0; idx < sched_count; idx++)
+	{
+		if (sched_heap[idx].id == id)
+		{
+			return idx;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Program the platform timer
+ *
+ * @param has_job false to stop the timer
+ * @param deadline deadline of the nearest job
+ */
+static void sched_program(bool has_job, uint32_t deadline)
+{
+#if defined NRF52_SERIES
+	xTimerStop(g_task_wakeup_timer, 0);
+#endif
+#if defined ARDUINO_ARCH_RP2040
+	TimerStop(&g_task_wakeup_timer);
+#endif
+#if defined ESP32
+	g_task_wakeup_timer.detach();
+#endif
+
+	if (!has_job)
+	{
+		return;
+	}
+
+	int32_t wait_time = (int32_t)(deadline - millis());
+	if (wait_time <= 0)
+	{
+		// Already due, let the loop handle it right away
+		api_wake_loop(SCHED_TICK);
+		return;
+	}
+
+#if defined NRF52_SERIES
+	TickType_t ticks = mypdMS_TO_TICKS(wait_time);
+	xTimerChangePeriod(g_task_wakeup_timer, ticks == 0 ? 1 : ticks, 0);
+#endif
+#if defined ARDUINO_ARCH_RP2040
+	TimerSetValue(&g_task_wakeup_timer, wait_time);
+	TimerStart(&g_task_wakeup_timer);
+#endif
+#if defined ESP32
+	g_task_wakeup_timer.once_ms(wait_time, periodic_wakeup);
+#endif
+}
+
+/**
+ * @brief Program the platform timer for the nearest deadline
+ *    The timer functions can't be called with the lock held. If another task programmed the timer
+ *    at the same time, its deadline may have been overwritten with an older one, the timer is
+ *    programmed again until no other task did it in between.
+ *
+ */
+static void sched_arm(void)
+{
+	bool force = false;
+	while (true)
+	{
+		SCHED_LOCK();
+		bool has_job = sched_count != 0;
+		uint32_t deadline = has_job ? sched_heap[0].deadline : 0;
+		bool changed = force || (has_job != sched_armed) || (deadline != sched_armed_deadline);
+		sched_armed = has_job;
+		sched_armed_deadline = deadline;
+		uint16_t sequence = changed ? ++sched_arm_sequence : sched_arm_sequence;
+		SCHED_UNLOCK();
+
+		if (!changed)
+		{
+			return;
+		}
+		sched_program(has_job, deadline);
+
+		SCHED_LOCK();
+		bool overlapped = sequence != sched_arm_sequence;
+		SCHED_UNLOCK();
+		if (!overlapped)
+		{
+			return;
+		}
+		force = true;
+	}
+}
+
+/**
+ * @brief Add a job to the heap
+ *
+ * @return uint8_t ID of the job, 0 if no job slot is free
+ */
+static uint8_t sched_add(uint16_t event, schedule_cb_t callback, uint32_t delay_ms, uint32_t period_ms)
+{
+	SCHED_LOCK();
+	if (sched_count == API_SCHEDULE_JOBS)
+	{
+		SCHED_UNLOCK();
+		API_LOG("SCHED", "No free job slot");
+		return 0;
+	}
+	// Find an unused ID
+	do
+	{
+		sched_last_id++;
+	} while ((sched_last_id == 0) || (sched_find(sched_last_id) >= 0));
+
+	s_sched_job *job = &sched_heap[sched_count];
+	job->deadline = millis() + delay_ms;
+	job->period = period_ms;
+	job->callback = callback;
+	job->event = event;
+	job->id = sched_last_id;
+	sched_count++;
+	sched_sift_up(sched_count - 1);
+	uint8_t id = sched_last_id;
+	SCHED_UNLOCK();
+
+	sched_arm();
+	return id;
+}
+
+/**
+ * @brief Create the platform timer used by the scheduler
+ *
+ */
+void api_schedule_init(void)
+{
+	if (sched_initialized)
+	{
+		return;
+	}
+	sched_initialized = true;
+#if defined NRF52_SERIES
+	g_task_wakeup_timer = xTimerCreate(NULL, 1, false, NULL, periodic_wakeup);
+#endif
+#if defined ARDUINO_ARCH_RP2040
+	g_task_wakeup_timer.oneShot = true;
+	TimerInit(&g_task_wakeup_timer, periodic_wakeup);
+#endif
+}
+
+/**
+ * @brief Schedule an event for the loop task
+ *
+ * @param event event that is sent to the loop, same bits as used in g_task_event_type
+ * @param delay_ms time until the first event
+ * @param period_ms repeat time of the event, 0 for a single event
+ * @return uint8_t ID of the job, 0 if no job slot is free
+ */
+uint8_t api_schedule_event(uint16_t event, uint32_t delay_ms, uint32_t period_ms)
+{
+	return sched_add(event, NULL, delay_ms, period_ms);
+}
+
+/**
+ * @brief Schedule a function that is called from the loop task
+ *
+ * @param callback function to call
+ * @param delay_ms time until the first call
+ * @param period_ms repeat time of the call, 0 for a single call
+ * @return uint8_t ID of the job, 0 if no job slot is free
+ */
+uint8_t api_schedule_callback(schedule_cb_t callback, uint32_t delay_ms, uint32_t period_ms)
+{
+	return sched_add(NO_EVENT, callback, delay_ms, period_ms);
+}
+
+/**
+ * @brief Change the timing of a scheduled job
+ *
+ * @param id ID of the job
+ * @param delay_ms time from now until the job is due
+ * @param period_ms new repeat time, 0 for a single run
+ * @return true if the job was changed
+ * @return false if the job was not found
+ */
+bool api_schedule_change(uint8_t id, uint32_t delay_ms, uint32_t period_ms)
+{
+	SCHED_LOCK();
+	int8_t idx = sched_find(id);
+	if ((id == 0) || (idx < 0))
+	{
+		SCHED_UNLOCK();
+		return false;
+	}
+	sched_heap[idx].deadline = millis() + delay_ms;
+	sched_heap[idx].period = period_ms;
+	sched_sift_down(idx);
+	sched_sift_up(idx);
+	SCHED_UNLOCK();
+
+	sched_arm();
+	return true;
+}
+
+/**
+ * @brief Remove a scheduled job
+ *
+ * @param id ID of the job
+ * @return true if the job was removed
+ * @return false if the job was not found
+ */
+bool api_schedule_cancel(uint8_t id)
+{
+	SCHED_LOCK();
+	int8_t idx = sched_find(id);
+	if ((id == 0) || (idx < 0))
+	{
+		SCHED_UNLOCK();
+		return false;
+	}
+	sched_remove_at(idx);
+	SCHED_UNLOCK();
+
+	sched_arm();
+	return true;
+}
+
+/**
+ * @brief Time until the next job is due
+ *
+ * @return uint32_t time in ms, 0xFFFFFFFF if no job is scheduled
+ */
+uint32_t api_schedule_next(void)
+{
+	uint32_t wait_time = 0xFFFFFFFF;
+	SCHED_LOCK();
+	if (sched_count != 0)
+	{
+		int32_t diff = (int32_t)(sched_heap[0].deadline - millis());
+		wait_time = diff < 0 ? 0 : diff;
+	}
+	SCHED_UNLOCK();
+	return wait_time;
+}
+
+/**
+ * @brief Run all jobs that are due
+ *    Called by the loop task on SCHED_TICK
+ *
+ */
+void api_schedule_run(void)
+{
+	uint32_t now = millis();
+	while (true)
+	{
+		SCHED_LOCK();
+		if ((sched_count == 0) || sched_before(now, sched_heap[0].deadline))
+		{
+			SCHED_UNLOCK();
+			break;
+		}
+		s_sched_job job = sched_heap[0];
+		if (job.period != 0)
+		{
+			// Keep the period without drift, skip missed runs
+			sched_heap[0].deadline += job.period;
+			if (!sched_before(now, sched_heap[0].deadline))
+			{
+				sched_heap[0].deadline = now + job.period;
+			}
+			sched_sift_down(0);
+		}
+		else
+		{
+			sched_remove_at(0);
+		}
+		SCHED_UNLOCK();
+
+		if (job.event != NO_EVENT)
+		{
+			api_event_push(job.event, job.id);
+		}
+		if (job.callback != NULL)
+		{
+			job.callback();
+		}
+	}
+
+	// Timer expired, program it for the next deadline
+	SCHED_LOCK();
+	sched_armed = false;
+	SCHED_UNLOCK();
+	sched_arm();
+}
@@ -16,9 +16,6 @@ char g_at_query_buf[ATQUERY_SIZE];
 
 bool has_custom_at = false;
 
-/** LoRaWAN application data buffer. */
-uint8_t m_lora_app_data_buffer[256];
-
 char *bandwidths[] = {(char *)"125", (char *)"250", (char *)"500", (char *)"062", (char *)"041", (char *)"031", (char *)"020", (char *)"015", (char *)"010", (char *)"007"};
 
 char *region_names[] = {(char *)"AS923", (char *)"AU915", (char *)"CN470", (char *)"CN779",
@@ -28,16 +25,9 @@ char *region_names[] = {(char *)"AS923", (char *)"AU915", (char *)"CN470", (char
 void set_new_config(void)
 {
 	Radio.Sleep();
-	Radio.SetTxConfig(MODEM_LORA, g_lorawan_settings.p2p_tx_power, 0, g_lorawan_settings.p2p_bandwidth,
-					  g_lorawan_settings.p2p_sf, g_lorawan_settings.p2p_cr,
-					  g_lorawan_settings.p2p_preamble_len, false,
-					  true, 0, 0, false, 5000);
-
-	Radio.SetRxConfig(MODEM_LORA, g_lorawan_settings.p2p_bandwidth, g_lorawan_settings.p2p_sf,
-					  g_lorawan_settings.p2p_cr, 0, g_lorawan_settings.p2p_preamble_len,
-					  g_lorawan_settings.p2p_symbol_timeout, false,
-					  0, true, 0, 0, false, true);
-	Radio.Rx(0);
+	p2p_radio_config();
+	// Restart RX depending on the RX mode
+	api_p2p_event(P2P_EV_MODE);
 }
 
 /**
@@ -214,15 +204,15 @@ static int at_exec_mode(char *str)
 
 	if (need_restart)
 	{
-		delay(100);
-		api_reset();
+		// Reset after the response was sent
+		api_schedule_callback(api_reset, 100);
 	}
 	return 0;
 }
 
 static int at_query_p2p_freq(void)
 {
-	snprintf(g_at_query_buf, ATQUERY_SIZE, "%ld", g_lorawan_settings.p2p_frequency);
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%ld", (long)g_lorawan_settings.p2p_frequency);
 	return 0;
 }
 
@@ -379,7 +369,7 @@ static int at_exec_p2p_txp(char *str)
 static int at_query_p2p_config(void)
 {
 	snprintf(g_at_query_buf, ATQUERY_SIZE, "%ld:%d:%s:%d:%d:%d",
-			 g_lorawan_settings.p2p_frequency,
+			 (long)g_lorawan_settings.p2p_frequency,
 			 g_lorawan_settings.p2p_sf,
 			 bandwidths[g_lorawan_settings.p2p_bandwidth],
 			 g_lorawan_settings.p2p_cr,
@@ -501,22 +491,26 @@ static int at_exec_p2p_send(char *str)
 	}
 
 	int data_size = strlen(str);
-	if (!(data_size % 2 == 0) || (data_size > 254))
+	if (!(data_size % 2 == 0) || (data_size > 510))
 	{
 		return AT_ERRNO_PARA_VAL;
 	}
 
-	int buff_idx = 0;
-	char buff_parse[3];
-	for (int idx = 0; idx <= data_size + 1; idx += 2)
+	// Parse the data directly into the TX buffer
+	uint8_t *tx_buffer = api_tx_acquire();
+	if (tx_buffer == NULL)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	if (hex2bin(str, tx_buffer, data_size / 2) < 0)
+	{
+		api_tx_release();
+		return AT_ERRNO_PARA_VAL;
+	}
+	if (api_tx_submit(data_size / 2) != LMH_SUCCESS)
 	{
-		buff_parse[0] = str[idx];
-		buff_parse[1] = str[idx + 1];
-		buff_parse[2] = 0;
-		m_lora_app_data_buffer[buff_idx] = strtol(buff_parse, NULL, 16);
-		buff_idx++;
+		return AT_ERRNO_NOALLOW;
 	}
-	send_p2p_packet(m_lora_app_data_buffer, data_size / 2);
 	return 0;
 }
 
@@ -548,8 +542,6 @@ static int at_exec_p2p_receive(char *str)
 			// TX only mode
 			g_lora_p2p_rx_mode = RX_MODE_NONE;
 			g_lora_p2p_rx_time = 0;
-			// Put Radio into sleep mode (stops receiving)
-			Radio.Sleep();
 			API_LOG("AT", "Set RX_MODE_NONE");
 		}
 		else if (rx_time == 65534)
@@ -557,8 +549,6 @@ static int at_exec_p2p_receive(char *str)
 			// RX continous
 			g_lora_p2p_rx_mode = RX_MODE_RX;
 			g_lora_p2p_rx_time = 0;
-			// Put Radio into continous RX mode
-			Radio.Rx(0);
 			API_LOG("AT", "Set RX_MODE_RX");
 		}
 		else if (rx_time == 65535)
@@ -566,23 +556,33 @@ static int at_exec_p2p_receive(char *str)
 			// RX until packet received
 			g_lora_p2p_rx_mode = RX_MODE_RX_WAIT;
 			g_lora_p2p_rx_time = 0;
-			// Put Radio into continous RX mode
-			Radio.Rx(0);
 			API_LOG("AT", "Set RX_MODE_RX_WAIT");
 		}
+		else if (rx_time == 65533)
+		{
+			// RX duty cycle with the sniff period
+			if (g_lora_p2p_sniff_period == 0)
+			{
+				API_LOG("AT", "Set sniff period first with AT+PSNIFF");
+				return AT_ERRNO_NOALLOW;
+			}
+			g_lora_p2p_rx_mode = RX_MODE_RX_SNIFF;
+			g_lora_p2p_rx_time = 0;
+			API_LOG("AT", "Set RX_MODE_RX_SNIFF");
+		}
 		else if (rx_time < 65534)
 		{
 			// RX for specific time
 			g_lora_p2p_rx_mode = RX_MODE_RX_TIMED;
 			g_lora_p2p_rx_time = rx_time;
-			// Put Radio into continous RX mode
-			Radio.Rx(rx_time);
 			API_LOG("AT", "Set RX_MODE_RX_TIMED");
 		}
 		else
 		{
 			return AT_ERRNO_PARA_VAL;
 		}
+		// Start or stop RX for the new mode
+		api_p2p_event(P2P_EV_MODE);
 		return 0;
 	}
 	return AT_ERRNO_PARA_NUM;
@@ -590,282 +590,880 @@ static int at_exec_p2p_receive(char *str)
 
 static int at_query_p2p_receive(void)
 {
-	snprintf(g_at_query_buf, ATQUERY_SIZE, "%ld", g_lora_p2p_rx_time);
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%ld", (long)g_lora_p2p_rx_time);
 	return 0;
 }
 
 /**
- * @brief AT+BAND=? Get regional frequency band
+ * @brief AT+PSNIFF=? Get the P2P sniff period
  *
  * @return int always 0
  */
-static int at_query_region(void)
+static int at_query_p2p_sniff(void)
 {
-	// 0: AS923 1: AU915 2: CN470 3: CN779 4: EU433 5: EU868 6: KR920 7: IN865 8: US915 9: AS923-2 10: AS923-3 11: AS923-4 12: RU864
-	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d %s", g_lorawan_settings.lora_region, region_names[g_lorawan_settings.lora_region]);
-
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%ld", (long)g_lora_p2p_sniff_period);
 	return 0;
 }
 
 /**
- * @brief AT+BAND=xx Set regional frequency band
- *  Values: 0: AS923 1: AU915 2: CN470 3: CN779 4: EU433 5: EU868 6: KR920 7: IN865 8: US915 9: AS923-2 10: AS923-3 11: AS923-4 12: RU864
- * @return int 0 if valid parameter
+ * @brief AT+PSNIFF=<period> Set the P2P sniff period in ms
+ *    Used for the long preamble when sending and for the RX duty cycle of AT+PRECV=65533
+ *
+ * @param str period in ms, 0 to switch off
+ * @return int 0 if the period is valid
  */
-static int at_exec_region(char *str)
+static int at_exec_p2p_sniff(char *str)
 {
-	if (!g_lorawan_settings.lorawan_enable)
+	if (g_lorawan_settings.lorawan_enable)
 	{
 		return AT_ERRNO_NOALLOW;
 	}
-	char *param;
-	uint8_t region;
-
-	param = strtok(str, ",");
-	if (param != NULL)
+	for (int idx = 0; str[idx] != 0; idx++)
 	{
-		region = strtol(param, NULL, 0);
-		// RAK4630 0: AS923 1: AU915 2: CN470 3: CN779 4: EU433 5: EU868 6: KR920 7: IN865 8: US915 9: AS923-2 10: AS923-3 11: AS923-4 12: RU864
-		if (region > 12)
+		if ((str[idx] < '0') || (str[idx] > '9'))
 		{
 			return AT_ERRNO_PARA_VAL;
 		}
-		g_lorawan_settings.lora_region = region;
-		save_settings();
 	}
-	else
+	uint32_t period = strtoul(str, NULL, 10);
+	if ((period > 60000) || !api_p2p_sniff(period))
 	{
 		return AT_ERRNO_PARA_VAL;
 	}
+	return 0;
+}
 
+/**
+ * @brief AT+PSTATE=? Get the P2P radio state and the time spent in each state
+ *
+ * @return int always 0
+ */
+static int at_query_p2p_state(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%s SLEEP:%ld RX:%ld CAD:%ld TX:%ld SNIFF:%ld",
+			 p2p_state_names[api_p2p_state()],
+			 (long)api_p2p_state_time(P2P_STATE_SLEEP), (long)api_p2p_state_time(P2P_STATE_RX),
+			 (long)api_p2p_state_time(P2P_STATE_CAD), (long)api_p2p_state_time(P2P_STATE_TX),
+			 (long)api_p2p_state_time(P2P_STATE_SNIFF));
 	return 0;
 }
 
 /**
- * @brief AT+MASK=? Get channel mask
- *  Only available for regions 1: AU915 2: CN470 8: US915
+ * @brief AT+PSTATE Clear the P2P radio state times
+ *
  * @return int always 0
  */
-static int at_query_mask(void)
+static int at_exec_p2p_state(void)
 {
-	if ((g_lorawan_settings.lora_region == 1) || (g_lorawan_settings.lora_region == 2) || (g_lorawan_settings.lora_region == 8))
-	{
-		snprintf(g_at_query_buf, ATQUERY_SIZE, "%d", g_lorawan_settings.subband_channels);
+	api_p2p_state_reset();
+	return 0;
+}
 
-		return 0;
-	}
-	return AT_ERRNO_PARA_VAL;
+/**
+ * @brief AT+PCAD=? Get the CAD attempts and the backoff time
+ *
+ * @return int always 0
+ */
+static int at_query_p2p_cad(void)
+{
+	uint8_t attempts;
+	uint16_t backoff;
+	api_p2p_lbt_get(&attempts, &backoff);
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%d", attempts, backoff);
+	return 0;
 }
 
 /**
- * @brief AT+MASK=xx Set channel mask
- *  Only available for regions 1: AU915 2: CN470 8: US915
- * @return int 0 if valid parameter
+ * @brief AT+PCAD=<attempts>:<backoff> Set the CAD attempts and the backoff time in ms
+ *
+ * @param str attempts 1 to 16, backoff 0 to 10000 ms
+ * @return int 0 if the values are valid
  */
-static int at_exec_mask(char *str)
+static int at_exec_p2p_cad(char *str)
 {
-	if (!g_lorawan_settings.lorawan_enable)
+	char *param = strtok(str, ":");
+	if (param == NULL)
 	{
-		return AT_ERRNO_NOALLOW;
+		return AT_ERRNO_PARA_NUM;
 	}
-	char *param;
-	uint8_t mask;
-
-	param = strtok(str, ",");
-	if (param != NULL)
+	long attempts = strtol(param, NULL, 0);
+	param = strtok(NULL, ":");
+	if (param == NULL)
 	{
-		mask = strtol(param, NULL, 0);
-
-		uint8_t maxBand = 1;
-		switch (g_lorawan_settings.lora_region)
-		{
-		case LORAMAC_REGION_AU915:
-			maxBand = 9;
-			break;
-		case LORAMAC_REGION_CN470:
-			maxBand = 12;
-			break;
-		case LORAMAC_REGION_US915:
-			maxBand = 9;
-			break;
-		default:
-			return AT_ERRNO_PARA_VAL;
-		}
-		if ((mask == 0) || (mask > maxBand))
-		{
-			return AT_ERRNO_PARA_VAL;
-		}
-		g_lorawan_settings.subband_channels = mask;
-		save_settings();
+		return AT_ERRNO_PARA_NUM;
 	}
-	else
+	long backoff = strtol(param, NULL, 0);
+	if ((attempts < 1) || (attempts > 16) || (backoff < 0) || (backoff > 10000))
 	{
-		return AT_ERRNO_PARA_NUM;
+		return AT_ERRNO_PARA_VAL;
 	}
-
+	api_p2p_lbt(attempts, backoff);
 	return 0;
 }
 
 /**
- * @brief AT+NJM=? Return current join modus
+ * @brief AT+PCADSTAT=? Get the busy/clear CAD counters per channel
+ *    One line per channel, the totals are the query result
  *
  * @return int always 0
  */
-static int at_query_joinmode(void)
+static int at_query_p2p_cad_stat(void)
 {
-	int mode;
-	mode = g_lorawan_settings.otaa_enabled == true ? 1 : 0;
-
-	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d", mode);
+	s_cad_stats stats[API_CAD_CHANNELS];
+	uint8_t num = api_p2p_cad_stats(stats, API_CAD_CHANNELS);
+	uint32_t busy = 0;
+	uint32_t clear = 0;
+	for (uint8_t idx = 0; idx < num; idx++)
+	{
+		AT_PRINTF("%ld busy:%ld clear:%ld\n", stats[idx].frequency, stats[idx].busy, stats[idx].clear);
+		busy += stats[idx].busy;
+		clear += stats[idx].clear;
+	}
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "busy:%ld clear:%ld", (long)busy, (long)clear);
 	return 0;
 }
 
 /**
- * @brief AT+NJM=x Set current join modus
+ * @brief AT+PCADSTAT Clear the CAD counters
  *
- * @param str 1 = OTAA 0 = ABP
- * @return int 0 if valid parameter
+ * @return int always 0
  */
-static int at_exec_joinmode(char *str)
+static int at_exec_p2p_cad_stat(void)
 {
-	if (!g_lorawan_settings.lorawan_enable)
-	{
-		return AT_ERRNO_NOALLOW;
-	}
-	int mode = strtol(str, NULL, 0);
-
-	if (mode != 0 && mode != 1)
-	{
-		return AT_ERRNO_PARA_VAL;
-	}
-
-	g_lorawan_settings.otaa_enabled = (mode == 1 ? true : false);
-	save_settings();
-
+	api_p2p_cad_stats_reset();
 	return 0;
 }
 
 /**
- * @brief AT+DEVEUI=? Get current Device EUI
+ * @brief AT+PHOP=? Get the frequency hopping plan and the hop index
  *
  * @return int always 0
  */
-static int at_query_deveui(void)
+static int at_query_p2p_hop(void)
 {
-	snprintf(g_at_query_buf, ATQUERY_SIZE,
-			 "%02X%02X%02X%02X%02X%02X%02X%02X",
-			 g_lorawan_settings.node_device_eui[0],
-			 g_lorawan_settings.node_device_eui[1],
-			 g_lorawan_settings.node_device_eui[2],
-			 g_lorawan_settings.node_device_eui[3],
-			 g_lorawan_settings.node_device_eui[4],
-			 g_lorawan_settings.node_device_eui[5],
-			 g_lorawan_settings.node_device_eui[6],
-			 g_lorawan_settings.node_device_eui[7]);
+	uint8_t channels;
+	uint32_t spacing;
+	uint32_t key;
+	api_p2p_hop_get(&channels, &spacing, &key);
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%ld:%08lX:%ld", channels, (long)spacing, (unsigned long)key, (long)api_p2p_hop_index());
 	return 0;
 }
 
 /**
- * @brief AT+DEVEUI=<XXXXXXXXXXXXXXXX> Set current Device EUI
- * @return int 0 if Dev EUI has correct length and was valid HEX
+ * @brief AT+PHOP=<channels>:<spacing>:<key> Set the frequency hopping plan
+ *    AT+PHOP=0 switches hopping off
+ *
+ * @param str number of channels, channel spacing in Hz, network key as 8 hex characters
+ * @return int 0 if the plan is valid
  */
-static int at_exec_deveui(char *str)
+static int at_exec_p2p_hop(char *str)
 {
-	if (!g_lorawan_settings.lorawan_enable)
+	if (g_lorawan_settings.lorawan_enable)
 	{
 		return AT_ERRNO_NOALLOW;
 	}
-	uint8_t len;
-	uint8_t buf[8];
-
-	len = hex2bin(str, buf, 8);
-
-	if (len != 8)
+	char *param = strtok(str, ":");
+	if (param == NULL)
+	{
+		return AT_ERRNO_PARA_NUM;
+	}
+	long channels = strtol(param, NULL, 0);
+	if ((channels < 0) || (channels > API_P2P_HOP_CHANNELS))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	if (channels < 2)
+	{
+		api_p2p_hop(0, 0, 0);
+		return 0;
+	}
+	param = strtok(NULL, ":");
+	if (param == NULL)
+	{
+		return AT_ERRNO_PARA_NUM;
+	}
+	uint32_t spacing = strtoul(param, NULL, 0);
+	param = strtok(NULL, ":");
+	if (param == NULL)
+	{
+		return AT_ERRNO_PARA_NUM;
+	}
+	uint8_t key[4];
+	if ((strlen(param) != 8) || (hex2bin(param, key, 4) != 4))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	if (!api_p2p_hop(channels, spacing, (uint32_t)key[0] << 24 | (uint32_t)key[1] << 16 | (uint32_t)key[2] << 8 | (uint32_t)key[3]))
 	{
 		return AT_ERRNO_PARA_VAL;
 	}
-
-	memcpy(g_lorawan_settings.node_device_eui, buf, 8);
-	save_settings();
-
 	return 0;
 }
 
 /**
- * @brief AT+APPEUI=? Get current Application (Join) EUI
+ * @brief AT+PTDMA=? Get the TDMA role, frame length, number of slots, own slot and sync state
  *
  * @return int always 0
  */
-static int at_query_appeui(void)
+static int at_query_p2p_tdma(void)
 {
-	snprintf(g_at_query_buf, ATQUERY_SIZE,
-			 "%02X%02X%02X%02X%02X%02X%02X%02X",
-			 g_lorawan_settings.node_app_eui[0],
-			 g_lorawan_settings.node_app_eui[1],
-			 g_lorawan_settings.node_app_eui[2],
-			 g_lorawan_settings.node_app_eui[3],
-			 g_lorawan_settings.node_app_eui[4],
-			 g_lorawan_settings.node_app_eui[5],
-			 g_lorawan_settings.node_app_eui[6],
-			 g_lorawan_settings.node_app_eui[7]);
+	s_tdma_status status;
+	api_p2p_tdma_status(&status);
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%ld:%d:%d:%d", status.role, (long)status.frame_ms, status.slots, status.slot, status.synced ? 1 : 0);
 	return 0;
 }
 
 /**
- * @brief AT+APPEUI=<XXXXXXXXXXXXXXXX> Set current Application (Join) EUI
+ * @brief AT+PTDMA=<role>[:<frame>:<slots>|:<slot>] Set the TDMA role
+ *    0 = off, 1:<frame ms>:<slots> = coordinator, 2[:<slot>] = node, without slot it is taken from the DevEUI
  *
- * @return int 0 if App EUI has correct length and was valid HEX
+ * @param str role and parameters
+ * @return int 0 if the parameters are valid
  */
-static int at_exec_appeui(char *str)
+static int at_exec_p2p_tdma(char *str)
 {
-	if (!g_lorawan_settings.lorawan_enable)
+	if (g_lorawan_settings.lorawan_enable)
 	{
 		return AT_ERRNO_NOALLOW;
 	}
-	uint8_t len;
-	uint8_t buf[8];
-
-	len = hex2bin(str, buf, 8);
-	if (len != 8)
+	char *param = strtok(str, ":");
+	if (param == NULL)
+	{
+		return AT_ERRNO_PARA_NUM;
+	}
+	long role = strtol(param, NULL, 0);
+	switch (role)
+	{
+	case TDMA_OFF:
+		api_p2p_tdma(TDMA_OFF);
+		return 0;
+	case TDMA_COORDINATOR:
+	{
+		param = strtok(NULL, ":");
+		if (param == NULL)
+		{
+			return AT_ERRNO_PARA_NUM;
+		}
+		long frame_ms = strtol(param, NULL, 0);
+		param = strtok(NULL, ":");
+		if (param == NULL)
+		{
+			return AT_ERRNO_PARA_NUM;
+		}
+		long slots = strtol(param, NULL, 0);
+		if ((frame_ms < 0) || (frame_ms > 3600000) || (slots < 1) || (slots > 254))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		return api_p2p_tdma(TDMA_COORDINATOR, frame_ms, slots) ? 0 : AT_ERRNO_PARA_VAL;
+	}
+	case TDMA_NODE:
 	{
+		uint8_t slot = TDMA_AUTO_SLOT;
+		param = strtok(NULL, ":");
+		if (param != NULL)
+		{
+			long value = strtol(param, NULL, 0);
+			if ((value < 0) || (value > 254))
+			{
+				return AT_ERRNO_PARA_VAL;
+			}
+			slot = value;
+		}
+		api_p2p_tdma_slot(slot);
+		api_p2p_tdma(TDMA_NODE);
+		return 0;
+	}
+	default:
 		return AT_ERRNO_PARA_VAL;
 	}
+}
 
-	memcpy(g_lorawan_settings.node_app_eui, buf, 8);
-	save_settings();
-
+/**
+ * @brief AT+AIRTIME=? Get the airtime of the last hour, the total airtime and the number of packets
+ *
+ * @return int always 0
+ */
+static int at_query_airtime(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%ld:%ld:%ld", (long)api_airtime_hour(), (long)api_airtime_total(), (long)api_airtime_packets());
 	return 0;
 }
 
 /**
- * @brief AT+APPKEY=? Get current Application Key
+ * @brief AT+AIRTIME Clear the airtime counters
  *
  * @return int always 0
  */
-static int at_query_appkey(void)
+static int at_exec_airtime(void)
 {
-	uint8_t i;
-	uint8_t len = 0;
-
-	for (i = 0; i < 16; i++)
-	{
-		len += snprintf(g_at_query_buf + len, ATQUERY_SIZE - len, "%02X", g_lorawan_settings.node_app_key[i]);
-		if (ATQUERY_SIZE <= len)
-		{
-			return -1;
-		}
-	}
+	api_airtime_reset();
 	return 0;
 }
 
 /**
- * @brief AT+APPKEY=<XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX> Set current Application (Join) EUI
+ * @brief AT+PDUTY=? Get the duty cycle limit, the queue mode, the airtime credit and the wait time for a packet like the last one
  *
- * @return int 0 if App Key has correct length and was valid HEX
+ * @return int always 0
  */
-static int at_exec_appkey(char *str)
+static int at_query_p2p_duty(void)
 {
-	if (!g_lorawan_settings.lorawan_enable)
+	uint16_t limit;
+	bool queue;
+	api_p2p_duty_cycle_get(&limit, &queue);
+	if (limit == 0)
+	{
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "0:%d", queue ? 1 : 0);
+		return 0;
+	}
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%d:%ld:%ld", limit, queue ? 1 : 0, (long)api_p2p_duty_credit(), (long)api_p2p_duty_wait(g_tx_data_len));
+	return 0;
+}
+
+/**
+ * @brief AT+PDUTY=<limit>[:<queue>] Set the duty cycle limit in per mille
+ *
+ * @param str limit 0 to 1000 per mille, queue 1 to delay packets (default), 0 to reject them
+ * @return int 0 if the values are valid
+ */
+static int at_exec_p2p_duty(char *str)
+{
+	char *param = strtok(str, ":");
+	if (param == NULL)
+	{
+		return AT_ERRNO_PARA_NUM;
+	}
+	long limit = strtol(param, NULL, 0);
+	bool queue = true;
+	param = strtok(NULL, ":");
+	if (param != NULL)
+	{
+		if ((param[0] != '0') && (param[0] != '1'))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		queue = param[0] == '1';
+	}
+	if ((limit < 0) || !api_p2p_duty_cycle(limit, queue))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	return 0;
+}
+
+/**
+ * @brief AT+PADAPT=? Get the adaptive mode, the current SF and TX power, the SNR average and the margin
+ *
+ * @return int always 0
+ */
+static int at_query_p2p_adapt(void)
+{
+	s_adapt_status status;
+	api_p2p_adapt_status(&status);
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%d:%d:%d:%d", status.enabled ? 1 : 0, status.sf, status.tx_power, status.snr, status.margin);
+	return 0;
+}
+
+/**
+ * @brief AT+PADAPT=<0|1> Enable or disable the adaptive SF and TX power
+ *
+ * @param str 1 to enable, 0 to go back to the saved P2P settings
+ * @return int 0 if the value is valid
+ */
+static int at_exec_p2p_adapt(char *str)
+{
+	if (g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	if (((str[0] != '0') && (str[0] != '1')) || (str[1] != 0))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	api_p2p_adapt(str[0] == '1');
+	return 0;
+}
+
+/**
+ * @brief AT+PREL=? Get the own address, the window and the number of frames waiting for delivery
+ *
+ * @return int always 0
+ */
+static int at_query_p2p_rel(void)
+{
+	uint8_t address;
+	uint8_t window;
+	api_p2p_reliable_get(&address, &window);
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%d:%d", address, window, api_p2p_reliable_pending());
+	return 0;
+}
+
+/**
+ * @brief AT+PREL=<address>[:<window>] Enable the reliable delivery
+ *
+ * @param str own address 1 to 254 (0 = off), window 1 to API_REL_WINDOW (default 1)
+ * @return int 0 if the values are valid
+ */
+static int at_exec_p2p_rel(char *str)
+{
+	if (g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	char *param = strtok(str, ":");
+	if (param == NULL)
+	{
+		return AT_ERRNO_PARA_NUM;
+	}
+	long address = strtol(param, NULL, 0);
+	long window = 1;
+	param = strtok(NULL, ":");
+	if (param != NULL)
+	{
+		window = strtol(param, NULL, 0);
+	}
+	if ((address < 0) || (address > 254) || (window < 1) || (window > API_REL_WINDOW))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	return api_p2p_reliable(address, window) ? 0 : AT_ERRNO_PARA_VAL;
+}
+
+/**
+ * @brief Result of a frame sent with AT+PRSEND
+ *
+ * @param handle handle of the frame
+ * @param result one of TX_RESULT
+ */
+static void at_p2p_rel_done(uint16_t handle, uint8_t result)
+{
+	AT_PRINTF("+EVT:PRSEND:%d:%d\n", handle, result);
+}
+
+/**
+ * @brief AT+PRSEND=<address>:<data> Send data with reliable delivery
+ *    The result is reported with +EVT:PRSEND:<handle>:<result>
+ *
+ * @param str receiver address (255 = broadcast) and data as hex string
+ * @return int 0 if the frame was queued
+ */
+static int at_exec_p2p_rel_send(char *str)
+{
+	if (g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	char *param = strtok(str, ":");
+	if (param == NULL)
+	{
+		return AT_ERRNO_PARA_NUM;
+	}
+	long address = strtol(param, NULL, 0);
+	param = strtok(NULL, ":");
+	if (param == NULL)
+	{
+		return AT_ERRNO_PARA_NUM;
+	}
+	int data_size = strlen(param);
+	if ((address < 1) || (address > 255) || !(data_size % 2 == 0) || (data_size > API_REL_PAYLOAD * 2))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	uint8_t data[API_REL_PAYLOAD];
+	if (hex2bin(param, data, data_size / 2) < 0)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	uint16_t handle = api_p2p_send_reliable(address, data, data_size / 2, API_REL_RETRIES, at_p2p_rel_done);
+	return handle == 0 ? AT_ERRNO_NOALLOW : 0;
+}
+
+/**
+ * @brief AT+PRELSTAT=? Get the statistics of the reliable delivery
+ *    Sent, retransmitted, acknowledged, failed, received, duplicates
+ *
+ * @return int always 0
+ */
+static int at_query_p2p_rel_stat(void)
+{
+	const s_rel_stats *stats = api_p2p_reliable_stats();
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%ld:%ld:%ld:%ld:%ld:%ld", (long)stats->sent, (long)stats->retransmits, (long)stats->acked,
+			 (long)stats->failed, (long)stats->received, (long)stats->duplicates);
+	return 0;
+}
+
+/**
+ * @brief AT+PRELSTAT Clear the statistics of the reliable delivery
+ *
+ * @return int always 0
+ */
+static int at_exec_p2p_rel_stat(void)
+{
+	api_p2p_reliable_stats_reset();
+	return 0;
+}
+
+/**
+ * @brief AT+LINKSTAT=? Get the link statistics
+ *    Received packets, CRC errors, timeouts, packet error rate in per mille,
+ *    RSSI average, min and max, SNR average, min and max
+ *
+ * @return int always 0
+ */
+static int at_query_link_stat(void)
+{
+	const s_link_stats *stats = api_link_stats();
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%ld:%ld:%ld:%d:%d:%d:%d:%d:%d:%d",
+			 (long)stats->rx_ok, (long)stats->rx_crc_error, (long)stats->rx_timeout, api_link_per(),
+			 stats->rssi_avg / LINK_AVG_SCALE, stats->rssi_min, stats->rssi_max,
+			 stats->snr_avg / LINK_AVG_SCALE, stats->snr_min, stats->snr_max);
+	return 0;
+}
+
+/**
+ * @brief AT+LINKSTAT Clear the link statistics
+ *
+ * @return int always 0
+ */
+static int at_exec_link_stat(void)
+{
+	api_link_reset();
+	return 0;
+}
+
+/**
+ * @brief AT+LINKHIST=? Get the RSSI and SNR histograms
+ *
+ * @return int always 0
+ */
+static int at_query_link_hist(void)
+{
+	const s_link_stats *stats = api_link_stats();
+	int len = 0;
+	for (uint8_t idx = 0; idx < LINK_HIST_BUCKETS; idx++)
+	{
+		len += snprintf(&g_at_query_buf[len], ATQUERY_SIZE - len, "%s%d", idx == 0 ? "" : ",", stats->rssi_hist[idx]);
+	}
+	for (uint8_t idx = 0; idx < LINK_HIST_BUCKETS; idx++)
+	{
+		len += snprintf(&g_at_query_buf[len], ATQUERY_SIZE - len, "%s%d", idx == 0 ? ":" : ",", stats->snr_hist[idx]);
+	}
+	return 0;
+}
+
+/**
+ * @brief AT+LINKDUMP=? Get the link statistics in binary format as hex string
+ *
+ * @return int always 0
+ */
+static int at_query_link_dump(void)
+{
+	uint8_t dump[LINK_DUMP_SIZE];
+	uint16_t size = api_link_dump(dump, LINK_DUMP_SIZE);
+	for (uint16_t idx = 0; idx < size; idx++)
+	{
+		snprintf(&g_at_query_buf[idx * 2], ATQUERY_SIZE - idx * 2, "%02X", dump[idx]);
+	}
+	return 0;
+}
+
+/**
+ * @brief AT+RXLAT=? Get the latency of the downlinks handled by a port handler
+ *    Number of downlinks, last, average and max time from the radio callback to the handler in us
+ *
+ * @return int always 0
+ */
+static int at_query_rx_latency(void)
+{
+	s_rx_latency latency;
+	api_rx_latency(&latency);
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%ld:%ld:%ld:%ld", (long)latency.count, (long)latency.last_us, (long)latency.avg_us, (long)latency.max_us);
+	return 0;
+}
+
+/**
+ * @brief AT+RXLAT Clear the latency statistics
+ *
+ * @return int always 0
+ */
+static int at_exec_rx_latency(void)
+{
+	api_rx_latency_reset();
+	return 0;
+}
+
+/**
+ * @brief AT+BAND=? Get regional frequency band
+ *
+ * @return int always 0
+ */
+static int at_query_region(void)
+{
+	// 0: AS923 1: AU915 2: CN470 3: CN779 4: EU433 5: EU868 6: KR920 7: IN865 8: US915 9: AS923-2 10: AS923-3 11: AS923-4 12: RU864
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d %s", g_lorawan_settings.lora_region, region_names[g_lorawan_settings.lora_region]);
+
+	return 0;
+}
+
+/**
+ * @brief AT+BAND=xx Set regional frequency band
+ *  Values: 0: AS923 1: AU915 2: CN470 3: CN779 4: EU433 5: EU868 6: KR920 7: IN865 8: US915 9: AS923-2 10: AS923-3 11: AS923-4 12: RU864
+ * @return int 0 if valid parameter
+ */
+static int at_exec_region(char *str)
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	char *param;
+	uint8_t region;
+
+	param = strtok(str, ",");
+	if (param != NULL)
+	{
+		region = strtol(param, NULL, 0);
+		// RAK4630 0: AS923 1: AU915 2: CN470 3: CN779 4: EU433 5: EU868 6: KR920 7: IN865 8: US915 9: AS923-2 10: AS923-3 11: AS923-4 12: RU864
+		if (region > 12)
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		g_lorawan_settings.lora_region = region;
+		save_settings();
+	}
+	else
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief AT+MASK=? Get channel mask
+ *  Only available for regions 1: AU915 2: CN470 8: US915
+ * @return int always 0
+ */
+static int at_query_mask(void)
+{
+	if ((g_lorawan_settings.lora_region == 1) || (g_lorawan_settings.lora_region == 2) || (g_lorawan_settings.lora_region == 8))
+	{
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "%d", g_lorawan_settings.subband_channels);
+
+		return 0;
+	}
+	return AT_ERRNO_PARA_VAL;
+}
+
+/**
+ * @brief AT+MASK=xx Set channel mask
+ *  Only available for regions 1: AU915 2: CN470 8: US915
+ * @return int 0 if valid parameter
+ */
+static int at_exec_mask(char *str)
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	char *param;
+	uint8_t mask;
+
+	param = strtok(str, ",");
+	if (param != NULL)
+	{
+		mask = strtol(param, NULL, 0);
+
+		uint8_t maxBand = 1;
+		switch (g_lorawan_settings.lora_region)
+		{
+		case LORAMAC_REGION_AU915:
+			maxBand = 9;
+			break;
+		case LORAMAC_REGION_CN470:
+			maxBand = 12;
+			break;
+		case LORAMAC_REGION_US915:
+			maxBand = 9;
+			break;
+		default:
+			return AT_ERRNO_PARA_VAL;
+		}
+		if ((mask == 0) || (mask > maxBand))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+		g_lorawan_settings.subband_channels = mask;
+		save_settings();
+	}
+	else
+	{
+		return AT_ERRNO_PARA_NUM;
+	}
+
+	return 0;
+}
+
+/**
+ * @brief AT+NJM=? Return current join modus
+ *
+ * @return int always 0
+ */
+static int at_query_joinmode(void)
+{
+	int mode;
+	mode = g_lorawan_settings.otaa_enabled == true ? 1 : 0;
+
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d", mode);
+	return 0;
+}
+
+/**
+ * @brief AT+NJM=x Set current join modus
+ *
+ * @param str 1 = OTAA 0 = ABP
+ * @return int 0 if valid parameter
+ */
+static int at_exec_joinmode(char *str)
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	int mode = strtol(str, NULL, 0);
+
+	if (mode != 0 && mode != 1)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+
+	g_lorawan_settings.otaa_enabled = (mode == 1 ? true : false);
+	save_settings();
+
+	return 0;
+}
+
+/**
+ * @brief AT+DEVEUI=? Get current Device EUI
+ *
+ * @return int always 0
+ */
+static int at_query_deveui(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE,
+			 "%02X%02X%02X%02X%02X%02X%02X%02X",
+			 g_lorawan_settings.node_device_eui[0],
+			 g_lorawan_settings.node_device_eui[1],
+			 g_lorawan_settings.node_device_eui[2],
+			 g_lorawan_settings.node_device_eui[3],
+			 g_lorawan_settings.node_device_eui[4],
+			 g_lorawan_settings.node_device_eui[5],
+			 g_lorawan_settings.node_device_eui[6],
+			 g_lorawan_settings.node_device_eui[7]);
+	return 0;
+}
+
+/**
+ * @brief AT+DEVEUI=<XXXXXXXXXXXXXXXX> Set current Device EUI
+ * @return int 0 if Dev EUI has correct length and was valid HEX
+ */
+static int at_exec_deveui(char *str)
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	uint8_t len;
+	uint8_t buf[8];
+
+	len = hex2bin(str, buf, 8);
+
+	if (len != 8)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+
+	memcpy(g_lorawan_settings.node_device_eui, buf, 8);
+	save_settings();
+
+	return 0;
+}
+
+/**
+ * @brief AT+APPEUI=? Get current Application (Join) EUI
+ *
+ * @return int always 0
+ */
+static int at_query_appeui(void)
+{
+	snprintf(g_at_query_buf, ATQUERY_SIZE,
+			 "%02X%02X%02X%02X%02X%02X%02X%02X",
+			 g_lorawan_settings.node_app_eui[0],
+			 g_lorawan_settings.node_app_eui[1],
+			 g_lorawan_settings.node_app_eui[2],
+			 g_lorawan_settings.node_app_eui[3],
+			 g_lorawan_settings.node_app_eui[4],
+			 g_lorawan_settings.node_app_eui[5],
+			 g_lorawan_settings.node_app_eui[6],
+			 g_lorawan_settings.node_app_eui[7]);
+	return 0;
+}
+
+/**
+ * @brief AT+APPEUI=<XXXXXXXXXXXXXXXX> Set current Application (Join) EUI
+ *
+ * @return int 0 if App EUI has correct length and was valid HEX
+ */
+static int at_exec_appeui(char *str)
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	uint8_t len;
+	uint8_t buf[8];
+
+	len = hex2bin(str, buf, 8);
+	if (len != 8)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+
+	memcpy(g_lorawan_settings.node_app_eui, buf, 8);
+	save_settings();
+
+	return 0;
+}
+
+/**
+ * @brief AT+APPKEY=? Get current Application Key
+ *
+ * @return int always 0
+ */
+static int at_query_appkey(void)
+{
+	uint8_t i;
+	uint8_t len = 0;
+
+	for (i = 0; i < 16; i++)
+	{
+		len += snprintf(g_at_query_buf + len, ATQUERY_SIZE - len, "%02X", g_lorawan_settings.node_app_key[i]);
+		if (ATQUERY_SIZE <= len)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief AT+APPKEY=<XXXXXXXXXXXXXXXXXXXXXXXXXXXXXXXX> Set current Application (Join) EUI
+ *
+ * @return int 0 if App Key has correct length and was valid HEX
+ */
+static int at_exec_appkey(char *str)
+{
+	if (!g_lorawan_settings.lorawan_enable)
 	{
 		return AT_ERRNO_NOALLOW;
 	}
@@ -893,11 +1491,11 @@ static int at_query_devaddr(void)
 {
 	if (otaaDevAddr != 0)
 	{
-		snprintf(g_at_query_buf, ATQUERY_SIZE, "%08lX\n", otaaDevAddr);
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "%08lX\n", (unsigned long)otaaDevAddr);
 	}
 	else
 	{
-		snprintf(g_at_query_buf, ATQUERY_SIZE, "%08lX\n", g_lorawan_settings.node_dev_addr);
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "%08lX\n", (unsigned long)g_lorawan_settings.node_dev_addr);
 	}
 	return 0;
 }
@@ -1086,9 +1684,12 @@ static int at_query_join(void)
 	}
 	// Param1 = Join command: 1 for joining the network , 0 for stop joining
 	// Param2 = Auto-Join config: 1 for Auto-join on power up) , 0 for no auto-join.
-	// Param3 = Reattempt interval: 7 - 255 seconds
+	// Param3 = Reattempt interval: current join back-off in seconds
 	// Param4 = No. of join attempts: 0 - 255
-	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d,%d,%d,%d", 0, g_lorawan_settings.auto_join, 8, g_lorawan_settings.join_trials);
+	s_join_status join_status;
+	api_join_status(&join_status);
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d,%d,%ld,%d", join_status.pending ? 1 : 0, g_lorawan_settings.auto_join,
+			 (long)(join_status.pending ? join_status.interval / 1000 : API_JOIN_BACKOFF_MIN / 1000), g_lorawan_settings.join_trials);
 
 	return 0;
 }
@@ -1187,42 +1788,201 @@ static int at_exec_join(char *str)
 		}
 		return 0;
 
-		if ((bJoin == 1) && g_lorawan_initialized && (lmh_join_status_get() != LMH_SET))
+		if ((bJoin == 1) && g_lorawan_initialized && (lmh_join_status_get() != LMH_SET))
+		{
+			// If if not yet joined, start join
+			lmh_join();
+			return 0;
+		}
+
+		if ((bJoin == 1) && g_lorawan_settings.auto_join)
+		{
+			// If auto join is set, restart the device to start join process
+			api_schedule_callback(api_reset, 100);
+			return 0;
+		}
+	}
+
+	return AT_ERRNO_PARA_VAL;
+}
+
+/**
+ * @brief AT+NJS Get current join status
+ *
+ * @return int always 0
+ */
+static int at_query_join_status()
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	uint8_t join_status;
+
+	join_status = (uint8_t)lmh_join_status_get();
+	s_join_status retry;
+	api_join_status(&retry);
+	if (retry.pending)
+	{
+		// Not joined, add the time to the next join in seconds and the number of failed joins
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%ld:%d", join_status, (long)((retry.next_attempt + 999) / 1000), retry.attempts);
+		return 0;
+	}
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d", join_status);
+
+	return 0;
+}
+
+/**
+ * @brief AT+SESSION=? Get the saved LoRaWAN session
+ *
+ * @return int always 0
+ */
+static int at_query_session(void)
+{
+	s_lorawan_session session;
+	if (!api_lorawan_session_get(&session))
+	{
+		snprintf(g_at_query_buf, ATQUERY_SIZE, "0");
+		return 0;
+	}
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "1:%08lX:%ld:%ld", (unsigned long)session.dev_addr, (long)session.fcnt_up, (long)session.fcnt_down);
+	return 0;
+}
+
+/**
+ * @brief AT+SESSION Delete the saved LoRaWAN session, the device joins again after the next reset
+ *
+ * @return int 0 if the session was deleted
+ */
+static int at_exec_session(void)
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	api_lorawan_session_clear();
+	return 0;
+}
+
+/**
+ * @brief AT+JOURNAL=? Get the state of the uplink journal
+ *
+ * @return int always 0
+ */
+static int at_query_journal(void)
+{
+	s_journal_status status;
+	api_journal_status(&status);
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%ld:%d:%ld:%ld", status.enabled, (long)status.max_age, status.send_age, (long)status.records, (long)status.dropped);
+	return 0;
+}
+
+/**
+ * @brief AT+JOURNAL=<enable>:<max age>:<send age> Enable or disable the uplink journal
+ *
+ * @param str enable 0 or 1, max age in seconds (optional, 0 = no limit), send age 0 or 1 (optional)
+ * @return int 0 if the parameters are valid
+ */
+static int at_exec_journal(char *str)
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	char *param = strtok(str, ":");
+	if (param == NULL)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	long enable = strtol(param, NULL, 0);
+	if ((enable != 0) && (enable != 1))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	long max_age = 0;
+	param = strtok(NULL, ":");
+	if (param != NULL)
+	{
+		max_age = strtol(param, NULL, 0);
+		if (max_age < 0)
 		{
-			// If if not yet joined, start join
-			delay(100);
-			lmh_join();
-			return 0;
+			return AT_ERRNO_PARA_VAL;
 		}
-
-		if ((bJoin == 1) && g_lorawan_settings.auto_join)
+	}
+	long send_age = 0;
+	param = strtok(NULL, ":");
+	if (param != NULL)
+	{
+		send_age = strtol(param, NULL, 0);
+		if ((send_age != 0) && (send_age != 1))
 		{
-			// If auto join is set, restart the device to start join process
-			delay(100);
-			api_reset();
-			return 0;
+			return AT_ERRNO_PARA_VAL;
 		}
 	}
+	api_journal(enable == 1, max_age, send_age == 1);
+	return 0;
+}
 
-	return AT_ERRNO_PARA_VAL;
+/**
+ * @brief AT+JOURNAL Delete all records of the uplink journal
+ *
+ * @return int always 0
+ */
+static int at_exec_journal_clear(void)
+{
+	api_journal_clear();
+	return 0;
 }
 
 /**
- * @brief AT+NJS Get current join status
+ * @brief AT+RCFG=? Get the state of the remote configuration
  *
  * @return int always 0
  */
-static int at_query_join_status()
+static int at_query_remote_config(void)
+{
+	uint8_t port = api_remote_config_port();
+	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d:%d", port != 0, port != 0 ? port : API_CONFIG_PORT);
+	return 0;
+}
+
+/**
+ * @brief AT+RCFG=<enable>:<fPort> Enable or disable the remote configuration over LoRaWAN
+ *
+ * @param str enable 0 or 1, fPort 1 to 223 (optional, default API_CONFIG_PORT)
+ * @return int 0 if the parameters are valid
+ */
+static int at_exec_remote_config(char *str)
 {
 	if (!g_lorawan_settings.lorawan_enable)
 	{
 		return AT_ERRNO_NOALLOW;
 	}
-	uint8_t join_status;
-
-	join_status = (uint8_t)lmh_join_status_get();
-	snprintf(g_at_query_buf, ATQUERY_SIZE, "%d", join_status);
-
+	char *param = strtok(str, ":");
+	if (param == NULL)
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	long enable = strtol(param, NULL, 0);
+	if ((enable != 0) && (enable != 1))
+	{
+		return AT_ERRNO_PARA_VAL;
+	}
+	long port = API_CONFIG_PORT;
+	param = strtok(NULL, ":");
+	if (param != NULL)
+	{
+		port = strtol(param, NULL, 0);
+		if ((port < 1) || (port > 223))
+		{
+			return AT_ERRNO_PARA_VAL;
+		}
+	}
+	if (!api_remote_config(enable == 1, port))
+	{
+		return AT_ERRNO_EXEC_FAIL;
+	}
 	return 0;
 }
 
@@ -1478,22 +2238,27 @@ static int at_exec_send(char *str)
 	// Get data to send
 	param = strtok(NULL, ":");
 	int data_size = strlen(param);
-	if (!(data_size % 2 == 0) || (data_size > 254))
+	if (!(data_size % 2 == 0) || (data_size > 510))
 	{
 		return AT_ERRNO_PARA_VAL;
 	}
 
-	int buff_idx = 0;
-	char buff_parse[3];
-	for (int idx = 0; idx <= data_size + 1; idx += 2)
+	// Parse the data directly into the TX buffer
+	uint8_t *tx_buffer = api_tx_acquire();
+	if (tx_buffer == NULL)
+	{
+		return AT_ERRNO_NOALLOW;
+	}
+	if (hex2bin(param, tx_buffer, data_size / 2) < 0)
+	{
+		api_tx_release();
+		return AT_ERRNO_PARA_VAL;
+	}
+	if (api_tx_submit(data_size / 2, fPort) != LMH_SUCCESS)
 	{
-		buff_parse[0] = param[idx];
-		buff_parse[1] = param[idx + 1];
-		buff_parse[2] = 0;
-		m_lora_app_data_buffer[buff_idx] = strtol(buff_parse, NULL, 16);
-		buff_idx++;
+		// Busy or payload too large for the current data rate
+		return AT_ERRNO_EXEC_FAIL;
 	}
-	send_lora_packet(m_lora_app_data_buffer, data_size / 2, fPort);
 	return 0;
 }
 
@@ -1560,8 +2325,8 @@ static int at_query_version(void)
  */
 static int at_exec_reboot(void)
 {
-	delay(100);
-	api_reset();
+	// Reset after the response was sent
+	api_schedule_callback(api_reset, 100);
 	return 0;
 }
 
@@ -1608,6 +2373,9 @@ static atcmd_t g_at_cmd_list[] = {
 	{"+JOIN", "Join network", at_query_join, at_exec_join, NULL},
 	{"+NJS", "Get the join status", at_query_join_status, NULL, NULL},
 	{"+NJM", "Get or set the network join mode", at_query_joinmode, at_exec_joinmode, NULL},
+	{"+SESSION", "Saved session valid:devaddr:uplink checkpoint:downlink counter, AT+SESSION deletes it", at_query_session, NULL, at_exec_session},
+	{"+JOURNAL", "Uplink journal enable:max age:send age:records:dropped, AT+JOURNAL deletes all records", at_query_journal, at_exec_journal, at_exec_journal_clear},
+	{"+RCFG", "Remote configuration over LoRaWAN enable:fPort", at_query_remote_config, at_exec_remote_config, NULL},
 	{"+SENDFREQ", "Deprecated! Use SENDINT instead", at_query_sendfreq, at_exec_sendfreq, NULL},
 	{"+SENDINT", "Get or Set the automatic send interval", at_query_sendfreq, at_exec_sendfreq, NULL},
 	{"+SEND", "Send data", NULL, at_exec_send, NULL},
@@ -1625,6 +2393,11 @@ static atcmd_t g_at_cmd_list[] = {
 	{"+SNR", "Last RX packet SNR", at_query_snr, NULL, NULL},
 	{"+VER", "Get SW version", at_query_version, NULL, NULL},
 	{"+STATUS", "Show LoRaWAN status", at_query_status, NULL, NULL},
+	{"+AIRTIME", "Airtime in ms last hour:total:packets", at_query_airtime, NULL, at_exec_airtime},
+	{"+LINKSTAT", "Link statistics rx:crc:timeout:per:rssi avg:min:max:snr avg:min:max", at_query_link_stat, NULL, at_exec_link_stat},
+	{"+LINKHIST", "RSSI and SNR histograms", at_query_link_hist, NULL, NULL},
+	{"+LINKDUMP", "Link statistics as binary dump", at_query_link_dump, NULL, NULL},
+	{"+RXLAT", "Downlink latency in us count:last:avg:max", at_query_rx_latency, NULL, at_exec_rx_latency},
 	// LoRa P2P management
 	{"+NWM", "Switch LoRa workmode", at_query_mode, at_exec_mode, NULL},
 	{"+PFREQ", "Set P2P frequency", at_query_p2p_freq, at_exec_p2p_freq, NULL},
@@ -1636,45 +2409,436 @@ static atcmd_t g_at_cmd_list[] = {
 	{"+P2P", "Set P2P configuration", at_query_p2p_config, at_exec_p2p_config, NULL},
 	{"+PSEND", "P2P send data", NULL, at_exec_p2p_send, NULL},
 	{"+PRECV", "P2P receive mode", at_query_p2p_receive, at_exec_p2p_receive, NULL},
+	{"+PSNIFF", "Set P2P sniff period in ms", at_query_p2p_sniff, at_exec_p2p_sniff, NULL},
+	{"+PSTATE", "P2P radio state and time in ms per state", at_query_p2p_state, NULL, at_exec_p2p_state},
+	{"+PCAD", "Set P2P CAD attempts and backoff in ms", at_query_p2p_cad, at_exec_p2p_cad, NULL},
+	{"+PCADSTAT", "P2P busy/clear CAD count per channel", at_query_p2p_cad_stat, NULL, at_exec_p2p_cad_stat},
+	{"+PHOP", "Set P2P frequency hopping channels:spacing:key", at_query_p2p_hop, at_exec_p2p_hop, NULL},
+	{"+PTDMA", "Set P2P TDMA role:frame:slots or role:slot", at_query_p2p_tdma, at_exec_p2p_tdma, NULL},
+	{"+PDUTY", "Set P2P duty cycle limit in per mille:queue", at_query_p2p_duty, at_exec_p2p_duty, NULL},
+	{"+PADAPT", "Set P2P adaptive SF and TX power on/off", at_query_p2p_adapt, at_exec_p2p_adapt, NULL},
+	{"+PREL", "Set P2P reliable delivery address:window", at_query_p2p_rel, at_exec_p2p_rel, NULL},
+	{"+PRSEND", "P2P send data with reliable delivery address:data", NULL, at_exec_p2p_rel_send, NULL},
+	{"+PRELSTAT", "P2P reliable delivery sent:retransmits:acked:failed:received:duplicates", at_query_p2p_rel_stat, NULL, at_exec_p2p_rel_stat},
+};
+
+/**
+ * @brief List all available commands with short help
+ *
+ * @return int always 0
+ */
+static int at_exec_list_all(void)
+{
+	AT_PRINTF("\r\n+++++++++++++++\r\n");
+	AT_PRINTF("AT command list\r\n");
+	AT_PRINTF("+++++++++++++++\r\n");
+
+	for (unsigned int idx = 0; idx < sizeof(g_at_cmd_list) / sizeof(atcmd_t); idx++)
+	{
+		if (idx < 4)
+		{
+			AT_PRINTF("AT%s\t\t%s\r\n", g_at_cmd_list[idx].cmd_name, g_at_cmd_list[idx].cmd_desc);
+		}
+		else
+		{
+			AT_PRINTF("AT%s\t%s\r\n", g_at_cmd_list[idx].cmd_name, g_at_cmd_list[idx].cmd_desc);
+		}
+	}
+
+	if (&g_user_at_cmd_list != 0)
+	{
+		AT_PRINTF("\r\n+++++++++++++++\r\n");
+		AT_PRINTF("User AT command list\r\n");
+		AT_PRINTF("+++++++++++++++\r\n");
+
+		for (unsigned int idx = 0; idx < g_user_at_cmd_num; idx++)
+		{
+			AT_PRINTF("AT%s\t%s\r\n", g_user_at_cmd_list[idx].cmd_name, g_user_at_cmd_list[idx].cmd_desc);
+		}
+	}
+
+	AT_PRINTF("+++++++++++++++\r\n");
+	return 0;
+}
+
+/** Number of built-in AT commands */
+#define AT_CMD_NUM (sizeof(g_at_cmd_list) / sizeof(atcmd_t))
+
+/** Forms of an AT command */
+enum AT_CMD_FORM
+{
+	AT_FORM_NO_PARA = 0, // AT+CMD
+	AT_FORM_TEST,		 // AT+CMD?
+	AT_FORM_QUERY,		 // AT+CMD=?
+	AT_FORM_EXEC,		 // AT+CMD=value
+	AT_FORM_INVALID
+};
+
+/** AT command list prepared for binary search */
+struct s_at_index
+{
+	const atcmd_t *list;
+	uint8_t *order;	   // Indices into list, sorted by command name
+	uint8_t *name_len; // Length of the command names
+	uint8_t num;
 };
 
+/** Sorted index of the built-in AT commands */
+static uint8_t at_cmd_order[AT_CMD_NUM];
+static uint8_t at_cmd_name_len[AT_CMD_NUM];
+static s_at_index at_cmd_index = {NULL, at_cmd_order, at_cmd_name_len, 0};
+/** Sorted index of the user AT commands, allocated on first use */
+static s_at_index at_user_index = {NULL, NULL, NULL, 0};
+
+/**
+ * @brief Compare a received command name with a command from a list
+ *
+ * @param name received command name, not 0 terminated
+ * @param len length of the received command name
+ * @param cmd_name command name from the list
+ * @param cmd_len length of the command name from the list
+ * @return int <0, 0 or >0 like strcmp()
+ */
+static int at_name_cmp(const char *name, uint16_t len, const char *cmd_name, uint8_t cmd_len)
+{
+	int result = strncmp(name, cmd_name, len < cmd_len ? len : cmd_len);
+	if (result != 0)
+	{
+		return result;
+	}
+	return (int)len - (int)cmd_len;
+}
+
+/**
+ * @brief Sort the commands of a list by name
+ *
+ * @param index index to be filled
+ * @param list AT command list
+ * @param num number of commands in the list
+ */
+static void at_index_build(s_at_index *index, const atcmd_t *list, uint8_t num)
+{
+	for (uint8_t idx = 0; idx < num; idx++)
+	{
+		index->name_len[idx] = strlen(list[idx].cmd_name);
+	}
+	// Insertion sort, the lists are short and sorted only once
+	for (uint8_t idx = 0; idx < num; idx++)
+	{
+		uint8_t entry = idx;
+		int16_t pos = idx - 1;
+		while ((pos >= 0) && (at_name_cmp(list[entry].cmd_name, index->name_len[entry],
+										  list[index->order[pos]].cmd_name, index->name_len[index->order[pos]]) < 0))
+		{
+			index->order[pos + 1] = index->order[pos];
+			pos--;
+		}
+		index->order[pos + 1] = entry;
+	}
+	index->list = list;
+	index->num = num;
+}
+
+/**
+ * @brief Find a command by name with binary search
+ *
+ * @param index sorted index of an AT command list
+ * @param name received command name, not 0 terminated
+ * @param len length of the received command name
+ * @return const atcmd_t* the command or NULL if not found
+ */
+static const atcmd_t *at_index_find(s_at_index *index, const char *name, uint16_t len)
+{
+	int16_t low = 0;
+	int16_t high = index->num - 1;
+	while (low <= high)
+	{
+		int16_t mid = (low + high) / 2;
+		uint8_t entry = index->order[mid];
+		int result = at_name_cmp(name, len, index->list[entry].cmd_name, index->name_len[entry]);
+		if (result == 0)
+		{
+			return &index->list[entry];
+		}
+		if (result < 0)
+		{
+			high = mid - 1;
+		}
+		else
+		{
+			low = mid + 1;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Find a user AT command
+ *    The index is rebuilt if the application changed the user command list
+ *
+ * @param name received command name, not 0 terminated
+ * @param len length of the received command name
+ * @return const atcmd_t* the command or NULL if not found
+ */
+static const atcmd_t *at_user_find(const char *name, uint16_t len)
+{
+	if ((at_user_index.list != g_user_at_cmd_list) || (at_user_index.num != g_user_at_cmd_num))
+	{
+		if (at_user_index.order != NULL)
+		{
+			free(at_user_index.order);
+		}
+		at_user_index.order = (uint8_t *)malloc(2 * g_user_at_cmd_num);
+		if (at_user_index.order == NULL)
+		{
+			at_user_index.list = NULL;
+			at_user_index.num = 0;
+			return NULL;
+		}
+		at_user_index.name_len = at_user_index.order + g_user_at_cmd_num;
+		at_index_build(&at_user_index, g_user_at_cmd_list, g_user_at_cmd_num);
+	}
+	return at_index_find(&at_user_index, name, len);
+}
+
+/**
+ * @brief Execute an AT command
+ *
+ * @param cmd the command from the command list
+ * @param form one of AT_CMD_FORM
+ * @param param parameter of AT+CMD=value
+ * @param response buffer for the response
+ * @param size size of the response buffer
+ * @return int 0 if the response is in the buffer, AT_CB_PRINT or an error code
+ */
+static int at_cmd_exec(const atcmd_t *cmd, uint8_t form, char *param, char *response, uint16_t size)
+{
+	int ret = 0;
+	switch (form)
+	{
+	case AT_FORM_TEST:
+		if (cmd->cmd_desc)
+		{
+			if (strncmp(cmd->cmd_desc, "OK", 2) == 0)
+			{
+				snprintf(response, size, "\r\nOK\r\n");
+			}
+			else
+			{
+				snprintf(response, size, "\r\n%s:\"%s\"\r\nOK\r\n",
+						 cmd->cmd_name, cmd->cmd_desc);
+			}
+		}
+		else
+		{
+			snprintf(response, size, "\r\n%s\r\nOK\r\n", cmd->cmd_name);
+		}
+		return 0;
+	case AT_FORM_QUERY:
+		if (cmd->query_cmd == NULL)
+		{
+			return AT_ERRNO_NOALLOW;
+		}
+		ret = cmd->query_cmd();
+		if (ret == 0)
+		{
+			snprintf(response, size, "\r\n%s:%s\r\nOK\r\n",
+					 cmd->cmd_name, g_at_query_buf);
+		}
+		return ret;
+	case AT_FORM_EXEC:
+		if (cmd->exec_cmd == NULL)
+		{
+			return AT_ERRNO_NOALLOW;
+		}
+		ret = cmd->exec_cmd(param);
+		break;
+	default:
+		if (cmd->exec_cmd_no_para == NULL)
+		{
+			return AT_ERRNO_NOALLOW;
+		}
+		ret = cmd->exec_cmd_no_para();
+		break;
+	}
+
+	if (ret == 0)
+	{
+		snprintf(response, size, "\r\nOK\r\n");
+	}
+	else if (ret == -1)
+	{
+		ret = AT_ERRNO_SYS;
+	}
+	return ret;
+}
+
+/** Commands that are allowed over the air, settings that can't lock the device out of the network.
+ *  Only the query (=?) and set (=<value>) forms are allowed */
+static const char *at_remote_allowed[] = {"+SENDINT", "+ADR", "+DR", "+TXP", "+CFM", "+PORT", "+CLASS"};
+/** fPort of the remote configuration, 0 if disabled */
+static uint8_t at_remote_port = 0;
+/** Command line of a remote configuration downlink */
+static char at_remote_line[sizeof(((s_rx_packet *)0)->data) + 1];
+
+/**
+ * @brief Execute one AT command received over LoRaWAN
+ *    Same syntax as over USB, the "AT" at the start can be left out
+ *
+ * @param line the command
+ * @param response set to the result of a query, "OK" or "E:<error code>"
+ * @param size size of the response buffer
+ */
+static void at_remote_exec(char *line, char *response, uint16_t size)
+{
+	if (strncmp(line, "AT", 2) == 0)
+	{
+		line += 2;
+	}
+	uint16_t name_len = strcspn(line, "=?");
+	char *suffix = &line[name_len];
+	uint8_t form = AT_FORM_INVALID;
+	if (suffix[0] == '\0')
+	{
+		form = AT_FORM_NO_PARA;
+	}
+	else if (strcmp(suffix, "=?") == 0)
+	{
+		form = AT_FORM_QUERY;
+	}
+	else if ((suffix[0] == '=') && (suffix[1] != '\0'))
+	{
+		form = AT_FORM_EXEC;
+	}
+
+	if (at_cmd_index.list == NULL)
+	{
+		at_index_build(&at_cmd_index, g_at_cmd_list, AT_CMD_NUM);
+	}
+	const atcmd_t *cmd = at_index_find(&at_cmd_index, line, name_len);
+	int ret = 0;
+	if ((cmd == NULL) || (form == AT_FORM_INVALID))
+	{
+		ret = AT_ERRNO_NOSUPP;
+	}
+	else
+	{
+		ret = AT_ERRNO_NOALLOW;
+		if (form != AT_FORM_NO_PARA)
+		{
+			for (uint8_t idx = 0; idx < sizeof(at_remote_allowed) / sizeof(at_remote_allowed[0]); idx++)
+			{
+				if (strcmp(cmd->cmd_name, at_remote_allowed[idx]) == 0)
+				{
+					ret = 0;
+					break;
+				}
+			}
+		}
+	}
+	if (ret == 0)
+	{
+		char result[ATQUERY_SIZE + 32];
+		ret = at_cmd_exec(cmd, form, suffix + 1, result, sizeof(result));
+	}
+	API_LOG("AT", "Remote AT%s result %d", line, ret);
+
+	if ((ret == 0) && (form == AT_FORM_QUERY))
+	{
+		snprintf(response, size, "%s", g_at_query_buf);
+	}
+	else if (ret == 0)
+	{
+		snprintf(response, size, "OK");
+	}
+	else
+	{
+		snprintf(response, size, "E:%x", ret);
+	}
+}
+
 /**
- * @brief List all available commands with short help
+ * @brief Handler for remote configuration downlinks
+ *    The payload has one or more AT commands separated by ';' or line breaks, e.g. "AT+SENDINT=600;AT+ADR=1".
+ *    The results are sent back on the same fPort, separated by ';'
  *
- * @return int always 0
+ * @param packet the downlink
  */
-static int at_exec_list_all(void)
+static void at_remote_handler(s_rx_packet *packet)
 {
-	AT_PRINTF("\r\n+++++++++++++++\r\n");
-	AT_PRINTF("AT command list\r\n");
-	AT_PRINTF("+++++++++++++++\r\n");
+	memcpy(at_remote_line, packet->data, packet->len);
+	at_remote_line[packet->len] = '\0';
 
-	for (unsigned int idx = 0; idx < sizeof(g_at_cmd_list) / sizeof(atcmd_t); idx++)
+	char answer[API_TX_QUEUE_PAYLOAD + 1];
+	uint16_t answer_len = 0;
+	char *save_ptr = NULL;
+	// Commands with parameters use strtok() as well, split the line with strtok_r()
+	for (char *line = strtok_r(at_remote_line, ";\r\n", &save_ptr); line != NULL; line = strtok_r(NULL, ";\r\n", &save_ptr))
 	{
-		if (idx < 4)
-		{
-			AT_PRINTF("AT%s\t\t%s\r\n", g_at_cmd_list[idx].cmd_name, g_at_cmd_list[idx].cmd_desc);
-		}
-		else
-		{
-			AT_PRINTF("AT%s\t%s\r\n", g_at_cmd_list[idx].cmd_name, g_at_cmd_list[idx].cmd_desc);
-		}
+		char response[ATQUERY_SIZE];
+		at_remote_exec(line, response, sizeof(response));
+		int added = snprintf(&answer[answer_len], sizeof(answer) - answer_len, "%s%s", answer_len == 0 ? "" : ";", response);
+		answer_len = (size_t)(answer_len + added) < sizeof(answer) ? answer_len + added : sizeof(answer) - 1;
 	}
-
-	if (&g_user_at_cmd_list != 0)
+	if (answer_len != 0)
 	{
-		AT_PRINTF("\r\n+++++++++++++++\r\n");
-		AT_PRINTF("User AT command list\r\n");
-		AT_PRINTF("+++++++++++++++\r\n");
+		api_tx_enqueue((uint8_t *)answer, answer_len, packet->fport);
+	}
+}
 
-		for (unsigned int idx = 0; idx < g_user_at_cmd_num; idx++)
-		{
-			AT_PRINTF("AT%s\t%s\r\n", g_user_at_cmd_list[idx].cmd_name, g_user_at_cmd_list[idx].cmd_desc);
-		}
+/**
+ * @brief Enable or disable the remote configuration over LoRaWAN
+ *    AT commands received on the fPort are executed as if they were sent over USB.
+ *    Only the commands in at_remote_allowed[] are allowed.
+ *
+ * @param enable true to enable the remote configuration
+ * @param port fPort for the AT commands, default API_CONFIG_PORT
+ * @return true if the handler was registered
+ * @return false if the fPort is invalid or no port handler is free
+ */
+bool api_remote_config(bool enable, uint8_t port)
+{
+	if (at_remote_port != 0)
+	{
+		api_register_port_handler(at_remote_port, NULL);
+		at_remote_port = 0;
+	}
+	if (!enable)
+	{
+		return true;
+	}
+	if (!api_register_port_handler(port, at_remote_handler))
+	{
+		return false;
 	}
+	at_remote_port = port;
+	return true;
+}
 
-	AT_PRINTF("+++++++++++++++\r\n");
-	return 0;
+/**
+ * @brief fPort of the remote configuration
+ *
+ * @return uint8_t fPort, 0 if the remote configuration is disabled
+ */
+uint8_t api_remote_config_port(void)
+{
+	return at_remote_port;
+}
+
+/**
+ * @brief Clear the command line for the next command
+ *    Only the bytes used by the command and its response are cleared
+ *
+ */
+static void at_line_clear(void)
+{
+	size_t used = strnlen(atcmd, ATCMD_SIZE);
+	if (used < atcmd_index)
+	{
+		used = atcmd_index;
+	}
+	memset(atcmd, 0xff, used < ATCMD_SIZE ? used + 1 : ATCMD_SIZE);
+	atcmd_index = 0;
 }
 
 /**
@@ -1683,130 +2847,57 @@ static int at_exec_list_all(void)
  */
 static void at_cmd_handle(void)
 {
-	uint8_t i;
 	int ret = 0;
-	const char *cmd_name;
 	char *rxcmd = atcmd + 2;
 	int16_t tmp = atcmd_index - 2;
-	uint16_t rxcmd_index;
 
 	if (atcmd_index < 2 || rxcmd[tmp] != '\0')
 	{
-		atcmd_index = 0;
-		memset(atcmd, 0xff, ATCMD_SIZE);
+		at_line_clear();
 		return;
 	}
 
 	// Serial.printf("atcmd_index==%d=%s==\n", atcmd_index, atcmd);
 	if (atcmd_index == 2 && strncmp(atcmd, "AT", atcmd_index) == 0)
 	{
-		atcmd_index = 0;
-		memset(atcmd, 0xff, ATCMD_SIZE);
+		at_line_clear();
 		AT_PRINTF("\r\nOK\r\n");
 		return;
 	}
 
-	rxcmd_index = tmp;
+	// Split the command into name and form
+	uint16_t name_len = strcspn(rxcmd, "=?");
+	if (name_len == 0)
+	{
+		// AT? is the command "?"
+		name_len = tmp;
+	}
+	char *suffix = &rxcmd[name_len];
+	uint8_t form = AT_FORM_INVALID;
+	if (suffix[0] == '\0')
+	{
+		form = AT_FORM_NO_PARA;
+	}
+	else if (strcmp(suffix, "?") == 0)
+	{
+		form = AT_FORM_TEST;
+	}
+	else if (strcmp(suffix, "=?") == 0)
+	{
+		form = AT_FORM_QUERY;
+	}
+	else if ((suffix[0] == '=') && (suffix[1] != '\0'))
+	{
+		form = AT_FORM_EXEC;
+	}
 
 	// Check for standard AT commands
-	for (i = 0; i < sizeof(g_at_cmd_list) / sizeof(atcmd_t); i++)
+	if (at_cmd_index.list == NULL)
 	{
-		cmd_name = g_at_cmd_list[i].cmd_name;
-		// Serial.printf("===rxcmd========%s================cmd_name=====%s====%d===\n", rxcmd, cmd_name, strlen(cmd_name));
-		if (strlen(cmd_name) && strncmp(rxcmd, cmd_name, strlen(cmd_name)) != 0)
-		{
-			continue;
-		}
-
-		// Serial.printf("===rxcmd_index========%d================strlen(cmd_name)=====%d=======\n", rxcmd_index, strlen(cmd_name));
-
-		if (rxcmd_index == (strlen(cmd_name) + 1) &&
-			rxcmd[strlen(cmd_name)] == '?')
-		{
-			/* test cmd */
-			if (g_at_cmd_list[i].cmd_desc)
-			{
-				if (strncmp(g_at_cmd_list[i].cmd_desc, "OK", 2) == 0)
-				{
-					snprintf(atcmd, ATCMD_SIZE, "\r\nOK\r\n");
-				}
-				else
-				{
-					snprintf(atcmd, ATCMD_SIZE, "\r\n%s:\"%s\"\r\nOK\r\n",
-							 cmd_name, g_at_cmd_list[i].cmd_desc);
-				}
-			}
-			else
-			{
-				snprintf(atcmd, ATCMD_SIZE, "\r\n%s\r\nOK\r\n", cmd_name);
-			}
-		}
-		else if (rxcmd_index == (strlen(cmd_name) + 2) &&
-				 strcmp(&rxcmd[strlen(cmd_name)], "=?") == 0)
-		{
-			/* query cmd */
-			if (g_at_cmd_list[i].query_cmd != NULL)
-			{
-				ret = g_at_cmd_list[i].query_cmd();
-
-				if (ret == 0)
-				{
-					snprintf(atcmd, ATCMD_SIZE, "\r\n%s:%s\r\nOK\r\n",
-							 cmd_name, g_at_query_buf);
-				}
-			}
-			else
-			{
-				ret = AT_ERRNO_NOALLOW;
-			}
-		}
-		else if (rxcmd_index > (strlen(cmd_name) + 1) &&
-				 rxcmd[strlen(cmd_name)] == '=')
-		{
-			/* exec cmd */
-			if (g_at_cmd_list[i].exec_cmd != NULL)
-			{
-				ret = g_at_cmd_list[i].exec_cmd(rxcmd + strlen(cmd_name) + 1);
-				if (ret == 0)
-				{
-					snprintf(atcmd, ATCMD_SIZE, "\r\nOK\r\n");
-				}
-				else if (ret == -1)
-				{
-					ret = AT_ERRNO_SYS;
-				}
-			}
-			else
-			{
-				ret = AT_ERRNO_NOALLOW;
-			}
-		}
-		else if (rxcmd_index == strlen(cmd_name))
-		{
-			/* exec cmd without parameter*/
-			if (g_at_cmd_list[i].exec_cmd_no_para != NULL)
-			{
-				ret = g_at_cmd_list[i].exec_cmd_no_para();
-				if (ret == 0)
-				{
-					snprintf(atcmd, ATCMD_SIZE, "\r\nOK\r\n");
-				}
-				else if (ret == -1)
-				{
-					ret = AT_ERRNO_SYS;
-				}
-			}
-			else
-			{
-				ret = AT_ERRNO_NOALLOW;
-			}
-		}
-		else
-		{
-			continue;
-		}
-		break;
+		at_index_build(&at_cmd_index, g_at_cmd_list, AT_CMD_NUM);
 	}
+	const atcmd_t *cmd = at_index_find(&at_cmd_index, rxcmd, name_len);
+	bool handled = false;
 
 #ifndef ESP32
 	// ESP32 has a problem with weak declarations of functions
@@ -1816,132 +2907,25 @@ static void at_cmd_handle(void)
 	}
 #endif
 	// Not a standard AT command?
-	if (has_custom_at)
+	if ((cmd == NULL) && has_custom_at)
 	{
-		if (i == sizeof(g_at_cmd_list) / sizeof(atcmd_t))
+		// Check user defined AT command from list
+		if (g_user_at_cmd_list != NULL)
 		{
-			// Check user defined AT command from list
-			if (g_user_at_cmd_list != NULL)
+			cmd = at_user_find(rxcmd, name_len);
+			if (cmd == NULL)
 			{
-				int j = 0;
-				for (j = 0; j < g_user_at_cmd_num; j++)
-				{
-					cmd_name = g_user_at_cmd_list[j].cmd_name;
-					// Serial.printf("===rxcmd========%s================cmd_name=====%s====%d===\n", rxcmd, cmd_name, strlen(cmd_name));
-					if (strlen(cmd_name) && strncmp(rxcmd, cmd_name, strlen(cmd_name)) != 0)
-					{
-						continue;
-					}
-
-					// Serial.printf("===rxcmd_index========%d================strlen(cmd_name)=====%d=======\n", rxcmd_index, strlen(cmd_name));
-
-					if (rxcmd_index == (strlen(cmd_name) + 1) &&
-						rxcmd[strlen(cmd_name)] == '?')
-					{
-						/* test cmd */
-						if (g_user_at_cmd_list[j].cmd_desc)
-						{
-							if (strncmp(g_user_at_cmd_list[j].cmd_desc, "OK", 2) == 0)
-							{
-								snprintf(atcmd, ATCMD_SIZE, "\r\nOK\r\n");
-							}
-							else
-							{
-								snprintf(atcmd, ATCMD_SIZE, "\r\n%s:\"%s\"\r\nOK\r\n",
-										 cmd_name, g_user_at_cmd_list[j].cmd_desc);
-							}
-						}
-						else
-						{
-							snprintf(atcmd, ATCMD_SIZE, "\r\n%s\r\nOK\r\n", cmd_name);
-						}
-					}
-					else if (rxcmd_index == (strlen(cmd_name) + 2) &&
-							 strcmp(&rxcmd[strlen(cmd_name)], "=?") == 0)
-					{
-						/* query cmd */
-						if (g_user_at_cmd_list[j].query_cmd != NULL)
-						{
-							ret = g_user_at_cmd_list[j].query_cmd();
-
-							if (ret == 0)
-							{
-								snprintf(atcmd, ATCMD_SIZE, "\r\n%s:%s\r\nOK\r\n",
-										 cmd_name, g_at_query_buf);
-							}
-						}
-						else
-						{
-							ret = AT_ERRNO_NOALLOW;
-						}
-					}
-					else if (rxcmd_index > (strlen(cmd_name) + 1) &&
-							 rxcmd[strlen(cmd_name)] == '=')
-					{
-						/* exec cmd */
-						if (g_user_at_cmd_list[j].exec_cmd != NULL)
-						{
-							ret = g_user_at_cmd_list[j].exec_cmd(rxcmd + strlen(cmd_name) + 1);
-							if (ret == 0)
-							{
-								snprintf(atcmd, ATCMD_SIZE, "\r\nOK\r\n");
-							}
-							else if (ret == -1)
-							{
-								ret = AT_ERRNO_SYS;
-							}
-						}
-						else
-						{
-							ret = AT_ERRNO_NOALLOW;
-						}
-					}
-					else if (rxcmd_index == strlen(cmd_name))
-					{
-						/* exec cmd without parameter*/
-						if (g_user_at_cmd_list[j].exec_cmd_no_para != NULL)
-						{
-							ret = g_user_at_cmd_list[j].exec_cmd_no_para();
-							if (ret == 0)
-							{
-								snprintf(atcmd, ATCMD_SIZE, "\r\nOK\r\n");
-							}
-							else if (ret == -1)
-							{
-								ret = AT_ERRNO_SYS;
-							}
-						}
-						else
-						{
-							ret = AT_ERRNO_NOALLOW;
-						}
-					}
-					else
-					{
-						continue;
-					}
-					break;
-				}
-				if (j == g_user_at_cmd_num)
-				{
-					API_LOG("AT", "Not a user AT command");
-					ret = AT_ERRNO_NOSUPP;
-				}
+				API_LOG("AT", "Not a user AT command");
 			}
-			// Check user AT command handler
-			else if (user_at_handler != NULL)
+		}
+		// Check user AT command handler
+		else if (user_at_handler != NULL)
+		{
+			handled = true;
+			if (user_at_handler(rxcmd, tmp))
 			{
-				if (user_at_handler(rxcmd, rxcmd_index))
-				{
-					ret = 0;
-					snprintf(atcmd, ATCMD_SIZE, "\r\nOK\r\n");
-				}
-				else
-				{
-					ret = AT_ERRNO_NOSUPP;
-				}
+				snprintf(atcmd, ATCMD_SIZE, "\r\nOK\r\n");
 			}
-			// No user defined AT commands available
 			else
 			{
 				ret = AT_ERRNO_NOSUPP;
@@ -1949,6 +2933,19 @@ static void at_cmd_handle(void)
 		}
 	}
 
+	if (handled)
+	{
+		// Response was set by the user AT command handler
+	}
+	else if ((cmd == NULL) || (form == AT_FORM_INVALID))
+	{
+		ret = AT_ERRNO_NOSUPP;
+	}
+	else
+	{
+		ret = at_cmd_exec(cmd, form, suffix + 1, atcmd, ATCMD_SIZE);
+	}
+
 	if (ret != 0 && ret != AT_CB_PRINT)
 	{
 		snprintf(atcmd, ATCMD_SIZE, "\r\n%s%x\r\n", AT_ERROR, ret);
@@ -1959,25 +2956,29 @@ static void at_cmd_handle(void)
 		AT_PRINTF(atcmd);
 	}
 
-	atcmd_index = 0;
-	memset(atcmd, 0xff, ATCMD_SIZE);
+	at_line_clear();
 	return;
 }
 
+/** Flag if the current line is longer than ATCMD_SIZE, it is dropped */
+static bool atcmd_overflow = false;
+
 /**
- * @brief Get Serial input and start parsing
+ * @brief Add a character to the command line, handles the line when it is complete
  *
  * @param cmd received character
  */
-void at_serial_input(uint8_t cmd)
+static void at_line_add(uint8_t cmd)
 {
-	Serial.printf("%c", cmd);
-
 	// Handle backspace
 	if (cmd == '\b')
 	{
-		atcmd[atcmd_index--] = '\0';
+		if (atcmd_index > 0)
+		{
+			atcmd[--atcmd_index] = '\0';
+		}
 		Serial.printf(" \b");
+		return;
 	}
 
 	// Convert to uppercase
@@ -1987,21 +2988,89 @@ void at_serial_input(uint8_t cmd)
 	}
 
 	// Check valid character
-	if ((cmd >= '0' && cmd <= '9') || (cmd >= 'a' && cmd <= 'z') ||
-		(cmd >= 'A' && cmd <= 'Z') || cmd == '?' || cmd == '+' || cmd == ':' ||
+	if ((cmd >= '0' && cmd <= '9') || (cmd >= 'A' && cmd <= 'Z') ||
+		cmd == '?' || cmd == '+' || cmd == ':' ||
 		cmd == '=' || cmd == ' ' || cmd == ',')
 	{
-		atcmd[atcmd_index++] = cmd;
+		if (atcmd_index < (ATCMD_SIZE - 1))
+		{
+			atcmd[atcmd_index++] = cmd;
+		}
+		else
+		{
+			atcmd_overflow = true;
+		}
 	}
 	else if (cmd == '\r' || cmd == '\n')
 	{
+		if (atcmd_overflow)
+		{
+			atcmd_overflow = false;
+			atcmd_index = 0;
+			API_LOG("AT", "Command longer than %d characters", ATCMD_SIZE - 1);
+			AT_PRINTF("\r\n%s%x\r\n", AT_ERROR, AT_ERRNO_PARA_NUM);
+			return;
+		}
 		atcmd[atcmd_index] = '\0';
 		at_cmd_handle();
 	}
+}
+
+/**
+ * @brief Get Serial input and start parsing
+ *
+ * @param cmd received character
+ */
+void at_serial_input(uint8_t cmd)
+{
+	Serial.printf("%c", cmd);
+	at_line_add(cmd);
+}
+
+/**
+ * @brief Feed a block of received characters to the parser
+ *    Complete lines are handled right away, an incomplete line is kept until the next block
+ *
+ * @param data received characters
+ * @param len number of received characters
+ */
+void at_serial_input(uint8_t *data, uint16_t len)
+{
+	uint16_t echo_start = 0;
+	for (uint16_t idx = 0; idx < len; idx++)
+	{
+		uint8_t cmd = data[idx];
+		if ((cmd == '\r') || (cmd == '\n') || (cmd == '\b'))
+		{
+			// Echo everything up to here before the response is sent
+			Serial.write(&data[echo_start], idx - echo_start + 1);
+			echo_start = idx + 1;
+		}
+		at_line_add(cmd);
+	}
+	if (echo_start < len)
+	{
+		Serial.write(&data[echo_start], len - echo_start);
+	}
+}
 
-	if (atcmd_index >= ATCMD_SIZE)
+/**
+ * @brief Read all available characters from a serial port and feed them to the parser
+ *
+ * @param port serial port, e.g. Serial, Serial1 or g_ble_uart
+ */
+void at_serial_read(Stream &port)
+{
+	uint8_t chunk[64];
+	int available;
+	while ((available = port.available()) > 0)
 	{
-		atcmd_index = 0;
+		size_t len = port.readBytes(chunk, available > (int)sizeof(chunk) ? sizeof(chunk) : available);
+		if (len == 0)
+		{
+			break;
+		}
+		at_serial_input(chunk, len);
 	}
 }
 
@@ -2013,7 +3082,8 @@ void at_serial_input(uint8_t cmd)
  */
 void tud_cdc_rx_cb(uint8_t itf)
 {
-	g_task_event_type |= AT_CMD;
+	(void)itf;
+	api_event_push(AT_CMD);
 	if (g_task_sem != NULL)
 	{
 		xSemaphoreGiveFromISR(g_task_sem, pdFALSE);
@@ -2027,7 +3097,7 @@ static BaseType_t xHigherPriorityTaskWoken = pdFALSE;
  */
 void usb_rx_cb(void)
 {
-	g_task_event_type |= AT_CMD;
+	api_event_push(AT_CMD);
 	if (g_task_sem != NULL)
 	{
 		xSemaphoreGiveFromISR(g_task_sem, &xHigherPriorityTaskWoken);
@@ -2053,7 +3123,7 @@ void serial1_rx_handler(void)
 {
 	if (_serial_task_thread != NULL)
 	{
-		g_task_event_type |= AT_CMD;
+		api_event_push(AT_CMD);
 		osSignalSet(_serial_task_thread, AT_CMD);
 	}
 }
@@ -2070,7 +3140,7 @@ void _serial_task()
 		while (Serial.available() > 0)
 		{
 			Serial.read();
-			delay(10);
+			api_delay(10);
 		}
 	}
 
@@ -2080,35 +3150,19 @@ void _serial_task()
 		while (Serial1.available() > 0)
 		{
 			Serial1.read();
-			delay(10);
+			api_delay(10);
 		}
 	}
 
 	while (true)
 	{
-		// Wait for serial USB RX
-		if (Serial.available())
-		{
-			while (Serial.available() > 0)
-			{
-				at_serial_input(uint8_t(Serial.read()));
-				delay(5);
-			}
-		}
+		// Handle serial USB RX
+		at_serial_read(Serial);
 
-		// Wait for serial 1 RX
-		// osEvent event = osSignalWait(0, osWaitForever);
-		if (Serial1.available())
-		{
-			while (Serial1.available() > 0)
-			{
-				at_serial_input(uint8_t(Serial1.read()));
-				delay(5);
-			}
-		}
-		// delay(100);
-		delay(3000);
-		yield();
+		// Handle serial 1 RX
+		at_serial_read(Serial1);
+		// Sleep until signaled, poll Serial1 every 3 seconds
+		osSignalWait(AT_CMD, 3000);
 	}
 }
 
@@ -22,15 +22,16 @@
 	}
 #endif
 #ifdef ESP32
-#define AT_PRINTF(...)                                                  \
-	Serial.printf(__VA_ARGS__);                                         \
-	if (g_ble_uart_is_connected)                                        \
-	{                                                                   \
-		char buff[255];                                                 \
-		int len = sprintf(buff, __VA_ARGS__);                           \
-		uart_tx_characteristic->setValue((uint8_t *)buff, (size_t)len); \
-		uart_tx_characteristic->notify(true);                           \
-		delay(50);                                                      \
+#define AT_PRINTF(...)                                                                                  \
+	Serial.printf(__VA_ARGS__);                                                                         \
+	if (g_ble_uart_is_connected)                                                                        \
+	{                                                                                                   \
+		char buff[255];                                                                                 \
+		int len = snprintf(buff, sizeof(buff), __VA_ARGS__);                                            \
+		if (len > 0)                                                                                    \
+		{                                                                                               \
+			ble_uart_notify((uint8_t *)buff, len < (int)sizeof(buff) ? (size_t)len : sizeof(buff) - 1); \
+		}                                                                                               \
 	}
 #endif
 #if defined ARDUINO_ARCH_RP2040
@@ -39,7 +40,10 @@
 #endif
 
 #define AT_ERROR "+CME ERROR:"
-#define ATCMD_SIZE 160
+// Max length of an AT command line, enough for AT+PSEND with 255 bytes payload
+#ifndef ATCMD_SIZE
+#define ATCMD_SIZE 540
+#endif
 #define ATQUERY_SIZE 128
 
 #define AT_ERRNO_NOSUPP (1)
@@ -58,6 +58,8 @@ StaticJsonDocument<512> json_buffer;
 
 /** Flag used to detect if a BLE advertising is enabled */
 bool g_ble_is_on = false;
+/** millis() of the last BLE UART notification */
+static uint32_t ble_uart_last_notify = 0;
 /** Flag if device is connected */
 bool g_ble_uart_is_connected = false;
 
@@ -177,8 +179,11 @@ class WiFiCallBackHandler : public BLECharacteristicCallbacks
 				g_conn_status_changed = true;
 				g_has_credentials = true;
 				WiFi.disconnect(true, true);
-				delay(1000);
-				init_wifi();
+				// Do not block the BLE task, reconnect from the loop task after the disconnect
+				if (api_schedule_callback(init_wifi, 1000) == 0)
+				{
+					init_wifi();
+				}
 			}
 			else if (json_buffer.containsKey("erase"))
 			{
@@ -317,8 +322,8 @@ class LoRaCallBackHandler : public BLECharacteristicCallbacks
 		if (g_lorawan_settings.resetRequest)
 		{
 			API_LOG("BLE", "Initiate reset");
-			delay(1000);
-			esp_restart();
+			// Do not block the BLE task, reset after the response was sent
+			api_schedule_callback(api_reset, 1000);
 		}
 	};
 
@@ -358,15 +363,34 @@ class UartCallBackHandler : public BLECharacteristicCallbacks
 		if (rx_value.length() > 0)
 		{
 			API_LOG("BLE", "Received Value: %s", rx_value.c_str());
-			for (int idx = 0; idx < rx_value.length(); idx++)
-			{
-				at_serial_input(rx_value[idx]);
-			}
+			at_serial_input((uint8_t *)rx_value.data(), rx_value.length());
 			at_serial_input('\r');
 		}
 	}
 };
 
+/**
+ * @brief Send one line over the BLE UART
+ *    NimBLE drops notifications that are queued faster than they are sent.
+ *    Lines are paced to API_BLE_NOTIFY_GAP, only the rest of the gap since the
+ *    last line is waited, a single line is sent right away.
+ *    Outside of the loop task the line is sent without waiting.
+ *
+ * @param data line to be sent
+ * @param len length of the line
+ */
+void ble_uart_notify(uint8_t *data, size_t len)
+{
+	uint32_t since = millis() - ble_uart_last_notify;
+	if ((since < API_BLE_NOTIFY_GAP) && api_blocking_allowed())
+	{
+		api_delay(API_BLE_NOTIFY_GAP - since);
+	}
+	uart_tx_characteristic->setValue(data, len);
+	uart_tx_characteristic->notify(true);
+	ble_uart_last_notify = millis();
+}
+
 /**
  * Initialize BLE service and characteristic
  * Start BLE server and service advertising
@@ -192,7 +192,7 @@ void bleuart_rx_callback(uint16_t conn_handle)
 {
 	(void)conn_handle;
 
-	g_task_event_type |= BLE_DATA;
+	api_event_push(BLE_DATA);
 	xSemaphoreGiveFromISR(g_task_sem, pdFALSE);
 }
 
@@ -229,10 +229,9 @@ BLEService init_settings_characteristic(void)
  */
 void settings_rx_callback(uint16_t conn_hdl, BLECharacteristic *chr, uint8_t *data, uint16_t len)
 {
+	(void)conn_hdl;
 	API_LOG("SETT", "Settings received");
 
-	delay(1000);
-
 	// Check the characteristic
 	if (chr->uuid == g_lora_data.uuid)
 	{
@@ -250,28 +249,13 @@ void settings_rx_callback(uint16_t conn_hdl, BLECharacteristic *chr, uint8_t *da
 		}
 
 		// Save new LoRa settings
+		// Writing to flash, notifying and a requested reset are done by the loop task
 		memcpy((void *)&g_lorawan_settings, data, sizeof(s_lorawan_settings));
 
-		// Save new settings
-		save_settings();
-
-		// Update settings
-		g_lora_data.write((void *)&g_lorawan_settings, sizeof(s_lorawan_settings));
-
-		// Inform connected device about new settings
-		g_lora_data.notify((void *)&g_lorawan_settings, sizeof(s_lorawan_settings));
-
-		if (g_lorawan_settings.resetRequest)
-		{
-			API_LOG("SETT", "Initiate reset");
-			delay(1000);
-			sd_nvic_SystemReset();
-		}
-
 		// Notify task about the event
 		if (g_task_sem != NULL)
 		{
-			g_task_event_type |= BLE_CONFIG;
+			api_event_push(BLE_CONFIG);
 			API_LOG("SETT", "Waking up loop task");
 			xSemaphoreGive(g_task_sem);
 		}
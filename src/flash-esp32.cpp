@@ -13,6 +13,7 @@
 #include "WisBlock-API.h"
 
 #include <Preferences.h>
+#include <LittleFS.h>
 
 /** ESP32 preferences */
 Preferences lora_prefs;
@@ -135,6 +136,216 @@ void flash_reset(void)
 	save_settings();
 }
 
+/**
+ * @brief Read the saved LoRaWAN session
+ *
+ * @param session structure for the session
+ * @return true if a session record was found
+ * @return false if no session was saved
+ */
+bool read_session(s_lorawan_session *session)
+{
+	lora_prefs.begin("LoRaSess", true);
+	size_t size = lora_prefs.getBytes("ses", session, sizeof(s_lorawan_session));
+	lora_prefs.end();
+	return size == sizeof(s_lorawan_session);
+}
+
+/**
+ * @brief Save the LoRaWAN session
+ *    The session is kept in its own namespace, the settings are not touched.
+ *    NVS keeps the old value until the new one is written completely.
+ *
+ * @param session session to save
+ * @return true if the session was written
+ * @return false if the preferences could not be written
+ */
+bool save_session(s_lorawan_session *session)
+{
+	lora_prefs.begin("LoRaSess", false);
+	size_t size = lora_prefs.putBytes("ses", session, sizeof(s_lorawan_session));
+	lora_prefs.end();
+	return size == sizeof(s_lorawan_session);
+}
+
+/**
+ * @brief Delete the saved LoRaWAN session
+ *
+ */
+void delete_session(void)
+{
+	lora_prefs.begin("LoRaSess", false);
+	lora_prefs.remove("ses");
+	lora_prefs.end();
+}
+
+/**
+ * @brief Read the saved join state
+ *
+ * @param state structure for the join state
+ * @return true if a join state was found
+ * @return false if no join state was saved
+ */
+bool read_join_state(s_join_state *state)
+{
+	lora_prefs.begin("LoRaSess", true);
+	size_t size = lora_prefs.getBytes("join", state, sizeof(s_join_state));
+	lora_prefs.end();
+	return size == sizeof(s_join_state);
+}
+
+/**
+ * @brief Save the join state
+ *
+ * @param state join state to save
+ * @return true if the join state was written
+ * @return false if the preferences could not be written
+ */
+bool save_join_state(s_join_state *state)
+{
+	lora_prefs.begin("LoRaSess", false);
+	size_t size = lora_prefs.putBytes("join", state, sizeof(s_join_state));
+	lora_prefs.end();
+	return size == sizeof(s_join_state);
+}
+
+/** File used by the api_file_* functions */
+File api_file;
+
+/**
+ * @brief Full path of a file in the file system
+ *
+ * @param filename name of the file
+ * @param path buffer for the path
+ * @param size size of the buffer
+ */
+static void api_file_path(const char *filename, char *path, size_t size)
+{
+	snprintf(path, size, "/%s", filename);
+}
+
+/**
+ * @brief Initialize the LittleFS file system, it is formatted if it can't be mounted
+ *    The settings stay in the preferences, the file system is used for the api_file_* functions
+ *
+ * @return true if the file system is mounted
+ */
+bool api_fs_init(void)
+{
+	return LittleFS.begin(true);
+}
+
+/**
+ * @brief Open a file for reading
+ *
+ * @param filename name of the file
+ * @return true if the file was opened
+ */
+bool api_file_open_read(const char *filename)
+{
+	char path[64];
+	api_file_path(filename, path, sizeof(path));
+	if (!LittleFS.exists(path))
+	{
+		return false;
+	}
+	api_file = LittleFS.open(path, FILE_READ);
+	return (bool)api_file;
+}
+
+/**
+ * @brief Open a file for writing, data is appended at the end of the file
+ *    The file is created if it doesn't exist
+ *
+ * @param filename name of the file
+ * @return true if the file was opened
+ */
+bool api_file_open_write(const char *filename)
+{
+	char path[64];
+	api_file_path(filename, path, sizeof(path));
+	api_file = LittleFS.open(path, FILE_APPEND);
+	return (bool)api_file;
+}
+
+/**
+ * @brief Read from the open file
+ *
+ * @param destination buffer for the data
+ * @param size number of bytes to read
+ * @return uint16_t number of bytes read, less than size at the end of the file
+ */
+uint16_t api_file_read(uint8_t *destination, uint16_t size)
+{
+	return api_file.read(destination, size);
+}
+
+/**
+ * @brief Write to the open file
+ *
+ * @param source data to write
+ * @param size number of bytes
+ */
+void api_file_write(uint8_t *source, uint32_t size)
+{
+	api_file.write(source, size);
+	api_file.flush();
+}
+
+/**
+ * @brief Delete a file
+ *
+ * @param filename name of the file
+ */
+void api_file_remove(const char *filename)
+{
+	char path[64];
+	api_file_path(filename, path, sizeof(path));
+	if (LittleFS.exists(path))
+	{
+		LittleFS.remove(path);
+	}
+}
+
+/**
+ * @brief Close the open file
+ *
+ * @param filename name of the file (not used, only one file can be open)
+ */
+void api_file_close(const char *filename)
+{
+	(void)filename;
+	api_file.close();
+}
+
+/**
+ * @brief Call a function for every file in the root folder
+ *    The callback must not open or remove files, the folder is open while it is called
+ *
+ * @param callback function that gets the name of the file
+ */
+void api_file_list(file_list_cb_t callback)
+{
+	File folder = LittleFS.open("/");
+	if (!folder)
+	{
+		return;
+	}
+	File entry = folder.openNextFile();
+	while (entry)
+	{
+		if (!entry.isDirectory())
+		{
+			// Older versions of the ESP32 core return the name with the path
+			const char *name = strrchr(entry.name(), '/');
+			callback(name != NULL ? name + 1 : entry.name());
+		}
+		entry.close();
+		entry = folder.openNextFile();
+	}
+	folder.close();
+}
+
 /**
  * @brief Printout of all settings
  *
@@ -142,19 +353,15 @@ void flash_reset(void)
 void ble_log_settings(void)
 {
 	api_ble_printf("Saved settings:\n");
-	delay(50);
 	api_ble_printf("Marks: %02X %02X\n", g_lorawan_settings.valid_mark_1, g_lorawan_settings.valid_mark_2);
-	delay(50);
 	api_ble_printf("Dev EUI %02X%02X%02X%02X%02X%02X%02X%02X\n", g_lorawan_settings.node_device_eui[0], g_lorawan_settings.node_device_eui[1],
 				   g_lorawan_settings.node_device_eui[2], g_lorawan_settings.node_device_eui[3],
 				   g_lorawan_settings.node_device_eui[4], g_lorawan_settings.node_device_eui[5],
 				   g_lorawan_settings.node_device_eui[6], g_lorawan_settings.node_device_eui[7]);
-	delay(50);
 	api_ble_printf("App EUI %02X%02X%02X%02X%02X%02X%02X%02X\n", g_lorawan_settings.node_app_eui[0], g_lorawan_settings.node_app_eui[1],
 				   g_lorawan_settings.node_app_eui[2], g_lorawan_settings.node_app_eui[3],
 				   g_lorawan_settings.node_app_eui[4], g_lorawan_settings.node_app_eui[5],
 				   g_lorawan_settings.node_app_eui[6], g_lorawan_settings.node_app_eui[7]);
-	delay(50);
 	api_ble_printf("App Key %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X\n",
 				   g_lorawan_settings.node_app_key[0], g_lorawan_settings.node_app_key[1],
 				   g_lorawan_settings.node_app_key[2], g_lorawan_settings.node_app_key[3],
@@ -164,9 +371,7 @@ void ble_log_settings(void)
 				   g_lorawan_settings.node_app_key[10], g_lorawan_settings.node_app_key[11],
 				   g_lorawan_settings.node_app_key[12], g_lorawan_settings.node_app_key[13],
 				   g_lorawan_settings.node_app_key[14], g_lorawan_settings.node_app_key[15]);
-	delay(50);
 	api_ble_printf("Dev Addr %08lX\n", g_lorawan_settings.node_dev_addr);
-	delay(50);
 	api_ble_printf("NWS Key %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X\n",
 				   g_lorawan_settings.node_nws_key[0], g_lorawan_settings.node_nws_key[1],
 				   g_lorawan_settings.node_nws_key[2], g_lorawan_settings.node_nws_key[3],
@@ -176,7 +381,6 @@ void ble_log_settings(void)
 				   g_lorawan_settings.node_nws_key[10], g_lorawan_settings.node_nws_key[11],
 				   g_lorawan_settings.node_nws_key[12], g_lorawan_settings.node_nws_key[13],
 				   g_lorawan_settings.node_nws_key[14], g_lorawan_settings.node_nws_key[15]);
-	delay(50);
 	api_ble_printf("Apps Key %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X\n",
 				   g_lorawan_settings.node_apps_key[0], g_lorawan_settings.node_apps_key[1],
 				   g_lorawan_settings.node_apps_key[2], g_lorawan_settings.node_apps_key[3],
@@ -186,51 +390,28 @@ void ble_log_settings(void)
 				   g_lorawan_settings.node_apps_key[10], g_lorawan_settings.node_apps_key[11],
 				   g_lorawan_settings.node_apps_key[12], g_lorawan_settings.node_apps_key[13],
 				   g_lorawan_settings.node_apps_key[14], g_lorawan_settings.node_apps_key[15]);
-	delay(50);
 	api_ble_printf("OTAA %s\n", g_lorawan_settings.otaa_enabled ? "enabled" : "disabled");
-	delay(50);
 	api_ble_printf("ADR %s\n", g_lorawan_settings.adr_enabled ? "enabled" : "disabled");
-	delay(50);
 	api_ble_printf("%s Network\n", g_lorawan_settings.public_network ? "Public" : "Private");
-	delay(50);
 	api_ble_printf("Dutycycle %s\n", g_lorawan_settings.duty_cycle_enabled ? "enabled" : "disabled");
-	delay(50);
 	api_ble_printf("Repeat time %ld\n", g_lorawan_settings.send_repeat_time);
-	delay(50);
 	api_ble_printf("Join trials %d\n", g_lorawan_settings.join_trials);
-	delay(50);
 	api_ble_printf("TX Power %d\n", g_lorawan_settings.tx_power);
-	delay(50);
 	api_ble_printf("DR %d\n", g_lorawan_settings.data_rate);
-	delay(50);
 	api_ble_printf("Class %d\n", g_lorawan_settings.lora_class);
-	delay(50);
 	api_ble_printf("Subband %d\n", g_lorawan_settings.subband_channels);
-	delay(50);
 	api_ble_printf("Auto join %s\n", g_lorawan_settings.auto_join ? "enabled" : "disabled");
-	delay(50);
 	api_ble_printf("Fport %d\n", g_lorawan_settings.app_port);
-	delay(50);
 	api_ble_printf("%s Message\n", g_lorawan_settings.confirmed_msg_enabled ? "Confirmed" : "Unconfirmed");
-	delay(50);
 	api_ble_printf("Region %s\n", region_names[g_lorawan_settings.lora_region]);
-	delay(50);
 	api_ble_printf("Mode %s\n", g_lorawan_settings.lorawan_enable ? "LPWAN" : "P2P");
-	delay(50);
 	api_ble_printf("P2P frequency %ld\n", g_lorawan_settings.p2p_frequency);
-	delay(50);
 	api_ble_printf("P2P TX Power %d\n", g_lorawan_settings.p2p_tx_power);
-	delay(50);
 	api_ble_printf("P2P BW %d\n", g_lorawan_settings.p2p_bandwidth);
-	delay(50);
 	api_ble_printf("P2P SF %d\n", g_lorawan_settings.p2p_sf);
-	delay(50);
 	api_ble_printf("P2P CR %d\n", g_lorawan_settings.p2p_cr);
-	delay(50);
 	api_ble_printf("P2P Preamble length %d\n", g_lorawan_settings.p2p_preamble_len);
-	delay(50);
 	api_ble_printf("P2P Symbol Timeout %d\n", g_lorawan_settings.p2p_symbol_timeout);
-	delay(50);
 }
 
 /**
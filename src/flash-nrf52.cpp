@@ -20,6 +20,10 @@ s_loracompat_settings g_flash_content_compat;
 using namespace Adafruit_LittleFS_Namespace;
 
 const char settings_name[] = "RAK";
+const char session_name[] = "SES";
+const char join_name[] = "JOIN";
+/** Session and join state are written to this file first */
+const char temp_name[] = "TMP";
 
 File lora_file(InternalFS);
 
@@ -44,7 +48,7 @@ void init_flash(void)
 	if (!lora_file)
 	{
 		API_LOG("FLASH", "File doesn't exist, force format");
-		delay(1000);
+		api_delay(1000);
 		flash_reset();
 		lora_file.open(settings_name, FILE_O_READ);
 	}
@@ -99,7 +103,7 @@ void init_flash(void)
 			// Data is not valid, reset to defaults
 			API_LOG("FLASH", "Invalid data set, deleting and restart node");
 			InternalFS.format();
-			delay(1000);
+			api_delay(1000);
 			sd_nvic_SystemReset();
 		}
 		log_settings();
@@ -121,7 +125,7 @@ boolean save_settings(void)
 	if (!lora_file)
 	{
 		API_LOG("FLASH", "File doesn't exist, force format");
-		delay(100);
+		api_delay(100);
 		flash_reset();
 		lora_file.open(settings_name, FILE_O_READ);
 	}
@@ -130,7 +134,7 @@ boolean save_settings(void)
 	if (memcmp((void *)&g_flash_content, (void *)&g_lorawan_settings, sizeof(s_lorawan_settings)) != 0)
 	{
 		API_LOG("FLASH", "Flash content changed, writing new data");
-		delay(100);
+		api_delay(100);
 
 		InternalFS.remove(settings_name);
 
@@ -165,26 +169,235 @@ void flash_reset(void)
 	}
 }
 
+/**
+ * @brief Read the saved LoRaWAN session
+ *
+ * @param session structure for the session
+ * @return true if a session record was found
+ * @return false if no session was saved
+ */
+bool read_session(s_lorawan_session *session)
+{
+	if (!lora_file.open(session_name, FILE_O_READ))
+	{
+		return false;
+	}
+	int size = lora_file.read((uint8_t *)session, sizeof(s_lorawan_session));
+	lora_file.close();
+	return size == sizeof(s_lorawan_session);
+}
+
+/**
+ * @brief Replace a file with a new record
+ *    The record is written to a temporary file that is renamed when it is complete,
+ *    LittleFS replaces the old file in one step. After a power loss the old or the new record is found.
+ *
+ * @param name name of the file
+ * @param record data to save
+ * @param size size of the record
+ * @return true if the record was written
+ * @return false if the file could not be created
+ */
+static bool save_record(const char *name, uint8_t *record, uint16_t size)
+{
+	InternalFS.remove(temp_name);
+	if (!lora_file.open(temp_name, FILE_O_WRITE))
+	{
+		return false;
+	}
+	int written = lora_file.write(record, size);
+	lora_file.flush();
+	lora_file.close();
+	if ((written != size) || !InternalFS.rename(temp_name, name))
+	{
+		InternalFS.remove(temp_name);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Save the LoRaWAN session
+ *    The session is kept in its own file, the settings file is not touched
+ *
+ * @param session session to save
+ * @return true if the session was written
+ * @return false if the file could not be created
+ */
+bool save_session(s_lorawan_session *session)
+{
+	return save_record(session_name, (uint8_t *)session, sizeof(s_lorawan_session));
+}
+
+/**
+ * @brief Delete the saved LoRaWAN session
+ *
+ */
+void delete_session(void)
+{
+	InternalFS.remove(session_name);
+}
+
+/**
+ * @brief Read the saved join state
+ *
+ * @param state structure for the join state
+ * @return true if a join state was found
+ * @return false if no join state was saved
+ */
+bool read_join_state(s_join_state *state)
+{
+	if (!lora_file.open(join_name, FILE_O_READ))
+	{
+		return false;
+	}
+	int size = lora_file.read((uint8_t *)state, sizeof(s_join_state));
+	lora_file.close();
+	return size == sizeof(s_join_state);
+}
+
+/**
+ * @brief Save the join state
+ *
+ * @param state join state to save
+ * @return true if the join state was written
+ * @return false if the file could not be created
+ */
+bool save_join_state(s_join_state *state)
+{
+	return save_record(join_name, (uint8_t *)state, sizeof(s_join_state));
+}
+
+/** File used by the api_file_* functions */
+File api_file(InternalFS);
+
+/**
+ * @brief Initialize the internal file system
+ *
+ * @return true if the file system is mounted
+ */
+bool api_fs_init(void)
+{
+	return InternalFS.begin();
+}
+
+/**
+ * @brief Open a file for reading
+ *
+ * @param filename name of the file
+ * @return true if the file was opened
+ */
+bool api_file_open_read(const char *filename)
+{
+	return api_file.open(filename, FILE_O_READ);
+}
+
+/**
+ * @brief Open a file for writing, data is appended at the end of the file
+ *    The file is created if it doesn't exist
+ *
+ * @param filename name of the file
+ * @return true if the file was opened
+ */
+bool api_file_open_write(const char *filename)
+{
+	return api_file.open(filename, FILE_O_WRITE);
+}
+
+/**
+ * @brief Read from the open file
+ *
+ * @param destination buffer for the data
+ * @param size number of bytes to read
+ * @return uint16_t number of bytes read, less than size at the end of the file
+ */
+uint16_t api_file_read(uint8_t *destination, uint16_t size)
+{
+	int result = api_file.read(destination, size);
+	return result < 0 ? 0 : result;
+}
+
+/**
+ * @brief Write to the open file
+ *
+ * @param source data to write
+ * @param size number of bytes
+ */
+void api_file_write(uint8_t *source, uint32_t size)
+{
+	api_file.write(source, size);
+	api_file.flush();
+}
+
+/**
+ * @brief Delete a file
+ *
+ * @param filename name of the file
+ */
+void api_file_remove(const char *filename)
+{
+	InternalFS.remove(filename);
+}
+
+/**
+ * @brief Close the open file
+ *
+ * @param filename name of the file (not used, only one file can be open)
+ */
+void api_file_close(const char *filename)
+{
+	(void)filename;
+	api_file.close();
+}
+
+/**
+ * @brief Call a function for every file in the root folder
+ *    The callback must not open or remove files, the folder is open while it is called
+ *
+ * @param callback function that gets the name of the file
+ */
+void api_file_list(file_list_cb_t callback)
+{
+	File folder = InternalFS.open("/", FILE_O_READ);
+	if (!folder)
+	{
+		return;
+	}
+	File entry = folder.openNextFile(FILE_O_READ);
+	while (entry)
+	{
+		if (!entry.isDirectory())
+		{
+			callback(entry.name());
+		}
+		entry.close();
+		entry = folder.openNextFile(FILE_O_READ);
+	}
+	folder.close();
+}
+
 /**
  * @brief Printout of all settings
+ *    g_ble_uart.printf() is not paced on the nRF52 (the ESP32 paces in ble_uart_notify()),
+ *    the delays keep the BLE UART FIFO from overflowing
  *
  */
 void ble_log_settings(void)
 {
 	g_ble_uart.printf("Saved settings:");
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Marks: %02X %02X", g_lorawan_settings.valid_mark_1, g_lorawan_settings.valid_mark_2);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Dev EUI %02X%02X%02X%02X%02X%02X%02X%02X", g_lorawan_settings.node_device_eui[0], g_lorawan_settings.node_device_eui[1],
 					  g_lorawan_settings.node_device_eui[2], g_lorawan_settings.node_device_eui[3],
 					  g_lorawan_settings.node_device_eui[4], g_lorawan_settings.node_device_eui[5],
 					  g_lorawan_settings.node_device_eui[6], g_lorawan_settings.node_device_eui[7]);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("App EUI %02X%02X%02X%02X%02X%02X%02X%02X", g_lorawan_settings.node_app_eui[0], g_lorawan_settings.node_app_eui[1],
 					  g_lorawan_settings.node_app_eui[2], g_lorawan_settings.node_app_eui[3],
 					  g_lorawan_settings.node_app_eui[4], g_lorawan_settings.node_app_eui[5],
 					  g_lorawan_settings.node_app_eui[6], g_lorawan_settings.node_app_eui[7]);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("App Key %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
 					  g_lorawan_settings.node_app_key[0], g_lorawan_settings.node_app_key[1],
 					  g_lorawan_settings.node_app_key[2], g_lorawan_settings.node_app_key[3],
@@ -194,9 +407,9 @@ void ble_log_settings(void)
 					  g_lorawan_settings.node_app_key[10], g_lorawan_settings.node_app_key[11],
 					  g_lorawan_settings.node_app_key[12], g_lorawan_settings.node_app_key[13],
 					  g_lorawan_settings.node_app_key[14], g_lorawan_settings.node_app_key[15]);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Dev Addr %08lX", g_lorawan_settings.node_dev_addr);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("NWS Key %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
 					  g_lorawan_settings.node_nws_key[0], g_lorawan_settings.node_nws_key[1],
 					  g_lorawan_settings.node_nws_key[2], g_lorawan_settings.node_nws_key[3],
@@ -206,7 +419,7 @@ void ble_log_settings(void)
 					  g_lorawan_settings.node_nws_key[10], g_lorawan_settings.node_nws_key[11],
 					  g_lorawan_settings.node_nws_key[12], g_lorawan_settings.node_nws_key[13],
 					  g_lorawan_settings.node_nws_key[14], g_lorawan_settings.node_nws_key[15]);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Apps Key %02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X",
 					  g_lorawan_settings.node_apps_key[0], g_lorawan_settings.node_apps_key[1],
 					  g_lorawan_settings.node_apps_key[2], g_lorawan_settings.node_apps_key[3],
@@ -216,51 +429,51 @@ void ble_log_settings(void)
 					  g_lorawan_settings.node_apps_key[10], g_lorawan_settings.node_apps_key[11],
 					  g_lorawan_settings.node_apps_key[12], g_lorawan_settings.node_apps_key[13],
 					  g_lorawan_settings.node_apps_key[14], g_lorawan_settings.node_apps_key[15]);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("OTAA %s", g_lorawan_settings.otaa_enabled ? "enabled" : "disabled");
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("ADR %s", g_lorawan_settings.adr_enabled ? "enabled" : "disabled");
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("%s Network", g_lorawan_settings.public_network ? "Public" : "Private");
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Dutycycle %s", g_lorawan_settings.duty_cycle_enabled ? "enabled" : "disabled");
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Repeat time %ld", g_lorawan_settings.send_repeat_time);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Join trials %d", g_lorawan_settings.join_trials);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("TX Power %d", g_lorawan_settings.tx_power);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("DR %d", g_lorawan_settings.data_rate);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Class %d", g_lorawan_settings.lora_class);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Subband %d", g_lorawan_settings.subband_channels);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Auto join %s", g_lorawan_settings.auto_join ? "enabled" : "disabled");
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Fport %d", g_lorawan_settings.app_port);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("%s Message", g_lorawan_settings.confirmed_msg_enabled ? "Confirmed" : "Unconfirmed");
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Region %s", region_names[g_lorawan_settings.lora_region]);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("Mode %s", g_lorawan_settings.lorawan_enable ? "LPWAN" : "P2P");
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("P2P frequency %ld", g_lorawan_settings.p2p_frequency);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("P2P TX Power %d", g_lorawan_settings.p2p_tx_power);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("P2P BW %d", g_lorawan_settings.p2p_bandwidth);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("P2P SF %d", g_lorawan_settings.p2p_sf);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("P2P CR %d", g_lorawan_settings.p2p_cr);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("P2P Preamble length %d", g_lorawan_settings.p2p_preamble_len);
-	delay(50);
+	api_delay(50);
 	g_ble_uart.printf("P2P Symbol Timeout %d", g_lorawan_settings.p2p_symbol_timeout);
-	delay(50);
+	api_delay(50);
 }
 
 #endif
\ No newline at end of file
@@ -19,6 +19,10 @@ s_loracompat_settings g_flash_content_compat;
 LittleFS_MBED *myFS;
 
 const char settings_name[] = MBED_LITTLEFS_FILE_PREFIX "/RAK.txt";
+const char session_name[] = MBED_LITTLEFS_FILE_PREFIX "/SES.txt";
+const char join_name[] = MBED_LITTLEFS_FILE_PREFIX "/JOIN.txt";
+/** Session and join state are written to this file first */
+const char temp_name[] = MBED_LITTLEFS_FILE_PREFIX "/TMP.txt";
 
 FILE *lora_file;
 
@@ -50,7 +54,7 @@ void init_flash(void)
 	if (!lora_file)
 	{
 		API_LOG("FLASH", "File doesn't exist, force format");
-		delay(100);
+		api_delay(100);
 		flash_reset();
 		lora_file = fopen(settings_name, "r");
 	}
@@ -63,7 +67,7 @@ void init_flash(void)
 		// Data is not valid, reset to defaults
 		API_LOG("FLASH", "Invalid data set, deleting and restart node");
 		remove(settings_name);
-		delay(1000);
+		api_delay(1000);
 		NVIC_SystemReset();
 	}
 	log_settings();
@@ -84,7 +88,7 @@ boolean save_settings(void)
 	if (!lora_file)
 	{
 		API_LOG("FLASH", "File doesn't exist, force format");
-		delay(100);
+		api_delay(100);
 		flash_reset();
 		lora_file = fopen(settings_name, "r");
 	}
@@ -93,7 +97,7 @@ boolean save_settings(void)
 	if (memcmp((void *)&g_flash_content, (void *)&g_lorawan_settings, sizeof(s_lorawan_settings)) != 0)
 	{
 		API_LOG("FLASH", "Flash content changed, writing new data");
-		delay(100);
+		api_delay(100);
 
 		remove(settings_name);
 
@@ -120,7 +124,7 @@ void flash_reset(void)
 {
 	API_LOG("FLASH", "flash_reset remove file");
 	remove(settings_name);
-	delay(1000);
+	api_delay(1000);
 
 	lora_file = fopen(settings_name, "w");
 	if (lora_file)
@@ -136,4 +140,249 @@ void flash_reset(void)
 	}
 }
 
+/**
+ * @brief Read the saved LoRaWAN session
+ *
+ * @param session structure for the session
+ * @return true if a session record was found
+ * @return false if no session was saved
+ */
+bool read_session(s_lorawan_session *session)
+{
+	FILE *session_file = fopen(session_name, "r");
+	if (!session_file)
+	{
+		return false;
+	}
+	size_t size = fread((uint8_t *)session, 1, sizeof(s_lorawan_session), session_file);
+	fclose(session_file);
+	return size == sizeof(s_lorawan_session);
+}
+
+/**
+ * @brief Replace a file with a new record
+ *    The record is written to a temporary file that is renamed when it is complete,
+ *    LittleFS replaces the old file in one step. After a power loss the old or the new record is found.
+ *
+ * @param name name of the file
+ * @param record data to save
+ * @param size size of the record
+ * @return true if the record was written
+ * @return false if the file could not be created
+ */
+static bool save_record(const char *name, uint8_t *record, size_t size)
+{
+	remove(temp_name);
+	FILE *temp_file = fopen(temp_name, "w");
+	if (!temp_file)
+	{
+		API_LOG("FLASH", "Failed to create %s", name);
+		return false;
+	}
+	size_t written = fwrite(record, 1, size, temp_file);
+	fflush(temp_file);
+	fclose(temp_file);
+	if ((written != size) || (rename(temp_name, name) != 0))
+	{
+		remove(temp_name);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Save the LoRaWAN session
+ *    The session is kept in its own file, the settings file is not touched
+ *
+ * @param session session to save
+ * @return true if the session was written
+ * @return false if the file could not be created
+ */
+bool save_session(s_lorawan_session *session)
+{
+	return save_record(session_name, (uint8_t *)session, sizeof(s_lorawan_session));
+}
+
+/**
+ * @brief Delete the saved LoRaWAN session
+ *
+ */
+void delete_session(void)
+{
+	remove(session_name);
+}
+
+/**
+ * @brief Read the saved join state
+ *
+ * @param state structure for the join state
+ * @return true if a join state was found
+ * @return false if no join state was saved
+ */
+bool read_join_state(s_join_state *state)
+{
+	FILE *join_file = fopen(join_name, "r");
+	if (!join_file)
+	{
+		return false;
+	}
+	size_t size = fread((uint8_t *)state, 1, sizeof(s_join_state), join_file);
+	fclose(join_file);
+	return size == sizeof(s_join_state);
+}
+
+/**
+ * @brief Save the join state
+ *
+ * @param state join state to save
+ * @return true if the join state was written
+ * @return false if the file could not be created
+ */
+bool save_join_state(s_join_state *state)
+{
+	return save_record(join_name, (uint8_t *)state, sizeof(s_join_state));
+}
+
+/** File used by the api_file_* functions */
+FILE *api_file = NULL;
+
+/**
+ * @brief Full path of a file in the file system
+ *
+ * @param filename name of the file
+ * @param path buffer for the path
+ * @param size size of the buffer
+ */
+static void api_file_path(const char *filename, char *path, size_t size)
+{
+	snprintf(path, size, "%s/%s", MBED_LITTLEFS_FILE_PREFIX, filename);
+}
+
+/**
+ * @brief Initialize the internal file system
+ *
+ * @return true if the file system is mounted
+ */
+bool api_fs_init(void)
+{
+	if (myFS != NULL)
+	{
+		return true;
+	}
+	myFS = new LittleFS_MBED();
+	return myFS->init();
+}
+
+/**
+ * @brief Open a file for reading
+ *
+ * @param filename name of the file
+ * @return true if the file was opened
+ */
+bool api_file_open_read(const char *filename)
+{
+	char path[64];
+	api_file_path(filename, path, sizeof(path));
+	api_file = fopen(path, "r");
+	return api_file != NULL;
+}
+
+/**
+ * @brief Open a file for writing, data is appended at the end of the file
+ *    The file is created if it doesn't exist
+ *
+ * @param filename name of the file
+ * @return true if the file was opened
+ */
+bool api_file_open_write(const char *filename)
+{
+	char path[64];
+	api_file_path(filename, path, sizeof(path));
+	api_file = fopen(path, "a");
+	return api_file != NULL;
+}
+
+/**
+ * @brief Read from the open file
+ *
+ * @param destination buffer for the data
+ * @param size number of bytes to read
+ * @return uint16_t number of bytes read, less than size at the end of the file
+ */
+uint16_t api_file_read(uint8_t *destination, uint16_t size)
+{
+	if (api_file == NULL)
+	{
+		return 0;
+	}
+	return fread(destination, 1, size, api_file);
+}
+
+/**
+ * @brief Write to the open file
+ *
+ * @param source data to write
+ * @param size number of bytes
+ */
+void api_file_write(uint8_t *source, uint32_t size)
+{
+	if (api_file == NULL)
+	{
+		return;
+	}
+	fwrite(source, 1, size, api_file);
+	fflush(api_file);
+}
+
+/**
+ * @brief Delete a file
+ *
+ * @param filename name of the file
+ */
+void api_file_remove(const char *filename)
+{
+	char path[64];
+	api_file_path(filename, path, sizeof(path));
+	remove(path);
+}
+
+/**
+ * @brief Close the open file
+ *
+ * @param filename name of the file (not used, only one file can be open)
+ */
+void api_file_close(const char *filename)
+{
+	(void)filename;
+	if (api_file != NULL)
+	{
+		fclose(api_file);
+		api_file = NULL;
+	}
+}
+
+/**
+ * @brief Call a function for every file in the root folder
+ *    The callback must not open or remove files, the folder is open while it is called
+ *
+ * @param callback function that gets the name of the file
+ */
+void api_file_list(file_list_cb_t callback)
+{
+	DIR *folder = opendir(MBED_LITTLEFS_FILE_PREFIX);
+	if (folder == NULL)
+	{
+		return;
+	}
+	struct dirent *entry;
+	while ((entry = readdir(folder)) != NULL)
+	{
+		if (entry->d_type != DT_DIR)
+		{
+			callback(entry->d_name);
+		}
+	}
+	closedir(folder);
+}
+
 #endif
\ No newline at end of file
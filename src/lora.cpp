@@ -21,6 +21,13 @@ void on_cad_done(bool cadResult);
 
 uint8_t g_lora_p2p_rx_mode = RX_MODE_NONE;
 uint32_t g_lora_p2p_rx_time = 0;
+/** Sniff period in ms for RX_MODE_RX_SNIFF and the long TX preamble, 0 = off */
+uint32_t g_lora_p2p_sniff_period = 0;
+
+/** Flag if a frame of the API is on air */
+static volatile bool p2p_frame_sending = false;
+/** Callback for the result of the frame of the API */
+static p2p_frame_cb_t p2p_frame_done = NULL;
 
 /**
  * @brief Initialize LoRa HW and LoRaWan MAC layer
@@ -36,7 +43,7 @@ int8_t init_lora(void)
 #ifdef ESP32
 		pinMode(WB_IO2, OUTPUT);
 		digitalWrite(WB_IO2, HIGH);
-		delay(500);
+		api_delay(500);
 #endif
 		// Initialize LoRa chip.
 		if (api_init_lora() != 0)
@@ -54,20 +61,16 @@ int8_t init_lora(void)
 		RadioEvents.CadDone = on_cad_done;
 
 		Radio.Init(&RadioEvents);
+
+		// Different backoff times on each device
+		randomSeed(Radio.Random());
 	}
 	Radio.Sleep(); // Radio.Standby();
 
-	Radio.SetChannel(g_lorawan_settings.p2p_frequency);
+	// Radio.Init() resets the frequency
+	p2p_hop_tune(true);
 
-	Radio.SetTxConfig(MODEM_LORA, g_lorawan_settings.p2p_tx_power, 0, g_lorawan_settings.p2p_bandwidth,
-					  g_lorawan_settings.p2p_sf, g_lorawan_settings.p2p_cr,
-					  g_lorawan_settings.p2p_preamble_len, false,
-					  true, 0, 0, false, 5000);
-
-	Radio.SetRxConfig(MODEM_LORA, g_lorawan_settings.p2p_bandwidth, g_lorawan_settings.p2p_sf,
-					  g_lorawan_settings.p2p_cr, 0, g_lorawan_settings.p2p_preamble_len,
-					  g_lorawan_settings.p2p_symbol_timeout, false,
-					  0, true, 0, 0, false, true);
+	p2p_radio_config();
 
 	if (g_lorawan_settings.send_repeat_time != 0)
 	{
@@ -76,21 +79,8 @@ int8_t init_lora(void)
 		api_timer_start();
 	}
 
-	switch (g_lora_p2p_rx_mode)
-	{
-	default:
-	case RX_MODE_NONE:
-		// No RX mode, do not start RX
-		Radio.Sleep();
-		break;
-	case RX_MODE_RX:
-	case RX_MODE_RX_WAIT:
-		Radio.Rx(0);
-		break;
-	case RX_MODE_RX_TIMED:
-		Radio.Rx(g_lora_p2p_rx_time);
-		break;
-	}
+	// Start RX depending on the RX mode
+	api_p2p_event(P2P_EV_MODE);
 
 	digitalWrite(LED_GREEN, LOW);
 
@@ -101,35 +91,144 @@ int8_t init_lora(void)
 	return 0;
 }
 
+/**
+ * @brief Get the LoRa symbol time of the P2P settings
+ *
+ * @return uint32_t symbol time in microseconds
+ */
+uint32_t api_p2p_symbol_time(void)
+{
+	return ((uint32_t)1 << api_p2p_sf()) * 1000000UL / api_lora_bw_hz(g_lorawan_settings.p2p_bandwidth);
+}
+
+/**
+ * @brief Get the preamble length used by LoRa P2P
+ *    With a sniff period the preamble is long enough to cover a full sleep period of the receiver
+ *
+ * @param period_ms sniff period in ms, 0 for the normal preamble
+ * @return uint32_t preamble length in symbols
+ */
+static uint32_t p2p_preamble_len(uint32_t period_ms)
+{
+	if (period_ms == 0)
+	{
+		return g_lorawan_settings.p2p_preamble_len;
+	}
+	uint32_t symbol_time = api_p2p_symbol_time();
+	return ((uint64_t)period_ms * 1000 + symbol_time - 1) / symbol_time + g_lorawan_settings.p2p_preamble_len;
+}
+
+/**
+ * @brief Get the time on air of a LoRa P2P packet with the current settings
+ *    Includes the long preamble of the sniff mode
+ *
+ * @param size payload size
+ * @return uint32_t time on air in microseconds
+ */
+uint32_t api_p2p_airtime(uint8_t size)
+{
+	uint32_t preamble_len = p2p_preamble_len(g_lora_p2p_sniff_period);
+	return api_lora_airtime(api_p2p_sf(), api_lora_bw_hz(g_lorawan_settings.p2p_bandwidth),
+							g_lorawan_settings.p2p_cr, preamble_len > 0xFFFF ? 0xFFFF : preamble_len, size);
+}
+
+/**
+ * @brief Set the sniff period for RX_MODE_RX_SNIFF
+ *    Packets are sent with a preamble that is longer than the sniff period, so receivers in sniff mode
+ *    wake up in time. Senders and receivers must use the same period
+ *
+ * @param period_ms time between two listen windows in ms, 0 to switch off the long preamble
+ * @return true if the period was set
+ * @return false if the period needs a preamble longer than 65535 symbols
+ */
+bool api_p2p_sniff(uint32_t period_ms)
+{
+	if (p2p_preamble_len(period_ms) > 0xFFFF)
+	{
+		return false;
+	}
+	g_lora_p2p_sniff_period = period_ms;
+	if (g_lora_p2p_rx_mode == RX_MODE_RX_SNIFF && period_ms == 0)
+	{
+		g_lora_p2p_rx_mode = RX_MODE_NONE;
+	}
+	p2p_radio_config();
+	api_p2p_event(P2P_EV_MODE);
+	return true;
+}
+
+/**
+ * @brief Apply the LoRa P2P settings to the radio
+ *    SF and TX power can be changed by the adaptive mode
+ *
+ */
+void p2p_radio_config(void)
+{
+	uint16_t preamble_len = p2p_preamble_len(g_lora_p2p_sniff_period);
+
+	Radio.SetTxConfig(MODEM_LORA, api_p2p_tx_power(), 0, g_lorawan_settings.p2p_bandwidth,
+					  api_p2p_sf(), g_lorawan_settings.p2p_cr,
+					  preamble_len, false,
+					  true, 0, 0, false, 5000 + g_lora_p2p_sniff_period);
+
+	Radio.SetRxConfig(MODEM_LORA, g_lorawan_settings.p2p_bandwidth, api_p2p_sf(),
+					  g_lorawan_settings.p2p_cr, 0, preamble_len,
+					  g_lorawan_settings.p2p_symbol_timeout, false,
+					  0, true, 0, 0, false, true);
+}
+
+/**
+ * @brief Finish a frame of the API, the result is not passed to the application
+ *    The callback runs after the radio event, so it can send the next frame
+ *
+ * @param result true if the frame was sent
+ * @param event radio event of the result
+ * @return true if a frame of the API was finished
+ * @return false if it was a packet of the application
+ */
+static bool p2p_frame_finished(bool result, uint8_t event)
+{
+	if (!p2p_frame_sending)
+	{
+		return false;
+	}
+	p2p_frame_sending = false;
+	api_tx_finished();
+	api_p2p_event(event);
+	if (p2p_frame_done != NULL)
+	{
+		p2p_frame_done(result);
+	}
+	return true;
+}
+
 /**
  * @brief Function to be executed on Radio Tx Done event
  */
 void on_tx_done(void)
 {
 	API_LOG("LORA", "TX finished");
+	uint32_t airtime = api_p2p_airtime(g_tx_data_len);
+	api_airtime_add(airtime);
+	p2p_duty_used(api_p2p_frequency(), airtime);
+	if (p2p_tdma_tx_done())
+	{
+		// Beacon sent, nothing to report to the application
+		api_p2p_event(P2P_EV_TX_DONE);
+		return;
+	}
+	if (p2p_frame_finished(true, P2P_EV_TX_DONE))
+	{
+		return;
+	}
 	g_rx_fin_result = true;
+	api_tx_finished();
+	tx_queue_result(TX_RESULT_SENT);
 
 	// Notify loop task
-	api_wake_loop(LORA_TX_FIN);
+	api_wake_loop(LORA_TX_FIN, g_rx_fin_result);
 
-	switch (g_lora_p2p_rx_mode)
-	{
-	default:
-	case RX_MODE_NONE:
-		// No RX mode, do not start RX
-		Radio.Sleep();
-		API_LOG("LORA", "TX finished - Do not start RX");
-		break;
-	case RX_MODE_RX:
-	case RX_MODE_RX_WAIT:
-		Radio.Rx(0);
-		API_LOG("LORA", "TX finished - Start RX");
-		break;
-	case RX_MODE_RX_TIMED:
-		Radio.Rx(g_lora_p2p_rx_time);
-		API_LOG("LORA", "TX finished - Start timed RX");
-		break;
-	}
+	api_p2p_event(P2P_EV_TX_DONE);
 }
 
 /**@brief Function to be executed on Radio Rx Done event
@@ -139,31 +238,33 @@ void on_rx_done(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr)
 	API_LOG("LORA", "LoRa Packet received with size:%d, rssi:%d, snr:%d",
 			size, rssi, snr);
 
-	g_last_rssi = rssi;
-	g_last_snr = snr;
+	api_link_rx(rssi, snr);
 
-	// Copy the data into loop data buffer
-	memcpy(g_rx_lora_data, payload, size);
-	g_rx_data_len = size;
+	// TDMA beacons and control frames of the adaptive mode are handled by the API
+	if (p2p_adapt_rx(payload, size, snr) || p2p_tdma_rx(payload, size))
+	{
+		api_p2p_event(P2P_EV_RX_DONE);
+		return;
+	}
 
-	// Notify loop task
-	api_wake_loop(LORA_DATA);
+	// Frames of the reliable delivery, new data frames are put into the RX ring
+	if (p2p_reliable_rx(payload, size, rssi, snr))
+	{
+		api_p2p_event(P2P_EV_RX_DONE);
+		return;
+	}
 
-	switch (g_lora_p2p_rx_mode)
+	// Copy the data into the next free RX slot and notify loop task
+	if (api_rx_put(payload, size, rssi, snr, 0))
 	{
-	default:
-	case RX_MODE_NONE:
-	case RX_MODE_RX_WAIT:
-	case RX_MODE_RX_TIMED:
-		// No RX mode, do not start RX
-		Radio.Sleep();
-		API_LOG("LORA", "RX finished - Stopping RX");
-		break;
-	case RX_MODE_RX:
-		Radio.Rx(0);
-		API_LOG("LORA", "RX finished - Restarting RX");
-		break;
+		api_wake_loop(LORA_DATA, size);
 	}
+	else
+	{
+		API_LOG("LORA", "RX ring full, packet dropped");
+	}
+
+	api_p2p_event(P2P_EV_RX_DONE);
 }
 
 /**@brief Function to be executed on Radio Tx Timeout event
@@ -171,26 +272,23 @@ void on_rx_done(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr)
 void on_tx_timeout(void)
 {
 	API_LOG("LORA", "TX timeout");
+	if (p2p_tdma_tx_done())
+	{
+		api_p2p_event(P2P_EV_TX_TIMEOUT);
+		return;
+	}
+	if (p2p_frame_finished(false, P2P_EV_TX_TIMEOUT))
+	{
+		return;
+	}
 	g_rx_fin_result = false;
+	api_tx_finished();
+	tx_queue_result(TX_RESULT_TIMEOUT);
 
 	// Notify loop task
-	api_wake_loop(LORA_TX_FIN);
+	api_wake_loop(LORA_TX_FIN, g_rx_fin_result);
 
-	switch (g_lora_p2p_rx_mode)
-	{
-	default:
-	case RX_MODE_NONE:
-	case RX_MODE_RX_WAIT:
-	case RX_MODE_RX_TIMED:
-		// No RX mode, do not start RX
-		Radio.Sleep();
-		API_LOG("LORA", "TX timeout - Do not start RX");
-		break;
-	case RX_MODE_RX:
-		Radio.Rx(0);
-		API_LOG("LORA", "TX timeout - Restart RX");
-		break;
-	}
+	api_p2p_event(P2P_EV_TX_TIMEOUT);
 }
 
 /**@brief Function to be executed on Radio Rx Timeout event
@@ -198,70 +296,64 @@ void on_tx_timeout(void)
 void on_rx_timeout(void)
 {
 	API_LOG("LORA", "OnRxTimeout");
+	api_link_error(true);
 
-	switch (g_lora_p2p_rx_mode)
-	{
-	default:
-	case RX_MODE_NONE:
-	case RX_MODE_RX_WAIT:
-	case RX_MODE_RX_TIMED:
-		// No RX mode, do not start RX
-		Radio.Sleep();
-		API_LOG("LORA", "RX timeout - Do not start RX");
-		break;
-	case RX_MODE_RX:
-		Radio.Rx(0);
-		API_LOG("LORA", "RX timeout - Restart RX");
-		break;
-	}
+	api_p2p_event(P2P_EV_RX_TIMEOUT);
 }
 
 /**@brief Function to be executed on Radio Rx Error event
  */
 void on_rx_crc_error(void)
 {
-	switch (g_lora_p2p_rx_mode)
-	{
-	default:
-	case RX_MODE_NONE:
-	case RX_MODE_RX_WAIT:
-	case RX_MODE_RX_TIMED:
-		// No RX mode, do not start RX
-		Radio.Sleep();
-		API_LOG("LORA", "RX CRC error - Do not start RX");
-		break;
-	case RX_MODE_RX:
-		Radio.Rx(0);
-		API_LOG("LORA", "RX CRC error - Restart RX");
-		break;
-	}
+	api_link_error(false);
+	p2p_adapt_loss();
+	api_p2p_event(P2P_EV_RX_ERROR);
 }
 
 /**@brief Function to be executed on Radio Rx Error event
  */
 void on_cad_done(bool cadResult)
 {
+	if (p2p_lbt_result(cadResult))
+	{
+		// Channel is busy, CAD is repeated after a backoff
+		api_p2p_event(P2P_EV_CAD_BUSY);
+		return;
+	}
+
 	if (cadResult)
 	{
-		switch (g_lora_p2p_rx_mode)
+		if (p2p_frame_finished(false, P2P_EV_CAD_BUSY))
 		{
-		default:
-		case RX_MODE_NONE:
-		case RX_MODE_RX_WAIT:
-		case RX_MODE_RX_TIMED:
-			// No RX mode, do not start RX
-			Radio.Sleep();
-			API_LOG("LORA", "CAD failed - Do not start RX");
-			break;
-		case RX_MODE_RX:
-			Radio.Rx(0);
-			API_LOG("LORA", "CAD failed - Restart RX");
-			break;
+			return;
 		}
+		// Channel is busy after all attempts, packet is not sent
+		g_rx_fin_result = false;
+		api_tx_finished();
+		tx_queue_result(TX_RESULT_FAILED);
+
+		// Notify loop task
+		api_wake_loop(LORA_TX_FIN, g_rx_fin_result);
+
+		api_p2p_event(P2P_EV_CAD_BUSY);
 	}
 	else
 	{
-		Radio.Send(g_tx_lora_data, g_tx_data_len);
+		api_p2p_event(P2P_EV_CAD_FREE);
+	}
+}
+
+/**
+ * @brief Start CAD for the packet in the TX buffer
+ *
+ */
+static void p2p_tx_start(void)
+{
+	// Start CAD, with TDMA in the TX slot of this node
+	p2p_lbt_start();
+	if (!p2p_tdma_defer())
+	{
+		api_p2p_event(P2P_EV_TX_START);
 	}
 }
 
@@ -271,22 +363,56 @@ void on_cad_done(bool cadResult)
  */
 bool send_p2p_packet(uint8_t *data, uint8_t size)
 {
-	if (size > 256)
+	// Data built with api_tx_acquire() is already in the TX buffer
+	if (!api_tx_start(data, size))
 	{
+		API_LOG("LORA", "TX buffer busy, skip sending packet");
 		return false;
 	}
-	g_tx_data_len = size;
-	memcpy(g_tx_lora_data, data, size);
 
-	// Prepare LoRa CAD
-	Radio.Sleep();
-	Radio.SetCadParams(LORA_CAD_08_SYMBOL, g_lorawan_settings.p2p_sf + 13, 10, LORA_CAD_ONLY, 0);
+	// Duty cycle limit, delay or reject the packet
+	uint32_t wait_time;
+	if (!p2p_duty_check(size, &wait_time))
+	{
+		if (!p2p_duty_queue() || (api_schedule_callback(p2p_tx_start, wait_time) == 0))
+		{
+			API_LOG("LORA", "Duty cycle limit, packet can be sent in %ldms", (long)wait_time);
+			api_tx_finished();
+			return false;
+		}
+		API_LOG("LORA", "Duty cycle limit, packet delayed by %ldms", (long)wait_time);
+	}
 
 	// Switch on Indicator lights
 	digitalWrite(LED_GREEN, HIGH);
 
-	// Start CAD
-	Radio.StartCad();
+	if (wait_time == 0)
+	{
+		p2p_tx_start();
+	}
+
+	return true;
+}
 
+/**
+ * @brief Send a frame of the API, e.g. a control frame
+ *    Uses the same path as the packets of the application (duty cycle, TDMA, CAD), but the result
+ *    is not passed to the application
+ *
+ * @param data frame to be sent
+ * @param size size of the frame
+ * @param done called with the result when the frame is sent or failed, can be NULL
+ * @return true if the frame is sent
+ * @return false if the TX buffer is busy or the frame is rejected by the duty cycle limit
+ */
+bool p2p_send_frame(uint8_t *data, uint8_t size, p2p_frame_cb_t done)
+{
+	p2p_frame_sending = true;
+	p2p_frame_done = done;
+	if (!send_p2p_packet(data, size))
+	{
+		p2p_frame_sending = false;
+		return false;
+	}
 	return true;
 }
@@ -0,0 +1,454 @@
+/**
+ * @file lora_adapt.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Adaptive spreading factor and TX power for LoRa P2P
+ * @version 0.1
+ * @date 2022-03-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/**
+ * Both ends measure the SNR of the packets they receive from each other and compare it with the
+ * demodulation floor of the current spreading factor. If the margin is more than API_ADAPT_MARGIN +
+ * API_ADAPT_HYST dB, the SF is lowered, at SF7 the TX power is lowered instead. If the margin is less than
+ * API_ADAPT_MARGIN - API_ADAPT_HYST dB or after API_ADAPT_LOSSES CRC errors in a row, the TX power
+ * and then the SF go up again, never above the saved P2P settings.
+ * A change is proposed with a request frame and only taken when the other end answers with an ACK frame.
+ * The ACK is sent with the old settings, the answering end switches after it is sent, the proposing end
+ * when it is received. Both ends use the same SF and TX power, so the SNR is measured on a symmetric link.
+ * If nothing is received for API_ADAPT_TIMEOUT ms, both ends go back to the saved P2P settings.
+ */
+
+/** Marker of a control frame */
+static const uint8_t adapt_mark[2] = {'A', 'D'};
+/** Control frame types */
+enum ADAPT_FRAME
+{
+	ADAPT_REQ = 1,
+	ADAPT_ACK = 2
+};
+/** SNR demodulation floor in 0.1 dB for SF7 to SF12 */
+static const int16_t adapt_floor[6] = {-75, -100, -125, -150, -175, -200};
+
+/** Flag if the adaptive settings are used */
+static bool adapt_enabled = false;
+/** Saved P2P settings the adaptive settings are based on */
+static uint8_t adapt_base_sf = 0;
+static uint8_t adapt_base_power = 0;
+/** Adaptive settings */
+static uint8_t adapt_sf = 0;
+static uint8_t adapt_power = 0;
+/** Average SNR of the received packets, scaled by LINK_AVG_SCALE */
+static int16_t adapt_snr = 0;
+/** Number of packets received since the last change */
+static uint8_t adapt_samples = 0;
+/** Number of CRC errors in a row */
+static uint8_t adapt_losses = 0;
+/** Proposed settings, adapt_req_sf is 0 if no request is open */
+static uint8_t adapt_req_sf = 0;
+static uint8_t adapt_req_power = 0;
+/** Number of requests sent for the proposed settings */
+static uint8_t adapt_req_count = 0;
+/** Settings to switch to after the ACK was sent */
+static uint8_t adapt_ack_sf = 0;
+static uint8_t adapt_ack_power = 0;
+/** Scheduler jobs */
+static uint8_t adapt_decide_job = 0;
+static uint8_t adapt_req_job = 0;
+static uint8_t adapt_ack_job = 0;
+static uint8_t adapt_watchdog_job = 0;
+
+/**
+ * @brief Take the saved P2P settings if they were changed, e.g. with AT+PSF or AT+PTP
+ *
+ */
+static void adapt_sync(void)
+{
+	if ((adapt_base_sf == g_lorawan_settings.p2p_sf) && (adapt_base_power == g_lorawan_settings.p2p_tx_power))
+	{
+		return;
+	}
+	adapt_base_sf = g_lorawan_settings.p2p_sf;
+	adapt_base_power = g_lorawan_settings.p2p_tx_power;
+	adapt_sf = adapt_base_sf;
+	adapt_power = adapt_base_power;
+	adapt_samples = 0;
+	adapt_req_sf = 0;
+}
+
+/**
+ * @brief Apply the settings to the radio
+ *    A running transmission is not interrupted, the settings are applied after it
+ *
+ */
+static void adapt_reconfigure(void)
+{
+	uint8_t state = api_p2p_state();
+	if ((state == P2P_STATE_CAD) || (state == P2P_STATE_TX))
+	{
+		api_schedule_callback(adapt_reconfigure, API_ADAPT_RETRY);
+		return;
+	}
+	Radio.Sleep();
+	p2p_radio_config();
+	// Restart RX depending on the RX mode
+	api_p2p_event(P2P_EV_MODE);
+}
+
+/**
+ * @brief No packet received for API_ADAPT_TIMEOUT ms, go back to the saved settings
+ *    The other end does the same, so both meet again on the saved settings
+ *
+ */
+static void adapt_watchdog(void)
+{
+	adapt_watchdog_job = 0;
+	API_LOG("ADAPT", "Link lost, back to SF%d %ddBm", adapt_base_sf, adapt_base_power);
+	adapt_sf = adapt_base_sf;
+	adapt_power = adapt_base_power;
+	adapt_samples = 0;
+	adapt_req_sf = 0;
+	adapt_reconfigure();
+}
+
+/**
+ * @brief Start or stop the watchdog, it runs only while the settings differ from the saved ones
+ *
+ */
+static void adapt_watchdog_arm(void)
+{
+	if ((adapt_sf == adapt_base_sf) && (adapt_power == adapt_base_power))
+	{
+		api_schedule_cancel(adapt_watchdog_job);
+		adapt_watchdog_job = 0;
+		return;
+	}
+	if ((adapt_watchdog_job == 0) || !api_schedule_change(adapt_watchdog_job, API_ADAPT_TIMEOUT))
+	{
+		adapt_watchdog_job = api_schedule_callback(adapt_watchdog, API_ADAPT_TIMEOUT);
+	}
+}
+
+/**
+ * @brief Switch to new settings
+ *
+ * @param sf spreading factor
+ * @param power TX power
+ */
+static void adapt_set(uint8_t sf, uint8_t power)
+{
+	API_LOG("ADAPT", "SF%d %ddBm -> SF%d %ddBm", adapt_sf, adapt_power, sf, power);
+	adapt_sf = sf;
+	adapt_power = power;
+	// The SNR of the new settings is measured from scratch
+	adapt_samples = 0;
+	adapt_losses = 0;
+	adapt_watchdog_arm();
+	adapt_reconfigure();
+}
+
+/**
+ * @brief Send a control frame
+ *
+ * @param type one of ADAPT_FRAME
+ * @param sf spreading factor
+ * @param power TX power
+ * @param done called when the frame is sent or failed, can be NULL
+ * @return true if the frame is sent
+ */
+static bool adapt_send(uint8_t type, uint8_t sf, uint8_t power, p2p_frame_cb_t done)
+{
+	uint8_t frame[ADAPT_FRAME_SIZE] = {adapt_mark[0], adapt_mark[1], type, sf, power};
+	return p2p_send_frame(frame, ADAPT_FRAME_SIZE, done);
+}
+
+/**
+ * @brief Send the request for the proposed settings, repeated until the ACK is received
+ *
+ */
+static void adapt_request(void)
+{
+	adapt_req_job = 0;
+	if (adapt_req_sf == 0)
+	{
+		return;
+	}
+	if (adapt_req_count > API_ADAPT_RETRIES)
+	{
+		API_LOG("ADAPT", "No ACK for SF%d %ddBm", adapt_req_sf, adapt_req_power);
+		adapt_req_sf = 0;
+		adapt_samples = 0;
+		return;
+	}
+	if (adapt_send(ADAPT_REQ, adapt_req_sf, adapt_req_power, NULL))
+	{
+		adapt_req_count++;
+	}
+	// Wait for the ACK, request and ACK are both on air
+	adapt_req_job = api_schedule_callback(adapt_request, 2 * api_p2p_airtime(ADAPT_FRAME_SIZE) / 1000 + API_ADAPT_ACK_WAIT);
+}
+
+/**
+ * @brief Propose new settings to the other end
+ *
+ * @param sf spreading factor
+ * @param power TX power
+ */
+static void adapt_propose(uint8_t sf, uint8_t power)
+{
+	if ((sf == adapt_sf) && (power == adapt_power))
+	{
+		return;
+	}
+	adapt_req_sf = sf;
+	adapt_req_power = power;
+	adapt_req_count = 0;
+	adapt_request();
+}
+
+/**
+ * @brief Step up after losses or with a low margin, TX power first, then SF
+ *
+ */
+static void adapt_step_up(void)
+{
+	if (adapt_power < adapt_base_power)
+	{
+		uint8_t power = adapt_power + API_ADAPT_POWER_STEP;
+		adapt_propose(adapt_sf, power < adapt_base_power ? power : adapt_base_power);
+	}
+	else if (adapt_sf < adapt_base_sf)
+	{
+		adapt_propose(adapt_sf + 1, adapt_power);
+	}
+}
+
+/**
+ * @brief Check the SNR margin and propose new settings
+ *    Runs in the loop task after a packet was received
+ *
+ */
+static void adapt_decide(void)
+{
+	adapt_decide_job = 0;
+	if (!adapt_enabled || (adapt_req_sf != 0) || (adapt_samples < API_ADAPT_SAMPLES))
+	{
+		return;
+	}
+	// Margin above the demodulation floor in 0.1 dB
+	int16_t margin = adapt_snr * 10 / LINK_AVG_SCALE - adapt_floor[adapt_sf - 7];
+	if (margin > (API_ADAPT_MARGIN + API_ADAPT_HYST) * 10)
+	{
+		// Strong link, lower the SF if the margin stays above the target, otherwise the TX power
+		if ((adapt_sf > 7) && (margin - (adapt_floor[adapt_sf - 8] - adapt_floor[adapt_sf - 7]) >= API_ADAPT_MARGIN * 10))
+		{
+			adapt_propose(adapt_sf - 1, adapt_power);
+		}
+		else if (adapt_power >= API_ADAPT_MIN_POWER + API_ADAPT_POWER_STEP)
+		{
+			adapt_propose(adapt_sf, adapt_power - API_ADAPT_POWER_STEP);
+		}
+	}
+	else if (margin < (API_ADAPT_MARGIN - API_ADAPT_HYST) * 10)
+	{
+		adapt_step_up();
+	}
+}
+
+/**
+ * @brief ACK was sent, switch to the accepted settings
+ *
+ * @param result true if the ACK was sent
+ */
+static void adapt_ack_done(bool result)
+{
+	if (result)
+	{
+		adapt_set(adapt_ack_sf, adapt_ack_power);
+	}
+}
+
+/**
+ * @brief Answer a request with an ACK
+ *
+ */
+static void adapt_ack(void)
+{
+	adapt_ack_job = 0;
+	adapt_send(ADAPT_ACK, adapt_ack_sf, adapt_ack_power, adapt_ack_done);
+}
+
+/**
+ * @brief Enable or disable the adaptive SF and TX power
+ *    Only for LoRa P2P. Both ends must have it enabled and must listen (RX mode) for the handshake.
+ *
+ * @param enable true to enable, false to go back to the saved P2P settings
+ * @return true if the mode was set
+ * @return false if the device is in LoRaWAN mode
+ */
+bool api_p2p_adapt(bool enable)
+{
+	if (g_lorawan_settings.lorawan_enable)
+	{
+		return false;
+	}
+	adapt_sync();
+	adapt_enabled = enable;
+	adapt_samples = 0;
+	adapt_losses = 0;
+	adapt_req_sf = 0;
+	if (!enable && ((adapt_sf != adapt_base_sf) || (adapt_power != adapt_base_power)))
+	{
+		adapt_sf = adapt_base_sf;
+		adapt_power = adapt_base_power;
+		adapt_reconfigure();
+	}
+	adapt_watchdog_arm();
+	return true;
+}
+
+/**
+ * @brief Get the state of the adaptive SF and TX power
+ *
+ * @param status filled with the mode, the current settings, the SNR and the margin
+ */
+void api_p2p_adapt_status(s_adapt_status *status)
+{
+	status->enabled = adapt_enabled;
+	status->sf = api_p2p_sf();
+	status->tx_power = api_p2p_tx_power();
+	status->samples = adapt_samples;
+	status->snr = adapt_snr / LINK_AVG_SCALE;
+	status->margin = adapt_samples == 0 ? 0 : (adapt_snr * 10 / LINK_AVG_SCALE - adapt_floor[status->sf - 7]) / 10;
+}
+
+/**
+ * @brief Get the spreading factor used for LoRa P2P
+ *
+ * @return uint8_t adaptive SF if enabled, otherwise the saved P2P SF
+ */
+uint8_t api_p2p_sf(void)
+{
+	if (!adapt_enabled)
+	{
+		return g_lorawan_settings.p2p_sf;
+	}
+	adapt_sync();
+	return adapt_sf;
+}
+
+/**
+ * @brief Get the TX power used for LoRa P2P
+ *
+ * @return uint8_t adaptive TX power if enabled, otherwise the saved P2P TX power
+ */
+uint8_t api_p2p_tx_power(void)
+{
+	if (!adapt_enabled)
+	{
+		return g_lorawan_settings.p2p_tx_power;
+	}
+	adapt_sync();
+	return adapt_power;
+}
+
+/**
+ * @brief Measure a received packet and handle control frames
+ *    Called from the RX done callback
+ *
+ * @param payload received packet
+ * @param size size of the packet
+ * @param snr SNR of the packet
+ * @return true if it was a control frame, it is not passed to the application
+ * @return false if it was a normal packet
+ */
+bool p2p_adapt_rx(uint8_t *payload, uint16_t size, int8_t snr)
+{
+	if (!adapt_enabled)
+	{
+		return false;
+	}
+	adapt_sync();
+	adapt_losses = 0;
+	adapt_watchdog_arm();
+
+	// EWMA like the link statistics
+	if (adapt_samples == 0)
+	{
+		adapt_snr = snr * LINK_AVG_SCALE;
+	}
+	else
+	{
+		adapt_snr += (snr * LINK_AVG_SCALE - adapt_snr) / (1 << API_LINK_EWMA_SHIFT);
+	}
+	if (adapt_samples < 0xFF)
+	{
+		adapt_samples++;
+	}
+
+	if ((size != ADAPT_FRAME_SIZE) || (payload[0] != adapt_mark[0]) || (payload[1] != adapt_mark[1]))
+	{
+		// Radio callbacks must not start a transmission, decide in the loop task
+		if ((adapt_decide_job == 0) && (adapt_samples >= API_ADAPT_SAMPLES) && (adapt_req_sf == 0))
+		{
+			adapt_decide_job = api_schedule_callback(adapt_decide, 1);
+		}
+		return false;
+	}
+
+	uint8_t sf = payload[3];
+	uint8_t power = payload[4];
+	switch (payload[2])
+	{
+	case ADAPT_REQ:
+		if ((sf < 7) || (sf > 12) || (power > adapt_base_power))
+		{
+			break;
+		}
+		// Requests from both ends at the same time, the more robust settings win
+		if ((adapt_req_sf != 0) && ((sf < adapt_req_sf) || ((sf == adapt_req_sf) && (power < adapt_req_power))))
+		{
+			break;
+		}
+		adapt_req_sf = 0;
+		adapt_ack_sf = sf;
+		adapt_ack_power = power;
+		if (adapt_ack_job == 0)
+		{
+			adapt_ack_job = api_schedule_callback(adapt_ack, 1);
+		}
+		break;
+	case ADAPT_ACK:
+		if ((adapt_req_sf == sf) && (adapt_req_power == power))
+		{
+			api_schedule_cancel(adapt_req_job);
+			adapt_req_job = 0;
+			adapt_req_sf = 0;
+			adapt_set(sf, power);
+		}
+		break;
+	}
+	return true;
+}
+
+/**
+ * @brief Count a lost packet, after API_ADAPT_LOSSES in a row the settings go up
+ *    Called from the RX error callback
+ *
+ */
+void p2p_adapt_loss(void)
+{
+	if (!adapt_enabled)
+	{
+		return;
+	}
+	adapt_losses++;
+	if ((adapt_losses >= API_ADAPT_LOSSES) && (adapt_req_sf == 0))
+	{
+		adapt_losses = 0;
+		api_schedule_callback(adapt_step_up, 1);
+	}
+}
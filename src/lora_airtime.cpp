@@ -0,0 +1,194 @@
+/**
+ * @file lora_airtime.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Time on air of LoRaWAN data rates and airtime counters
+ * @version 0.1
+ * @date 2022-03-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/** Data rate coding, spreading factor in bits 0-3, bandwidth setting in bits 4-7, 0 = no LoRa data rate (FSK or RFU) */
+#define DR_LORA(sf, bw) ((sf) | ((bw) << 4))
+
+/** LoRaWAN Regional Parameters, data rate to SF and bandwidth */
+static const uint8_t dr_eu868[] = {DR_LORA(12, 0), DR_LORA(11, 0), DR_LORA(10, 0), DR_LORA(9, 0), DR_LORA(8, 0), DR_LORA(7, 0), DR_LORA(7, 1), 0};
+static const uint8_t dr_us915[] = {DR_LORA(10, 0), DR_LORA(9, 0), DR_LORA(8, 0), DR_LORA(7, 0), DR_LORA(8, 2), 0, 0, 0,
+								   DR_LORA(12, 2), DR_LORA(11, 2), DR_LORA(10, 2), DR_LORA(9, 2), DR_LORA(8, 2), DR_LORA(7, 2)};
+static const uint8_t dr_au915[] = {DR_LORA(12, 0), DR_LORA(11, 0), DR_LORA(10, 0), DR_LORA(9, 0), DR_LORA(8, 0), DR_LORA(7, 0), DR_LORA(8, 2), 0,
+								   DR_LORA(12, 2), DR_LORA(11, 2), DR_LORA(10, 2), DR_LORA(9, 2), DR_LORA(8, 2), DR_LORA(7, 2)};
+static const uint8_t dr_cn470[] = {DR_LORA(12, 0), DR_LORA(11, 0), DR_LORA(10, 0), DR_LORA(9, 0), DR_LORA(8, 0), DR_LORA(7, 0)};
+
+/** LoRaWAN frame overhead, MHDR (1) + FHDR without FOpts (7) + FPort (1) + MIC (4) */
+#define LORAWAN_OVERHEAD 13
+
+/**
+ * @brief Get the spreading factor and bandwidth of a LoRaWAN data rate
+ *
+ * @param region LoRaWAN region, same order as LoRaMacRegion_t
+ * @param datarate data rate
+ * @param sf set to the spreading factor
+ * @param bw set to the bandwidth setting, 0: 125 kHz, 1: 250 kHz, 2: 500 kHz
+ * @return true if the data rate is a LoRa data rate of the region
+ * @return false if the data rate is FSK or not available in the region
+ */
+bool api_lorawan_dr_params(uint8_t region, uint8_t datarate, uint8_t *sf, uint8_t *bw)
+{
+	const uint8_t *table;
+	uint8_t size;
+
+	switch (region)
+	{
+	case LORAMAC_REGION_US915:
+		table = dr_us915;
+		size = sizeof(dr_us915);
+		break;
+	case LORAMAC_REGION_AU915:
+		table = dr_au915;
+		size = sizeof(dr_au915);
+		break;
+	case LORAMAC_REGION_CN470:
+	case LORAMAC_REGION_KR920:
+		table = dr_cn470;
+		size = sizeof(dr_cn470);
+		break;
+	case LORAMAC_REGION_AS923:
+	case LORAMAC_REGION_AS923_2:
+	case LORAMAC_REGION_AS923_3:
+	case LORAMAC_REGION_AS923_4:
+	case LORAMAC_REGION_CN779:
+	case LORAMAC_REGION_EU433:
+	case LORAMAC_REGION_EU868:
+	case LORAMAC_REGION_IN865:
+	case LORAMAC_REGION_RU864:
+		table = dr_eu868;
+		size = sizeof(dr_eu868);
+		break;
+	default:
+		return false;
+	}
+	if ((datarate >= size) || (table[datarate] == 0))
+	{
+		return false;
+	}
+	*sf = table[datarate] & 0x0F;
+	*bw = table[datarate] >> 4;
+	return true;
+}
+
+/**
+ * @brief Time on air of a LoRaWAN uplink
+ *    Preamble 8 symbols, coding rate 4/5, explicit header and CRC, no FOpts
+ *
+ * @param region LoRaWAN region, same order as LoRaMacRegion_t
+ * @param datarate data rate
+ * @param size application payload size
+ * @return uint32_t time on air in microseconds, 0 if the data rate is not a LoRa data rate of the region
+ */
+uint32_t api_lorawan_airtime(uint8_t region, uint8_t datarate, uint8_t size)
+{
+	uint8_t sf;
+	uint8_t bw;
+	if (!api_lorawan_dr_params(region, datarate, &sf, &bw))
+	{
+		return 0;
+	}
+	return api_lora_airtime(sf, api_lora_bw_hz(bw), 1, 8, size + LORAWAN_OVERHEAD);
+}
+
+/** Airtime per minute of the last hour in microseconds */
+static uint32_t airtime_minute[60] = {0};
+/** Minute (since start) of the newest entry in airtime_minute */
+static uint32_t airtime_last_minute = 0;
+/** Airtime since start or reset in milliseconds */
+static uint32_t airtime_total_ms = 0;
+/** Rest of the total airtime below 1 ms in microseconds */
+static uint32_t airtime_total_us = 0;
+/** Number of packets since start or reset */
+static uint32_t airtime_packets = 0;
+
+/**
+ * @brief Clear the minutes that passed since the last update
+ *
+ */
+static void airtime_roll(void)
+{
+	uint32_t minute = millis() / 60000;
+	uint32_t passed = minute - airtime_last_minute;
+	if (passed > 60)
+	{
+		passed = 60;
+	}
+	for (uint32_t idx = 1; idx <= passed; idx++)
+	{
+		airtime_minute[(airtime_last_minute + idx) % 60] = 0;
+	}
+	airtime_last_minute = minute;
+}
+
+/**
+ * @brief Add the time on air of a sent packet to the counters
+ *    Called by the API for every LoRa P2P and LoRaWAN packet
+ *
+ * @param airtime_us time on air in microseconds
+ */
+void api_airtime_add(uint32_t airtime_us)
+{
+	airtime_roll();
+	airtime_minute[airtime_last_minute % 60] += airtime_us;
+	airtime_total_us += airtime_us;
+	airtime_total_ms += airtime_total_us / 1000;
+	airtime_total_us %= 1000;
+	airtime_packets++;
+}
+
+/**
+ * @brief Get the airtime of the last 60 minutes
+ *
+ * @return uint32_t airtime in milliseconds
+ */
+uint32_t api_airtime_hour(void)
+{
+	airtime_roll();
+	uint32_t sum_us = 0;
+	for (uint8_t idx = 0; idx < 60; idx++)
+	{
+		sum_us += airtime_minute[idx];
+	}
+	return sum_us / 1000;
+}
+
+/**
+ * @brief Get the airtime since start or since api_airtime_reset()
+ *
+ * @return uint32_t airtime in milliseconds
+ */
+uint32_t api_airtime_total(void)
+{
+	return airtime_total_ms;
+}
+
+/**
+ * @brief Get the number of packets since start or since api_airtime_reset()
+ *
+ * @return uint32_t number of packets
+ */
+uint32_t api_airtime_packets(void)
+{
+	return airtime_packets;
+}
+
+/**
+ * @brief Clear the airtime counters
+ *
+ */
+void api_airtime_reset(void)
+{
+	memset(airtime_minute, 0, sizeof(airtime_minute));
+	airtime_last_minute = millis() / 60000;
+	airtime_total_ms = 0;
+	airtime_total_us = 0;
+	airtime_packets = 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file lora_airtime.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief LoRa time on air, Semtech formula (SX1261/2 datasheet 6.1.4)
+ *    No dependencies, can be used on the host for capacity planning
+ * @version 0.1
+ * @date 2022-03-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef LORA_AIRTIME_H
+#define LORA_AIRTIME_H
+
+#include <stdint.h>
+
+/**
+ * @brief Bandwidth in Hz of an SX126x bandwidth setting
+ *
+ * @param bw 0: 125 kHz, 1: 250 kHz, 2: 500 kHz, 3: 62.5 kHz, 4: 41.67 kHz, 5: 31.25 kHz,
+ *    6: 20.83 kHz, 7: 15.63 kHz, 8: 10.42 kHz, 9: 7.81 kHz, other values 125 kHz
+ * @return uint32_t bandwidth in Hz
+ */
+constexpr uint32_t api_lora_bw_hz(uint8_t bw)
+{
+	return bw == 1 ? 250000 : bw == 2 ? 500000
+						  : bw == 3	  ? 62500
+						  : bw == 4	  ? 41670
+						  : bw == 5	  ? 31250
+						  : bw == 6	  ? 20830
+						  : bw == 7	  ? 15630
+						  : bw == 8	  ? 10420
+						  : bw == 9	  ? 7810
+									  : 125000;
+}
+
+/**
+ * @brief Check if low data rate optimization is used, symbol time of 16 ms and more
+ *
+ * @param sf spreading factor 7 .. 12
+ * @param bw_hz bandwidth in Hz
+ * @return true if low data rate optimization is on
+ */
+constexpr bool api_lora_ldro(uint8_t sf, uint32_t bw_hz)
+{
+	return ((uint32_t)1 << sf) * 1000UL >= 16UL * bw_hz;
+}
+
+/**
+ * @brief Division rounded up, 0 for values <= 0
+ */
+constexpr int32_t lora_airtime_ceil(int32_t num, int32_t den)
+{
+	return num <= 0 ? 0 : (num + den - 1) / den;
+}
+
+/**
+ * @brief Number of payload symbols, including the 8 symbols of the header block
+ *
+ * @param sf spreading factor 7 .. 12
+ * @param bw_hz bandwidth in Hz
+ * @param cr coding rate 1: 4/5, 2: 4/6, 3: 4/7, 4: 4/8
+ * @param size payload size in bytes
+ * @param implicit_header true if no LoRa header is sent
+ * @param crc true if the payload CRC is sent
+ * @return uint32_t number of symbols
+ */
+constexpr uint32_t api_lora_payload_symbols(uint8_t sf, uint32_t bw_hz, uint8_t cr, uint16_t size, bool implicit_header, bool crc)
+{
+	return 8 + lora_airtime_ceil(8 * (int32_t)size - 4 * (int32_t)sf + 28 + (crc ? 16 : 0) - (implicit_header ? 20 : 0),
+								 4 * ((int32_t)sf - (api_lora_ldro(sf, bw_hz) ? 2 : 0))) *
+				   (cr + 4);
+}
+
+/**
+ * @brief Limit to 32 bit
+ */
+constexpr uint32_t lora_airtime_limit(uint64_t value)
+{
+	return value > 0xFFFFFFFFULL ? 0xFFFFFFFFUL : (uint32_t)value;
+}
+
+/**
+ * @brief Time on air of a LoRa packet
+ *    (preamble + 4.25 + payload symbols) * 2^SF / BW
+ *
+ * @param sf spreading factor 7 .. 12
+ * @param bw_hz bandwidth in Hz
+ * @param cr coding rate 1: 4/5, 2: 4/6, 3: 4/7, 4: 4/8
+ * @param preamble_len preamble length in symbols
+ * @param size payload size in bytes
+ * @param implicit_header true if no LoRa header is sent
+ * @param crc true if the payload CRC is sent
+ * @return uint32_t time on air in microseconds, 0xFFFFFFFF if longer than 71 minutes
+ */
+constexpr uint32_t api_lora_airtime(uint8_t sf, uint32_t bw_hz, uint8_t cr, uint16_t preamble_len, uint16_t size,
+									bool implicit_header = false, bool crc = true)
+{
+	return lora_airtime_limit(((((uint64_t)preamble_len * 4 + 17 + 4 * (uint64_t)api_lora_payload_symbols(sf, bw_hz, cr, size, implicit_header, crc))
+								<< sf) *
+								   1000000ULL +
+							   2ULL * bw_hz) /
+							  (4ULL * bw_hz));
+}
+
+#endif
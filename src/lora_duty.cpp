@@ -0,0 +1,206 @@
+/**
+ * @file lora_duty.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Duty cycle limit per sub-band for LoRa P2P
+ * @version 0.1
+ * @date 2022-03-15
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/**
+ * Each regulatory sub-band has a token bucket with airtime credit in microseconds. The credit grows with the
+ * duty cycle limit, e.g. 10 us per ms with 1% (10 per mille), up to the airtime allowed in
+ * API_DUTY_WINDOW. A packet is sent only if the credit covers its time on air. The airtime of a sent
+ * packet is taken from the bucket of the sub-band it was sent on, all channels of a sub-band share it,
+ * so hopping between channels of a sub-band doesn't get more airtime.
+ * The sub-bands are the ones of 863 to 870 MHz (ERC Recommendation 70-03, annex 1). Frequencies
+ * outside of them share one bucket.
+ */
+
+/** Edges of the sub-bands in Hz, a sub-band goes from its edge up to the next edge */
+static const uint32_t duty_band_edges[] = {863000000, 865000000, 868000000, 868600000, 868700000,
+										   869200000, 869400000, 869650000, 869700000, 870000000};
+/** Number of buckets, one per sub-band and one for all frequencies outside of the sub-bands */
+#define DUTY_BANDS (sizeof(duty_band_edges) / sizeof(duty_band_edges[0]))
+
+/** Token bucket of a sub-band */
+struct s_duty_bucket
+{
+	uint32_t updated;
+	int64_t credit;
+};
+
+/** Buckets per sub-band, the last one is for the frequencies outside of the sub-bands */
+static s_duty_bucket duty_buckets[DUTY_BANDS];
+/** Duty cycle limit in per mille, 0 = no limit */
+static uint16_t duty_limit = 0;
+/** Flag if packets are delayed (true) or rejected (false) */
+static bool duty_queue = true;
+
+/**
+ * @brief Max credit of a bucket
+ *
+ * @return int64_t airtime allowed within API_DUTY_WINDOW in microseconds
+ */
+static int64_t duty_capacity(void)
+{
+	return (int64_t)duty_limit * API_DUTY_WINDOW;
+}
+
+/**
+ * @brief Get the sub-band of a frequency
+ *
+ * @param frequency frequency of the channel
+ * @return uint8_t index of the bucket of the sub-band
+ */
+static uint8_t duty_band(uint32_t frequency)
+{
+	for (uint8_t idx = 0; idx < DUTY_BANDS - 1; idx++)
+	{
+		if ((frequency >= duty_band_edges[idx]) && (frequency < duty_band_edges[idx + 1]))
+		{
+			return idx;
+		}
+	}
+	return DUTY_BANDS - 1;
+}
+
+/**
+ * @brief Get the bucket of the sub-band of a channel with the credit updated to now
+ *
+ * @param frequency frequency of the channel
+ * @return s_duty_bucket* bucket of the sub-band
+ */
+static s_duty_bucket *duty_bucket(uint32_t frequency)
+{
+	uint32_t now = millis();
+	s_duty_bucket *bucket = &duty_buckets[duty_band(frequency)];
+	uint32_t elapsed = now - bucket->updated;
+	bucket->credit = elapsed >= API_DUTY_WINDOW ? duty_capacity() : bucket->credit + (int64_t)elapsed * duty_limit;
+	if (bucket->credit > duty_capacity())
+	{
+		bucket->credit = duty_capacity();
+	}
+	bucket->updated = now;
+	return bucket;
+}
+
+/**
+ * @brief Set the duty cycle limit for LoRa P2P
+ *    The limit is the same for all sub-bands, use the limit of the strictest sub-band the channels are in
+ *
+ * @param limit_permille max airtime in per mille, e.g. 1 = 0.1%, 10 = 1%, 100 = 10%, 0 = no limit
+ * @param queue true to delay packets until the channel has enough credit, false to reject them
+ * @return true if the limit was set
+ * @return false if the limit is above 1000 per mille
+ */
+bool api_p2p_duty_cycle(uint16_t limit_permille, bool queue)
+{
+	if (limit_permille > 1000)
+	{
+		return false;
+	}
+	duty_limit = limit_permille;
+	duty_queue = queue;
+	// Start with full buckets
+	uint32_t now = millis();
+	for (uint8_t idx = 0; idx < DUTY_BANDS; idx++)
+	{
+		duty_buckets[idx].updated = now;
+		duty_buckets[idx].credit = duty_capacity();
+	}
+	return true;
+}
+
+/**
+ * @brief Get the duty cycle limit
+ *
+ * @param limit_permille set to the limit in per mille, 0 = no limit
+ * @param queue set to true if packets are delayed, false if they are rejected
+ */
+void api_p2p_duty_cycle_get(uint16_t *limit_permille, bool *queue)
+{
+	*limit_permille = duty_limit;
+	*queue = duty_queue;
+}
+
+/**
+ * @brief Get the time until a packet can be sent in the sub-band of the current channel
+ *
+ * @param size payload size
+ * @return uint32_t wait time in ms, 0 if the packet can be sent now
+ */
+uint32_t api_p2p_duty_wait(uint8_t size)
+{
+	if (duty_limit == 0)
+	{
+		return 0;
+	}
+	s_duty_bucket *bucket = duty_bucket(api_p2p_frequency());
+	int64_t missing = (int64_t)api_p2p_airtime(size) - bucket->credit;
+	if (missing <= 0)
+	{
+		return 0;
+	}
+	return (uint32_t)((missing + duty_limit - 1) / duty_limit);
+}
+
+/**
+ * @brief Get the airtime credit of the sub-band of the current channel
+ *
+ * @return uint32_t airtime that can be used now in ms
+ */
+uint32_t api_p2p_duty_credit(void)
+{
+	if (duty_limit == 0)
+	{
+		return 0xFFFFFFFF;
+	}
+	s_duty_bucket *bucket = duty_bucket(api_p2p_frequency());
+	return bucket->credit > 0 ? (uint32_t)(bucket->credit / 1000) : 0;
+}
+
+/**
+ * @brief Check if a packet can be sent now
+ *    Called from send_p2p_packet()
+ *
+ * @param size payload size
+ * @param wait_ms set to the time until the packet can be sent
+ * @return true if the packet can be sent now
+ * @return false if the packet has to wait (queue mode) or is rejected
+ */
+bool p2p_duty_check(uint8_t size, uint32_t *wait_ms)
+{
+	*wait_ms = api_p2p_duty_wait(size);
+	return *wait_ms == 0;
+}
+
+/**
+ * @brief Check if packets are delayed when the duty cycle limit is reached
+ *
+ * @return true if packets are delayed
+ * @return false if packets are rejected
+ */
+bool p2p_duty_queue(void)
+{
+	return duty_queue;
+}
+
+/**
+ * @brief Take the airtime of a sent packet from the bucket of the sub-band of its channel
+ *    Called from the TX done callback
+ *
+ * @param frequency frequency the packet was sent on
+ * @param airtime_us time on air of the packet
+ */
+void p2p_duty_used(uint32_t frequency, uint32_t airtime_us)
+{
+	if (duty_limit == 0)
+	{
+		return;
+	}
+	duty_bucket(frequency)->credit -= airtime_us;
+}
@@ -0,0 +1,210 @@
+/**
+ * @file lora_frag.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Max payload per region and data rate, fragmentation of large payloads
+ * @version 0.1
+ * @date 2022-03-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/** Max application payload per DR, LoRaWAN Regional Parameters, no repeater */
+static const uint8_t max_payload_eu868[] = {51, 51, 51, 115, 242, 242, 242, 242};
+/** AS923 uses uplink dwell time limits */
+static const uint8_t max_payload_as923[] = {0, 0, 11, 53, 125, 242, 242, 242};
+static const uint8_t max_payload_au915[] = {51, 51, 51, 115, 242, 242, 242, 0, 53, 129, 242, 242, 242, 242};
+static const uint8_t max_payload_cn470[] = {51, 51, 51, 115, 222, 222};
+static const uint8_t max_payload_kr920[] = {51, 51, 51, 115, 242, 242};
+/** IN865 DR6 is RFU */
+static const uint8_t max_payload_in865[] = {51, 51, 51, 115, 242, 242, 0, 242};
+static const uint8_t max_payload_us915[] = {11, 53, 125, 242, 242, 0, 0, 0, 53, 129, 242, 242, 242, 242};
+
+/**
+ * @brief Get the max application payload of a region and data rate
+ *
+ * @param region LoRaWAN region, same order as LoRaMacRegion_t
+ * @param datarate data rate
+ * @return uint8_t max payload size, 0 if the data rate is not available in the region
+ */
+uint8_t api_region_max_payload(uint8_t region, uint8_t datarate)
+{
+	const uint8_t *table;
+	uint8_t size;
+
+	switch (region)
+	{
+	case LORAMAC_REGION_AS923:
+	case LORAMAC_REGION_AS923_2:
+	case LORAMAC_REGION_AS923_3:
+	case LORAMAC_REGION_AS923_4:
+		table = max_payload_as923;
+		size = sizeof(max_payload_as923);
+		break;
+	case LORAMAC_REGION_AU915:
+		table = max_payload_au915;
+		size = sizeof(max_payload_au915);
+		break;
+	case LORAMAC_REGION_CN470:
+		table = max_payload_cn470;
+		size = sizeof(max_payload_cn470);
+		break;
+	case LORAMAC_REGION_KR920:
+		table = max_payload_kr920;
+		size = sizeof(max_payload_kr920);
+		break;
+	case LORAMAC_REGION_US915:
+		table = max_payload_us915;
+		size = sizeof(max_payload_us915);
+		break;
+	case LORAMAC_REGION_IN865:
+		table = max_payload_in865;
+		size = sizeof(max_payload_in865);
+		break;
+	case LORAMAC_REGION_CN779:
+	case LORAMAC_REGION_EU433:
+	case LORAMAC_REGION_EU868:
+	case LORAMAC_REGION_RU864:
+		table = max_payload_eu868;
+		size = sizeof(max_payload_eu868);
+		break;
+	default:
+		return 0;
+	}
+	if (datarate >= size)
+	{
+		return 0;
+	}
+	return table[datarate];
+}
+
+/**
+ * @brief Get the max application payload that can be sent now
+ *    In LoRaWAN mode the MAC is asked, it knows the DR set by ADR and pending MAC commands.
+ *    Before the MAC is initialized the region and DR from the settings are used.
+ *
+ * @return uint8_t max payload size
+ */
+uint8_t api_max_payload(void)
+{
+	if (!g_lorawan_settings.lorawan_enable)
+	{
+		// LoRa P2P packets are only limited by the radio
+		return 255;
+	}
+
+	if (g_lorawan_initialized)
+	{
+		LoRaMacTxInfo_t tx_info;
+		LoRaMacQueryTxPossible(0, &tx_info);
+		return tx_info.MaxPossiblePayload;
+	}
+
+	return api_region_max_payload(g_lorawan_settings.lora_region, g_lorawan_settings.data_rate);
+}
+
+/** Counter to distinguish fragmented messages */
+static uint8_t frag_msg_id = 0;
+
+/** Reassembly buffer */
+static uint8_t frag_buffer[API_FRAG_MAX_SIZE];
+/** Number of bytes in the reassembly buffer */
+static uint16_t frag_len = 0;
+/** ID of the message that is reassembled */
+static uint8_t frag_rx_id = 0;
+/** Index of the next expected fragment */
+static uint8_t frag_next_index = 0;
+
+/**
+ * @brief Split a large payload into fragments and put them into the TX queue
+ *    Each fragment starts with a 2 byte header: message ID, then fragment index (bits 0-5)
+ *    and a flag for the last fragment (bit 7). The fragment size is taken from the current max payload.
+ *
+ * @param data data to be sent
+ * @param size size of the data
+ * @param fport fPort to be used, 0 to use the fPort from the settings (LoRaWAN only)
+ * @param priority priority of the fragments in the TX queue
+ * @param retries number of retries per fragment
+ * @param callback function called for every finished fragment, can be NULL
+ * @return uint8_t number of fragments queued, 0 if the payload is too large or the TX queue has not enough space
+ */
+uint8_t api_tx_fragment(uint8_t *data, uint16_t size, uint8_t fport, uint8_t priority, uint8_t retries, tx_done_cb_t callback)
+{
+	uint8_t frag_size = api_max_payload();
+	if (frag_size > API_TX_QUEUE_PAYLOAD)
+	{
+		frag_size = API_TX_QUEUE_PAYLOAD;
+	}
+	if (frag_size <= FRAG_HEADER_SIZE)
+	{
+		return 0;
+	}
+	frag_size -= FRAG_HEADER_SIZE;
+
+	uint16_t num_frags = (size + frag_size - 1) / frag_size;
+	if ((num_frags == 0) || (num_frags > FRAG_MAX_FRAGMENTS) || (num_frags > (API_TX_QUEUE_SIZE - api_tx_pending())))
+	{
+		API_LOG("FRAG", "Cannot send %d bytes in %d fragments", size, num_frags);
+		return 0;
+	}
+
+	uint8_t fragment[API_TX_QUEUE_PAYLOAD];
+	frag_msg_id++;
+	for (uint16_t idx = 0; idx < num_frags; idx++)
+	{
+		uint16_t offset = idx * frag_size;
+		uint8_t len = (size - offset) > frag_size ? frag_size : (size - offset);
+		fragment[0] = frag_msg_id;
+		fragment[1] = idx | ((idx == num_frags - 1) ? FRAG_LAST : 0);
+		memcpy(&fragment[FRAG_HEADER_SIZE], &data[offset], len);
+		api_tx_enqueue(fragment, len + FRAG_HEADER_SIZE, fport, priority, retries, callback);
+	}
+	return num_frags;
+}
+
+/**
+ * @brief Collect received fragments
+ *    Fragments must arrive in order, a missing fragment drops the message
+ *
+ * @param data received fragment including the header
+ * @param size size of the fragment
+ * @param message set to the reassembled message when it is complete
+ * @return uint16_t size of the complete message, 0 if more fragments are needed or the fragment was invalid
+ */
+uint16_t api_frag_receive(uint8_t *data, uint8_t size, uint8_t **message)
+{
+	if (size < FRAG_HEADER_SIZE)
+	{
+		return 0;
+	}
+	uint8_t msg_id = data[0];
+	uint8_t index = data[1] & FRAG_INDEX_MASK;
+	uint8_t len = size - FRAG_HEADER_SIZE;
+
+	if (index == 0)
+	{
+		// Start of a new message
+		frag_rx_id = msg_id;
+		frag_len = 0;
+		frag_next_index = 0;
+	}
+	if ((msg_id != frag_rx_id) || (index != frag_next_index) || ((frag_len + len) > API_FRAG_MAX_SIZE))
+	{
+		API_LOG("FRAG", "Fragment %d of message %d dropped", index, msg_id);
+		frag_next_index = 0xFF;
+		return 0;
+	}
+
+	memcpy(&frag_buffer[frag_len], &data[FRAG_HEADER_SIZE], len);
+	frag_len += len;
+	frag_next_index++;
+
+	if ((data[1] & FRAG_LAST) != FRAG_LAST)
+	{
+		return 0;
+	}
+	frag_next_index = 0xFF;
+	*message = frag_buffer;
+	return frag_len;
+}
@@ -0,0 +1,218 @@
+/**
+ * @file lora_hop.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Frequency hopping for LoRa P2P
+ * @version 0.1
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/**
+ * The channel plan starts at g_lorawan_settings.p2p_frequency and has up to API_P2P_HOP_CHANNELS
+ * channels with a fixed spacing. Every packet uses the next entry of the hop sequence. The sequence
+ * is a new permutation of all channels for each round, derived from the network key, so all nodes
+ * with the same key and hop index compute the same channel.
+ * The hop index advances on every sent packet and on every received packet (including CRC errors),
+ * so two nodes stay on the same channel as long as no packet is lost.
+ */
+
+/** Number of channels, 0 or 1 = hopping off */
+static uint8_t hop_channels = 0;
+/** Channel spacing in Hz */
+static uint32_t hop_spacing = 0;
+/** Network key, seed of the hop sequence */
+static uint32_t hop_key = 0;
+/** Index of the current packet in the hop sequence */
+static volatile uint32_t hop_index = 0;
+
+/** Channel order of the current round */
+static uint8_t hop_order[API_P2P_HOP_CHANNELS];
+/** Round the channel order was calculated for */
+static uint32_t hop_order_round = 0;
+/** Flag if hop_order is valid */
+static bool hop_order_valid = false;
+
+/** Frequency the radio is tuned to, 0 if unknown */
+static uint32_t hop_tuned = 0;
+
+/**
+ * @brief Mix key and round into the start value of the random generator
+ *
+ * @param key network key
+ * @param round round of the hop sequence
+ * @return uint32_t start value, never 0
+ */
+static uint32_t hop_seed(uint32_t key, uint32_t round)
+{
+	uint32_t seed = key ^ (round * 0x9E3779B9);
+	seed ^= seed >> 16;
+	seed *= 0x85EBCA6B;
+	seed ^= seed >> 13;
+	seed *= 0xC2B2AE35;
+	seed ^= seed >> 16;
+	return seed == 0 ? 1 : seed;
+}
+
+/**
+ * @brief Calculate the channel order of one round
+ *    Fisher-Yates shuffle with a xorshift generator, the same on all platforms
+ *
+ * @param round round of the hop sequence
+ */
+static void hop_build_order(uint32_t round)
+{
+	uint32_t rnd = hop_seed(hop_key, round);
+	for (uint8_t idx = 0; idx < hop_channels; idx++)
+	{
+		hop_order[idx] = idx;
+	}
+	for (uint8_t idx = hop_channels - 1; idx > 0; idx--)
+	{
+		rnd ^= rnd << 13;
+		rnd ^= rnd >> 17;
+		rnd ^= rnd << 5;
+		uint8_t swap = rnd % (idx + 1);
+		uint8_t temp = hop_order[idx];
+		hop_order[idx] = hop_order[swap];
+		hop_order[swap] = temp;
+	}
+	hop_order_round = round;
+	hop_order_valid = true;
+}
+
+/**
+ * @brief Set the frequency hopping channel plan
+ *    The first channel is g_lorawan_settings.p2p_frequency. The hop index is reset to 0.
+ *    All nodes of a P2P network must use the same plan and key.
+ *
+ * @param channels number of channels, 0 or 1 to switch hopping off
+ * @param spacing channel spacing in Hz
+ * @param key network key, seed of the hop sequence
+ * @return true if the plan was set
+ * @return false if there are too many channels or the last channel is above 960 MHz
+ */
+bool api_p2p_hop(uint8_t channels, uint32_t spacing, uint32_t key)
+{
+	if (channels > 1)
+	{
+		if ((channels > API_P2P_HOP_CHANNELS) || (spacing == 0) || (spacing > 10000000))
+		{
+			return false;
+		}
+		if ((g_lorawan_settings.p2p_frequency + (uint64_t)(channels - 1) * spacing) > 960000000)
+		{
+			return false;
+		}
+	}
+	else
+	{
+		channels = 0;
+	}
+	hop_channels = channels;
+	hop_spacing = spacing;
+	hop_key = key;
+	hop_index = 0;
+	hop_order_valid = false;
+	// Restart RX on the first channel
+	api_p2p_event(P2P_EV_MODE);
+	return true;
+}
+
+/**
+ * @brief Get the frequency hopping channel plan
+ *
+ * @param channels set to the number of channels, 0 if hopping is off
+ * @param spacing set to the channel spacing in Hz
+ * @param key set to the network key
+ */
+void api_p2p_hop_get(uint8_t *channels, uint32_t *spacing, uint32_t *key)
+{
+	*channels = hop_channels;
+	*spacing = hop_spacing;
+	*key = hop_key;
+}
+
+/**
+ * @brief Get the channel of a packet in the hop sequence
+ *
+ * @param index hop index of the packet
+ * @return uint8_t channel number, 0 is g_lorawan_settings.p2p_frequency
+ */
+uint8_t api_p2p_hop_channel(uint32_t index)
+{
+	if (hop_channels < 2)
+	{
+		return 0;
+	}
+	uint32_t round = index / hop_channels;
+	if (!hop_order_valid || (round != hop_order_round))
+	{
+		hop_build_order(round);
+	}
+	return hop_order[index % hop_channels];
+}
+
+/**
+ * @brief Get the current hop index
+ *
+ * @return uint32_t index of the next packet in the hop sequence
+ */
+uint32_t api_p2p_hop_index(void)
+{
+	return hop_index;
+}
+
+/**
+ * @brief Set the hop index, e.g. to get in sync with another node again
+ *
+ * @param index index of the next packet in the hop sequence
+ */
+void api_p2p_hop_sync(uint32_t index)
+{
+	hop_index = index;
+	api_p2p_event(P2P_EV_MODE);
+}
+
+/**
+ * @brief Get the frequency for the next packet
+ *
+ * @return uint32_t frequency in Hz
+ */
+uint32_t api_p2p_frequency(void)
+{
+	return g_lorawan_settings.p2p_frequency + api_p2p_hop_channel(hop_index) * hop_spacing;
+}
+
+/**
+ * @brief Advance to the next packet of the hop sequence
+ *    Called by the state machine after a packet was sent or received
+ *
+ */
+void p2p_hop_next(void)
+{
+	if (hop_channels > 1)
+	{
+		hop_index++;
+	}
+}
+
+/**
+ * @brief Tune the radio to the frequency of the next packet
+ *    Called by the state machine before RX or CAD is started
+ *
+ * @param force true to set the frequency even if it did not change, e.g. after Radio.Init()
+ */
+void p2p_hop_tune(bool force)
+{
+	uint32_t frequency = api_p2p_frequency();
+	if (!force && (frequency == hop_tuned))
+	{
+		return;
+	}
+	Radio.Standby();
+	Radio.SetChannel(frequency);
+	hop_tuned = frequency;
+}
@@ -0,0 +1,163 @@
+/**
+ * @file lora_lbt.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Listen before talk for LoRa P2P, CAD retries with backoff and channel statistics
+ * @version 0.1
+ * @date 2022-03-11
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/** Max number of CAD attempts per packet */
+static uint8_t lbt_max_attempts = API_CAD_MAX_ATTEMPTS;
+/** Backoff after the first busy CAD in ms, doubled with every attempt */
+static uint16_t lbt_backoff = API_CAD_BACKOFF;
+/** CAD attempts of the current packet */
+static uint8_t lbt_attempt = 0;
+/** Frequency the current CAD runs on */
+static uint32_t lbt_frequency = 0;
+
+/** Busy/clear counters per channel */
+static s_cad_stats lbt_stats[API_CAD_CHANNELS];
+
+/**
+ * @brief Configure listen before talk
+ *
+ * @param max_attempts max number of CAD attempts per packet, 1 = no retry
+ * @param backoff_ms backoff after the first busy CAD, doubled with every attempt
+ */
+void api_p2p_lbt(uint8_t max_attempts, uint16_t backoff_ms)
+{
+	lbt_max_attempts = max_attempts == 0 ? 1 : max_attempts;
+	lbt_backoff = backoff_ms;
+}
+
+/**
+ * @brief Get the listen before talk configuration
+ *
+ * @param max_attempts set to the max number of CAD attempts
+ * @param backoff_ms set to the backoff after the first busy CAD
+ */
+void api_p2p_lbt_get(uint8_t *max_attempts, uint16_t *backoff_ms)
+{
+	*max_attempts = lbt_max_attempts;
+	*backoff_ms = lbt_backoff;
+}
+
+/**
+ * @brief Get the busy/clear counters
+ *
+ * @param stats array to copy the counters into
+ * @param max size of the array
+ * @return uint8_t number of channels copied
+ */
+uint8_t api_p2p_cad_stats(s_cad_stats *stats, uint8_t max)
+{
+	uint8_t count = 0;
+	for (uint8_t idx = 0; (idx < API_CAD_CHANNELS) && (count < max); idx++)
+	{
+		if (lbt_stats[idx].frequency != 0)
+		{
+			stats[count++] = lbt_stats[idx];
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief Clear the busy/clear counters
+ *
+ */
+void api_p2p_cad_stats_reset(void)
+{
+	memset(lbt_stats, 0, sizeof(lbt_stats));
+}
+
+/**
+ * @brief Count a CAD result for the channel it was done on
+ *    If all slots are used, the channel with the fewest CADs is replaced
+ *
+ * @param busy true if the channel was busy
+ */
+static void lbt_count(bool busy)
+{
+	s_cad_stats *entry = NULL;
+	for (uint8_t idx = 0; idx < API_CAD_CHANNELS; idx++)
+	{
+		if (lbt_stats[idx].frequency == lbt_frequency)
+		{
+			entry = &lbt_stats[idx];
+			break;
+		}
+		if ((entry == NULL) || (lbt_stats[idx].busy + lbt_stats[idx].clear < entry->busy + entry->clear))
+		{
+			entry = &lbt_stats[idx];
+		}
+	}
+	if (entry->frequency != lbt_frequency)
+	{
+		entry->frequency = lbt_frequency;
+		entry->busy = 0;
+		entry->clear = 0;
+	}
+	if (busy)
+	{
+		entry->busy++;
+	}
+	else
+	{
+		entry->clear++;
+	}
+}
+
+/**
+ * @brief Retry the CAD after the backoff, called by the scheduler in the loop task
+ *
+ */
+static void lbt_retry(void)
+{
+	lbt_frequency = api_p2p_frequency();
+	api_p2p_event(P2P_EV_TX_START);
+}
+
+/**
+ * @brief Start listen before talk for a new packet
+ *
+ */
+void p2p_lbt_start(void)
+{
+	lbt_attempt = 1;
+	lbt_frequency = api_p2p_frequency();
+}
+
+/**
+ * @brief Handle the result of a CAD
+ *    Called from the CAD done callback
+ *
+ * @param busy true if activity was detected on the channel
+ * @return true if a retry is scheduled, the packet is still pending
+ * @return false if the channel is clear or all attempts failed
+ */
+bool p2p_lbt_result(bool busy)
+{
+	lbt_count(busy);
+	if (!busy || (lbt_attempt >= lbt_max_attempts))
+	{
+		return false;
+	}
+
+	// Randomized exponential backoff, between 1x and 2x of the current window
+	uint8_t shift = lbt_attempt - 1 < 8 ? lbt_attempt - 1 : 8;
+	uint32_t window = (uint32_t)lbt_backoff << shift;
+	uint32_t wait_time = window + random(0, window + 1);
+	lbt_attempt++;
+	if (api_schedule_callback(lbt_retry, wait_time == 0 ? 1 : wait_time) == 0)
+	{
+		// No scheduler slot, give up
+		return false;
+	}
+	API_LOG("LBT", "Channel busy, attempt %d in %ldms", lbt_attempt, (long)wait_time);
+	return true;
+}
@@ -0,0 +1,182 @@
+/**
+ * @file lora_link.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Link quality statistics, RSSI/SNR average, min/max, histograms and packet error rate
+ * @version 0.1
+ * @date 2022-03-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/** Link statistics */
+static s_link_stats link_stats;
+/** Flag if the first packet was received, min/max and the averages start with it */
+static bool link_first = true;
+
+/**
+ * @brief Histogram bucket of a value
+ *
+ * @param value RSSI or SNR
+ * @param start lower limit of the first bucket
+ * @param step width of a bucket
+ * @return uint8_t bucket, values below the first or above the last bucket are counted in the first or last bucket
+ */
+static uint8_t link_bucket(int16_t value, int16_t start, int16_t step)
+{
+	if (value < start)
+	{
+		return 0;
+	}
+	int16_t bucket = (value - start) / step;
+	return bucket >= LINK_HIST_BUCKETS ? LINK_HIST_BUCKETS - 1 : bucket;
+}
+
+/**
+ * @brief Count a histogram entry, stops at the max value
+ */
+static void link_hist_count(uint16_t *counter)
+{
+	if (*counter != 0xFFFF)
+	{
+		(*counter)++;
+	}
+}
+
+/**
+ * @brief Add a received packet to the statistics
+ *    Called from the RX callbacks of LoRa P2P and LoRaWAN
+ *
+ * @param rssi RSSI of the packet
+ * @param snr SNR of the packet
+ */
+void api_link_rx(int16_t rssi, int8_t snr)
+{
+	link_stats.rx_ok++;
+	if (link_first)
+	{
+		link_first = false;
+		link_stats.rssi_avg = rssi * LINK_AVG_SCALE;
+		link_stats.snr_avg = snr * LINK_AVG_SCALE;
+		link_stats.rssi_min = rssi;
+		link_stats.rssi_max = rssi;
+		link_stats.snr_min = snr;
+		link_stats.snr_max = snr;
+	}
+	else
+	{
+		// EWMA with weight 1 / 2^API_LINK_EWMA_SHIFT for the new value, fixed point with LINK_AVG_SCALE
+		link_stats.rssi_avg += (rssi * LINK_AVG_SCALE - link_stats.rssi_avg) / (1 << API_LINK_EWMA_SHIFT);
+		link_stats.snr_avg += (snr * LINK_AVG_SCALE - link_stats.snr_avg) / (1 << API_LINK_EWMA_SHIFT);
+		link_stats.rssi_min = rssi < link_stats.rssi_min ? rssi : link_stats.rssi_min;
+		link_stats.rssi_max = rssi > link_stats.rssi_max ? rssi : link_stats.rssi_max;
+		link_stats.snr_min = snr < link_stats.snr_min ? snr : link_stats.snr_min;
+		link_stats.snr_max = snr > link_stats.snr_max ? snr : link_stats.snr_max;
+	}
+	link_hist_count(&link_stats.rssi_hist[link_bucket(rssi, LINK_RSSI_START, LINK_RSSI_STEP)]);
+	link_hist_count(&link_stats.snr_hist[link_bucket(snr, LINK_SNR_START, LINK_SNR_STEP)]);
+}
+
+/**
+ * @brief Count a lost packet
+ *    Called on CRC errors and on RX timeouts
+ *
+ * @param timeout true for a timeout, false for a CRC error
+ */
+void api_link_error(bool timeout)
+{
+	if (timeout)
+	{
+		link_stats.rx_timeout++;
+	}
+	else
+	{
+		link_stats.rx_crc_error++;
+	}
+}
+
+/**
+ * @brief Get the packet error rate
+ *
+ * @return uint16_t lost packets (CRC errors and timeouts) in per mille of all packets
+ */
+uint16_t api_link_per(void)
+{
+	uint32_t errors = link_stats.rx_crc_error + link_stats.rx_timeout;
+	uint32_t total = link_stats.rx_ok + errors;
+	if (total == 0)
+	{
+		return 0;
+	}
+	return (uint16_t)(((uint64_t)errors * 1000) / total);
+}
+
+/**
+ * @brief Get the link statistics
+ *
+ * @return const s_link_stats* statistics, averages are scaled by LINK_AVG_SCALE
+ */
+const s_link_stats *api_link_stats(void)
+{
+	return &link_stats;
+}
+
+/**
+ * @brief Clear the link statistics
+ *
+ */
+void api_link_reset(void)
+{
+	memset(&link_stats, 0, sizeof(link_stats));
+	link_first = true;
+}
+
+/**
+ * @brief Put a value into the buffer, little endian
+ */
+static uint16_t link_put(uint8_t *buffer, uint16_t idx, uint32_t value, uint8_t size)
+{
+	for (uint8_t byte = 0; byte < size; byte++)
+	{
+		buffer[idx++] = (uint8_t)(value >> (8 * byte));
+	}
+	return idx;
+}
+
+/**
+ * @brief Write the link statistics in a compact binary format, little endian
+ *    Version (1), packets received (4), CRC errors (4), timeouts (4), RSSI average x16 (2), SNR average x16 (2),
+ *    RSSI min (2), RSSI max (2), SNR min (1), SNR max (1), RSSI histogram (8 x 2), SNR histogram (8 x 2)
+ *
+ * @param buffer buffer for the data
+ * @param size size of the buffer
+ * @return uint16_t number of bytes written, 0 if the buffer is smaller than LINK_DUMP_SIZE
+ */
+uint16_t api_link_dump(uint8_t *buffer, uint16_t size)
+{
+	if (size < LINK_DUMP_SIZE)
+	{
+		return 0;
+	}
+	uint16_t idx = 0;
+	buffer[idx++] = LINK_DUMP_VERSION;
+	idx = link_put(buffer, idx, link_stats.rx_ok, 4);
+	idx = link_put(buffer, idx, link_stats.rx_crc_error, 4);
+	idx = link_put(buffer, idx, link_stats.rx_timeout, 4);
+	idx = link_put(buffer, idx, (uint16_t)link_stats.rssi_avg, 2);
+	idx = link_put(buffer, idx, (uint16_t)link_stats.snr_avg, 2);
+	idx = link_put(buffer, idx, (uint16_t)link_stats.rssi_min, 2);
+	idx = link_put(buffer, idx, (uint16_t)link_stats.rssi_max, 2);
+	buffer[idx++] = (uint8_t)link_stats.snr_min;
+	buffer[idx++] = (uint8_t)link_stats.snr_max;
+	for (uint8_t bucket = 0; bucket < LINK_HIST_BUCKETS; bucket++)
+	{
+		idx = link_put(buffer, idx, link_stats.rssi_hist[bucket], 2);
+	}
+	for (uint8_t bucket = 0; bucket < LINK_HIST_BUCKETS; bucket++)
+	{
+		idx = link_put(buffer, idx, link_stats.snr_hist[bucket], 2);
+	}
+	return idx;
+}
@@ -0,0 +1,220 @@
+/**
+ * @file lora_p2p_state.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief LoRa P2P radio state machine
+ * @version 0.1
+ * @date 2022-03-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/**
+ * The radio callbacks, the AT commands and send_p2p_packet() report events to api_p2p_event().
+ * The action for an event depends on the P2P RX mode and is taken from p2p_actions[][].
+ * The action decides the next radio state. All Radio calls of the P2P mode are in p2p_run_action().
+ */
+
+/** Radio actions */
+enum P2P_ACTION
+{
+	P2P_ACT_SLEEP = 0, // Radio.Sleep()
+	P2P_ACT_RX,		   // Radio.Rx(0)
+	P2P_ACT_RX_TIMED,  // Radio.Rx(g_lora_p2p_rx_time)
+	P2P_ACT_CAD,	   // Start CAD before sending
+	P2P_ACT_SEND,	   // Send the TX buffer
+	P2P_ACT_SNIFF	   // Radio.SetRxDutyCycle()
+};
+
+/** Radio state after an action */
+static const uint8_t p2p_action_state[] = {P2P_STATE_SLEEP, P2P_STATE_RX, P2P_STATE_RX, P2P_STATE_CAD, P2P_STATE_TX, P2P_STATE_SNIFF};
+
+/** Action per event and RX mode */
+static const uint8_t p2p_actions[P2P_EV_NUM][P2P_RX_MODES] = {
+	/*               RX_MODE_NONE | RX_MODE_RX | RX_MODE_RX_TIMED | RX_MODE_RX_WAIT | RX_MODE_RX_SNIFF */
+	/* MODE       */ {P2P_ACT_SLEEP, P2P_ACT_RX, P2P_ACT_RX_TIMED, P2P_ACT_RX, P2P_ACT_SNIFF},
+	/* TX_START   */ {P2P_ACT_CAD, P2P_ACT_CAD, P2P_ACT_CAD, P2P_ACT_CAD, P2P_ACT_CAD},
+	/* CAD_FREE   */ {P2P_ACT_SEND, P2P_ACT_SEND, P2P_ACT_SEND, P2P_ACT_SEND, P2P_ACT_SEND},
+	/* CAD_BUSY   */ {P2P_ACT_SLEEP, P2P_ACT_RX, P2P_ACT_SLEEP, P2P_ACT_SLEEP, P2P_ACT_SNIFF},
+	/* TX_DONE    */ {P2P_ACT_SLEEP, P2P_ACT_RX, P2P_ACT_RX_TIMED, P2P_ACT_RX, P2P_ACT_SNIFF},
+	/* TX_TIMEOUT */ {P2P_ACT_SLEEP, P2P_ACT_RX, P2P_ACT_SLEEP, P2P_ACT_SLEEP, P2P_ACT_SNIFF},
+	/* RX_DONE    */ {P2P_ACT_SLEEP, P2P_ACT_RX, P2P_ACT_SLEEP, P2P_ACT_SLEEP, P2P_ACT_SNIFF},
+	/* RX_TIMEOUT */ {P2P_ACT_SLEEP, P2P_ACT_RX, P2P_ACT_SLEEP, P2P_ACT_SLEEP, P2P_ACT_SNIFF},
+	/* RX_ERROR   */ {P2P_ACT_SLEEP, P2P_ACT_RX, P2P_ACT_SLEEP, P2P_ACT_SLEEP, P2P_ACT_SNIFF},
+};
+
+/** Names of the radio states */
+const char *p2p_state_names[P2P_STATE_NUM] = {"SLEEP", "RX", "CAD", "TX", "SNIFF"};
+#if API_DEBUG > 0
+/** Names of the events for the log output */
+static const char *p2p_event_names[P2P_EV_NUM] = {"MODE", "TX_START", "CAD_FREE", "CAD_BUSY", "TX_DONE", "TX_TIMEOUT", "RX_DONE", "RX_TIMEOUT", "RX_ERROR"};
+#endif
+
+/** Current radio state */
+static volatile uint8_t p2p_state = P2P_STATE_SLEEP;
+/** Time the current state was entered */
+static uint32_t p2p_state_start = 0;
+/** Time spent in each state, without the current one */
+static uint32_t p2p_state_time[P2P_STATE_NUM] = {0};
+
+/** Last transitions */
+static s_p2p_transition p2p_log[API_P2P_LOG_SIZE];
+/** Number of transitions written into the log (wraps) */
+static uint16_t p2p_log_count = 0;
+
+/**
+ * @brief Start RX duty cycle mode
+ *    The radio listens for API_P2P_SNIFF_SYMBOLS symbols, then sleeps for the rest of the sniff period.
+ *    If a preamble is detected, the radio stays in RX until the packet is received.
+ *
+ */
+static void p2p_start_sniff(void)
+{
+	// SX126x duty cycle times are in steps of 15.625 us
+	uint32_t rx_time = (api_p2p_symbol_time() * API_P2P_SNIFF_SYMBOLS * 64 + 999) / 1000;
+	uint32_t period = g_lora_p2p_sniff_period * 64;
+	uint32_t sleep_time = period > rx_time ? period - rx_time : 1;
+	Radio.SetRxDutyCycle(rx_time, sleep_time);
+}
+
+/**
+ * @brief Execute a radio action
+ *
+ * @param action one of P2P_ACTION
+ */
+static void p2p_run_action(uint8_t action)
+{
+	switch (action)
+	{
+	default:
+	case P2P_ACT_SLEEP:
+		Radio.Sleep();
+		break;
+	case P2P_ACT_RX:
+		p2p_hop_tune(false);
+		Radio.Rx(0);
+		break;
+	case P2P_ACT_RX_TIMED:
+		p2p_hop_tune(false);
+		Radio.Rx(g_lora_p2p_rx_time);
+		break;
+	case P2P_ACT_CAD:
+		Radio.Sleep();
+		p2p_hop_tune(false);
+		Radio.SetCadParams(LORA_CAD_08_SYMBOL, api_p2p_sf() + 13, 10, LORA_CAD_ONLY, 0);
+		Radio.StartCad();
+		break;
+	case P2P_ACT_SEND:
+		Radio.Send(g_tx_lora_data, g_tx_data_len);
+		break;
+	case P2P_ACT_SNIFF:
+		p2p_hop_tune(false);
+		p2p_start_sniff();
+		break;
+	}
+}
+
+/**
+ * @brief Handle an event of the LoRa P2P radio
+ *
+ * @param event one of P2P_EVENT
+ */
+void api_p2p_event(uint8_t event)
+{
+	if (event >= P2P_EV_NUM)
+	{
+		return;
+	}
+	uint8_t mode = g_lora_p2p_rx_mode < P2P_RX_MODES ? g_lora_p2p_rx_mode : (uint8_t)RX_MODE_NONE;
+	uint8_t action = p2p_actions[event][mode];
+	uint8_t from = p2p_state;
+	uint8_t to = p2p_action_state[action];
+
+	// Time accounting
+	uint32_t now = millis();
+	p2p_state_time[from] += now - p2p_state_start;
+	p2p_state_start = now;
+	p2p_state = to;
+
+	// Transition log
+	s_p2p_transition *entry = &p2p_log[p2p_log_count % API_P2P_LOG_SIZE];
+	entry->time = now;
+	entry->from = from;
+	entry->event = event;
+	entry->to = to;
+	p2p_log_count++;
+
+	API_LOG("P2P", "%s --%s--> %s", p2p_state_names[from], p2p_event_names[event], p2p_state_names[to]);
+
+	// A packet was on air, next packet uses the next channel of the hop sequence
+	if ((event == P2P_EV_TX_DONE) || (event == P2P_EV_RX_DONE) || (event == P2P_EV_RX_ERROR))
+	{
+		p2p_hop_next();
+	}
+
+	p2p_run_action(action);
+}
+
+/**
+ * @brief Get the current state of the LoRa P2P radio
+ *
+ * @return uint8_t one of P2P_STATE
+ */
+uint8_t api_p2p_state(void)
+{
+	return p2p_state;
+}
+
+/**
+ * @brief Get the time the LoRa P2P radio spent in a state
+ *
+ * @param state one of P2P_STATE
+ * @return uint32_t time in milliseconds since start or since api_p2p_state_reset()
+ */
+uint32_t api_p2p_state_time(uint8_t state)
+{
+	if (state >= P2P_STATE_NUM)
+	{
+		return 0;
+	}
+	uint32_t time = p2p_state_time[state];
+	if (state == p2p_state)
+	{
+		time += millis() - p2p_state_start;
+	}
+	return time;
+}
+
+/**
+ * @brief Clear the time accounting and the transition log
+ *
+ */
+void api_p2p_state_reset(void)
+{
+	memset(p2p_state_time, 0, sizeof(p2p_state_time));
+	p2p_state_start = millis();
+	p2p_log_count = 0;
+}
+
+/**
+ * @brief Get the last transitions of the LoRa P2P radio
+ *
+ * @param log array to copy the transitions into, oldest first
+ * @param max size of the array
+ * @return uint8_t number of transitions copied
+ */
+uint8_t api_p2p_log(s_p2p_transition *log, uint8_t max)
+{
+	uint16_t count = p2p_log_count < API_P2P_LOG_SIZE ? p2p_log_count : API_P2P_LOG_SIZE;
+	if (count > max)
+	{
+		count = max;
+	}
+	uint16_t first = p2p_log_count - count;
+	for (uint16_t idx = 0; idx < count; idx++)
+	{
+		log[idx] = p2p_log[(first + idx) % API_P2P_LOG_SIZE];
+	}
+	return count;
+}
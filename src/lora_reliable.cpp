@@ -0,0 +1,677 @@
+/**
+ * @file lora_reliable.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Reliable delivery for LoRa P2P with sequence numbers, ACKs, retransmission and duplicate suppression
+ * @version 0.1
+ * @date 2022-03-18
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+#if (API_REL_WINDOW < 1) || (API_REL_WINDOW > 8)
+#error "API_REL_WINDOW must be between 1 and 8"
+#endif
+#if (API_REL_PAYLOAD + REL_HEADER_SIZE) > 255
+#error "API_REL_PAYLOAD must be 249 or less"
+#endif
+
+/**
+ * Data frame: marker 'R' 'L' (2), REL_DATA (1), destination (1), source (1), sequence number (1), payload
+ * ACK frame:  marker 'R' 'L' (2), REL_ACK (1), destination (1), source (1), sequence number (1), bitmap (1)
+ *
+ * The receiver answers a data frame with an ACK while the sender listens after the frame. The ACK has
+ * the newest sequence number received from the sender and a bitmap of the 8 sequence numbers before it,
+ * bit 0 is newest - 1. With a window of more than one frame, a lost ACK is covered by the next one and
+ * only the frames that are not acknowledged are sent again. The receiver keeps the newest sequence
+ * number and a bitmap of the 32 before it per sender to drop duplicates. Duplicates are acknowledged again.
+ * Frames to REL_BROADCAST are sent once and not acknowledged.
+ */
+
+/** Marker of a frame of the reliable delivery */
+static const uint8_t rel_mark[2] = {'R', 'L'};
+/** Frame types */
+enum REL_FRAME
+{
+	REL_DATA = 1,
+	REL_ACK = 2
+};
+/** State of a TX slot */
+enum REL_SLOT_STATE
+{
+	REL_FREE = 0,
+	REL_QUEUED,	  // Waiting to be sent (again)
+	REL_WAIT_ACK, // Sent, waiting for the ACK
+	REL_DONE	  // Finished, callback is pending
+};
+
+/** Frame waiting for delivery */
+struct s_rel_slot
+{
+	uint16_t handle;
+	uint8_t state;
+	uint8_t dst;
+	uint8_t seq;
+	uint8_t size;
+	uint8_t retries;
+	uint8_t result;
+	bool sent;
+	uint32_t deadline;
+	tx_done_cb_t callback;
+	uint8_t data[API_REL_PAYLOAD];
+};
+
+/** Sequence numbers received from a sender */
+struct s_rel_peer
+{
+	uint8_t address;
+	uint8_t seq;
+	bool ack_pending;
+	uint32_t received;
+	uint32_t last_rx;
+};
+
+/** Own address, 0 = reliable delivery is off */
+static uint8_t rel_address = 0;
+/** Max number of frames on air without ACK */
+static uint8_t rel_window = 1;
+/** Frames waiting for delivery */
+static s_rel_slot rel_slots[API_REL_WINDOW];
+/** Senders of received frames */
+static s_rel_peer rel_peers[API_REL_PEERS];
+/** Next sequence number */
+static uint8_t rel_next_seq = 0;
+/** Last handle given out */
+static uint16_t rel_last_handle = 0;
+/** Flag if a frame of the reliable delivery is on air */
+static volatile bool rel_sending = false;
+/** Slot of the data frame on air, -1 for an ACK */
+static int8_t rel_sending_slot = -1;
+/** Flag if the RX mode was changed to listen for ACKs */
+static bool rel_rx_override = false;
+/** Scheduler job of rel_pump() */
+static uint8_t rel_job = 0;
+/** Frame that is sent */
+static uint8_t rel_frame[REL_HEADER_SIZE + API_REL_PAYLOAD];
+/** Statistics */
+static s_rel_stats rel_stats;
+
+static void rel_pump(void);
+
+/**
+ * @brief Run rel_pump() in the loop task
+ *
+ * @param delay_ms time until it runs
+ */
+static void rel_schedule(uint32_t delay_ms)
+{
+	if ((rel_job == 0) || !api_schedule_change(rel_job, delay_ms))
+	{
+		rel_job = api_schedule_callback(rel_pump, delay_ms);
+	}
+}
+
+/**
+ * @brief Time to wait for the ACK after a data frame was sent
+ *
+ * @return uint32_t time in ms
+ */
+static uint32_t rel_ack_wait(void)
+{
+	return api_p2p_airtime(REL_ACK_SIZE) / 1000 + API_REL_ACK_WAIT;
+}
+
+/**
+ * @brief Listen for the ACKs if the application does not listen
+ *
+ * @param on true to listen after data frames, false to go back to the RX mode of the application
+ */
+static void rel_listen(bool on)
+{
+	if (on && (g_lora_p2p_rx_mode == RX_MODE_NONE))
+	{
+		rel_rx_override = true;
+		g_lora_p2p_rx_mode = RX_MODE_RX_TIMED;
+		g_lora_p2p_rx_time = rel_ack_wait();
+	}
+	else if (!on && rel_rx_override)
+	{
+		rel_rx_override = false;
+		if (g_lora_p2p_rx_mode == RX_MODE_RX_TIMED)
+		{
+			g_lora_p2p_rx_mode = RX_MODE_NONE;
+			uint8_t state = api_p2p_state();
+			if ((state != P2P_STATE_CAD) && (state != P2P_STATE_TX))
+			{
+				api_p2p_event(P2P_EV_MODE);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Finish a frame, the callback is called from rel_pump()
+ *
+ * @param slot slot of the frame
+ * @param result one of TX_RESULT
+ */
+static void rel_finish(s_rel_slot *slot, uint8_t result)
+{
+	slot->state = REL_DONE;
+	slot->result = result;
+	if (result == TX_RESULT_ACKED)
+	{
+		rel_stats.acked++;
+	}
+	else if (result != TX_RESULT_SENT)
+	{
+		rel_stats.failed++;
+	}
+}
+
+/**
+ * @brief Result of a frame sent by rel_pump()
+ *
+ * @param result true if the frame was sent
+ */
+static void rel_sent(bool result)
+{
+	rel_sending = false;
+	// Skip frames that finished while they were waiting for the channel, e.g. with the ACK of an earlier try
+	if ((rel_sending_slot >= 0) && (rel_slots[rel_sending_slot].state == REL_QUEUED))
+	{
+		s_rel_slot *slot = &rel_slots[rel_sending_slot];
+		slot->sent = true;
+		if (!result)
+		{
+			// Channel busy or TX timeout, counts as a try
+			if (slot->retries == 0)
+			{
+				rel_finish(slot, TX_RESULT_FAILED);
+			}
+			else
+			{
+				slot->retries--;
+			}
+		}
+		else if (slot->dst == REL_BROADCAST)
+		{
+			rel_finish(slot, TX_RESULT_SENT);
+		}
+		else
+		{
+			slot->state = REL_WAIT_ACK;
+			slot->deadline = millis() + rel_ack_wait();
+		}
+	}
+	rel_sending_slot = -1;
+	rel_schedule(1);
+}
+
+/**
+ * @brief Send the ACK for a sender
+ *
+ * @param peer sender of the acknowledged frames
+ * @return true if the ACK is sent
+ */
+static bool rel_send_ack(s_rel_peer *peer)
+{
+	rel_frame[0] = rel_mark[0];
+	rel_frame[1] = rel_mark[1];
+	rel_frame[2] = REL_ACK;
+	rel_frame[3] = peer->address;
+	rel_frame[4] = rel_address;
+	rel_frame[5] = peer->seq;
+	rel_frame[6] = (uint8_t)peer->received;
+	rel_sending_slot = -1;
+	rel_sending = true;
+	if (!p2p_send_frame(rel_frame, REL_ACK_SIZE, rel_sent))
+	{
+		rel_sending = false;
+		return false;
+	}
+	peer->ack_pending = false;
+	return true;
+}
+
+/**
+ * @brief Send a data frame
+ *
+ * @param idx slot of the frame
+ * @return true if the frame is sent
+ */
+static bool rel_send_data(uint8_t idx)
+{
+	s_rel_slot *slot = &rel_slots[idx];
+	rel_frame[0] = rel_mark[0];
+	rel_frame[1] = rel_mark[1];
+	rel_frame[2] = REL_DATA;
+	rel_frame[3] = slot->dst;
+	rel_frame[4] = rel_address;
+	rel_frame[5] = slot->seq;
+	memcpy(&rel_frame[REL_HEADER_SIZE], slot->data, slot->size);
+	if (slot->dst != REL_BROADCAST)
+	{
+		rel_listen(true);
+	}
+	rel_sending_slot = idx;
+	rel_sending = true;
+	if (!p2p_send_frame(rel_frame, REL_HEADER_SIZE + slot->size, rel_sent))
+	{
+		rel_sending = false;
+		rel_sending_slot = -1;
+		return false;
+	}
+	if (slot->sent)
+	{
+		rel_stats.retransmits++;
+	}
+	else
+	{
+		rel_stats.sent++;
+	}
+	return true;
+}
+
+/**
+ * @brief Handle timeouts, callbacks and the next frame to be sent
+ *    Runs in the loop task
+ *
+ */
+static void rel_pump(void)
+{
+	rel_job = 0;
+	uint32_t now = millis();
+	uint8_t in_flight = 0;
+	uint8_t used = 0;
+	uint32_t next_run = 0xFFFFFFFF;
+
+	for (uint8_t idx = 0; idx < API_REL_WINDOW; idx++)
+	{
+		s_rel_slot *slot = &rel_slots[idx];
+		if ((slot->state == REL_WAIT_ACK) && ((int32_t)(now - slot->deadline) >= 0))
+		{
+			// No ACK, send it again
+			if (slot->retries == 0)
+			{
+				API_LOG("REL", "No ACK for %d from %d", slot->seq, slot->dst);
+				rel_finish(slot, TX_RESULT_NACKED);
+			}
+			else
+			{
+				slot->retries--;
+				slot->state = REL_QUEUED;
+			}
+		}
+		if (slot->state == REL_DONE)
+		{
+			uint16_t handle = slot->handle;
+			tx_done_cb_t callback = slot->callback;
+			uint8_t result = slot->result;
+			slot->state = REL_FREE;
+			slot->handle = 0;
+			if (callback != NULL)
+			{
+				callback(handle, result);
+			}
+		}
+		if (slot->state == REL_WAIT_ACK)
+		{
+			uint32_t wait_time = slot->deadline - now;
+			next_run = wait_time < next_run ? wait_time : next_run;
+		}
+		if ((slot->state == REL_WAIT_ACK) || ((slot->state == REL_QUEUED) && slot->sent))
+		{
+			in_flight++;
+		}
+		if (slot->state != REL_FREE)
+		{
+			used++;
+		}
+	}
+
+	if (!rel_sending)
+	{
+		// ACKs first, the sender listens only for a short time
+		bool busy = false;
+		for (uint8_t idx = 0; idx < API_REL_PEERS; idx++)
+		{
+			if (rel_peers[idx].ack_pending)
+			{
+				busy = !rel_send_ack(&rel_peers[idx]);
+				break;
+			}
+		}
+		if (!rel_sending && !busy)
+		{
+			// Oldest frame first, new frames only if the window is not full
+			int8_t next = -1;
+			for (uint8_t idx = 0; idx < API_REL_WINDOW; idx++)
+			{
+				s_rel_slot *slot = &rel_slots[idx];
+				if ((slot->state != REL_QUEUED) || (!slot->sent && (in_flight >= rel_window)))
+				{
+					continue;
+				}
+				if ((next < 0) || ((uint8_t)(rel_next_seq - slot->seq) > (uint8_t)(rel_next_seq - rel_slots[next].seq)))
+				{
+					next = idx;
+				}
+			}
+			if (next >= 0)
+			{
+				busy = !rel_send_data(next);
+			}
+		}
+		if (busy)
+		{
+			// TX buffer is used by the application
+			next_run = next_run < API_REL_BUSY_RETRY ? next_run : API_REL_BUSY_RETRY;
+		}
+	}
+
+	if (used == 0)
+	{
+		rel_listen(false);
+	}
+	if (next_run != 0xFFFFFFFF)
+	{
+		rel_schedule(next_run == 0 ? 1 : next_run);
+	}
+}
+
+/**
+ * @brief Enable the reliable delivery for LoRa P2P
+ *
+ * @param address own address 1 to 254, 0 to switch it off
+ * @param window max number of frames on air without ACK, 1 to API_REL_WINDOW
+ * @return true if the settings were accepted
+ * @return false if the address or window is invalid or the device is in LoRaWAN mode
+ */
+bool api_p2p_reliable(uint8_t address, uint8_t window)
+{
+	if (g_lorawan_settings.lorawan_enable || (address == REL_BROADCAST) || (window == 0) || (window > API_REL_WINDOW))
+	{
+		return false;
+	}
+	if ((address == 0) || (address != rel_address))
+	{
+		// Frames of the old address are dropped
+		for (uint8_t idx = 0; idx < API_REL_WINDOW; idx++)
+		{
+			if ((rel_slots[idx].state != REL_FREE) && (rel_slots[idx].state != REL_DONE))
+			{
+				rel_finish(&rel_slots[idx], TX_RESULT_FAILED);
+			}
+		}
+		memset(rel_peers, 0, sizeof(rel_peers));
+		rel_schedule(1);
+	}
+	if (rel_address == 0)
+	{
+		// Different start on each device and after each reset
+		rel_next_seq = random(0, 256);
+	}
+	rel_address = address;
+	rel_window = window;
+	return true;
+}
+
+/**
+ * @brief Get the settings of the reliable delivery
+ *
+ * @param address set to the own address, 0 if off
+ * @param window set to the max number of frames on air without ACK
+ */
+void api_p2p_reliable_get(uint8_t *address, uint8_t *window)
+{
+	*address = rel_address;
+	*window = rel_window;
+}
+
+/**
+ * @brief Send a frame with reliable delivery
+ *    Must be called from the loop task. The data is copied, the buffer can be reused after the call
+ *
+ * @param dst address of the receiver, REL_BROADCAST to send once without ACK
+ * @param data data to be sent
+ * @param size size of the data, max API_REL_PAYLOAD
+ * @param retries number of retries if the frame is not acknowledged
+ * @param callback called with TX_RESULT_ACKED, TX_RESULT_NACKED, TX_RESULT_FAILED or TX_RESULT_SENT (broadcast), can be NULL
+ * @return uint16_t handle of the frame, 0 if reliable delivery is off, all slots are used or the data is too large
+ */
+uint16_t api_p2p_send_reliable(uint8_t dst, uint8_t *data, uint8_t size, uint8_t retries, tx_done_cb_t callback)
+{
+	if ((rel_address == 0) || (dst == 0) || (size > API_REL_PAYLOAD))
+	{
+		return 0;
+	}
+	for (uint8_t idx = 0; idx < API_REL_WINDOW; idx++)
+	{
+		s_rel_slot *slot = &rel_slots[idx];
+		if (slot->state != REL_FREE)
+		{
+			continue;
+		}
+		rel_last_handle++;
+		if (rel_last_handle == 0)
+		{
+			rel_last_handle = 1;
+		}
+		slot->handle = rel_last_handle;
+		slot->dst = dst;
+		slot->seq = rel_next_seq++;
+		slot->size = size;
+		slot->retries = retries;
+		slot->sent = false;
+		slot->callback = callback;
+		memcpy(slot->data, data, size);
+		slot->state = REL_QUEUED;
+		rel_schedule(1);
+		return slot->handle;
+	}
+	API_LOG("REL", "All slots used");
+	return 0;
+}
+
+/**
+ * @brief Number of frames that are not finished yet
+ *
+ * @return uint8_t number of frames
+ */
+uint8_t api_p2p_reliable_pending(void)
+{
+	uint8_t count = 0;
+	for (uint8_t idx = 0; idx < API_REL_WINDOW; idx++)
+	{
+		if (rel_slots[idx].state != REL_FREE)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief Get the statistics of the reliable delivery
+ *
+ * @return const s_rel_stats* statistics
+ */
+const s_rel_stats *api_p2p_reliable_stats(void)
+{
+	return &rel_stats;
+}
+
+/**
+ * @brief Clear the statistics of the reliable delivery
+ *
+ */
+void api_p2p_reliable_stats_reset(void)
+{
+	memset(&rel_stats, 0, sizeof(rel_stats));
+}
+
+/**
+ * @brief Check a sequence number from a sender for a duplicate
+ *
+ * @param address sender
+ * @param seq sequence number
+ * @return s_rel_peer* entry of the sender, NULL if the frame is a duplicate
+ */
+static s_rel_peer *rel_check_seq(uint8_t address, uint8_t seq)
+{
+	s_rel_peer *peer = NULL;
+	s_rel_peer *oldest = &rel_peers[0];
+	for (uint8_t idx = 0; idx < API_REL_PEERS; idx++)
+	{
+		if (rel_peers[idx].address == address)
+		{
+			peer = &rel_peers[idx];
+			break;
+		}
+		if ((rel_peers[idx].address == 0) || ((oldest->address != 0) && ((int32_t)(rel_peers[idx].last_rx - oldest->last_rx) < 0)))
+		{
+			oldest = &rel_peers[idx];
+		}
+	}
+	uint32_t now = millis();
+	if (peer == NULL)
+	{
+		// New sender, replaces the one not heard for the longest time
+		peer = oldest;
+		peer->address = address;
+		peer->seq = seq;
+		peer->received = 0;
+		peer->ack_pending = false;
+		peer->last_rx = now;
+		return peer;
+	}
+	peer->last_rx = now;
+
+	int8_t diff = (int8_t)(seq - peer->seq);
+	if (diff > 0)
+	{
+		// Shift the bitmap to the new newest sequence number, the old newest one is bit diff - 1
+		peer->received = diff >= 32 ? 0 : peer->received << diff;
+		if (diff <= 32)
+		{
+			peer->received |= (uint32_t)1 << (diff - 1);
+		}
+		peer->seq = seq;
+		return peer;
+	}
+	if (diff == 0)
+	{
+		return NULL;
+	}
+	uint8_t bit = -diff - 1;
+	if (bit >= 32)
+	{
+		// Far behind, the sender was restarted
+		peer->seq = seq;
+		peer->received = 0;
+		return peer;
+	}
+	if (peer->received & ((uint32_t)1 << bit))
+	{
+		return NULL;
+	}
+	peer->received |= (uint32_t)1 << bit;
+	return peer;
+}
+
+/**
+ * @brief Handle a received ACK
+ *
+ * @param src sender of the ACK
+ * @param seq newest sequence number received by the sender of the ACK
+ * @param bitmap sequence numbers before seq received by the sender of the ACK
+ */
+static void rel_ack_rx(uint8_t src, uint8_t seq, uint8_t bitmap)
+{
+	for (uint8_t idx = 0; idx < API_REL_WINDOW; idx++)
+	{
+		s_rel_slot *slot = &rel_slots[idx];
+		if (((slot->state != REL_WAIT_ACK) && (slot->state != REL_QUEUED)) || !slot->sent || (slot->dst != src))
+		{
+			continue;
+		}
+		uint8_t behind = seq - slot->seq;
+		if ((behind == 0) || ((behind <= 8) && (bitmap & (1 << (behind - 1)))))
+		{
+			rel_finish(slot, TX_RESULT_ACKED);
+		}
+	}
+	rel_schedule(1);
+}
+
+/**
+ * @brief Check a received packet for a frame of the reliable delivery
+ *    Called from the RX done callback
+ *
+ * @param payload received packet
+ * @param size size of the packet
+ * @param rssi RSSI of the packet
+ * @param snr SNR of the packet
+ * @return true if it was a frame of the reliable delivery, the payload of new data frames is put into the RX ring
+ * @return false if it was a normal packet
+ */
+bool p2p_reliable_rx(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr)
+{
+	if ((rel_address == 0) || (size < REL_HEADER_SIZE) || (payload[0] != rel_mark[0]) || (payload[1] != rel_mark[1]))
+	{
+		return false;
+	}
+	uint8_t dst = payload[3];
+	uint8_t src = payload[4];
+	uint8_t seq = payload[5];
+	if ((src == 0) || (src == REL_BROADCAST) || ((dst != rel_address) && (dst != REL_BROADCAST)))
+	{
+		// Not for this device
+		return true;
+	}
+
+	if ((payload[2] == REL_ACK) && (size == REL_ACK_SIZE))
+	{
+		rel_ack_rx(src, seq, payload[6]);
+		return true;
+	}
+	if (payload[2] != REL_DATA)
+	{
+		return true;
+	}
+
+	if (api_rx_count() >= API_RX_SLOTS)
+	{
+		// No ACK, the sender tries again
+		API_LOG("REL", "RX ring full, frame dropped");
+		return true;
+	}
+	s_rel_peer *peer = rel_check_seq(src, seq);
+	if (peer == NULL)
+	{
+		rel_stats.duplicates++;
+	}
+	else
+	{
+		// The source address is passed in the fPort field
+		rel_stats.received++;
+		api_rx_put(&payload[REL_HEADER_SIZE], size - REL_HEADER_SIZE, rssi, snr, src);
+		api_wake_loop(LORA_DATA, size - REL_HEADER_SIZE);
+	}
+	if (dst != REL_BROADCAST)
+	{
+		// Duplicates are acknowledged again, the last ACK might be lost
+		for (uint8_t idx = 0; idx < API_REL_PEERS; idx++)
+		{
+			if (rel_peers[idx].address == src)
+			{
+				rel_peers[idx].ack_pending = true;
+			}
+		}
+		// Radio callbacks must not start a transmission, the ACK is sent from the loop task
+		rel_schedule(1);
+	}
+	return true;
+}
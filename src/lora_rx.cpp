@@ -0,0 +1,294 @@
+/**
+ * @file lora_rx.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Ring of received LoRa/LoRaWAN packets and the fPort handlers
+ * @version 0.1
+ * @date 2022-03-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+#if (API_RX_SLOTS < 1) || (API_RX_SLOTS > 128)
+#error "API_RX_SLOTS must be between 1 and 128"
+#endif
+// The 8 bit head and tail wrap at 256, slot index is only continuous if the size divides 256
+#if (API_RX_SLOTS & (API_RX_SLOTS - 1)) != 0
+#error "API_RX_SLOTS must be a power of 2"
+#endif
+
+/** Received packets. Written by the radio callbacks, read by the loop task */
+static s_rx_packet rx_ring[API_RX_SLOTS];
+/** Number of packets written into the ring (wraps) */
+static volatile uint8_t rx_head = 0;
+/** Number of packets released by the application (wraps) */
+static volatile uint8_t rx_tail = 0;
+
+/** Packet that is currently handed to the application */
+s_rx_packet *g_rx_packet = NULL;
+/** Number of packets lost because all slots were in use */
+volatile uint32_t g_rx_dropped = 0;
+
+/** Payload of the packet currently handed to the application */
+uint8_t *g_rx_lora_data = rx_ring[0].data;
+/** Length of the packet currently handed to the application */
+uint8_t g_rx_data_len = 0;
+
+/**
+ * @brief Store a received packet in the next free slot
+ *    Called from the radio callbacks, only one producer is allowed
+ *
+ * @param payload received data
+ * @param size size of received data
+ * @param rssi RSSI of the packet
+ * @param snr SNR of the packet
+ * @param fport LoRaWAN fPort, 0 for LoRa P2P
+ * @return true if the packet was stored
+ * @return false if all slots are in use, the packet is dropped
+ */
+bool api_rx_put(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr, uint8_t fport)
+{
+	uint8_t head = rx_head;
+	if ((uint8_t)(head - __atomic_load_n(&rx_tail, __ATOMIC_ACQUIRE)) >= API_RX_SLOTS)
+	{
+		g_rx_dropped++;
+		return false;
+	}
+	if (size > sizeof(rx_ring[0].data))
+	{
+		size = sizeof(rx_ring[0].data);
+	}
+
+	s_rx_packet *packet = &rx_ring[head % API_RX_SLOTS];
+	memcpy(packet->data, payload, size);
+	packet->len = size;
+	packet->rssi = rssi;
+	packet->snr = snr;
+	packet->fport = fport;
+	packet->timestamp = millis();
+	packet->timestamp_us = micros();
+
+	// Publish the packet
+	__atomic_store_n(&rx_head, (uint8_t)(head + 1), __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * @brief Get the oldest received packet without copying it
+ *    The packet stays valid until it is released with api_rx_release()
+ *
+ * @return s_rx_packet* pointer to the packet or NULL if no packet is waiting
+ */
+s_rx_packet *api_rx_borrow(void)
+{
+	uint8_t tail = rx_tail;
+	if (__atomic_load_n(&rx_head, __ATOMIC_ACQUIRE) == tail)
+	{
+		return NULL;
+	}
+	return &rx_ring[tail % API_RX_SLOTS];
+}
+
+/**
+ * @brief Return a borrowed packet to the ring
+ *    Packets must be released in the order they were borrowed
+ *
+ * @param packet the packet returned by api_rx_borrow()
+ */
+void api_rx_release(s_rx_packet *packet)
+{
+	if (packet == NULL)
+	{
+		return;
+	}
+	uint8_t tail = rx_tail;
+	if ((__atomic_load_n(&rx_head, __ATOMIC_ACQUIRE) == tail) || (packet != &rx_ring[tail % API_RX_SLOTS]))
+	{
+		// Not the oldest packet, nothing to release
+		return;
+	}
+	if (packet == g_rx_packet)
+	{
+		g_rx_packet = NULL;
+		g_rx_data_len = 0;
+	}
+	__atomic_store_n(&rx_tail, (uint8_t)(tail + 1), __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief Number of received packets waiting in the ring
+ *
+ * @return uint8_t number of packets
+ */
+uint8_t api_rx_count(void)
+{
+	return (uint8_t)(__atomic_load_n(&rx_head, __ATOMIC_ACQUIRE) - rx_tail);
+}
+
+/**
+ * @brief Hand the oldest packet to the application
+ *    Sets g_rx_packet and the legacy globals g_rx_lora_data, g_rx_data_len,
+ *    g_last_rssi, g_last_snr and g_last_fport
+ *
+ * @return true if a packet is available
+ * @return false if the ring is empty
+ */
+bool api_rx_deliver(void)
+{
+	g_rx_packet = api_rx_borrow();
+	if (g_rx_packet == NULL)
+	{
+		g_rx_data_len = 0;
+		return false;
+	}
+	g_rx_lora_data = g_rx_packet->data;
+	g_rx_data_len = g_rx_packet->len;
+	g_last_rssi = g_rx_packet->rssi;
+	g_last_snr = g_rx_packet->snr;
+	g_last_fport = g_rx_packet->fport;
+	return true;
+}
+
+/** Handler for a range of fPorts */
+struct s_port_handler
+{
+	uint8_t first; // 0 => entry is free
+	uint8_t last;
+	port_handler_t handler;
+};
+
+/** Registered fPort handlers */
+static s_port_handler port_handlers[API_PORT_HANDLERS];
+/** Latency of the downlinks handled by a port handler */
+static s_rx_latency rx_latency;
+
+/**
+ * @brief Register a handler for LoRaWAN downlinks on a range of fPorts
+ *    Downlinks on these fPorts are handed to the handler in the loop task before any other event
+ *    handling and don't go to lora_data_handler(). Downlinks are handled in the order they were received.
+ *    The packet with payload, RSSI and SNR stays in the RX ring until the handler returns, copy the data if it is needed later.
+ *    If ranges overlap, the handler with the smallest range is used.
+ *
+ * @param first first fPort 1 to 255
+ * @param last last fPort, first to 255
+ * @param handler function to call, NULL to remove the handler of this range
+ * @return true if the handler was registered or removed
+ * @return false if the range is invalid or all API_PORT_HANDLERS entries are used
+ */
+bool api_register_port_range(uint8_t first, uint8_t last, port_handler_t handler)
+{
+	if ((first == 0) || (last < first))
+	{
+		return false;
+	}
+	int8_t free_entry = -1;
+	for (uint8_t idx = 0; idx < API_PORT_HANDLERS; idx++)
+	{
+		if ((port_handlers[idx].first == first) && (port_handlers[idx].last == last))
+		{
+			if (handler == NULL)
+			{
+				port_handlers[idx].first = 0;
+			}
+			port_handlers[idx].handler = handler;
+			return true;
+		}
+		if ((port_handlers[idx].first == 0) && (free_entry < 0))
+		{
+			free_entry = idx;
+		}
+	}
+	if (handler == NULL)
+	{
+		return true;
+	}
+	if (free_entry < 0)
+	{
+		API_LOG("RX", "No free port handler for ports %d to %d", first, last);
+		return false;
+	}
+	port_handlers[free_entry].handler = handler;
+	port_handlers[free_entry].last = last;
+	port_handlers[free_entry].first = first;
+	return true;
+}
+
+/**
+ * @brief Register a handler for LoRaWAN downlinks on an fPort
+ *    Same as api_register_port_range() with a range of one fPort
+ *
+ * @param port fPort 1 to 255
+ * @param handler function to call, NULL to remove the handler
+ * @return true if the handler was registered or removed
+ * @return false if the port is invalid or all API_PORT_HANDLERS entries are used
+ */
+bool api_register_port_handler(uint8_t port, port_handler_t handler)
+{
+	return api_register_port_range(port, port, handler);
+}
+
+/**
+ * @brief Hand the packet in g_rx_packet to the handler of its fPort
+ *    Called by the loop task after api_rx_deliver()
+ *
+ * @return true if a handler took the packet, it can be released
+ * @return false if there is no handler, the packet goes to lora_data_handler()
+ */
+bool api_rx_dispatch(void)
+{
+	if ((g_rx_packet == NULL) || !g_lorawan_settings.lorawan_enable || (g_rx_packet->fport == 0))
+	{
+		return false;
+	}
+	// Find the smallest range with the fPort
+	int8_t found = -1;
+	uint8_t fport = g_rx_packet->fport;
+	for (uint8_t idx = 0; idx < API_PORT_HANDLERS; idx++)
+	{
+		if ((port_handlers[idx].first == 0) || (fport < port_handlers[idx].first) || (fport > port_handlers[idx].last) || (port_handlers[idx].handler == NULL))
+		{
+			continue;
+		}
+		if ((found < 0) || ((port_handlers[idx].last - port_handlers[idx].first) < (port_handlers[found].last - port_handlers[found].first)))
+		{
+			found = idx;
+		}
+	}
+	if (found < 0)
+	{
+		return false;
+	}
+
+	uint32_t latency = micros() - g_rx_packet->timestamp_us;
+	rx_latency.count++;
+	rx_latency.last_us = latency;
+	// Moving average over 8 downlinks, the first one sets it
+	rx_latency.avg_us = rx_latency.count == 1 ? latency : rx_latency.avg_us - (rx_latency.avg_us / 8) + (latency / 8);
+	if (latency > rx_latency.max_us)
+	{
+		rx_latency.max_us = latency;
+	}
+	port_handlers[found].handler(g_rx_packet);
+	return true;
+}
+
+/**
+ * @brief Get the latency of the downlinks handled by a port handler
+ *
+ * @param latency set to the number of downlinks and the last, average and max time
+ *    from the radio callback to the handler in us
+ */
+void api_rx_latency(s_rx_latency *latency)
+{
+	memcpy(latency, &rx_latency, sizeof(s_rx_latency));
+}
+
+/**
+ * @brief Clear the latency statistics
+ *
+ */
+void api_rx_latency_reset(void)
+{
+	memset(&rx_latency, 0, sizeof(s_rx_latency));
+}
@@ -0,0 +1,325 @@
+/**
+ * @file lora_tdma.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Time slots (TDMA) for LoRa P2P with beacon synchronization
+ * @version 0.1
+ * @date 2022-03-13
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/**
+ * The coordinator sends a beacon at the start of every frame. The beacon has the number of slots,
+ * a frame counter, the frame length and the length of the beacon slot. After the beacon slot the
+ * frame is split into equal TX slots. A node takes its slot from its DevEUI (or a fixed slot) and
+ * sends only in its slot. Between its slot and the next beacon window the radio of a node sleeps.
+ * All timing runs on the API scheduler. Beacons are not passed to the application.
+ */
+
+/** Marker of a beacon */
+static const uint8_t tdma_mark[2] = {'T', 'B'};
+
+/** Role of this device, one of TDMA_ROLE */
+static uint8_t tdma_role = TDMA_OFF;
+/** Frame length in ms */
+static uint32_t tdma_frame_ms = 0;
+/** Length of the beacon slot in ms */
+static uint16_t tdma_beacon_slot = API_TDMA_BEACON_SLOT;
+/** Number of TX slots per frame */
+static uint8_t tdma_slots = 0;
+/** Fixed TX slot or TDMA_AUTO_SLOT */
+static uint8_t tdma_slot_cfg = TDMA_AUTO_SLOT;
+/** Frame counter */
+static uint16_t tdma_frame = 0;
+/** Start time of the current frame */
+static uint32_t tdma_frame_start = 0;
+/** Length of the beacon RX window in ms */
+static uint32_t tdma_window = 0;
+/** Flag if the node is in sync with the coordinator */
+static bool tdma_synced = false;
+/** Flag if a beacon was received since the last beacon window */
+static bool tdma_beacon_heard = false;
+/** Number of missed beacons in a row */
+static uint8_t tdma_missed = 0;
+/** Flag if a beacon is on air */
+static volatile bool tdma_beacon_sending = false;
+/** Scheduler job for the beacon (coordinator) or the beacon window (node) */
+static uint8_t tdma_job = 0;
+/** RX mode of the application, restored when TDMA is switched off */
+static uint8_t tdma_app_rx_mode = RX_MODE_NONE;
+/** RX time of the application, restored when TDMA is switched off */
+static uint32_t tdma_app_rx_time = 0;
+
+/**
+ * @brief Get the TX slot of this node
+ *
+ * @return uint8_t slot number
+ */
+static uint8_t tdma_slot(void)
+{
+	if (tdma_slots == 0)
+	{
+		return 0;
+	}
+	if (tdma_slot_cfg != TDMA_AUTO_SLOT)
+	{
+		return tdma_slot_cfg % tdma_slots;
+	}
+	// FNV-1a hash of the DevEUI
+	uint32_t hash = 2166136261UL;
+	for (uint8_t idx = 0; idx < 8; idx++)
+	{
+		hash ^= g_lorawan_settings.node_device_eui[idx];
+		hash *= 16777619UL;
+	}
+	return hash % tdma_slots;
+}
+
+/**
+ * @brief Coordinator, send the beacon at the start of a frame
+ *    The beacon slot belongs to the coordinator, the beacon is sent without CAD
+ *
+ */
+static void tdma_send_beacon(void)
+{
+	tdma_frame++;
+	tdma_frame_start = millis();
+
+	uint8_t *beacon = api_tx_acquire();
+	if (beacon == NULL)
+	{
+		API_LOG("TDMA", "TX buffer busy, beacon %d skipped", tdma_frame);
+		return;
+	}
+	beacon[0] = tdma_mark[0];
+	beacon[1] = tdma_mark[1];
+	beacon[2] = tdma_slots;
+	beacon[3] = (uint8_t)(tdma_frame);
+	beacon[4] = (uint8_t)(tdma_frame >> 8);
+	beacon[5] = (uint8_t)(tdma_frame_ms);
+	beacon[6] = (uint8_t)(tdma_frame_ms >> 8);
+	beacon[7] = (uint8_t)(tdma_frame_ms >> 16);
+	beacon[8] = (uint8_t)(tdma_frame_ms >> 24);
+	beacon[9] = (uint8_t)(tdma_beacon_slot);
+	beacon[10] = (uint8_t)(tdma_beacon_slot >> 8);
+	api_tx_start(beacon, TDMA_BEACON_SIZE);
+	tdma_beacon_sending = true;
+	api_p2p_event(P2P_EV_CAD_FREE);
+}
+
+/**
+ * @brief Node, open the beacon window
+ *    If the beacon is received, the next window is scheduled from the beacon.
+ *    Otherwise this job runs again one frame later. After API_TDMA_MAX_MISSED missed beacons
+ *    the node listens continuously until it gets a beacon again.
+ *
+ */
+static void tdma_listen(void)
+{
+	if (!tdma_beacon_heard)
+	{
+		tdma_missed++;
+		if (tdma_missed >= API_TDMA_MAX_MISSED)
+		{
+			API_LOG("TDMA", "Lost sync");
+			tdma_synced = false;
+			tdma_job = 0;
+			g_lora_p2p_rx_mode = RX_MODE_RX;
+			api_p2p_event(P2P_EV_MODE);
+			return;
+		}
+	}
+	tdma_beacon_heard = false;
+	tdma_frame_start += tdma_frame_ms;
+	tdma_job = api_schedule_callback(tdma_listen, tdma_frame_ms);
+
+	uint8_t state = api_p2p_state();
+	if ((state != P2P_STATE_CAD) && (state != P2P_STATE_TX))
+	{
+		api_p2p_event(P2P_EV_MODE);
+	}
+}
+
+/**
+ * @brief Node, start the deferred packet in the TX slot
+ *
+ */
+static void tdma_tx_slot(void)
+{
+	api_p2p_event(P2P_EV_TX_START);
+}
+
+/**
+ * @brief Set the TDMA role
+ *
+ * @param role TDMA_OFF, TDMA_COORDINATOR or TDMA_NODE
+ * @param frame_ms frame length in ms, coordinator only
+ * @param slots number of TX slots per frame, coordinator only
+ * @return true if the role was set
+ * @return false if the frame is too short for the beacon slot and the TX slots
+ */
+bool api_p2p_tdma(uint8_t role, uint32_t frame_ms, uint8_t slots)
+{
+	if (role == TDMA_COORDINATOR)
+	{
+		if ((slots == 0) || (frame_ms <= API_TDMA_BEACON_SLOT) || ((frame_ms - API_TDMA_BEACON_SLOT) / slots < 4 * API_TDMA_GUARD))
+		{
+			return false;
+		}
+	}
+	else if (role != TDMA_NODE)
+	{
+		role = TDMA_OFF;
+	}
+
+	api_schedule_cancel(tdma_job);
+	tdma_job = 0;
+	if (tdma_role == TDMA_NODE)
+	{
+		g_lora_p2p_rx_mode = tdma_app_rx_mode;
+		g_lora_p2p_rx_time = tdma_app_rx_time;
+	}
+	tdma_role = role;
+	tdma_synced = false;
+
+	switch (role)
+	{
+	case TDMA_COORDINATOR:
+		tdma_frame_ms = frame_ms;
+		tdma_slots = slots;
+		tdma_beacon_slot = API_TDMA_BEACON_SLOT;
+		tdma_synced = true;
+		tdma_job = api_schedule_callback(tdma_send_beacon, 1, frame_ms);
+		break;
+	case TDMA_NODE:
+		// Listen until the first beacon is received
+		tdma_app_rx_mode = g_lora_p2p_rx_mode;
+		tdma_app_rx_time = g_lora_p2p_rx_time;
+		g_lora_p2p_rx_mode = RX_MODE_RX;
+		api_p2p_event(P2P_EV_MODE);
+		break;
+	default:
+		api_p2p_event(P2P_EV_MODE);
+		break;
+	}
+	return true;
+}
+
+/**
+ * @brief Set the TX slot of a node
+ *
+ * @param slot slot number or TDMA_AUTO_SLOT to calculate the slot from the DevEUI
+ */
+void api_p2p_tdma_slot(uint8_t slot)
+{
+	tdma_slot_cfg = slot;
+}
+
+/**
+ * @brief Get the TDMA status
+ *
+ * @param status filled with role, timing, slot and sync state
+ */
+void api_p2p_tdma_status(s_tdma_status *status)
+{
+	status->role = tdma_role;
+	status->synced = tdma_synced;
+	status->slots = tdma_slots;
+	status->slot = tdma_role == TDMA_NODE ? tdma_slot() : 0;
+	status->frame = tdma_frame;
+	status->frame_ms = tdma_frame_ms;
+}
+
+/**
+ * @brief Check a received packet for a beacon
+ *    Called from the RX done callback
+ *
+ * @param payload received packet
+ * @param size size of the packet
+ * @return true if it was a beacon, it is not passed to the application
+ * @return false if it was a normal packet
+ */
+bool p2p_tdma_rx(uint8_t *payload, uint16_t size)
+{
+	if ((tdma_role != TDMA_NODE) || (size != TDMA_BEACON_SIZE) || (payload[0] != tdma_mark[0]) || (payload[1] != tdma_mark[1]))
+	{
+		return false;
+	}
+	uint8_t slots = payload[2];
+	uint32_t frame_ms = (uint32_t)payload[5] | (uint32_t)payload[6] << 8 | (uint32_t)payload[7] << 16 | (uint32_t)payload[8] << 24;
+	uint16_t beacon_slot = (uint16_t)payload[9] | (uint16_t)payload[10] << 8;
+	if ((slots == 0) || (frame_ms <= beacon_slot))
+	{
+		return true;
+	}
+
+	// The frame started when the beacon was sent
+	uint32_t time_on_air = Radio.TimeOnAir(MODEM_LORA, size);
+	uint32_t now = millis();
+	tdma_frame_start = now - time_on_air;
+	tdma_frame = (uint16_t)payload[3] | (uint16_t)payload[4] << 8;
+	tdma_slots = slots;
+	tdma_frame_ms = frame_ms;
+	tdma_beacon_slot = beacon_slot;
+	tdma_window = time_on_air + 2 * API_TDMA_GUARD;
+	tdma_beacon_heard = true;
+	tdma_missed = 0;
+
+	if (!tdma_synced)
+	{
+		API_LOG("TDMA", "Synced, %d slots, frame %ldms, slot %d", slots, (long)frame_ms, tdma_slot());
+		tdma_synced = true;
+	}
+	// Between the beacons the radio only listens after own packets
+	g_lora_p2p_rx_mode = RX_MODE_RX_TIMED;
+	g_lora_p2p_rx_time = tdma_window;
+
+	// Open the next beacon window a guard time before the beacon
+	api_schedule_cancel(tdma_job);
+	int32_t wait_time = (int32_t)(tdma_frame_start + tdma_frame_ms - API_TDMA_GUARD - now);
+	tdma_job = api_schedule_callback(tdma_listen, wait_time > 0 ? wait_time : 1);
+	return true;
+}
+
+/**
+ * @brief Check if a finished transmission was a beacon
+ *    Called from the TX done and TX timeout callbacks
+ *
+ * @return true if it was a beacon, the result is not passed to the application
+ * @return false if it was a packet of the application
+ */
+bool p2p_tdma_tx_done(void)
+{
+	if (!tdma_beacon_sending)
+	{
+		return false;
+	}
+	tdma_beacon_sending = false;
+	api_tx_finished();
+	return true;
+}
+
+/**
+ * @brief Delay a packet to the TX slot of this node
+ *    Called from send_p2p_packet(). Without sync the packet is sent right away.
+ *
+ * @return true if the packet is sent in the TX slot
+ * @return false if the packet has to be sent now
+ */
+bool p2p_tdma_defer(void)
+{
+	if ((tdma_role != TDMA_NODE) || !tdma_synced)
+	{
+		return false;
+	}
+	uint32_t slot_len = (tdma_frame_ms - tdma_beacon_slot) / tdma_slots;
+	uint32_t now = millis();
+	uint32_t start = tdma_frame_start + tdma_beacon_slot + tdma_slot() * slot_len + API_TDMA_GUARD;
+	while ((int32_t)(start - now) < 0)
+	{
+		start += tdma_frame_ms;
+	}
+	return api_schedule_callback(tdma_tx_slot, start == now ? 1 : start - now) != 0;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file lora_tx.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief TX buffer lease for LoRa/LoRaWAN packets
+ * @version 0.1
+ * @date 2022-03-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/** Buffer for LoRa/LoRaWAN data to be sent */
+uint8_t g_tx_lora_data[256];
+/** Length of data to be sent */
+uint8_t g_tx_data_len = 0;
+
+/** State of the TX buffer */
+enum TX_BUFFER_STATE
+{
+	TX_BUF_FREE = 0,
+	TX_BUF_LEASED = 1,
+	TX_BUF_SENDING = 2
+};
+static volatile uint8_t tx_buffer_state = TX_BUF_FREE;
+
+/**
+ * @brief Get the TX buffer to build a packet in place
+ *    The buffer is owned by the caller until api_tx_submit() or api_tx_release() is called
+ *
+ * @return uint8_t* pointer to the 256 byte TX buffer or NULL if the buffer is in use
+ */
+uint8_t *api_tx_acquire(void)
+{
+	if (tx_buffer_state != TX_BUF_FREE)
+	{
+		return NULL;
+	}
+	tx_buffer_state = TX_BUF_LEASED;
+	return g_tx_lora_data;
+}
+
+/**
+ * @brief Give the TX buffer back without sending it
+ *
+ */
+void api_tx_release(void)
+{
+	if (tx_buffer_state == TX_BUF_LEASED)
+	{
+		tx_buffer_state = TX_BUF_FREE;
+	}
+}
+
+/**
+ * @brief Send the content of the leased TX buffer
+ *    Uses LoRaWAN or LoRa P2P depending on the settings
+ *
+ * @param size number of bytes in the TX buffer
+ * @param fport fPort to be used, 0 to use the fPort from the settings (LoRaWAN only)
+ * @return lmh_error_status LMH_SUCCESS if the packet was accepted
+ *     LMH_BUSY if LoRaWAN is busy, LMH_ERROR if the buffer was not leased or sending failed
+ */
+lmh_error_status api_tx_submit(uint8_t size, uint8_t fport)
+{
+	if (tx_buffer_state != TX_BUF_LEASED)
+	{
+		API_LOG("LORA", "TX buffer was not acquired");
+		return LMH_ERROR;
+	}
+
+	if (g_lorawan_settings.lorawan_enable)
+	{
+		// The LoRaWAN MAC copies the payload into its frame buffer, the TX buffer is free after the request
+		lmh_error_status result = send_lora_packet(g_tx_lora_data, size, fport);
+		tx_buffer_state = TX_BUF_FREE;
+		return result;
+	}
+
+	// LoRa P2P sends the TX buffer after CAD, it stays in use until TX is finished
+	if (!send_p2p_packet(g_tx_lora_data, size))
+	{
+		tx_buffer_state = TX_BUF_FREE;
+		return LMH_ERROR;
+	}
+	return LMH_SUCCESS;
+}
+
+/**
+ * @brief Mark the TX buffer as used by a LoRa P2P transmission
+ *
+ * @param data data to be sent
+ * @param size size of the data
+ * @return true if the data is in the TX buffer
+ * @return false if the TX buffer is still used by another transmission
+ */
+bool api_tx_start(uint8_t *data, uint8_t size)
+{
+	if (data != g_tx_lora_data)
+	{
+		if (tx_buffer_state != TX_BUF_FREE)
+		{
+			return false;
+		}
+		memcpy(g_tx_lora_data, data, size);
+	}
+	g_tx_data_len = size;
+	tx_buffer_state = TX_BUF_SENDING;
+	return true;
+}
+
+/**
+ * @brief Free the TX buffer after a LoRa P2P transmission finished or failed
+ *
+ */
+void api_tx_finished(void)
+{
+	if (tx_buffer_state == TX_BUF_SENDING)
+	{
+		tx_buffer_state = TX_BUF_FREE;
+	}
+}
@@ -13,15 +13,6 @@
 /** LoRaWAN setting from flash */
 s_lorawan_settings g_lorawan_settings;
 
-/** Buffer for received LoRaWan data */
-uint8_t g_rx_lora_data[256];
-/** Length of received data */
-uint8_t g_rx_data_len = 0;
-/** Buffer for received LoRaWan data */
-uint8_t g_tx_lora_data[256];
-/** Length of received data */
-uint8_t g_tx_data_len = 0;
-
 /** RSSI of last received packet */
 int16_t g_last_rssi = 0;
 /** SNR of last received packet */
@@ -39,10 +30,8 @@ bool g_join_result = false;
 /**************************************************************/
 /* LoRaWAN properties                                            */
 /**************************************************************/
-/** LoRaWAN application data buffer. */
-static uint8_t m_lora_app_data_buffer[256];
-/** Lora application data structure. */
-static lmh_app_data_t m_lora_app_data = {m_lora_app_data_buffer, 0, 0, 0, 0};
+/** Lora application data structure, the buffer points to the data of the application */
+static lmh_app_data_t m_lora_app_data = {NULL, 0, 0, 0, 0};
 
 // LoRaWAN event handlers
 /** LoRaWAN callback when join network finished */
@@ -96,7 +85,7 @@ int8_t init_lorawan(void)
 #ifdef ESP32
 	pinMode(WB_IO2, OUTPUT);
 	digitalWrite(WB_IO2, HIGH);
-	delay(500);
+	api_delay(500);
 #endif
 
 	// Initialize LoRa chip.
@@ -142,9 +131,28 @@ int8_t init_lorawan(void)
 	// Initialize the app timer
 	api_timer_init();
 
+	// A saved OTAA session replaces the join
+	if (g_lorawan_settings.otaa_enabled && lorawan_session_restore())
+	{
+		API_LOG("LORA", "Session restored, skip join");
+		g_lorawan_initialized = true;
+		lpwan_joined_handler();
+		return 0;
+	}
+
 	API_LOG("LORA", "Start Join");
 	// Start Join process
-	lmh_join();
+	if (g_lorawan_settings.otaa_enabled)
+	{
+		// Failed joins are retried with back-off
+		lorawan_join_start();
+	}
+	else
+	{
+		lmh_join();
+		// ABP has no join, continue with the saved frame counters
+		lorawan_session_restore();
+	}
 
 	g_lorawan_initialized = true;
 	return 0;
@@ -160,12 +168,13 @@ void lpwan_join_fail_handler(void)
 {
 	API_LOG("LORA", "OTAA joined failed");
 	API_LOG("LORA", "Check LPWAN credentials and if a gateway is in range");
-	// Restart Join procedure
-	API_LOG("LORA", "Restart network join request");
 	g_join_result = false;
 
+	// Schedule the next join
+	lorawan_join_failed();
+
 	// Notify loop task
-	api_wake_loop(LORA_JOIN_FIN);
+	api_wake_loop(LORA_JOIN_FIN, g_join_result);
 }
 
 /**
@@ -180,34 +189,26 @@ static void lpwan_joined_handler(void)
 #if API_DEBUG > 0
 	if (g_lorawan_settings.otaa_enabled)
 	{
-		API_LOG("LORA", "OTAA joined and got dev address %08lX", otaaDevAddr);
+		API_LOG("LORA", "OTAA joined and got dev address %08lX", (unsigned long)otaaDevAddr);
 	}
 	else
 	{
 		API_LOG("LORA", "ABP joined");
 	}
-
-	delay(100); // Just to enable the serial port to send the message
 #endif
 
 	g_join_result = true;
 
 	// Notify loop task
-	api_wake_loop(LORA_JOIN_FIN);
-
-	delay(100); // Just to enable the serial port to send the message
+	api_wake_loop(LORA_JOIN_FIN, g_join_result);
 
 	g_lpwan_has_joined = true;
 
-	if (g_lorawan_settings.send_repeat_time != 0)
-	{
-		API_LOG("LORA", "Start timer");
-		delay(100); // Just to enable the serial port to send the message
-		// Now we are connected, start the timer that will wakeup the loop frequently
-		api_timer_start();
-		API_LOG("LORA", "Started timer");
-		delay(100); // Just to enable the serial port to send the message
-	}
+	// Stop join retries and keep the session for the next restart
+	lorawan_join_done();
+	lorawan_session_joined();
+
+	// The loop task starts the timer that will wakeup the loop frequently
 }
 
 /**
@@ -220,16 +221,18 @@ static void lpwan_rx_handler(lmh_app_data_t *app_data)
 	API_LOG("LORA", "LoRa Packet received on port %d, size:%d, rssi:%d, snr:%d",
 			app_data->port, app_data->buffsize, app_data->rssi, app_data->snr);
 
-	g_last_rssi = app_data->rssi;
-	g_last_snr = app_data->snr;
-	g_last_fport = app_data->port;
+	api_link_rx(app_data->rssi, app_data->snr);
+	lorawan_session_downlink();
 
-	// Copy the data into loop data buffer
-	memcpy(g_rx_lora_data, app_data->buffer, app_data->buffsize);
-	g_rx_data_len = app_data->buffsize;
-
-	// Notify loop task
-	api_wake_loop(LORA_DATA);
+	// Copy the data into the next free RX slot and notify loop task
+	if (api_rx_put(app_data->buffer, app_data->buffsize, app_data->rssi, app_data->snr, app_data->port))
+	{
+		api_wake_loop(LORA_DATA, app_data->buffsize);
+	}
+	else
+	{
+		API_LOG("LORA", "RX ring full, packet dropped");
+	}
 }
 
 /**
@@ -239,6 +242,8 @@ static void lpwan_rx_handler(lmh_app_data_t *app_data)
  */
 static void lpwan_class_confirm_handler(DeviceClass_t Class)
 {
+	// Only used by the log output
+	(void)Class;
 	API_LOG("LORA", "switch to class %c done", "ABC"[Class]);
 
 	g_lpwan_has_joined = true;
@@ -255,9 +260,12 @@ static void lpwan_unconfirm_tx_finished(void)
 {
 	API_LOG("LORA", "Uncomfirmed TX finished");
 	g_rx_fin_result = true;
+	tx_queue_result(TX_RESULT_SENT);
+	// A downlink with only MAC commands has no RX callback
+	lorawan_session_downlink();
 
 	// Notify loop task
-	api_wake_loop(LORA_TX_FIN);
+	api_wake_loop(LORA_TX_FIN, g_rx_fin_result);
 }
 
 /**
@@ -269,9 +277,16 @@ static void lpwan_confirm_tx_finished(bool result)
 {
 	API_LOG("LORA", "Comfirmed TX finished with result %s", result ? "ACK" : "NAK");
 	g_rx_fin_result = result;
+	tx_queue_result(result ? TX_RESULT_ACKED : TX_RESULT_NACKED);
+	if (!result)
+	{
+		// No ACK received, count as lost downlink
+		api_link_error(true);
+	}
+	lorawan_session_downlink();
 
 	// Notify loop task
-	api_wake_loop(LORA_TX_FIN);
+	api_wake_loop(LORA_TX_FIN, g_rx_fin_result);
 }
 
 /**
@@ -283,8 +298,23 @@ lmh_error_status send_lora_packet(uint8_t *data, uint8_t size, uint8_t fport)
 {
 	if (lmh_join_status_get() != LMH_SET)
 	{
-		// Not joined, try again later
-		API_LOG("LORA", "Did not join network, skip sending frame");
+		// Not joined, keep the frame in the journal if enabled
+		if (lorawan_journal_capture(data, size, fport))
+		{
+			API_LOG("LORA", "Did not join network, frame stored in journal");
+		}
+		else
+		{
+			API_LOG("LORA", "Did not join network, skip sending frame");
+		}
+		return LMH_ERROR;
+	}
+
+	uint8_t max_payload = api_max_payload();
+	if (size > max_payload)
+	{
+		// Too large for the current DR, use api_tx_fragment() for large payloads
+		API_LOG("LORA", "Packet with %d bytes too large, max %d bytes with current DR", size, max_payload);
 		return LMH_ERROR;
 	}
 
@@ -297,9 +327,19 @@ lmh_error_status send_lora_packet(uint8_t *data, uint8_t size, uint8_t fport)
 		m_lora_app_data.port = g_lorawan_settings.app_port;
 	}
 
+	// No copy needed, the LoRaWAN MAC copies the payload into its frame buffer
+	m_lora_app_data.buffer = data;
 	m_lora_app_data.buffsize = size;
 
-	memcpy(m_lora_app_data_buffer, data, size);
-
-	return lmh_send(&m_lora_app_data, g_lorawan_settings.confirmed_msg_enabled);
+	lmh_error_status result = lmh_send(&m_lora_app_data, g_lorawan_settings.confirmed_msg_enabled);
+	if (result == LMH_SUCCESS)
+	{
+		// ADR can change the data rate, use the one of the MAC
+		MibRequestConfirm_t mib_req;
+		mib_req.Type = MIB_CHANNELS_DATARATE;
+		LoRaMacMibGetRequestConfirm(&mib_req);
+		api_airtime_add(api_lorawan_airtime(g_lorawan_settings.lora_region, mib_req.Param.ChannelsDatarate, size));
+		lorawan_session_uplink();
+	}
+	return result;
 }
@@ -0,0 +1,280 @@
+/**
+ * @file lorawan_join.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief LoRaWAN join retries with randomized exponential back-off and data rate rotation
+ * @version 0.1
+ * @date 2022-03-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/**
+ * After a failed join the next join is scheduled after a back-off that starts with API_JOIN_BACKOFF_MIN
+ * and is doubled after each failed join up to API_JOIN_BACKOFF_MAX. The wait time is a random value
+ * between half and the full back-off, so devices that failed at the same time don't retry together.
+ * The wait time is never shorter than the join duty cycle of the LoRaWAN specification allows,
+ * 1% during the first 11 hours (36 s per hour), then 0.01% (8.7 s per 24 hours).
+ * Each retry uses the next lower data rate, down to API_JOIN_DR_SPAN below the configured one.
+ * The number of failed joins is saved in flash, after a reset the back-off continues.
+ */
+
+/** Join request size, api_lorawan_airtime() adds 13 bytes frame overhead for the 23 byte join request */
+#define JOIN_AIRTIME_SIZE 10
+/** Join duty cycle limit changes after 11 hours */
+#define JOIN_DUTY_PERIOD (11UL * 3600000UL)
+/** Failed joins that are saved, the back-off doesn't grow beyond it */
+#define JOIN_SAVED_ATTEMPTS 16
+
+/** Flag if failed joins are retried */
+static bool join_enabled = true;
+/** Join state, saved in flash */
+static s_join_state join_state;
+/** Flag if the join state was read from flash */
+static bool join_state_read = false;
+/** Failed joins since start, selects the data rate */
+static uint16_t join_tries = 0;
+/** Time of the first join since start */
+static uint32_t join_start_time = 0;
+/** Flag if the first join was started */
+static bool join_started = false;
+/** Data rate of the last join */
+static uint8_t join_datarate = 0;
+/** Scheduler job of the next join, 0 if none */
+static uint8_t join_job = 0;
+/** Time of the next join */
+static uint32_t join_next_time = 0;
+/** Wait time before the next join */
+static uint32_t join_interval = 0;
+
+/**
+ * @brief Save the join state if it changed
+ *    Failed joins are saved only up to JOIN_SAVED_ATTEMPTS to limit flash writes
+ *
+ * @param attempts failed joins
+ */
+static void join_save(uint16_t attempts)
+{
+	if (attempts > JOIN_SAVED_ATTEMPTS)
+	{
+		attempts = JOIN_SAVED_ATTEMPTS;
+	}
+	if (attempts == join_state.attempts)
+	{
+		return;
+	}
+	join_state.attempts = attempts;
+	if (!save_join_state(&join_state))
+	{
+		API_LOG("JOIN", "Failed to save the join state");
+	}
+}
+
+/**
+ * @brief Read the join state from flash once after start
+ *
+ */
+static void join_load(void)
+{
+	if (join_state_read)
+	{
+		return;
+	}
+	join_state_read = true;
+	s_join_state saved;
+	if (read_join_state(&saved) && (saved.valid_mark_1 == 0xAA) && (saved.valid_mark_2 == JOIN_STATE_MARKER))
+	{
+		join_state.attempts = saved.attempts;
+	}
+	API_LOG("JOIN", "%d failed joins before start", join_state.attempts);
+}
+
+/**
+ * @brief Data rate of a join
+ *    Starts with the configured data rate and steps down with each retry
+ *
+ * @return uint8_t data rate
+ */
+static uint8_t join_dr(void)
+{
+	uint8_t lowest = g_lorawan_settings.data_rate > API_JOIN_DR_SPAN ? g_lorawan_settings.data_rate - API_JOIN_DR_SPAN : 0;
+	return g_lorawan_settings.data_rate - (join_tries % (g_lorawan_settings.data_rate - lowest + 1));
+}
+
+/**
+ * @brief Wait time before the next join
+ *    Random value between half and the full back-off, at least the time the join duty cycle requires
+ *
+ * @param attempts failed joins
+ * @return uint32_t wait time in ms
+ */
+static uint32_t join_backoff(uint16_t attempts)
+{
+	uint32_t backoff = API_JOIN_BACKOFF_MIN;
+	for (uint16_t idx = 1; (idx < attempts) && (backoff < API_JOIN_BACKOFF_MAX); idx++)
+	{
+		backoff *= 2;
+	}
+	if (backoff > API_JOIN_BACKOFF_MAX)
+	{
+		backoff = API_JOIN_BACKOFF_MAX;
+	}
+	backoff = backoff / 2 + random(0, backoff / 2 + 1);
+
+	// Airtime of the last join with all its trials, the MAC sends join_trials requests per join
+	uint64_t airtime_us = (uint64_t)api_lorawan_airtime(g_lorawan_settings.lora_region, join_datarate, JOIN_AIRTIME_SIZE) * (g_lorawan_settings.join_trials == 0 ? 1 : g_lorawan_settings.join_trials);
+	uint32_t duty = (millis() - join_start_time) < JOIN_DUTY_PERIOD ? 100 : 10000;
+	uint64_t min_wait = airtime_us * duty / 1000;
+	if (min_wait > backoff)
+	{
+		backoff = min_wait > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)min_wait;
+	}
+	return backoff;
+}
+
+/**
+ * @brief Start a join
+ *    Called from the scheduler or directly from lorawan_join_start()
+ */
+static void join_attempt(void)
+{
+	join_job = 0;
+	if (lmh_join_status_get() == LMH_SET)
+	{
+		return;
+	}
+	if (!join_started)
+	{
+		join_started = true;
+		join_start_time = millis();
+	}
+	join_datarate = join_dr();
+	lmh_datarate_set(join_datarate, g_lorawan_settings.adr_enabled);
+	API_LOG("JOIN", "Start join %d with DR %d", join_tries + 1, join_datarate);
+	lmh_join();
+}
+
+/**
+ * @brief Schedule the next join
+ *    Called from the loop after a failed join, saves the join state
+ */
+static void join_retry(void)
+{
+	join_job = 0;
+	join_tries++;
+	join_save(join_state.attempts + 1);
+	if (!join_enabled)
+	{
+		return;
+	}
+	join_interval = join_backoff(join_state.attempts);
+	join_job = api_schedule_callback(join_attempt, join_interval);
+	join_next_time = millis() + join_interval;
+	API_LOG("JOIN", "Join failed %d times, next join in %ld ms", join_state.attempts, (long)join_interval);
+}
+
+/**
+ * @brief Clear the failed joins in flash after a successful join
+ *
+ */
+static void join_clear(void)
+{
+	join_save(0);
+}
+
+/**
+ * @brief Start joining the network
+ *    Called from init_lorawan() instead of lmh_join(). Joins at once if the last join was successful,
+ *    otherwise the back-off continues from the failed joins before the reset.
+ */
+void lorawan_join_start(void)
+{
+	join_load();
+	if (!join_enabled || (join_state.attempts == 0))
+	{
+		join_attempt();
+		return;
+	}
+	if (join_job != 0)
+	{
+		return;
+	}
+	join_datarate = join_dr();
+	join_interval = join_backoff(join_state.attempts);
+	join_job = api_schedule_callback(join_attempt, join_interval);
+	join_next_time = millis() + join_interval;
+	API_LOG("JOIN", "%d failed joins before reset, first join in %ld ms", join_state.attempts, (long)join_interval);
+}
+
+/**
+ * @brief Handle a failed join
+ *    Called from the join failed callback, the retry is scheduled from the loop
+ */
+void lorawan_join_failed(void)
+{
+	if (join_job != 0)
+	{
+		return;
+	}
+	join_job = api_schedule_callback(join_retry, 1);
+}
+
+/**
+ * @brief Handle a successful join
+ *    Called from the joined callback, the configured data rate is used again
+ */
+void lorawan_join_done(void)
+{
+	if (join_job != 0)
+	{
+		api_schedule_cancel(join_job);
+		join_job = 0;
+	}
+	if (join_started)
+	{
+		lmh_datarate_set(g_lorawan_settings.data_rate, g_lorawan_settings.adr_enabled);
+	}
+	join_tries = 0;
+	if (join_state.attempts != 0)
+	{
+		// Flash writes are done from the loop
+		api_schedule_callback(join_clear, 1);
+	}
+}
+
+/**
+ * @brief Enable or disable join retries
+ *    If disabled, a failed join is only reported with LORA_JOIN_FIN, the application has to restart the join
+ *
+ * @param enable true to retry failed joins (default)
+ */
+void api_join_retry(bool enable)
+{
+	join_enabled = enable;
+	if (!enable && (join_job != 0))
+	{
+		api_schedule_cancel(join_job);
+		join_job = 0;
+	}
+}
+
+/**
+ * @brief Get the state of the join retries
+ *
+ * @param status set to the state, next_attempt and interval are in ms
+ */
+void api_join_status(s_join_status *status)
+{
+	status->enabled = join_enabled;
+	status->pending = (join_job != 0) && (lmh_join_status_get() != LMH_SET);
+	status->attempts = join_state.attempts;
+	status->interval = join_interval;
+	status->datarate = join_datarate;
+	status->next_attempt = 0;
+	if (status->pending)
+	{
+		int32_t wait = (int32_t)(join_next_time - millis());
+		status->next_attempt = wait > 0 ? wait : 0;
+	}
+}
@@ -0,0 +1,806 @@
+/**
+ * @file lorawan_journal.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Journal in flash for LoRaWAN uplinks that could not be sent, replayed after the device joined
+ * @version 0.1
+ * @date 2022-03-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+#if API_TX_QUEUE_PAYLOAD > 246
+#error "API_TX_QUEUE_PAYLOAD must be 246 or less for the journal, the record size is 8 bit"
+#endif
+
+/**
+ * The journal is a ring of API_JOURNAL_SEGMENTS segment files "JR0" ... "JR7". Each segment starts with
+ * a 4 byte header (marker, version, 16 bit segment number) followed by up to API_JOURNAL_SEGMENT_RECORDS records.
+ * Record format: length, fPort, 32 bit time in seconds, payload, CRC-8 over all bytes before it.
+ * Segments are only appended. For each record that is sent or dropped one byte is appended to the
+ * ack file "JA0" ... "JA7" of the segment, a segment is deleted when all its records are done.
+ * A power loss while writing leaves a record with a wrong CRC at the end of the segment, the records
+ * before it are kept and new records go into the next segment.
+ * Records are replayed as new uplinks, the frame counter keeps counting up (see lorawan_session.cpp).
+ * The journal time is seconds since start or since api_journal_set_time(), after a reset it continues
+ * with the time of the newest record.
+ * The file names are only known here, the flash backends provide the file functions and a list of the files.
+ */
+
+/** Size of the record header (length, fPort, time) */
+#define JOURNAL_RECORD_HEADER 6
+/** Size of the segment header */
+#define JOURNAL_SEGMENT_HEADER 4
+/** Records that are checked for max age in one call of the pump */
+#define JOURNAL_EXPIRE_BATCH 8
+
+/** Flag if the journal is enabled */
+static bool journal_enabled = false;
+/** Flag if the age of a record is appended to the payload */
+static bool journal_send_age = false;
+/** Max age of a record in seconds, 0 = no limit */
+static uint32_t journal_max_age = 0;
+/** Flag if the journal was read from flash */
+static bool journal_loaded = false;
+/** Flag if the journal has no segments */
+static bool journal_empty = true;
+/** Oldest segment */
+static uint16_t journal_first = 0;
+/** Segment records are written to */
+static uint16_t journal_last = 0;
+/** Flag if the last segment can't be appended, e.g. after a power loss while writing */
+static bool journal_closed = false;
+/** Records per segment slot */
+static uint8_t journal_records[API_JOURNAL_SEGMENTS];
+/** Sent or dropped records per segment slot */
+static uint8_t journal_done[API_JOURNAL_SEGMENTS];
+/** Statistics since start */
+static uint32_t journal_stored = 0;
+static uint32_t journal_sent = 0;
+static uint32_t journal_dropped = 0;
+/** Record that is replayed */
+static uint8_t journal_buf[API_TX_QUEUE_PAYLOAD];
+static uint8_t journal_size = 0;
+/** Flag if a record is in the TX queue */
+static bool journal_inflight = false;
+/** Segment and index of the record in the TX queue */
+static uint16_t journal_inflight_segment = 0;
+static uint8_t journal_inflight_index = 0;
+/** Scheduler job of the next replay, 0 if none */
+static uint8_t journal_job = 0;
+/** Journal clock, seconds at journal_time_ms */
+static uint32_t journal_time_s = 0;
+static uint32_t journal_time_ms = 0;
+
+/**
+ * @brief CRC-8 (polynomial 0x07)
+ *
+ * @param crc start value
+ * @param data data
+ * @param size size of the data
+ * @return uint8_t CRC
+ */
+static uint8_t journal_crc(uint8_t crc, uint8_t *data, uint16_t size)
+{
+	for (uint16_t idx = 0; idx < size; idx++)
+	{
+		crc ^= data[idx];
+		for (uint8_t bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+		}
+	}
+	return crc;
+}
+
+/**
+ * @brief File names of a segment slot
+ *
+ * @param slot segment slot
+ * @param records set to the name of the segment file
+ * @param acks set to the name of the ack file
+ */
+static void journal_slot_names(uint16_t slot, char *records, char *acks)
+{
+	snprintf(records, 8, "JR%d", slot);
+	snprintf(acks, 8, "JA%d", slot);
+}
+
+/**
+ * @brief File names of a segment
+ *
+ * @param segment segment number
+ * @param records set to the name of the segment file
+ * @param acks set to the name of the ack file
+ */
+static void journal_names(uint16_t segment, char *records, char *acks)
+{
+	journal_slot_names(segment % API_JOURNAL_SEGMENTS, records, acks);
+}
+
+/**
+ * @brief Delete the files of a segment
+ *
+ * @param segment segment number
+ */
+static void journal_remove(uint16_t segment)
+{
+	char records[8];
+	char acks[8];
+	journal_names(segment, records, acks);
+	api_file_remove(records);
+	api_file_remove(acks);
+	journal_records[segment % API_JOURNAL_SEGMENTS] = 0;
+	journal_done[segment % API_JOURNAL_SEGMENTS] = 0;
+}
+
+/** Number of segment slots found in the file system by journal_list_file() */
+static uint16_t journal_found_slots = 0;
+
+/**
+ * @brief Check if a file belongs to the journal
+ *    Called by api_file_list(), finds the slots of a journal that had more segments as well
+ *
+ * @param filename name of the file
+ */
+static void journal_list_file(const char *filename)
+{
+	if ((filename[0] != 'J') || ((filename[1] != 'R') && (filename[1] != 'A')) || !isdigit(filename[2]))
+	{
+		return;
+	}
+	uint16_t slot = atoi(&filename[2]);
+	if ((slot < 1000) && (slot >= journal_found_slots))
+	{
+		journal_found_slots = slot + 1;
+	}
+}
+
+/**
+ * @brief Delete all files of the journal
+ *    Other files in the file system are kept
+ */
+static void journal_remove_all(void)
+{
+	journal_found_slots = API_JOURNAL_SEGMENTS;
+	api_file_list(journal_list_file);
+	char records[8];
+	char acks[8];
+	for (uint16_t slot = 0; slot < journal_found_slots; slot++)
+	{
+		journal_slot_names(slot, records, acks);
+		api_file_remove(records);
+		api_file_remove(acks);
+	}
+	memset(journal_records, 0, sizeof(journal_records));
+	memset(journal_done, 0, sizeof(journal_done));
+}
+
+/**
+ * @brief Read the next record from the open segment file
+ *
+ * @param buffer buffer for the record, at least JOURNAL_RECORD_HEADER + API_JOURNAL_PAYLOAD + 1 bytes
+ * @param end set to true if the file ends before the record, can be NULL
+ * @return uint8_t size of the record, 0 if there is no complete record with correct CRC
+ */
+static uint8_t journal_read_record(uint8_t *buffer, bool *end = NULL)
+{
+	uint16_t header = api_file_read(buffer, JOURNAL_RECORD_HEADER);
+	if (end != NULL)
+	{
+		*end = header == 0;
+	}
+	if ((header != JOURNAL_RECORD_HEADER) || (buffer[0] == 0) || (buffer[0] > API_JOURNAL_PAYLOAD))
+	{
+		return 0;
+	}
+	uint8_t size = JOURNAL_RECORD_HEADER + buffer[0];
+	if (api_file_read(&buffer[JOURNAL_RECORD_HEADER], buffer[0] + 1) != buffer[0] + 1)
+	{
+		return 0;
+	}
+	if (journal_crc(0, buffer, size) != buffer[size])
+	{
+		return 0;
+	}
+	return size;
+}
+
+/**
+ * @brief Read the header and count the records of a segment slot
+ *
+ * @param slot segment slot
+ * @param segment set to the segment number
+ * @param newest set to the time of the newest record
+ * @param torn set to true if the segment ends with an incomplete record
+ * @return true if the slot has a valid segment
+ */
+static bool journal_scan_slot(uint8_t slot, uint16_t *segment, uint32_t *newest, bool *torn)
+{
+	char records[8];
+	char acks[8];
+	journal_names(slot, records, acks);
+	if (!api_file_open_read(records))
+	{
+		return false;
+	}
+	uint8_t buffer[JOURNAL_RECORD_HEADER + API_JOURNAL_PAYLOAD + 1];
+	if ((api_file_read(buffer, JOURNAL_SEGMENT_HEADER) != JOURNAL_SEGMENT_HEADER) || (buffer[0] != JOURNAL_MARKER) || (buffer[1] != JOURNAL_VERSION))
+	{
+		api_file_close(records);
+		return false;
+	}
+	*segment = buffer[2] | (buffer[3] << 8);
+	uint8_t count = 0;
+	bool end = false;
+	while ((count < API_JOURNAL_SEGMENT_RECORDS) && (journal_read_record(buffer, &end) != 0))
+	{
+		count++;
+		uint32_t time = buffer[2] | (buffer[3] << 8) | (buffer[4] << 16) | ((uint32_t)buffer[5] << 24);
+		if ((int32_t)(time - *newest) > 0)
+		{
+			*newest = time;
+		}
+	}
+	// Anything after the last good record is a write that was interrupted
+	*torn = (count < API_JOURNAL_SEGMENT_RECORDS) && !end;
+	api_file_close(records);
+
+	uint8_t done = 0;
+	if (api_file_open_read(acks))
+	{
+		while ((done < count) && (api_file_read(buffer, 1) == 1))
+		{
+			done++;
+		}
+		api_file_close(acks);
+	}
+	journal_records[slot] = count;
+	journal_done[slot] = done;
+	return true;
+}
+
+/**
+ * @brief Number of records that are not sent yet
+ *
+ * @return uint32_t number of records
+ */
+static uint32_t journal_pending(void)
+{
+	if (journal_empty)
+	{
+		return 0;
+	}
+	uint32_t pending = 0;
+	for (uint16_t segment = journal_first; segment != (uint16_t)(journal_last + 1); segment++)
+	{
+		pending += journal_records[segment % API_JOURNAL_SEGMENTS] - journal_done[segment % API_JOURNAL_SEGMENTS];
+	}
+	return pending;
+}
+
+/**
+ * @brief Read the journal from flash once
+ *    Finds the oldest and newest segment and counts the records that are not sent yet
+ */
+static void journal_load(void)
+{
+	if (journal_loaded)
+	{
+		return;
+	}
+	journal_loaded = true;
+	api_fs_init();
+
+	bool found[API_JOURNAL_SEGMENTS];
+	uint16_t segments[API_JOURNAL_SEGMENTS];
+	bool torn[API_JOURNAL_SEGMENTS];
+	uint32_t newest = 0;
+	int8_t reference = -1;
+	for (uint8_t slot = 0; slot < API_JOURNAL_SEGMENTS; slot++)
+	{
+		torn[slot] = false;
+		found[slot] = journal_scan_slot(slot, &segments[slot], &newest, &torn[slot]);
+		if (found[slot] && ((segments[slot] % API_JOURNAL_SEGMENTS) != slot))
+		{
+			// Segment in the wrong slot, can't be from this journal
+			found[slot] = false;
+		}
+		if (found[slot] && (reference < 0))
+		{
+			reference = slot;
+		}
+	}
+	journal_empty = true;
+	if (reference < 0)
+	{
+		API_LOG("JRNL", "Journal is empty");
+		return;
+	}
+
+	// Segment numbers wrap around, compare them with the difference to one of them
+	journal_first = segments[reference];
+	journal_last = segments[reference];
+	for (uint8_t slot = 0; slot < API_JOURNAL_SEGMENTS; slot++)
+	{
+		if (!found[slot])
+		{
+			continue;
+		}
+		if ((int16_t)(segments[slot] - journal_first) < 0)
+		{
+			journal_first = segments[slot];
+		}
+		if ((int16_t)(segments[slot] - journal_last) > 0)
+		{
+			journal_last = segments[slot];
+		}
+	}
+	if ((uint16_t)(journal_last - journal_first) >= API_JOURNAL_SEGMENTS)
+	{
+		// Segments of different journals, start again
+		API_LOG("JRNL", "Journal is corrupt, deleting it");
+		journal_remove_all();
+		return;
+	}
+	journal_empty = false;
+	journal_closed = torn[journal_last % API_JOURNAL_SEGMENTS];
+
+	// Skip segments that are already done, only the last one stays
+	while ((journal_first != journal_last) && (journal_done[journal_first % API_JOURNAL_SEGMENTS] >= journal_records[journal_first % API_JOURNAL_SEGMENTS]))
+	{
+		journal_remove(journal_first);
+		journal_first++;
+	}
+
+	// Continue the clock with the newest record
+	journal_time_s = newest;
+	journal_time_ms = millis();
+
+	API_LOG("JRNL", "Journal segments %d to %d, %ld records to send", journal_first, journal_last, (long)journal_pending());
+}
+
+/**
+ * @brief Start a new segment
+ *    Drops the oldest segment if all slots are used
+ *
+ * @return true if the segment file was created
+ */
+static bool journal_new_segment(void)
+{
+	uint16_t segment = journal_empty ? journal_last : journal_last + 1;
+	if (!journal_empty && ((uint16_t)(segment - journal_first) >= API_JOURNAL_SEGMENTS))
+	{
+		uint8_t slot = journal_first % API_JOURNAL_SEGMENTS;
+		journal_dropped += journal_records[slot] - journal_done[slot];
+		API_LOG("JRNL", "Journal full, dropped %d records", journal_records[slot] - journal_done[slot]);
+		journal_remove(journal_first);
+		journal_first++;
+	}
+	// Remove leftovers of an interrupted delete
+	journal_remove(segment);
+
+	char records[8];
+	char acks[8];
+	journal_names(segment, records, acks);
+	if (!api_file_open_write(records))
+	{
+		API_LOG("JRNL", "Can't create journal segment");
+		return false;
+	}
+	uint8_t header[JOURNAL_SEGMENT_HEADER] = {JOURNAL_MARKER, JOURNAL_VERSION, (uint8_t)(segment & 0xFF), (uint8_t)(segment >> 8)};
+	api_file_write(header, JOURNAL_SEGMENT_HEADER);
+	api_file_close(records);
+
+	if (journal_empty)
+	{
+		journal_first = segment;
+		journal_empty = false;
+	}
+	journal_last = segment;
+	journal_closed = false;
+	return true;
+}
+
+/**
+ * @brief Append a record to the journal
+ *
+ * @param data payload
+ * @param size size of the payload
+ * @param fport fPort, 0 to use the fPort from the settings
+ * @return true if the record was written
+ */
+static bool journal_write(uint8_t *data, uint8_t size, uint8_t fport)
+{
+	if ((size == 0) || (size > API_JOURNAL_PAYLOAD))
+	{
+		API_LOG("JRNL", "Payload size %d not possible for the journal", size);
+		return false;
+	}
+	journal_load();
+	if (journal_empty || journal_closed || (journal_records[journal_last % API_JOURNAL_SEGMENTS] >= API_JOURNAL_SEGMENT_RECORDS))
+	{
+		if (!journal_new_segment())
+		{
+			return false;
+		}
+	}
+
+	uint8_t record[JOURNAL_RECORD_HEADER + API_JOURNAL_PAYLOAD + 1];
+	uint32_t time = api_journal_time();
+	record[0] = size;
+	record[1] = fport != 0 ? fport : g_lorawan_settings.app_port;
+	record[2] = time & 0xFF;
+	record[3] = (time >> 8) & 0xFF;
+	record[4] = (time >> 16) & 0xFF;
+	record[5] = (time >> 24) & 0xFF;
+	memcpy(&record[JOURNAL_RECORD_HEADER], data, size);
+	record[JOURNAL_RECORD_HEADER + size] = journal_crc(0, record, JOURNAL_RECORD_HEADER + size);
+
+	char records[8];
+	char acks[8];
+	journal_names(journal_last, records, acks);
+	if (!api_file_open_write(records))
+	{
+		API_LOG("JRNL", "Can't open journal segment");
+		return false;
+	}
+	api_file_write(record, JOURNAL_RECORD_HEADER + size + 1);
+	api_file_close(records);
+	journal_records[journal_last % API_JOURNAL_SEGMENTS]++;
+	journal_stored++;
+	return true;
+}
+
+/**
+ * @brief Mark the oldest record as done
+ *    Deletes the segment when all its records are done
+ */
+static void journal_next(void)
+{
+	uint8_t slot = journal_first % API_JOURNAL_SEGMENTS;
+	char records[8];
+	char acks[8];
+	journal_names(journal_first, records, acks);
+	if (api_file_open_write(acks))
+	{
+		uint8_t ack = 'A';
+		api_file_write(&ack, 1);
+		api_file_close(acks);
+	}
+	journal_done[slot]++;
+	if (journal_done[slot] < journal_records[slot])
+	{
+		return;
+	}
+	if (journal_first != journal_last)
+	{
+		journal_remove(journal_first);
+		journal_first++;
+	}
+	else if (journal_closed || (journal_records[slot] >= API_JOURNAL_SEGMENT_RECORDS))
+	{
+		// Last segment is full and done, the next record starts a new one
+		journal_remove(journal_first);
+		journal_last++;
+		journal_first = journal_last;
+		journal_empty = true;
+	}
+}
+
+/**
+ * @brief Read the oldest record that is not sent yet
+ *
+ * @param record buffer for the record
+ * @return uint8_t size of the record, 0 if the journal has no records or the record is damaged
+ */
+static uint8_t journal_read_oldest(uint8_t *record)
+{
+	uint8_t slot = journal_first % API_JOURNAL_SEGMENTS;
+	char records[8];
+	char acks[8];
+	journal_names(journal_first, records, acks);
+	if (!api_file_open_read(records))
+	{
+		return 0;
+	}
+	// Only sequential reads are possible, skip the header and the records that are done
+	uint8_t size = 0;
+	if (api_file_read(record, JOURNAL_SEGMENT_HEADER) == JOURNAL_SEGMENT_HEADER)
+	{
+		for (uint8_t idx = 0; idx <= journal_done[slot]; idx++)
+		{
+			size = journal_read_record(record);
+			if (size == 0)
+			{
+				break;
+			}
+		}
+	}
+	api_file_close(records);
+	return size;
+}
+
+/**
+ * @brief Replay the next record when the wait time is over
+ *    Called from the scheduler
+ */
+static void journal_wake(void)
+{
+	journal_job = 0;
+	lorawan_journal_pump();
+}
+
+/**
+ * @brief Wake the loop to replay the next record
+ *
+ * @param delay_ms wait time in ms
+ */
+static void journal_schedule(uint32_t delay_ms)
+{
+	if (journal_job != 0)
+	{
+		api_schedule_cancel(journal_job);
+	}
+	journal_job = api_schedule_callback(journal_wake, delay_ms);
+}
+
+/**
+ * @brief Result of a replayed record
+ *    Called from the TX queue in the loop task
+ *
+ * @param handle handle of the uplink, not used, only one record is in the TX queue
+ * @param result one of TX_RESULT
+ */
+static void journal_tx_done(uint16_t handle, uint8_t result)
+{
+	(void)handle;
+	journal_inflight = false;
+	if (journal_empty || (journal_first != journal_inflight_segment) || (journal_done[journal_first % API_JOURNAL_SEGMENTS] != journal_inflight_index))
+	{
+		// Segment was dropped or the journal cleared while the record was sent
+		journal_schedule(1);
+		return;
+	}
+	switch (result)
+	{
+	case TX_RESULT_SENT:
+	case TX_RESULT_ACKED:
+		journal_sent++;
+		journal_next();
+		journal_schedule(1);
+		break;
+	case TX_RESULT_FAILED:
+		if (lmh_join_status_get() == LMH_SET)
+		{
+			// Rejected by the MAC, e.g. too large for the data rate
+			API_LOG("JRNL", "Journal record rejected, dropped");
+			journal_dropped++;
+			journal_next();
+			journal_schedule(1);
+			break;
+		}
+		journal_schedule(API_JOURNAL_RETRY);
+		break;
+	default:
+		API_LOG("JRNL", "Journal record not sent, retry in %d ms", API_JOURNAL_RETRY);
+		journal_schedule(API_JOURNAL_RETRY);
+		break;
+	}
+}
+
+/**
+ * @brief Send the oldest record of the journal
+ *    Called from the loop, only one record is in the TX queue at a time.
+ *    Nothing is sent while a retry is scheduled.
+ */
+void lorawan_journal_pump(void)
+{
+	if (!journal_enabled || journal_inflight || (journal_job != 0) || !g_lorawan_settings.lorawan_enable || (lmh_join_status_get() != LMH_SET))
+	{
+		return;
+	}
+	journal_load();
+
+	uint8_t record[JOURNAL_RECORD_HEADER + API_JOURNAL_PAYLOAD + 1];
+	for (uint8_t idx = 0; idx < JOURNAL_EXPIRE_BATCH; idx++)
+	{
+		if (journal_pending() == 0)
+		{
+			return;
+		}
+		if (journal_read_oldest(record) == 0)
+		{
+			API_LOG("JRNL", "Journal record damaged, dropped");
+			journal_dropped++;
+			journal_next();
+			continue;
+		}
+		uint32_t time = record[2] | (record[3] << 8) | (record[4] << 16) | ((uint32_t)record[5] << 24);
+		uint32_t age = api_journal_time() - time;
+		if ((int32_t)age < 0)
+		{
+			// Record is from before the clock was set
+			age = 0;
+		}
+		if ((journal_max_age != 0) && (age > journal_max_age))
+		{
+			journal_dropped++;
+			journal_next();
+			continue;
+		}
+
+		journal_size = record[0];
+		memcpy(journal_buf, &record[JOURNAL_RECORD_HEADER], journal_size);
+		if (journal_send_age)
+		{
+			journal_buf[journal_size++] = age & 0xFF;
+			journal_buf[journal_size++] = (age >> 8) & 0xFF;
+			journal_buf[journal_size++] = (age >> 16) & 0xFF;
+			journal_buf[journal_size++] = (age >> 24) & 0xFF;
+		}
+		// The TX queue can call journal_tx_done() before it returns
+		journal_inflight = true;
+		journal_inflight_segment = journal_first;
+		journal_inflight_index = journal_done[journal_first % API_JOURNAL_SEGMENTS];
+		if (api_tx_enqueue(journal_buf, journal_size, record[1], 0, 0, journal_tx_done) == 0)
+		{
+			journal_inflight = false;
+			journal_schedule(API_JOURNAL_RETRY);
+		}
+		return;
+	}
+	// More expired records, continue on the next wake up
+	journal_schedule(1);
+}
+
+/**
+ * @brief Store an uplink that can't be sent because the device has not joined
+ *    Called from send_lora_packet(). An uplink that can't be stored, e.g. larger than API_JOURNAL_PAYLOAD,
+ *    is counted as dropped.
+ *
+ * @param data payload
+ * @param size size of the payload
+ * @param fport fPort, 0 to use the fPort from the settings
+ * @return true if the uplink was stored
+ */
+bool lorawan_journal_capture(uint8_t *data, uint8_t size, uint8_t fport)
+{
+	if (!journal_enabled)
+	{
+		return false;
+	}
+	if (journal_inflight && (size == journal_size) && (memcmp(data, journal_buf, size) == 0))
+	{
+		// Replayed record, it is still in the journal
+		return false;
+	}
+	if (!journal_write(data, size, fport))
+	{
+		journal_dropped++;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Enable or disable the uplink journal
+ *    Uplinks that are sent while the device has not joined are stored in flash and sent after the join
+ *
+ * @param enable true to enable the journal
+ * @param max_age records older than max_age seconds are dropped, 0 = no limit
+ * @param send_age true to append the age of the record in seconds as 32 bit little endian to the payload
+ * @return true if the journal could be read from flash
+ */
+bool api_journal(bool enable, uint32_t max_age, bool send_age)
+{
+	journal_enabled = enable;
+	journal_max_age = max_age;
+	journal_send_age = send_age;
+	if (!enable)
+	{
+		if (journal_job != 0)
+		{
+			api_schedule_cancel(journal_job);
+			journal_job = 0;
+		}
+		return true;
+	}
+	journal_load();
+	journal_schedule(1);
+	return true;
+}
+
+/**
+ * @brief Store an uplink in the journal, it is sent when the device has joined
+ *    Must be called from the loop task
+ *
+ * @param data payload, max API_JOURNAL_PAYLOAD bytes
+ * @param size size of the payload
+ * @param fport fPort, 0 to use the fPort from the settings
+ * @return true if the uplink was stored
+ */
+bool api_journal_add(uint8_t *data, uint8_t size, uint8_t fport)
+{
+	if (!journal_write(data, size, fport))
+	{
+		return false;
+	}
+	if (journal_enabled && !journal_inflight)
+	{
+		journal_schedule(1);
+	}
+	return true;
+}
+
+/**
+ * @brief Delete all records of the journal
+ *
+ */
+void api_journal_clear(void)
+{
+	journal_load();
+	journal_remove_all();
+	journal_empty = true;
+	journal_closed = false;
+	journal_first = 0;
+	journal_last = 0;
+}
+
+/**
+ * @brief Get the state of the journal
+ *
+ * @param status set to the state, records is the number of records not sent yet
+ */
+void api_journal_status(s_journal_status *status)
+{
+	journal_load();
+	status->enabled = journal_enabled;
+	status->send_age = journal_send_age;
+	status->max_age = journal_max_age;
+	status->records = journal_pending();
+	status->stored = journal_stored;
+	status->sent = journal_sent;
+	status->dropped = journal_dropped;
+}
+
+/**
+ * @brief Time of the journal in seconds
+ *    Must be called at least every 49 days to handle the millis() overflow, the pump and the writes do it
+ *
+ * @return uint32_t seconds
+ */
+uint32_t api_journal_time(void)
+{
+	uint32_t seconds = (millis() - journal_time_ms) / 1000;
+	journal_time_s += seconds;
+	journal_time_ms += seconds * 1000;
+	return journal_time_s;
+}
+
+/**
+ * @brief Set the time of the journal, e.g. to the Unix time from a GNSS or a network time request
+ *
+ * @param seconds time in seconds
+ */
+void api_journal_set_time(uint32_t seconds)
+{
+	journal_time_s = seconds;
+	journal_time_ms = millis();
+}
+
+/**
+ * @brief Delete the files of the journal, the settings and other files are kept
+ *
+ * @param filename if not NULL an empty file with this name is created
+ */
+void api_fs_format(const char *filename)
+{
+	api_fs_init();
+	api_journal_clear();
+	if ((filename != NULL) && api_file_open_write(filename))
+	{
+		api_file_close(filename);
+	}
+}
@@ -0,0 +1,349 @@
+/**
+ * @file lorawan_session.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief LoRaWAN session persistence, restores the session after a reset instead of joining again
+ * @version 0.1
+ * @date 2022-03-21
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/**
+ * The session is written to flash after a join and whenever the uplink counter gets close to the
+ * last checkpoint. The saved uplink counter is API_SESSION_FCNT_STEP ahead of the real counter,
+ * after a reset the device continues with the checkpoint, so the counter never goes backwards.
+ * This costs one flash write every API_SESSION_FCNT_STEP / 2 uplinks and one after each restart.
+ * Frame counters skipped after a reset are no problem for the network server.
+ * The downlink counter can't be saved ahead, the device would reject the downlinks of the network server
+ * until it catches up. It is saved after each downlink instead, downlinks are rare compared to uplinks.
+ */
+
+/** Last session written to flash */
+static s_lorawan_session session;
+/** Flag if the session in flash belongs to the current credentials */
+static bool session_valid = false;
+/** Flag if the session of the MAC is kept in flash, cleared by api_lorawan_session_clear() */
+static bool session_active = false;
+/** Flag if a save is scheduled */
+static bool session_save_pending = false;
+
+/**
+ * @brief Fletcher-16 checksum over the session record without the checksum field
+ *
+ * @param record session record
+ * @return uint16_t checksum
+ */
+static uint16_t session_checksum(s_lorawan_session *record)
+{
+	uint8_t *data = (uint8_t *)record;
+	uint16_t sum_1 = 0;
+	uint16_t sum_2 = 0;
+	for (size_t idx = 0; idx < offsetof(s_lorawan_session, checksum); idx++)
+	{
+		sum_1 = (sum_1 + data[idx]) % 255;
+		sum_2 = (sum_2 + sum_1) % 255;
+	}
+	return (sum_2 << 8) | sum_1;
+}
+
+/**
+ * @brief FNV-1a hash of the AppKey
+ *    Only the hash is saved with the session, it shows if the key was changed since the join
+ *
+ * @param key AppKey
+ * @return uint32_t hash
+ */
+static uint32_t session_key_hash(uint8_t *key)
+{
+	uint32_t hash = 0x811C9DC5;
+	for (uint8_t idx = 0; idx < 16; idx++)
+	{
+		hash = (hash ^ key[idx]) * 0x01000193;
+	}
+	return hash;
+}
+
+/**
+ * @brief Number of 16 bit words in the channel mask of a region
+ *
+ * @param region LoRaWAN region
+ * @return uint8_t 6 for the regions with 72 or 96 channels, 1 for all others
+ */
+static uint8_t session_mask_size(uint8_t region)
+{
+	switch (region)
+	{
+	case LORAMAC_REGION_AU915:
+	case LORAMAC_REGION_CN470:
+	case LORAMAC_REGION_US915:
+		return LORAWAN_SESSION_MASK_SIZE;
+	default:
+		return 1;
+	}
+}
+
+/**
+ * @brief Check if a session record is valid and belongs to the current settings
+ *    OTAA sessions must match the EUIs and the AppKey, ABP sessions the device address and the keys as well
+ *
+ * @param record session record read from flash
+ * @return true if the session can be used
+ */
+static bool session_matches(s_lorawan_session *record)
+{
+	if ((record->valid_mark_1 != 0xAA) || (record->valid_mark_2 != LORAWAN_SESSION_MARKER) || (record->version != LORAWAN_SESSION_VERSION))
+	{
+		return false;
+	}
+	if (record->checksum != session_checksum(record))
+	{
+		API_LOG("SESS", "Session checksum error");
+		return false;
+	}
+	if ((record->region != g_lorawan_settings.lora_region) || (record->otaa != g_lorawan_settings.otaa_enabled) || (memcmp(record->dev_eui, g_lorawan_settings.node_device_eui, 8) != 0) || (memcmp(record->app_eui, g_lorawan_settings.node_app_eui, 8) != 0))
+	{
+		return false;
+	}
+	if (record->otaa && (record->app_key_hash != session_key_hash(g_lorawan_settings.node_app_key)))
+	{
+		return false;
+	}
+	if (!record->otaa && ((record->dev_addr != g_lorawan_settings.node_dev_addr) || (memcmp(record->nwk_skey, g_lorawan_settings.node_nws_key, 16) != 0) || (memcmp(record->app_skey, g_lorawan_settings.node_apps_key, 16) != 0)))
+	{
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Read the session from the MAC and write it to flash if it changed
+ *    Called from the loop by the scheduler
+ */
+static void session_save(void)
+{
+	session_save_pending = false;
+	if (!session_active || (lmh_join_status_get() != LMH_SET))
+	{
+		return;
+	}
+
+	// Clear the padding between the fields as well, the record is compared with memcmp() and checksummed
+	s_lorawan_session record;
+	memset((void *)&record, 0, sizeof(s_lorawan_session));
+	record.valid_mark_1 = 0xAA;
+	record.valid_mark_2 = LORAWAN_SESSION_MARKER;
+	record.version = LORAWAN_SESSION_VERSION;
+	record.region = g_lorawan_settings.lora_region;
+	record.otaa = g_lorawan_settings.otaa_enabled;
+	memcpy(record.dev_eui, g_lorawan_settings.node_device_eui, 8);
+	memcpy(record.app_eui, g_lorawan_settings.node_app_eui, 8);
+	record.app_key_hash = session_key_hash(g_lorawan_settings.node_app_key);
+
+	MibRequestConfirm_t mib_req;
+	mib_req.Type = MIB_DEV_ADDR;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	record.dev_addr = mib_req.Param.DevAddr;
+	mib_req.Type = MIB_NWK_SKEY;
+	if (LoRaMacMibGetRequestConfirm(&mib_req) != LORAMAC_STATUS_OK)
+	{
+		API_LOG("SESS", "Can't read the session keys");
+		return;
+	}
+	memcpy(record.nwk_skey, mib_req.Param.NwkSKey, 16);
+	mib_req.Type = MIB_APP_SKEY;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	memcpy(record.app_skey, mib_req.Param.AppSKey, 16);
+	mib_req.Type = MIB_UPLINK_COUNTER;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	record.fcnt_up = mib_req.Param.UpLinkCounter + API_SESSION_FCNT_STEP;
+	mib_req.Type = MIB_DOWNLINK_COUNTER;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	record.fcnt_down = mib_req.Param.DownLinkCounter;
+	mib_req.Type = MIB_CHANNELS_MASK;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	memcpy(record.channel_mask, mib_req.Param.ChannelsMask, session_mask_size(record.region) * sizeof(uint16_t));
+	mib_req.Type = MIB_RX2_CHANNEL;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	record.rx2_frequency = mib_req.Param.Rx2Channel.Frequency;
+	record.rx2_datarate = mib_req.Param.Rx2Channel.Datarate;
+	mib_req.Type = MIB_CHANNELS_DATARATE;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	record.datarate = mib_req.Param.ChannelsDatarate;
+	record.checksum = session_checksum(&record);
+
+	if (session_valid && (memcmp(&record, &session, sizeof(s_lorawan_session)) == 0))
+	{
+		return;
+	}
+	if (!save_session(&record))
+	{
+		API_LOG("SESS", "Failed to save the session");
+		return;
+	}
+	memcpy(&session, &record, sizeof(s_lorawan_session));
+	session_valid = true;
+	API_LOG("SESS", "Session saved, uplink checkpoint %ld", (long)record.fcnt_up);
+}
+
+/**
+ * @brief Schedule writing the session to flash
+ *    Flash writes are slow, they are done from the loop and not from the MAC callbacks
+ */
+static void session_schedule_save(void)
+{
+	if (session_save_pending)
+	{
+		return;
+	}
+	if (api_schedule_callback(session_save, 1) != 0)
+	{
+		session_save_pending = true;
+	}
+}
+
+/**
+ * @brief Restore the saved session into the MAC
+ *    Must be called after lmh_init(). For OTAA the complete session is restored and the join can be skipped.
+ *    For ABP only the frame counters are restored, call it after lmh_join().
+ *
+ * @return true if a saved session was restored
+ * @return false if no session was saved or it doesn't belong to the current settings
+ */
+bool lorawan_session_restore(void)
+{
+	s_lorawan_session record;
+	if (!read_session(&record) || !session_matches(&record))
+	{
+		API_LOG("SESS", "No saved session");
+		session_valid = false;
+		return false;
+	}
+	memcpy(&session, &record, sizeof(s_lorawan_session));
+	session_valid = true;
+	session_active = true;
+
+	MibRequestConfirm_t mib_req;
+	if (record.otaa)
+	{
+		mib_req.Type = MIB_DEV_ADDR;
+		mib_req.Param.DevAddr = record.dev_addr;
+		LoRaMacMibSetRequestConfirm(&mib_req);
+		mib_req.Type = MIB_NWK_SKEY;
+		mib_req.Param.NwkSKey = record.nwk_skey;
+		LoRaMacMibSetRequestConfirm(&mib_req);
+		mib_req.Type = MIB_APP_SKEY;
+		mib_req.Param.AppSKey = record.app_skey;
+		LoRaMacMibSetRequestConfirm(&mib_req);
+		mib_req.Type = MIB_CHANNELS_MASK;
+		mib_req.Param.ChannelsMask = record.channel_mask;
+		LoRaMacMibSetRequestConfirm(&mib_req);
+		mib_req.Type = MIB_RX2_CHANNEL;
+		mib_req.Param.Rx2Channel.Frequency = record.rx2_frequency;
+		mib_req.Param.Rx2Channel.Datarate = record.rx2_datarate;
+		LoRaMacMibSetRequestConfirm(&mib_req);
+		if (g_lorawan_settings.adr_enabled)
+		{
+			// Continue with the data rate ADR had chosen
+			mib_req.Type = MIB_CHANNELS_DATARATE;
+			mib_req.Param.ChannelsDatarate = record.datarate;
+			LoRaMacMibSetRequestConfirm(&mib_req);
+		}
+		mib_req.Type = MIB_NETWORK_JOINED;
+		mib_req.Param.IsNetworkJoined = true;
+		LoRaMacMibSetRequestConfirm(&mib_req);
+	}
+	mib_req.Type = MIB_UPLINK_COUNTER;
+	mib_req.Param.UpLinkCounter = record.fcnt_up;
+	LoRaMacMibSetRequestConfirm(&mib_req);
+	mib_req.Type = MIB_DOWNLINK_COUNTER;
+	mib_req.Param.DownLinkCounter = record.fcnt_down;
+	LoRaMacMibSetRequestConfirm(&mib_req);
+
+	API_LOG("SESS", "Session restored, dev address %08lX uplink counter %ld", (unsigned long)record.dev_addr, (long)record.fcnt_up);
+
+	// Move the checkpoint ahead before the restored counter is used
+	session_schedule_save();
+	return true;
+}
+
+/**
+ * @brief Save the session after a join
+ *    Called from the joined callback
+ */
+void lorawan_session_joined(void)
+{
+	session_active = true;
+	session_schedule_save();
+}
+
+/**
+ * @brief Check if a new frame counter checkpoint is needed
+ *    Called after an uplink was started. The checkpoint is moved ahead when half of the step is used,
+ *    so a reset before the save is done can't reuse a counter.
+ */
+void lorawan_session_uplink(void)
+{
+	if (!session_active)
+	{
+		return;
+	}
+	MibRequestConfirm_t mib_req;
+	mib_req.Type = MIB_UPLINK_COUNTER;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	if (!session_valid || (mib_req.Param.UpLinkCounter + (API_SESSION_FCNT_STEP / 2) >= session.fcnt_up))
+	{
+		session_schedule_save();
+	}
+}
+
+/**
+ * @brief Save the downlink counter if a downlink was received
+ *    Called from the RX and TX finished callbacks, downlinks without payload or with only MAC commands
+ *    count as well. The downlink counter in flash can't get behind by more than the downlink that
+ *    arrived just before a reset.
+ */
+void lorawan_session_downlink(void)
+{
+	if (!session_active)
+	{
+		return;
+	}
+	MibRequestConfirm_t mib_req;
+	mib_req.Type = MIB_DOWNLINK_COUNTER;
+	LoRaMacMibGetRequestConfirm(&mib_req);
+	if (!session_valid || (mib_req.Param.DownLinkCounter != session.fcnt_down))
+	{
+		session_schedule_save();
+	}
+}
+
+/**
+ * @brief Get the session saved in flash
+ *
+ * @param record structure for the session
+ * @return true if a session for the current settings is saved
+ * @return false if no session is saved, record is not changed
+ */
+bool api_lorawan_session_get(s_lorawan_session *record)
+{
+	if (!session_valid)
+	{
+		return false;
+	}
+	memcpy(record, &session, sizeof(s_lorawan_session));
+	return true;
+}
+
+/**
+ * @brief Delete the saved session
+ *    The device joins again after the next reset. Use it if the network server lost the session.
+ *
+ */
+void api_lorawan_session_clear(void)
+{
+	delete_session();
+	session_valid = false;
+	session_active = false;
+}
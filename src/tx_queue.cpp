@@ -0,0 +1,276 @@
+/**
+ * @file tx_queue.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Queue for LoRa/LoRaWAN uplinks with priorities, retries and completion callbacks
+ * @version 0.1
+ * @date 2022-03-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+
+/** Queued uplink */
+struct s_tx_entry
+{
+	uint16_t handle; // 0 => slot is free
+	uint16_t order;
+	uint8_t data[API_TX_QUEUE_PAYLOAD];
+	uint8_t size;
+	uint8_t fport;
+	uint8_t priority;
+	uint8_t retries;
+	tx_done_cb_t callback;
+};
+
+/** The queued uplinks */
+static s_tx_entry tx_queue[API_TX_QUEUE_SIZE];
+/** Last handle given out */
+static uint16_t last_handle = 0;
+/** Counter to keep the order of uplinks with the same priority */
+static uint16_t next_order = 0;
+/** Index of the uplink that is sent, -1 if none */
+static int8_t tx_inflight = -1;
+/** Result of the uplink that is sent, set by the LoRa callbacks */
+static volatile uint8_t tx_inflight_result = TX_RESULT_TIMEOUT;
+/** Scheduler job that restarts the queue after a back-off, 0 if none */
+static uint8_t tx_backoff_job = 0;
+
+/**
+ * @brief Restart the queue after the back-off
+ *    Called by the scheduler from the loop task
+ *
+ */
+static void tx_queue_wake(void)
+{
+	tx_backoff_job = 0;
+	tx_queue_pump();
+}
+
+/**
+ * @brief Pause the queue for a random time between API_TX_QUEUE_BACKOFF and twice that time
+ *    The random part keeps nodes that failed at the same time from retrying together
+ *
+ */
+static void tx_queue_backoff(void)
+{
+	if (tx_backoff_job != 0)
+	{
+		return;
+	}
+	uint32_t delay_ms = API_TX_QUEUE_BACKOFF + random(API_TX_QUEUE_BACKOFF + 1);
+	tx_backoff_job = api_schedule_callback(tx_queue_wake, delay_ms);
+	if (tx_backoff_job == 0)
+	{
+		// No scheduler slot, retry on the next wake up
+		API_LOG("TXQ", "No scheduler slot for TX back-off");
+	}
+}
+
+/**
+ * @brief Put an uplink into the TX queue
+ *    Must be called from the loop task. The data is copied, the buffer can be reused after the call
+ *
+ * @param data data to be sent
+ * @param size size of the data, max API_TX_QUEUE_PAYLOAD
+ * @param fport fPort to be used, 0 to use the fPort from the settings (LoRaWAN only)
+ * @param priority uplinks with higher priority are sent first
+ * @param retries number of retries if sending fails or is not acknowledged
+ * @param callback function called when the uplink is finished, can be NULL
+ * @return uint16_t handle of the uplink, 0 if the queue is full or the data is too large
+ */
+uint16_t api_tx_enqueue(uint8_t *data, uint8_t size, uint8_t fport, uint8_t priority, uint8_t retries, tx_done_cb_t callback)
+{
+	if (size > API_TX_QUEUE_PAYLOAD)
+	{
+		API_LOG("TXQ", "Payload too large for TX queue");
+		return 0;
+	}
+
+	for (uint8_t idx = 0; idx < API_TX_QUEUE_SIZE; idx++)
+	{
+		if (tx_queue[idx].handle == 0)
+		{
+			last_handle++;
+			if (last_handle == 0)
+			{
+				last_handle = 1;
+			}
+			tx_queue[idx].handle = last_handle;
+			tx_queue[idx].order = next_order++;
+			memcpy(tx_queue[idx].data, data, size);
+			tx_queue[idx].size = size;
+			tx_queue[idx].fport = fport;
+			tx_queue[idx].priority = priority;
+			tx_queue[idx].retries = retries;
+			tx_queue[idx].callback = callback;
+
+			// Try to send it right away
+			tx_queue_pump();
+			return last_handle;
+		}
+	}
+	API_LOG("TXQ", "TX queue full");
+	return 0;
+}
+
+/**
+ * @brief Remove an uplink from the TX queue
+ *    An uplink that is already sent cannot be cancelled
+ *
+ * @param handle handle returned by api_tx_enqueue()
+ * @return true if the uplink was removed
+ * @return false if the uplink was not found or is already sent
+ */
+bool api_tx_cancel(uint16_t handle)
+{
+	for (uint8_t idx = 0; idx < API_TX_QUEUE_SIZE; idx++)
+	{
+		if ((handle != 0) && (tx_queue[idx].handle == handle) && (idx != tx_inflight))
+		{
+			tx_queue[idx].handle = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Number of uplinks in the TX queue, including the one that is sent
+ *
+ * @return uint8_t number of uplinks
+ */
+uint8_t api_tx_pending(void)
+{
+	uint8_t count = 0;
+	for (uint8_t idx = 0; idx < API_TX_QUEUE_SIZE; idx++)
+	{
+		if (tx_queue[idx].handle != 0)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief Remember the result of the current uplink
+ *    Called from the LoRa callbacks, the uplink is finished in the loop task
+ *
+ * @param result one of TX_RESULT
+ */
+void tx_queue_result(uint8_t result)
+{
+	tx_inflight_result = result;
+}
+
+/**
+ * @brief Finish the uplink that was sent
+ *    Called by the loop task on LORA_TX_FIN
+ *
+ */
+void tx_queue_finish(void)
+{
+	if (tx_inflight < 0)
+	{
+		// Uplink was not sent from the queue
+		return;
+	}
+	s_tx_entry *entry = &tx_queue[tx_inflight];
+	tx_inflight = -1;
+
+	uint8_t result = tx_inflight_result;
+	if ((result != TX_RESULT_SENT) && (result != TX_RESULT_ACKED) && (entry->retries != 0))
+	{
+		// Keep the uplink in the queue for another try
+		entry->retries--;
+		API_LOG("TXQ", "Uplink %d failed, %d retries left", entry->handle, entry->retries);
+		tx_queue_backoff();
+		return;
+	}
+
+	uint16_t handle = entry->handle;
+	tx_done_cb_t callback = entry->callback;
+	entry->handle = 0;
+	if (callback != NULL)
+	{
+		callback(handle, result);
+	}
+}
+
+/**
+ * @brief Send the next uplink from the TX queue
+ *    Called by the loop task after events were handled
+ *
+ */
+void tx_queue_pump(void)
+{
+	if (tx_inflight >= 0)
+	{
+		// Wait until the current uplink is finished
+		return;
+	}
+
+	if (tx_backoff_job != 0)
+	{
+		// Wait until the back-off is over
+		return;
+	}
+
+	if (g_lorawan_settings.lorawan_enable && !g_lpwan_has_joined)
+	{
+		// Keep the uplinks until the device joined the network
+		return;
+	}
+
+	// Find the oldest uplink with the highest priority
+	int8_t next = -1;
+	for (uint8_t idx = 0; idx < API_TX_QUEUE_SIZE; idx++)
+	{
+		if (tx_queue[idx].handle == 0)
+		{
+			continue;
+		}
+		if ((next < 0) || (tx_queue[idx].priority > tx_queue[next].priority) ||
+			((tx_queue[idx].priority == tx_queue[next].priority) && ((int16_t)(tx_queue[idx].order - tx_queue[next].order) < 0)))
+		{
+			next = idx;
+		}
+	}
+	if (next < 0)
+	{
+		return;
+	}
+
+	s_tx_entry *entry = &tx_queue[next];
+	// The result is updated by the LoRa callbacks
+	tx_inflight_result = TX_RESULT_TIMEOUT;
+	lmh_error_status result;
+	if (g_lorawan_settings.lorawan_enable)
+	{
+		result = send_lora_packet(entry->data, entry->size, entry->fport);
+	}
+	else
+	{
+		result = send_p2p_packet(entry->data, entry->size) ? LMH_SUCCESS : LMH_BUSY;
+	}
+
+	switch (result)
+	{
+	case LMH_SUCCESS:
+		tx_inflight = next;
+		API_LOG("TXQ", "Uplink %d sent", entry->handle);
+		break;
+	case LMH_BUSY:
+		// Try again after the back-off
+		API_LOG("TXQ", "LoRa busy, uplink %d stays queued", entry->handle);
+		tx_queue_backoff();
+		break;
+	default:
+		// Request was rejected, e.g. payload too large for the current DR
+		tx_inflight_result = TX_RESULT_FAILED;
+		tx_inflight = next;
+		tx_queue_finish();
+		break;
+	}
+}
@@ -138,11 +138,11 @@ void init_wifi(void)
 	}
 
 	WiFi.disconnect(true);
-	delay(100);
+	api_delay(100);
 	WiFi.enableSTA(true);
-	delay(100);
+	api_delay(100);
 	WiFi.mode(WIFI_STA);
-	delay(100);
+	api_delay(100);
 	WiFi.onEvent(wifi_event_cb);
 
 	create_dev_name();
@@ -23,6 +23,35 @@ union latLong_s
 	int8_t val8[4];
 };
 
+/**
+ * @brief Construct a WisCayenne object that encodes into an external buffer
+ *    e.g. the TX buffer returned by api_tx_acquire(), to avoid copying the payload
+ *
+ * @param buffer buffer to encode the data into
+ * @param size size of the buffer
+ */
+WisCayenne::WisCayenne(uint8_t *buffer, uint8_t size) : CayenneLPP(1)
+{
+	// Replace the buffer allocated by CayenneLPP
+	free(_buffer);
+	_buffer = buffer;
+	_maxsize = size;
+	_cursor = 0;
+	_external_buffer = true;
+}
+
+/**
+ * @brief Destroy the WisCayenne object
+ *    An external buffer is not owned and must not be freed
+ */
+WisCayenne::~WisCayenne()
+{
+	if (_external_buffer)
+	{
+		_buffer = NULL;
+	}
+}
+
 /**
  * @brief Add GNSS data in Cayenne LPP standard format
  *
@@ -277,4 +306,225 @@ uint8_t WisCayenne::addVoc_index(uint8_t channel, uint32_t voc_index)
 	_buffer[_cursor++] = voc_union.val8[0];
 
 	return _cursor;
-}
\ No newline at end of file
+}
+/**
+ * @brief Add as many batched samples as fit into the packet
+ *    Samples that are added are removed from the batch
+ *
+ * @param batch the collected samples
+ * @param max_size max size of the packet, e.g. the max payload of the current DR, 0 to use the buffer size
+ * @return uint8_t bytes added to the data packet
+ */
+uint8_t WisCayenne::addBatch(WisCayenneBatch &batch, uint8_t max_size)
+{
+	uint8_t limit = ((max_size == 0) || (max_size > _maxsize)) ? _maxsize : max_size;
+	if (_cursor >= limit)
+	{
+		_error = LPP_ERROR_OVERFLOW;
+		return 0;
+	}
+	_cursor += batch.pack(&_buffer[_cursor], limit - _cursor);
+
+	return _cursor;
+}
+
+/**
+ * @brief Get the resolution of a data type
+ *
+ * @param type LPP data type
+ * @return uint16_t multiplier to convert the value into the LPP integer, 0 if the type cannot be batched
+ */
+static uint16_t batch_multiplier(uint8_t type)
+{
+	switch (type)
+	{
+	case LPP_DIGITAL_INPUT:
+	case LPP_DIGITAL_OUTPUT:
+	case LPP_GENERIC_SENSOR:
+	case LPP_LUMINOSITY:
+	case LPP_PRESENCE:
+	case LPP_FREQUENCY:
+	case LPP_PERCENTAGE:
+	case LPP_ALTITUDE:
+	case LPP_CONCENTRATION:
+	case LPP_POWER:
+	case LPP_DIRECTION:
+	case LPP_VOC:
+		return 1;
+	case LPP_RELATIVE_HUMIDITY:
+		return 2;
+	case LPP_TEMPERATURE:
+	case LPP_BAROMETRIC_PRESSURE:
+		return 10;
+	case LPP_ANALOG_INPUT:
+	case LPP_ANALOG_OUTPUT:
+	case LPP_VOLTAGE:
+		return 100;
+	case LPP_CURRENT:
+	case LPP_DISTANCE:
+	case LPP_ENERGY:
+		return 1000;
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Write an unsigned varint (7 bits per byte, LSB first)
+ *
+ * @param buffer destination, at least 5 bytes
+ * @param value value to write
+ * @return uint8_t number of bytes written
+ */
+static uint8_t put_varint(uint8_t *buffer, uint32_t value)
+{
+	uint8_t len = 0;
+	while (value >= 0x80)
+	{
+		buffer[len++] = (uint8_t)(value | 0x80);
+		value >>= 7;
+	}
+	buffer[len++] = (uint8_t)value;
+	return len;
+}
+
+/**
+ * @brief Zigzag encode a signed value, small negative values get small codes
+ *
+ * @param value signed value
+ * @return uint32_t encoded value
+ */
+static uint32_t zigzag(int32_t value)
+{
+	return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/**
+ * @brief Add a sample to the batch
+ *    If the batch is full, the oldest sample is dropped
+ *
+ * @param channel LPP channel
+ * @param type LPP data type, only single value types are supported
+ * @param value sensor value
+ * @return true if the sample was added
+ * @return false if the data type cannot be batched
+ */
+bool WisCayenneBatch::addSample(uint8_t channel, uint8_t type, float value)
+{
+	uint16_t multiplier = batch_multiplier(type);
+	if (multiplier == 0)
+	{
+		return false;
+	}
+
+	if (_count == LPP_BATCH_SAMPLES)
+	{
+		// Drop the oldest sample
+		memmove(&_samples[0], &_samples[1], (LPP_BATCH_SAMPLES - 1) * sizeof(s_batch_sample));
+		_count--;
+		_dropped++;
+	}
+
+	float scaled = value * multiplier;
+	_samples[_count].time = millis() / 1000;
+	_samples[_count].value = (int32_t)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+	_samples[_count].channel = channel;
+	_samples[_count].type = type;
+	_count++;
+	return true;
+}
+
+/**
+ * @brief Pack as many samples as fit into the buffer, one LPP_BATCH record per channel and data type
+ *    Packed samples are removed, the others stay for the next packet
+ *
+ * @param buffer destination
+ * @param max_size available space in the destination
+ * @return uint8_t number of bytes written
+ */
+uint8_t WisCayenneBatch::pack(uint8_t *buffer, uint8_t max_size)
+{
+	// 0 => not handled, 1 => packed, 2 => did not fit
+	uint8_t state[LPP_BATCH_SAMPLES] = {0};
+	uint8_t encoded[10];
+	uint8_t used = 0;
+	uint32_t now = millis() / 1000;
+
+	for (uint16_t idx = 0; idx < _count; idx++)
+	{
+		if (state[idx] != 0)
+		{
+			continue;
+		}
+		s_batch_sample *first = &_samples[idx];
+
+		// Header and first sample
+		uint8_t len = put_varint(encoded, now - first->time);
+		len += put_varint(&encoded[len], zigzag(first->value));
+		bool fits = (used + 4 + len) <= max_size;
+		uint8_t count_pos = used + 3;
+		uint8_t count = 0;
+		if (fits)
+		{
+			buffer[used++] = first->channel;
+			buffer[used++] = LPP_BATCH;
+			buffer[used++] = first->type;
+			buffer[used++] = 0;
+			memcpy(&buffer[used], encoded, len);
+			used += len;
+			count = 1;
+		}
+		state[idx] = fits ? 1 : 2;
+
+		// Following samples of the same channel and data type
+		s_batch_sample *last = first;
+		for (uint16_t next = idx + 1; next < _count; next++)
+		{
+			s_batch_sample *sample = &_samples[next];
+			if ((state[next] != 0) || (sample->channel != first->channel) || (sample->type != first->type))
+			{
+				continue;
+			}
+			if (fits && (count < 255))
+			{
+				len = put_varint(encoded, sample->time - last->time);
+				len += put_varint(&encoded[len], zigzag(sample->value - last->value));
+				fits = (used + len) <= max_size;
+			}
+			else
+			{
+				fits = false;
+			}
+			if (fits)
+			{
+				memcpy(&buffer[used], encoded, len);
+				used += len;
+				count++;
+				last = sample;
+				state[next] = 1;
+			}
+			else
+			{
+				// Keep this and all newer samples in order for the next packet
+				state[next] = 2;
+			}
+		}
+		if (count != 0)
+		{
+			buffer[count_pos] = count;
+		}
+	}
+
+	// Remove the packed samples
+	uint16_t kept = 0;
+	for (uint16_t idx = 0; idx < _count; idx++)
+	{
+		if (state[idx] != 1)
+		{
+			_samples[kept++] = _samples[idx];
+		}
+	}
+	_count = kept;
+
+	return used;
+}
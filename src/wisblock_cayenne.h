@@ -19,6 +19,7 @@
 #define LPP_GPS4 136 // 3 byte lon/lat 0.0001 °, 3 bytes alt 0.01 meter (Cayenne LPP default)
 #define LPP_GPS6 137 // 4 byte lon/lat 0.000001 °, 3 bytes alt 0.01 meter (Customized Cayenne LPP)
 #define LPP_VOC 138	 // 2 byte VOC index
+#define LPP_BATCH 139 // Batch of timestamped samples of one data type, varint encoded
 
 // Only Data Size
 #define LPP_GPS4_SIZE 9
@@ -77,17 +78,54 @@
 #define LPP_CHANNEL_EQ_COLLAPSE 47	   // RAK12027
 #define LPP_CHANNEL_SWITCH 48		   // RAK13011
 
+// Number of samples the batch can hold
+#ifndef LPP_BATCH_SAMPLES
+#define LPP_BATCH_SAMPLES 64
+#endif
+
+/**
+ * @brief Collects timestamped samples and packs them into LPP_BATCH records
+ *    Record format: channel, LPP_BATCH, data type, sample count, then for every sample
+ *    the time delta in seconds (unsigned varint, first sample: age at packing time)
+ *    and the value delta (zigzag varint, first sample: the value itself)
+ */
+class WisCayenneBatch
+{
+public:
+	bool addSample(uint8_t channel, uint8_t type, float value);
+	uint8_t pack(uint8_t *buffer, uint8_t max_size);
+	uint16_t getCount(void) { return _count; }
+	uint32_t getDropped(void) { return _dropped; }
+	void reset(void) { _count = 0; }
+
+private:
+	struct s_batch_sample
+	{
+		uint32_t time;
+		int32_t value;
+		uint8_t channel;
+		uint8_t type;
+	};
+	s_batch_sample _samples[LPP_BATCH_SAMPLES];
+	uint16_t _count = 0;
+	uint32_t _dropped = 0;
+};
+
 class WisCayenne : public CayenneLPP
 {
 public:
 	WisCayenne(uint8_t size) : CayenneLPP(size) {}
+	WisCayenne(uint8_t *buffer, uint8_t size);
+	~WisCayenne();
 
 	uint8_t addGNSS_4(uint8_t channel, int32_t latitude, int32_t longitude, int32_t altitude);
 	uint8_t addGNSS_6(uint8_t channel, int32_t latitude, int32_t longitude, int32_t altitude);
 	uint8_t addGNSS_H(int32_t latitude, int32_t longitude, int16_t altitude, int16_t accuracy, int16_t battery);
 	uint8_t addGNSS_T(int32_t latitude, int32_t longitude, int16_t altitude, float accuracy, int8_t sats);
 	uint8_t addVoc_index(uint8_t channel, uint32_t voc_index);
+	uint8_t addBatch(WisCayenneBatch &batch, uint8_t max_size = 0);
 
 private:
+	bool _external_buffer = false;
 };
 #endif
\ No newline at end of file
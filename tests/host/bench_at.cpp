@@ -0,0 +1,84 @@
+/**
+ * @file bench_at.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief AT command throughput, commands per second through at_serial_input()
+ *    Uses only at_serial_input(uint8_t), so the same file measures older versions of the library
+ * @version 0.1
+ * @date 2022-03-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <chrono>
+#include "WisBlock-API.h"
+#include "host_platform.h"
+
+/** Mix of commands, queries of built-in commands from the start, the middle and the end of the list */
+static const char *bench_cmds[] = {"AT+APPEUI=?", "AT+DEVEUI=?", "AT+SENDINT=?", "AT+PSEND=?", "AT+PRECV=?",
+								   "AT+NJS=?", "AT+STATUS?", "AT+VER?", "AT+BAND?", "AT+PTP?"};
+/** Number of commands per run */
+#define BENCH_LOOPS 200000
+/** Number of runs, the best run is reported */
+#define BENCH_RUNS 5
+
+/**
+ * @brief Feed one command line into the AT parser
+ *
+ * @param cmd command without line end
+ */
+static void bench_send(const char *cmd)
+{
+	for (const char *ptr = cmd; *ptr; ptr++)
+	{
+		at_serial_input((uint8_t)*ptr);
+	}
+	at_serial_input((uint8_t)'\r');
+}
+
+/**
+ * @brief Run the command mix several times
+ *
+ * @param discard true to drop the responses without formatting them
+ * @return double commands per second of the best run
+ */
+static double bench_run(bool discard)
+{
+	uint8_t num_cmds = sizeof(bench_cmds) / sizeof(bench_cmds[0]);
+	double best = 0;
+
+	g_host_serial_discard = discard;
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int loop = 0; loop < BENCH_LOOPS; loop++)
+		{
+			bench_send(bench_cmds[loop % num_cmds]);
+			// Responses are not needed, keep the capture buffer small
+			g_host_serial_out.clear();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double rate = BENCH_LOOPS / seconds;
+		if (rate > best)
+		{
+			best = rate;
+		}
+	}
+	g_host_serial_discard = false;
+	return best;
+}
+
+int main(void)
+{
+	// Check that the commands are really executed
+	bench_send("AT+VER?");
+	if (g_host_serial_out.find("OK") == std::string::npos)
+	{
+		printf("bench_at: AT+VER? failed\n");
+		return 1;
+	}
+
+	printf("bench_at: best of %d runs with %d commands\n", BENCH_RUNS, BENCH_LOOPS);
+	printf("bench_at: %.0f commands/s with formatted responses\n", bench_run(false));
+	printf("bench_at: %.0f commands/s with responses discarded (parser and handlers only)\n", bench_run(true));
+	return 0;
+}
@@ -0,0 +1,394 @@
+/**
+ * @file host_hw.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Fakes of the hardware libraries, so the whole library can be linked on a PC.
+ *    Application callbacks and battery functions are weak, a test can define its own.
+ * @version 0.1
+ * @date 2022-03-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <Arduino.h>
+#include <LoRaWan-Arduino.h>
+#include <bluefruit.h>
+#include <Adafruit_LittleFS.h>
+#include <InternalFileSystem.h>
+#include <CayenneLPP.h>
+#include <nrf_nvic.h>
+#include "host_hw.h"
+
+using namespace Adafruit_LittleFS_Namespace;
+
+s_host_radio g_host_radio;
+s_host_lmh g_host_lmh;
+std::map<std::string, std::vector<uint8_t>> g_host_files;
+
+/**
+ * @brief Clear the recorded radio calls, keep the callbacks
+ *
+ */
+void host_radio_reset(void)
+{
+	RadioEvents_t *events = g_host_radio.events;
+	memset(&g_host_radio, 0, sizeof(g_host_radio));
+	g_host_radio.events = events;
+}
+
+/**
+ * @brief Clear the fake LoRaMAC state, keep the callbacks
+ *
+ */
+void host_lmh_reset(void)
+{
+	lmh_callback_t *callbacks = g_host_lmh.callbacks;
+	memset(&g_host_lmh, 0, sizeof(g_host_lmh));
+	g_host_lmh.callbacks = callbacks;
+	g_host_lmh.join_status = LMH_RESET;
+	g_host_lmh.send_result = LMH_SUCCESS;
+	g_host_lmh.max_payload = 51;
+}
+
+// SX126x radio
+static void host_radio_call(uint8_t call)
+{
+	g_host_radio.last_call = call;
+	g_host_radio.calls[call]++;
+}
+static void radio_init(RadioEvents_t *events)
+{
+	g_host_radio.events = events;
+	host_radio_call(HOST_RADIO_INIT);
+}
+static void radio_sleep(void) { host_radio_call(HOST_RADIO_SLEEP); }
+static void radio_standby(void) { host_radio_call(HOST_RADIO_STANDBY); }
+static void radio_set_channel(uint32_t freq)
+{
+	g_host_radio.channel = freq;
+	host_radio_call(HOST_RADIO_SET_CHANNEL);
+}
+static void radio_set_tx_config(RadioModems_t, int8_t, uint32_t, uint32_t, uint32_t, uint8_t, uint16_t, bool, bool, bool, uint8_t, bool, uint32_t)
+{
+	host_radio_call(HOST_RADIO_TX_CONFIG);
+}
+static void radio_set_rx_config(RadioModems_t, uint32_t, uint32_t, uint8_t, uint32_t, uint16_t, uint16_t, bool, uint8_t, bool, bool, uint8_t, bool, bool)
+{
+	host_radio_call(HOST_RADIO_RX_CONFIG);
+}
+static void radio_rx(uint32_t timeout)
+{
+	g_host_radio.rx_timeout = timeout;
+	host_radio_call(HOST_RADIO_RX);
+}
+static void radio_send(uint8_t *data, uint8_t size)
+{
+	memcpy(g_host_radio.tx_data, data, size);
+	g_host_radio.tx_len = size;
+	host_radio_call(HOST_RADIO_SEND);
+}
+static void radio_start_cad(void) { host_radio_call(HOST_RADIO_START_CAD); }
+static void radio_set_cad_params(uint8_t, uint8_t, uint8_t, uint8_t, uint32_t) { host_radio_call(HOST_RADIO_CAD_PARAMS); }
+static void radio_set_rx_duty_cycle(uint32_t, uint32_t) { host_radio_call(HOST_RADIO_RX_DUTY_CYCLE); }
+static uint32_t radio_random(void) { return (uint32_t)random(0x7FFFFFFF); }
+static uint32_t radio_time_on_air(RadioModems_t, uint8_t) { return g_host_radio.time_on_air; }
+
+const struct Radio_s Radio = {radio_init, radio_sleep, radio_standby, radio_set_channel, radio_set_tx_config,
+							  radio_set_rx_config, radio_rx, radio_send, radio_start_cad, radio_set_cad_params,
+							  radio_set_rx_duty_cycle, radio_random, radio_time_on_air};
+
+uint32_t lora_rak4630_init(void) { return 0; }
+void BoardGetUniqueId(uint8_t *id)
+{
+	for (uint8_t idx = 0; idx < 8; idx++)
+	{
+		id[idx] = 0x10 + idx;
+	}
+}
+uint32_t BoardGetRandomSeed(void) { return 0x12345678; }
+
+// LoRaMAC handler
+lmh_error_status lmh_init(lmh_callback_t *callbacks, lmh_param_t, bool, eDeviceClass, LoRaMacRegion_t, bool)
+{
+	g_host_lmh.callbacks = callbacks;
+	return LMH_SUCCESS;
+}
+void lmh_setDevEui(uint8_t *) {}
+void lmh_setAppEui(uint8_t *) {}
+void lmh_setAppKey(uint8_t *) {}
+void lmh_setNwkSKey(uint8_t *) {}
+void lmh_setAppSKey(uint8_t *) {}
+void lmh_setDevAddr(uint32_t) {}
+bool lmh_setSubBandChannels(uint8_t) { return true; }
+void lmh_join(void)
+{
+	g_host_lmh.joins++;
+	g_host_lmh.join_status = LMH_ONGOING;
+}
+uint32_t lmh_getDevAddr(void) { return 0x26011234; }
+lmh_join_status lmh_join_status_get(void) { return g_host_lmh.join_status; }
+lmh_error_status lmh_send(lmh_app_data_t *app_data, lmh_confirm)
+{
+	g_host_lmh.sends++;
+	if (g_host_lmh.send_result == LMH_SUCCESS)
+	{
+		memcpy(g_host_lmh.tx_data, app_data->buffer, app_data->buffsize);
+		g_host_lmh.tx_len = app_data->buffsize;
+		g_host_lmh.tx_port = app_data->port;
+		g_host_lmh.uplink_counter++;
+	}
+	return g_host_lmh.send_result;
+}
+void lmh_datarate_set(uint8_t datarate, bool) { g_host_lmh.datarate = datarate; }
+void lmh_tx_power_set(uint8_t tx_power) { g_host_lmh.tx_power = tx_power; }
+
+// LoRaMAC MIB, only the values the library reads back
+static uint8_t host_nwk_skey[16];
+static uint8_t host_app_skey[16];
+static uint16_t host_channels_mask[6] = {0x00FF};
+
+LoRaMacStatus_t LoRaMacMibGetRequestConfirm(MibRequestConfirm_t *req)
+{
+	switch (req->Type)
+	{
+	case MIB_CHANNELS_DATARATE:
+		req->Param.ChannelsDatarate = g_host_lmh.datarate;
+		break;
+	case MIB_UPLINK_COUNTER:
+		req->Param.UpLinkCounter = g_host_lmh.uplink_counter;
+		break;
+	case MIB_DOWNLINK_COUNTER:
+		req->Param.DownLinkCounter = g_host_lmh.downlink_counter;
+		break;
+	case MIB_DEV_ADDR:
+		req->Param.DevAddr = lmh_getDevAddr();
+		break;
+	case MIB_NWK_SKEY:
+		req->Param.NwkSKey = host_nwk_skey;
+		break;
+	case MIB_APP_SKEY:
+		req->Param.AppSKey = host_app_skey;
+		break;
+	case MIB_NETWORK_JOINED:
+		req->Param.IsNetworkJoined = g_host_lmh.join_status == LMH_SET;
+		break;
+	case MIB_RX2_CHANNEL:
+		req->Param.Rx2Channel = {869525000, 0};
+		break;
+	case MIB_CHANNELS_MASK:
+		req->Param.ChannelsMask = host_channels_mask;
+		break;
+	}
+	return LORAMAC_STATUS_OK;
+}
+
+LoRaMacStatus_t LoRaMacMibSetRequestConfirm(MibRequestConfirm_t *req)
+{
+	switch (req->Type)
+	{
+	case MIB_UPLINK_COUNTER:
+		g_host_lmh.uplink_counter = req->Param.UpLinkCounter;
+		break;
+	case MIB_DOWNLINK_COUNTER:
+		g_host_lmh.downlink_counter = req->Param.DownLinkCounter;
+		break;
+	case MIB_NETWORK_JOINED:
+		g_host_lmh.join_status = req->Param.IsNetworkJoined ? LMH_SET : LMH_RESET;
+		break;
+	default:
+		break;
+	}
+	return LORAMAC_STATUS_OK;
+}
+
+LoRaMacStatus_t LoRaMacQueryTxPossible(uint8_t size, LoRaMacTxInfo_t *tx_info)
+{
+	tx_info->MaxPossiblePayload = g_host_lmh.max_payload;
+	tx_info->CurrentPayloadSize = size;
+	return size <= g_host_lmh.max_payload ? LORAMAC_STATUS_OK : LORAMAC_STATUS_LENGTH_ERROR;
+}
+
+// Internal file system, kept in g_host_files
+IFS InternalFS;
+bool IFS::begin() { return true; }
+bool IFS::format()
+{
+	g_host_files.clear();
+	return true;
+}
+bool IFS::remove(const char *name) { return g_host_files.erase(name) != 0; }
+bool IFS::exists(const char *name) { return g_host_files.count(name) != 0; }
+bool IFS::rename(const char *from, const char *to)
+{
+	if (g_host_files.count(from) == 0)
+	{
+		return false;
+	}
+	g_host_files[to] = g_host_files[from];
+	g_host_files.erase(from);
+	return true;
+}
+
+File::File() {}
+template <>
+File::File(IFS &) {}
+
+File IFS::open(const char *name, int)
+{
+	File folder;
+	if (strcmp(name, "/") == 0)
+	{
+		folder.open("/", FILE_O_READ);
+	}
+	return folder;
+}
+File File::openNextFile(int)
+{
+	File entry;
+	if (_folder && (_pos < g_host_files.size()))
+	{
+		auto file = g_host_files.begin();
+		std::advance(file, _pos++);
+		entry.open(file->first.c_str(), FILE_O_READ);
+	}
+	return entry;
+}
+const char *File::name() { return _name; }
+bool File::isDirectory() { return _folder; }
+
+bool File::open(const char *name, int mode)
+{
+	// The fake file system has only the root folder
+	_folder = strcmp(name, "/") == 0;
+	if (_folder)
+	{
+		snprintf(_name, sizeof(_name), "/");
+		_pos = 0;
+		return true;
+	}
+	if ((mode == FILE_O_READ) && (g_host_files.count(name) == 0))
+	{
+		_name[0] = 0;
+		return false;
+	}
+	snprintf(_name, sizeof(_name), "%s", name);
+	// Like LittleFS, a file opened for writing is created and written at the end
+	_pos = mode == FILE_O_WRITE ? g_host_files[_name].size() : 0;
+	return true;
+}
+File::operator bool() { return _name[0] != 0; }
+int File::read(uint8_t *buffer, int size)
+{
+	if (_name[0] == 0)
+	{
+		return -1;
+	}
+	std::vector<uint8_t> &file = g_host_files[_name];
+	int count = 0;
+	while ((count < size) && (_pos < file.size()))
+	{
+		buffer[count++] = file[_pos++];
+	}
+	return count;
+}
+int File::read(void *buffer, int size) { return read((uint8_t *)buffer, size); }
+int File::write(const uint8_t *data, int size)
+{
+	if (_name[0] == 0)
+	{
+		return -1;
+	}
+	std::vector<uint8_t> &file = g_host_files[_name];
+	for (int idx = 0; idx < size; idx++)
+	{
+		if (_pos < file.size())
+		{
+			file[_pos] = data[idx];
+		}
+		else
+		{
+			file.push_back(data[idx]);
+		}
+		_pos++;
+	}
+	return size;
+}
+int File::write(uint8_t *data, int size) { return write((const uint8_t *)data, size); }
+void File::flush() {}
+void File::close() { _name[0] = 0; }
+uint32_t File::size() { return _name[0] != 0 ? g_host_files[_name].size() : 0; }
+bool File::seek(uint32_t pos)
+{
+	_pos = pos;
+	return true;
+}
+uint32_t File::position() { return _pos; }
+
+// Bluefruit, BLE is never connected in the host tests
+Bluefruit_ Bluefruit;
+bool BLEUuid::operator==(const BLEUuid &) const { return true; }
+BLECharacteristic::BLECharacteristic(int) {}
+void BLECharacteristic::write(void *, int) {}
+void BLECharacteristic::notify(void *, int) {}
+void BLECharacteristic::setProperties(int) {}
+void BLECharacteristic::setPermission(int, int) {}
+void BLECharacteristic::setFixedLen(int) {}
+void BLECharacteristic::setWriteCallback(void (*)(uint16_t, BLECharacteristic *, uint8_t *, uint16_t)) {}
+void BLECharacteristic::begin() {}
+BLEService::BLEService() {}
+BLEService::BLEService(int) {}
+void BLEService::begin() {}
+void BLEUart::begin() {}
+void BLEUart::setRxCallback(void (*)(uint16_t)) {}
+void BLEDfu::begin() {}
+void BLEDis::setManufacturer(const char *) {}
+void BLEDis::setModel(const char *) {}
+void BLEDis::setSoftwareRev(const char *) {}
+void BLEDis::setHardwareRev(const char *) {}
+void BLEDis::begin() {}
+void Adv::addFlags(int) {}
+void Adv::addService(BLEService &) {}
+void Adv::addName() {}
+void Adv::addTxPower() {}
+void Adv::restartOnDisconnect(bool) {}
+void Adv::setInterval(int, int) {}
+void Adv::setFastTimeout(int) {}
+void Adv::start(int) {}
+void Periph_::setConnectCallback(void (*)(uint16_t)) {}
+void Periph_::setDisconnectCallback(void (*)(uint16_t, uint8_t)) {}
+void Bluefruit_::configPrphBandwidth(int) {}
+void Bluefruit_::configPrphConn(int, int, int, int) {}
+void Bluefruit_::begin(int, int) {}
+void Bluefruit_::setTxPower(int) {}
+void Bluefruit_::autoConnLed(bool) {}
+void Bluefruit_::setName(const char *) {}
+
+// CayenneLPP
+CayenneLPP::CayenneLPP(uint8_t size) : _maxsize(size), _cursor(0)
+{
+	_buffer = (uint8_t *)malloc(size);
+}
+CayenneLPP::~CayenneLPP() { free(_buffer); }
+void CayenneLPP::reset() { _cursor = 0; }
+uint8_t CayenneLPP::getSize() { return _cursor; }
+uint8_t *CayenneLPP::getBuffer() { return _buffer; }
+uint8_t CayenneLPP::getError() { return _error; }
+
+// Reset is recorded instead of done
+uint32_t g_host_resets = 0;
+void sd_nvic_SystemReset(void) { g_host_resets++; }
+
+// Battery, bat.cpp needs the WisBlock pin definitions
+__attribute__((weak)) void init_batt(void) {}
+__attribute__((weak)) float read_batt(void) { return 4000.0; }
+__attribute__((weak)) uint8_t get_lora_batt(void) { return 200; }
+
+// Application, a test can define its own
+__attribute__((weak)) char g_ble_dev_name[10] = "HOST";
+__attribute__((weak)) void setup_app(void) {}
+__attribute__((weak)) bool init_app(void) { return true; }
+__attribute__((weak)) void app_event_handler(void) {}
+__attribute__((weak)) void lora_data_handler(void) {}
+// No custom AT commands. On the target an undefined weak variable reads as 0, here it must exist.
+// Declared without the atcmd_t type to keep this file independent of the library headers.
+__attribute__((weak)) void *g_user_at_cmd_list = NULL;
+__attribute__((weak)) uint8_t g_user_at_cmd_num = 0;
@@ -0,0 +1,80 @@
+/**
+ * @file host_hw.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Fakes of the SX126x-Arduino, Bluefruit, LittleFS and battery functions
+ *    used when the whole library is linked for a host test
+ * @version 0.1
+ * @date 2022-03-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef HOST_HW_H
+#define HOST_HW_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "LoRaWan-Arduino.h"
+
+/** Radio functions recorded by the fake SX126x driver */
+enum HOST_RADIO_CALL
+{
+	HOST_RADIO_NONE = 0,
+	HOST_RADIO_INIT,
+	HOST_RADIO_SLEEP,
+	HOST_RADIO_STANDBY,
+	HOST_RADIO_SET_CHANNEL,
+	HOST_RADIO_TX_CONFIG,
+	HOST_RADIO_RX_CONFIG,
+	HOST_RADIO_RX,
+	HOST_RADIO_SEND,
+	HOST_RADIO_START_CAD,
+	HOST_RADIO_CAD_PARAMS,
+	HOST_RADIO_RX_DUTY_CYCLE,
+	HOST_RADIO_CALLS
+};
+
+/** State of the fake radio */
+struct s_host_radio
+{
+	RadioEvents_t *events;		   // Callbacks given to Radio.Init()
+	uint8_t last_call;			   // Last HOST_RADIO_CALL
+	uint32_t calls[HOST_RADIO_CALLS]; // Number of calls per function
+	uint32_t channel;			   // Last frequency
+	uint32_t rx_timeout;		   // Timeout of the last Radio.Rx()
+	uint8_t tx_data[256];		   // Last packet given to Radio.Send()
+	uint8_t tx_len;
+	uint32_t time_on_air;		   // Returned by Radio.TimeOnAir()
+};
+extern s_host_radio g_host_radio;
+void host_radio_reset(void);
+
+/** State of the fake LoRaMAC handler */
+struct s_host_lmh
+{
+	lmh_callback_t *callbacks;	 // Callbacks given to lmh_init()
+	lmh_join_status join_status; // Returned by lmh_join_status_get()
+	lmh_error_status send_result; // Returned by lmh_send()
+	uint32_t joins;				 // Number of lmh_join() calls
+	uint32_t sends;				 // Number of lmh_send() calls
+	uint8_t tx_data[256];		 // Last uplink
+	uint8_t tx_len;
+	uint8_t tx_port;
+	uint8_t datarate;
+	uint8_t tx_power;
+	uint32_t uplink_counter;   // MIB_UPLINK_COUNTER
+	uint32_t downlink_counter; // MIB_DOWNLINK_COUNTER
+	uint8_t max_payload;	   // Returned by LoRaMacQueryTxPossible()
+};
+extern s_host_lmh g_host_lmh;
+void host_lmh_reset(void);
+
+/** Number of sd_nvic_SystemReset() calls */
+extern uint32_t g_host_resets;
+
+/** Files of the fake internal file system */
+extern std::map<std::string, std::vector<uint8_t>> g_host_files;
+
+#endif
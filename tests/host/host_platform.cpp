@@ -0,0 +1,153 @@
+/**
+ * @file host_platform.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Fake Arduino and FreeRTOS functions to run library modules on a PC
+ * @version 0.1
+ * @date 2022-03-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <atomic>
+#include <stdarg.h>
+#include "Arduino.h"
+#include "host_platform.h"
+
+/** Fake time in microseconds */
+static std::atomic<uint64_t> host_time_us(0);
+/** State of the pseudo random generator */
+static uint32_t host_random_state = 1;
+/** Pending serial input */
+static std::string host_serial_in;
+
+/** Serial output collected for the test */
+std::string g_host_serial_out;
+/** Drop the serial output */
+bool g_host_serial_discard = false;
+
+Stream Serial;
+Stream Serial1;
+
+static SCB_Type host_scb = {0};
+SCB_Type *SCB = &host_scb;
+
+void host_set_time_us(uint64_t time_us) { host_time_us = time_us; }
+void host_advance_ms(uint32_t ms) { host_time_us += (uint64_t)ms * 1000; }
+void host_advance_us(uint32_t us) { host_time_us += us; }
+void host_serial_feed(const char *input) { host_serial_in += input; }
+void host_random_seed(uint32_t seed) { host_random_state = seed != 0 ? seed : 1; }
+
+unsigned long millis(void) { return (unsigned long)(uint32_t)(host_time_us / 1000); }
+unsigned long micros(void) { return (unsigned long)(uint32_t)host_time_us; }
+void delay(unsigned long ms) { host_advance_ms(ms); }
+void yield(void) {}
+
+void pinMode(int, int) {}
+void digitalWrite(int, int) {}
+int digitalRead(int) { return LOW; }
+
+void randomSeed(unsigned long seed) { host_random_seed(seed); }
+
+long random(long max)
+{
+	// xorshift32, good enough and the same on every host
+	host_random_state ^= host_random_state << 13;
+	host_random_state ^= host_random_state >> 17;
+	host_random_state ^= host_random_state << 5;
+	return max > 0 ? (long)(host_random_state % (uint32_t)max) : 0;
+}
+
+long random(long min, long max) { return max > min ? min + random(max - min) : min; }
+
+int Stream::available() { return (int)host_serial_in.size(); }
+
+int Stream::read()
+{
+	if (host_serial_in.empty())
+	{
+		return -1;
+	}
+	int c = (uint8_t)host_serial_in[0];
+	host_serial_in.erase(0, 1);
+	return c;
+}
+
+size_t Stream::readBytes(char *buffer, size_t len)
+{
+	size_t count = 0;
+	while ((count < len) && !host_serial_in.empty())
+	{
+		buffer[count++] = (char)read();
+	}
+	return count;
+}
+
+size_t Stream::readBytes(uint8_t *buffer, size_t len) { return readBytes((char *)buffer, len); }
+
+size_t Stream::write(const uint8_t *data, size_t len)
+{
+	if (g_host_serial_discard)
+	{
+		return len;
+	}
+	g_host_serial_out.append((const char *)data, len);
+	return len;
+}
+
+int Stream::printf(const char *format, ...)
+{
+	if (g_host_serial_discard)
+	{
+		return 0;
+	}
+	char line[512];
+	va_list args;
+	va_start(args, format);
+	int len = vsnprintf(line, sizeof(line), format, args);
+	va_end(args);
+	g_host_serial_out += line;
+	return len;
+}
+
+void Stream::flush() {}
+void Stream::begin(int) {}
+Stream::operator bool() { return true; }
+void Stream::print(const char *text)
+{
+	if (!g_host_serial_discard)
+	{
+		g_host_serial_out += text;
+	}
+}
+void Stream::println(const char *text)
+{
+	if (!g_host_serial_discard)
+	{
+		g_host_serial_out += std::string(text) + "\r\n";
+	}
+}
+void Stream::println()
+{
+	if (!g_host_serial_discard)
+	{
+		g_host_serial_out += "\r\n";
+	}
+}
+void Stream::onReceive(void (*)(void)) {}
+
+// FreeRTOS, the tests run everything in one task
+SemaphoreHandle_t xSemaphoreCreateBinary() { return (SemaphoreHandle_t)&host_scb; }
+int xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+int xSemaphoreTake(SemaphoreHandle_t, uint32_t) { return pdTRUE; }
+int xSemaphoreGiveFromISR(SemaphoreHandle_t, BaseType_t *) { return pdTRUE; }
+TimerHandle_t xTimerCreate(const char *, TickType_t, int, void *, void (*)(TimerHandle_t)) { return (TimerHandle_t)&host_scb; }
+int xTimerChangePeriod(TimerHandle_t, TickType_t, TickType_t) { return pdTRUE; }
+int xTimerStart(TimerHandle_t, TickType_t) { return pdTRUE; }
+int xTimerStop(TimerHandle_t, TickType_t) { return pdTRUE; }
+int xTimerChangePeriodFromISR(TimerHandle_t, TickType_t, BaseType_t *) { return pdTRUE; }
+int xTimerStartFromISR(TimerHandle_t, BaseType_t *) { return pdTRUE; }
+int xTimerStopFromISR(TimerHandle_t, BaseType_t *) { return pdTRUE; }
+void portYIELD_FROM_ISR(BaseType_t) {}
+bool isInISR(void) { return false; }
+TickType_t xTaskGetTickCount(void) { return (TickType_t)millis(); }
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return (TaskHandle_t)&host_scb; }
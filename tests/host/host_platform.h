@@ -0,0 +1,31 @@
+/**
+ * @file host_platform.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Controls of the fake Arduino platform used by the host tests
+ * @version 0.1
+ * @date 2022-03-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef HOST_PLATFORM_H
+#define HOST_PLATFORM_H
+
+#include <stdint.h>
+#include <string>
+
+// Fake clock, millis() and micros() only move when the test moves them
+void host_set_time_us(uint64_t time_us);
+void host_advance_ms(uint32_t ms);
+void host_advance_us(uint32_t us);
+
+// Serial, everything written is collected, input is read from a buffer
+extern std::string g_host_serial_out;
+// Set to drop the output without formatting it, e.g. for benchmarks
+extern bool g_host_serial_discard;
+void host_serial_feed(const char *input);
+
+// Make random() reproducible
+void host_random_seed(uint32_t seed);
+
+#endif
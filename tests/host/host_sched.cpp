@@ -0,0 +1,197 @@
+/**
+ * @file host_sched.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Fake scheduler for host tests, jobs run when the fake clock passes their deadline
+ * @version 0.1
+ * @date 2022-03-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+#include "host_platform.h"
+#include "host_sched.h"
+
+/** Max number of jobs */
+#define HOST_SCHED_JOBS 16
+
+/** A scheduled job */
+struct s_host_job
+{
+	uint8_t id; // 0 => slot is free
+	uint32_t deadline;
+	uint32_t period;
+	schedule_cb_t callback;
+	uint16_t event;
+};
+
+static s_host_job host_jobs[HOST_SCHED_JOBS];
+static uint8_t host_last_id = 0;
+static uint32_t host_last_delay = 0;
+
+/**
+ * @brief Put a job into a free slot
+ *
+ * @return uint8_t job id, 0 if all slots are used
+ */
+static uint8_t host_sched_add(schedule_cb_t callback, uint16_t event, uint32_t delay_ms, uint32_t period_ms)
+{
+	for (uint8_t idx = 0; idx < HOST_SCHED_JOBS; idx++)
+	{
+		if (host_jobs[idx].id == 0)
+		{
+			host_last_id++;
+			if (host_last_id == 0)
+			{
+				host_last_id = 1;
+			}
+			host_jobs[idx] = {host_last_id, (uint32_t)millis() + delay_ms, period_ms, callback, event};
+			host_last_delay = delay_ms;
+			return host_last_id;
+		}
+	}
+	return 0;
+}
+
+void api_schedule_init(void) { host_sched_clear(); }
+
+uint8_t api_schedule_event(uint16_t event, uint32_t delay_ms, uint32_t period_ms)
+{
+	return host_sched_add(NULL, event, delay_ms, period_ms);
+}
+
+uint8_t api_schedule_callback(schedule_cb_t callback, uint32_t delay_ms, uint32_t period_ms)
+{
+	return host_sched_add(callback, NO_EVENT, delay_ms, period_ms);
+}
+
+bool api_schedule_change(uint8_t id, uint32_t delay_ms, uint32_t period_ms)
+{
+	for (uint8_t idx = 0; idx < HOST_SCHED_JOBS; idx++)
+	{
+		if ((id != 0) && (host_jobs[idx].id == id))
+		{
+			host_jobs[idx].deadline = (uint32_t)millis() + delay_ms;
+			host_jobs[idx].period = period_ms;
+			host_last_delay = delay_ms;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool api_schedule_cancel(uint8_t id)
+{
+	for (uint8_t idx = 0; idx < HOST_SCHED_JOBS; idx++)
+	{
+		if ((id != 0) && (host_jobs[idx].id == id))
+		{
+			host_jobs[idx].id = 0;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t api_schedule_next(void)
+{
+	uint32_t next = UINT32_MAX;
+	for (uint8_t idx = 0; idx < HOST_SCHED_JOBS; idx++)
+	{
+		if (host_jobs[idx].id != 0)
+		{
+			int32_t wait = (int32_t)(host_jobs[idx].deadline - (uint32_t)millis());
+			if (wait < 0)
+			{
+				wait = 0;
+			}
+			if ((uint32_t)wait < next)
+			{
+				next = (uint32_t)wait;
+			}
+		}
+	}
+	return next;
+}
+
+void api_schedule_run(void)
+{
+	bool found = true;
+	while (found)
+	{
+		// Run the job with the earliest deadline that is due
+		found = false;
+		uint8_t due = 0;
+		for (uint8_t idx = 0; idx < HOST_SCHED_JOBS; idx++)
+		{
+			if ((host_jobs[idx].id != 0) && ((int32_t)(host_jobs[idx].deadline - (uint32_t)millis()) <= 0) &&
+				(!found || ((int32_t)(host_jobs[idx].deadline - host_jobs[due].deadline) < 0)))
+			{
+				due = idx;
+				found = true;
+			}
+		}
+		if (!found)
+		{
+			break;
+		}
+		s_host_job job = host_jobs[due];
+		if (job.period != 0)
+		{
+			host_jobs[due].deadline += job.period;
+		}
+		else
+		{
+			host_jobs[due].id = 0;
+		}
+		if (job.callback != NULL)
+		{
+			job.callback();
+		}
+		else
+		{
+			api_event_push(job.event, job.id);
+		}
+	}
+}
+
+uint8_t host_sched_count(void)
+{
+	uint8_t count = 0;
+	for (uint8_t idx = 0; idx < HOST_SCHED_JOBS; idx++)
+	{
+		if (host_jobs[idx].id != 0)
+		{
+			count++;
+		}
+	}
+	return count;
+}
+
+uint32_t host_sched_last_delay(void) { return host_last_delay; }
+
+void host_sched_run_for(uint32_t ms)
+{
+	uint32_t end = (uint32_t)millis() + ms;
+	while (true)
+	{
+		uint32_t next = api_schedule_next();
+		uint32_t left = end - (uint32_t)millis();
+		if (next > left)
+		{
+			host_advance_ms(left);
+			api_schedule_run();
+			return;
+		}
+		host_advance_ms(next);
+		api_schedule_run();
+	}
+}
+
+void host_sched_clear(void)
+{
+	for (uint8_t idx = 0; idx < HOST_SCHED_JOBS; idx++)
+	{
+		host_jobs[idx].id = 0;
+	}
+}
@@ -0,0 +1,25 @@
+/**
+ * @file host_sched.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Fake scheduler for host tests of modules that use api_schedule_*()
+ * @version 0.1
+ * @date 2022-03-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef HOST_SCHED_H
+#define HOST_SCHED_H
+
+#include <stdint.h>
+
+// Number of jobs that are waiting
+uint8_t host_sched_count(void);
+// Delay of the last scheduled job
+uint32_t host_sched_last_delay(void);
+// Move the fake clock forward and run the jobs that are due on the way
+void host_sched_run_for(uint32_t ms);
+// Remove all jobs
+void host_sched_clear(void);
+
+#endif
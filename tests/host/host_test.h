@@ -0,0 +1,56 @@
+/**
+ * @file host_test.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Minimal check macros for the host tests
+ * @version 0.1
+ * @date 2022-03-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <stdio.h>
+
+/** Number of failed checks of the running test */
+inline int host_failures = 0;
+
+/** Check a condition, report the location if it fails */
+#define CHECK(cond)                                                             \
+	do                                                                          \
+	{                                                                           \
+		if (!(cond))                                                            \
+		{                                                                       \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);     \
+			host_failures++;                                                    \
+		}                                                                       \
+	} while (0)
+
+/** Check two integer values for equality, report both values if they differ */
+#define CHECK_EQ(a, b)                                                          \
+	do                                                                          \
+	{                                                                           \
+		long long _a = (long long)(a);                                          \
+		long long _b = (long long)(b);                                          \
+		if (_a != _b)                                                           \
+		{                                                                       \
+			printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n",            \
+				   __FILE__, __LINE__, #a, #b, _a, _b);                         \
+			host_failures++;                                                    \
+		}                                                                       \
+	} while (0)
+
+/**
+ * @brief Print the result of a test
+ *
+ * @param name name of the test
+ * @return int exit code, 0 if all checks passed
+ */
+inline int host_report(const char *name)
+{
+	printf("%s: %s\n", name, host_failures == 0 ? "OK" : "FAILED");
+	return host_failures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,36 @@
+// Host test stub of <Adafruit_LittleFS.h>, declares only what the library uses
+#pragma once
+#include <Arduino.h>
+#define FILE_O_READ 0
+#define FILE_O_WRITE 1
+namespace Adafruit_LittleFS_Namespace
+{
+	class File
+	{
+	public:
+		File();
+		template <class T>
+		File(T &);
+		bool open(const char *, int);
+		operator bool();
+		int read(uint8_t *, int);
+		int read(void *, int);
+		int write(uint8_t *, int);
+		int write(const uint8_t *, int);
+		void flush();
+		void close();
+		uint32_t size();
+		bool seek(uint32_t);
+		uint32_t position();
+		File openNextFile(int);
+		const char *name();
+		bool isDirectory();
+
+	private:
+		// Name of the open file in the fake file system, empty if closed
+		char _name[64] = {0};
+		uint32_t _pos = 0;
+		// Root folder, _pos is the index of the next file
+		bool _folder = false;
+	};
+}
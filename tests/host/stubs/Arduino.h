@@ -0,0 +1,43 @@
+// Host test stub of <Arduino.h>, declares only what the library uses
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <time.h>
+#include <math.h>
+typedef bool boolean;
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+#define LED_GREEN 35
+#define LED_BLUE 36
+#define WB_IO2 34
+void pinMode(int, int); void digitalWrite(int, int); int digitalRead(int);
+unsigned long millis(void); unsigned long micros(void); void delay(unsigned long); void yield(void);
+long random(long); long random(long, long); void randomSeed(unsigned long);
+#define PRINTF printf
+class Stream { public: int available(); int read(); size_t readBytes(char *b, size_t l); size_t readBytes(uint8_t *b, size_t l); size_t write(const uint8_t *, size_t); void flush(); int printf(const char *, ...); void begin(int); operator bool(); void print(const char*); void println(const char*); void println(); void onReceive(void (*)(void)); };
+extern Stream Serial; extern Stream Serial1;
+#define noInterrupts()
+#define interrupts()
+// FreeRTOS
+typedef void *SemaphoreHandle_t; typedef void *TimerHandle_t; typedef uint32_t TickType_t; typedef long BaseType_t;
+#define pdFALSE 0
+#define pdTRUE 1
+#define portMAX_DELAY 0xffffffff
+#define configTICK_RATE_HZ 1024
+SemaphoreHandle_t xSemaphoreCreateBinary(); int xSemaphoreGive(SemaphoreHandle_t); int xSemaphoreTake(SemaphoreHandle_t, uint32_t); int xSemaphoreGiveFromISR(SemaphoreHandle_t, BaseType_t*);
+TimerHandle_t xTimerCreate(const char*, TickType_t, int, void*, void(*)(TimerHandle_t));
+int xTimerChangePeriod(TimerHandle_t, TickType_t, TickType_t); int xTimerStart(TimerHandle_t, TickType_t); int xTimerStop(TimerHandle_t, TickType_t);
+int xTimerChangePeriodFromISR(TimerHandle_t, TickType_t, BaseType_t*); int xTimerStartFromISR(TimerHandle_t, BaseType_t*); int xTimerStopFromISR(TimerHandle_t, BaseType_t*);
+void portYIELD_FROM_ISR(BaseType_t); bool isInISR(void);
+TickType_t xTaskGetTickCount(void);
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+typedef void *TaskHandle_t; TaskHandle_t xTaskGetCurrentTaskHandle(void);
+struct SCB_Type { volatile uint32_t ICSR; }; extern SCB_Type *SCB; 
+#define SCB_ICSR_VECTACTIVE_Msk 0x1FFUL
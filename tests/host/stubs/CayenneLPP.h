@@ -0,0 +1,28 @@
+// Host test stub of <CayenneLPP.h>, declares only what the library uses
+#pragma once
+#include <Arduino.h>
+#define LPP_ERROR_OK 0
+#define LPP_ERROR_OVERFLOW 1
+class CayenneLPP { public: CayenneLPP(uint8_t size); ~CayenneLPP(); void reset(); uint8_t getSize(); uint8_t *getBuffer(); uint8_t copy(uint8_t *buffer); uint8_t getError();
+ uint8_t addTemperature(uint8_t, float); uint8_t addRelativeHumidity(uint8_t, float);
+protected: uint8_t *_buffer; uint8_t _maxsize; uint8_t _cursor; uint8_t _error = LPP_ERROR_OK; };
+#define LPP_DIGITAL_INPUT 0
+#define LPP_DIGITAL_OUTPUT 1
+#define LPP_ANALOG_INPUT 2
+#define LPP_ANALOG_OUTPUT 3
+#define LPP_GENERIC_SENSOR 100
+#define LPP_LUMINOSITY 101
+#define LPP_PRESENCE 102
+#define LPP_TEMPERATURE 103
+#define LPP_RELATIVE_HUMIDITY 104
+#define LPP_BAROMETRIC_PRESSURE 115
+#define LPP_VOLTAGE 116
+#define LPP_CURRENT 117
+#define LPP_FREQUENCY 118
+#define LPP_PERCENTAGE 120
+#define LPP_ALTITUDE 121
+#define LPP_CONCENTRATION 125
+#define LPP_POWER 128
+#define LPP_DISTANCE 130
+#define LPP_ENERGY 131
+#define LPP_DIRECTION 132
@@ -0,0 +1,5 @@
+// Host test stub of <InternalFileSystem.h>, declares only what the library uses
+#pragma once
+#include <Adafruit_LittleFS.h>
+struct IFS { bool begin(); bool format(); bool remove(const char*); bool exists(const char*); bool rename(const char*, const char*); Adafruit_LittleFS_Namespace::File open(const char*, int); };
+extern IFS InternalFS;
@@ -0,0 +1,36 @@
+// Host test stub of <LoRaWan-Arduino.h>, declares only what the library uses
+#pragma once
+#include <Arduino.h>
+typedef enum { LMH_SUCCESS = 0, LMH_BUSY = -1, LMH_ERROR = -2 } lmh_error_status;
+typedef enum { LMH_UNCONFIRMED_MSG = 0, LMH_CONFIRMED_MSG = !LMH_UNCONFIRMED_MSG } lmh_confirm;
+typedef enum { LMH_RESET = 0, LMH_SET = 1, LMH_ONGOING = 2, LMH_FAILED = 3 } lmh_join_status;
+typedef enum { CLASS_A, CLASS_B, CLASS_C } DeviceClass_t; typedef DeviceClass_t eDeviceClass;
+typedef enum { LORAMAC_REGION_AS923, LORAMAC_REGION_AU915, LORAMAC_REGION_CN470, LORAMAC_REGION_CN779, LORAMAC_REGION_EU433, LORAMAC_REGION_EU868, LORAMAC_REGION_KR920, LORAMAC_REGION_IN865, LORAMAC_REGION_US915, LORAMAC_REGION_AS923_2, LORAMAC_REGION_AS923_3, LORAMAC_REGION_AS923_4, LORAMAC_REGION_RU864 } LoRaMacRegion_t;
+typedef struct { uint8_t *buffer; uint8_t buffsize; uint8_t port; int16_t rssi; int8_t snr; } lmh_app_data_t;
+typedef struct { bool adr_enable; int8_t tx_data_rate; bool enable_public_network; uint8_t nb_trials; int8_t tx_power; bool duty_cycle; } lmh_param_t;
+typedef struct { uint8_t (*BoardGetBatteryLevel)(void); void (*BoardGetUniqueId)(uint8_t *id); uint32_t (*BoardGetRandomSeed)(void); void (*lmh_RxData)(lmh_app_data_t *appdata); void (*lmh_has_joined)(void); void (*lmh_ConfirmClass)(DeviceClass_t Class); void (*lmh_has_joined_failed)(void); void (*lmh_unconf_finished)(void); void (*lmh_conf_result)(bool result); } lmh_callback_t;
+void BoardGetUniqueId(uint8_t *id); uint32_t BoardGetRandomSeed(void);
+void lmh_setDevEui(uint8_t*); void lmh_setAppEui(uint8_t*); void lmh_setAppKey(uint8_t*); void lmh_setNwkSKey(uint8_t*); void lmh_setAppSKey(uint8_t*); void lmh_setDevAddr(uint32_t);
+lmh_error_status lmh_init(lmh_callback_t *callbacks, lmh_param_t lora_param, bool otaa, eDeviceClass nodeClass = CLASS_A, LoRaMacRegion_t region = LORAMAC_REGION_EU868, bool region_change = false);
+bool lmh_setSubBandChannels(uint8_t); void lmh_join(void); uint32_t lmh_getDevAddr(void); lmh_join_status lmh_join_status_get(void);
+lmh_error_status lmh_send(lmh_app_data_t *app_data, lmh_confirm is_tx_confirmed); void lmh_datarate_set(uint8_t, bool); void lmh_tx_power_set(uint8_t);
+typedef enum { MODEM_FSK = 0, MODEM_LORA } RadioModems_t;
+typedef struct { void (*TxDone)(void); void (*TxTimeout)(void); void (*RxDone)(uint8_t *payload, uint16_t size, int16_t rssi, int8_t snr); void (*RxTimeout)(void); void (*RxError)(void); void (*FhssChangeChannel)(uint8_t); void (*CadDone)(bool); void (*PreAmpDetect)(void); } RadioEvents_t;
+typedef enum { LORA_CAD_01_SYMBOL, LORA_CAD_02_SYMBOL, LORA_CAD_04_SYMBOL, LORA_CAD_08_SYMBOL, LORA_CAD_16_SYMBOL } RadioLoRaCadSymbols_t;
+typedef enum { LORA_CAD_ONLY, LORA_CAD_RX, LORA_CAD_LBT } RadioCadExitModes_t;
+struct Radio_s { void (*Init)(RadioEvents_t *); void (*Sleep)(void); void (*Standby)(void); void (*SetChannel)(uint32_t);
+ void (*SetTxConfig)(RadioModems_t modem, int8_t power, uint32_t fdev, uint32_t bandwidth, uint32_t datarate, uint8_t coderate, uint16_t preambleLen, bool fixLen, bool crcOn, bool FreqHopOn, uint8_t HopPeriod, bool iqInverted, uint32_t timeout);
+ void (*SetRxConfig)(RadioModems_t modem, uint32_t bandwidth, uint32_t datarate, uint8_t coderate, uint32_t bandwidthAfc, uint16_t preambleLen, uint16_t symbTimeout, bool fixLen, uint8_t payloadLen, bool crcOn, bool FreqHopOn, uint8_t HopPeriod, bool iqInverted, bool rxContinuous);
+ void (*Rx)(uint32_t); void (*Send)(uint8_t *, uint8_t); void (*StartCad)(void); void (*SetCadParams)(uint8_t, uint8_t, uint8_t, uint8_t, uint32_t); void (*SetRxDutyCycle)(uint32_t, uint32_t); uint32_t (*Random)(void); uint32_t (*TimeOnAir)(RadioModems_t modem, uint8_t pktLen); };
+extern const struct Radio_s Radio;
+uint32_t lora_rak4630_init(void);
+typedef struct TimerEvent_s { uint32_t Timestamp; uint32_t ReloadValue; bool IsRunning; bool oneShot; void (*Callback)(void); } TimerEvent_t;
+void TimerInit(TimerEvent_t *, void (*)(void)); void TimerStart(TimerEvent_t *); void TimerStop(TimerEvent_t *); void TimerSetValue(TimerEvent_t *, uint32_t);
+typedef enum { MIB_CHANNELS_DATARATE = 1, MIB_UPLINK_COUNTER, MIB_DOWNLINK_COUNTER, MIB_DEV_ADDR, MIB_NWK_SKEY, MIB_APP_SKEY, MIB_NETWORK_JOINED, MIB_RX2_CHANNEL, MIB_CHANNELS_MASK } Mib_t;
+typedef struct { uint32_t Frequency; uint8_t Datarate; } Rx2ChannelParams_t;
+typedef union { int8_t ChannelsDatarate; uint32_t UpLinkCounter; uint32_t DownLinkCounter; uint32_t DevAddr; uint8_t *NwkSKey; uint8_t *AppSKey; bool IsNetworkJoined; Rx2ChannelParams_t Rx2Channel; uint16_t *ChannelsMask; } MibParam_t;
+typedef struct { Mib_t Type; MibParam_t Param; } MibRequestConfirm_t;
+typedef enum { LORAMAC_STATUS_OK = 0, LORAMAC_STATUS_BUSY, LORAMAC_STATUS_LENGTH_ERROR } LoRaMacStatus_t;
+LoRaMacStatus_t LoRaMacMibGetRequestConfirm(MibRequestConfirm_t *); LoRaMacStatus_t LoRaMacMibSetRequestConfirm(MibRequestConfirm_t *);
+typedef struct { uint8_t MaxPossiblePayload; uint8_t CurrentPayloadSize; } LoRaMacTxInfo_t;
+LoRaMacStatus_t LoRaMacQueryTxPossible(uint8_t size, LoRaMacTxInfo_t *txInfo);
@@ -0,0 +1,19 @@
+// Host test stub of <bluefruit.h>, declares only what the library uses
+#pragma once
+#include <Arduino.h>
+struct BLEUuid { bool operator==(const BLEUuid&) const; };
+class BLECharacteristic { public: BLECharacteristic(int); BLEUuid uuid; void write(void*, int); void notify(void*, int); void setProperties(int); void setPermission(int,int); void setFixedLen(int); void setWriteCallback(void (*)(uint16_t, BLECharacteristic*, uint8_t*, uint16_t)); void begin(); };
+class BLEService { public: BLEService(); BLEService(int); void begin(); };
+class BLEUart : public Stream { public: void begin(); void setRxCallback(void (*)(uint16_t)); };
+class BLEDfu { public: void begin(); }; class BLEDis { public: void setManufacturer(const char*); void setModel(const char*); void setSoftwareRev(const char*); void setHardwareRev(const char*); void begin(); };
+#define CHR_PROPS_NOTIFY 1
+#define CHR_PROPS_READ 2
+#define CHR_PROPS_WRITE 4
+#define SECMODE_OPEN 0
+#define BANDWIDTH_MAX 0
+#define BLE_GAP_EVENT_LENGTH_MIN 0
+#define BLE_GAP_ADV_FLAGS_LE_ONLY_GENERAL_DISC_MODE 0
+struct Adv { void addFlags(int); void addService(BLEService&); void addName(); void addTxPower(); void restartOnDisconnect(bool); void setInterval(int,int); void setFastTimeout(int); void start(int); };
+struct Periph_ { void setConnectCallback(void (*)(uint16_t)); void setDisconnectCallback(void (*)(uint16_t, uint8_t)); };
+struct Bluefruit_ { void configPrphBandwidth(int); void configPrphConn(int,int,int,int); void begin(int,int); void setTxPower(int); void autoConnLed(bool); void setName(const char*); Periph_ Periph; Adv Advertising; };
+extern Bluefruit_ Bluefruit;
@@ -0,0 +1,3 @@
+// Host test stub of <nrf_nvic.h>, declares only what the library uses
+#pragma once
+void sd_nvic_SystemReset(void);
@@ -0,0 +1,56 @@
+/**
+ * @file tdma_node.h
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief One virtual node of the TDMA simulation
+ * @version 0.1
+ * @date 2022-03-13
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+// No include guard, test_tdma.cpp includes this file once per node, each time inside its own namespace.
+// The functions below hide the global API from the copy of lora_tdma.cpp of this node,
+// so every node has its own module state, clock, scheduler and radio.
+
+/** The node */
+static sim_node node;
+
+/** Settings and RX mode of this node */
+s_lorawan_settings g_lorawan_settings;
+uint8_t g_lora_p2p_rx_mode = RX_MODE_NONE;
+uint32_t g_lora_p2p_rx_time = 0;
+
+unsigned long millis(void) { return sim_millis(&node); }
+uint8_t api_schedule_callback(schedule_cb_t callback, uint32_t delay_ms, uint32_t period_ms = 0) { return sim_schedule(&node, callback, delay_ms, period_ms); }
+bool api_schedule_cancel(uint8_t id) { return sim_cancel(&node, id); }
+uint8_t *api_tx_acquire(void) { return sim_tx_acquire(&node); }
+bool api_tx_start(uint8_t *data, uint8_t size) { return sim_tx_start(&node, data, size); }
+void api_tx_finished(void) { node.tx_busy = false; }
+// Takes the enum, an uint8_t parameter would be ambiguous with the global function found by argument lookup
+void api_p2p_event(P2P_EVENT event) { sim_event(&node, event); }
+uint8_t api_p2p_state(void) { return node.state; }
+
+#include "lora_tdma.cpp"
+
+/**
+ * @brief Connect the node to its copy of the TDMA module
+ *
+ * @param ppm clock error of the node
+ * @param offset_ms start value of millis() of the node
+ * @return sim_node* the node
+ */
+static sim_node *node_init(int32_t ppm, uint32_t offset_ms)
+{
+	node = {};
+	node.tdma = api_p2p_tdma;
+	node.tdma_slot = api_p2p_tdma_slot;
+	node.tdma_status = api_p2p_tdma_status;
+	node.tdma_rx = p2p_tdma_rx;
+	node.tdma_tx_done = p2p_tdma_tx_done;
+	node.tdma_defer = p2p_tdma_defer;
+	node.rx_mode = &g_lora_p2p_rx_mode;
+	node.rx_time = &g_lora_p2p_rx_time;
+	node.ppm = ppm;
+	node.offset_ms = offset_ms;
+	return &node;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file test_airtime.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the LoRa time on air against the Semtech formula
+ * @version 0.1
+ * @date 2022-03-14
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <math.h>
+#include "lora_airtime.h"
+#include "host_test.h"
+
+// The calculation works at compile time
+static_assert(api_lora_airtime(7, 125000, 1, 8, 23) == 61696, "SF7 125kHz 23 bytes");
+
+/**
+ * @brief Time on air with the formula of the SX1261/2 datasheet 6.1.4, in floating point
+ *
+ * @return double time on air in us
+ */
+static double semtech_airtime(int sf, double bw_hz, int cr, int preamble_len, int size, bool implicit_header, bool crc)
+{
+	double symbol_time = pow(2, sf) / bw_hz;
+	int ldro = symbol_time >= 0.016 ? 1 : 0;
+	double payload = 8 + fmax(ceil((8.0 * size - 4 * sf + 28 + 16 * crc - 20 * implicit_header) / (4.0 * (sf - 2 * ldro))) * (cr + 4), 0);
+	return (preamble_len + 4.25 + payload) * symbol_time * 1e6;
+}
+
+/**
+ * @brief All spreading factors, bandwidths, coding rates and payload sizes, with and without header and CRC
+ *
+ */
+static void test_formula(void)
+{
+	long checked = 0;
+	long mismatches = 0;
+	for (int sf = 7; sf <= 12; sf++)
+	{
+		for (int bw = 0; bw < 10; bw++)
+		{
+			uint32_t bw_hz = api_lora_bw_hz(bw);
+			for (int cr = 1; cr <= 4; cr++)
+			{
+				for (int size = 0; size < 256; size++)
+				{
+					for (int flags = 0; flags < 4; flags++)
+					{
+						bool implicit_header = flags & 1;
+						bool crc = flags & 2;
+						uint32_t airtime = api_lora_airtime(sf, bw_hz, cr, 8, size, implicit_header, crc);
+						double expected = semtech_airtime(sf, bw_hz, cr, 8, size, implicit_header, crc);
+						checked++;
+						// Rounded to the next us
+						if (fabs(airtime - expected) > 0.5001)
+						{
+							if (mismatches++ < 10)
+							{
+								printf("SF%d BW %dHz CR4/%d %d bytes IH %d CRC %d: %ldus, expected %.1fus\n",
+									   sf, bw_hz, cr + 4, size, implicit_header, crc, (long)airtime, expected);
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+	CHECK_EQ(mismatches, 0);
+	CHECK_EQ(checked, 6 * 10 * 4 * 256 * 4);
+}
+
+/**
+ * @brief Preamble length and the low data rate optimization
+ *
+ */
+static void test_preamble_ldro(void)
+{
+	for (int preamble_len = 6; preamble_len <= 0xFFFF; preamble_len += 997)
+	{
+		CHECK(fabs(api_lora_airtime(9, 125000, 1, preamble_len, 20) - semtech_airtime(9, 125000, 1, preamble_len, 20, false, true)) <= 0.5001);
+	}
+	// Symbol time 16ms and more
+	CHECK(!api_lora_ldro(10, 125000));
+	CHECK(api_lora_ldro(11, 125000));
+	CHECK(api_lora_ldro(12, 125000));
+	CHECK(!api_lora_ldro(11, 250000));
+	CHECK(api_lora_ldro(8, 15630));
+	CHECK(!api_lora_ldro(7, 10420));
+	CHECK(api_lora_ldro(8, 10420));
+	// Unknown bandwidth settings are 125kHz
+	CHECK_EQ(api_lora_bw_hz(10), 125000);
+	CHECK_EQ(api_lora_bw_hz(0xFF), 125000);
+}
+
+/**
+ * @brief Known values, 10 bytes payload of a LoRaWAN uplink with 13 bytes overhead
+ *
+ */
+static void test_known_values(void)
+{
+	CHECK_EQ(api_lora_airtime(7, 125000, 1, 8, 23), 61696);
+	CHECK_EQ(api_lora_airtime(12, 125000, 1, 8, 23), 1482752);
+	CHECK_EQ(api_lora_airtime(7, 250000, 1, 8, 23), 30848);
+	// Longest packet, SF12 at 7.81kHz with a maximum preamble is clipped
+	CHECK_EQ(api_lora_airtime(12, 7810, 4, 0xFFFF, 255), 0xFFFFFFFF);
+}
+
+int main(void)
+{
+	test_formula();
+	test_preamble_ldro();
+	test_known_values();
+	return host_report("test_airtime");
+}
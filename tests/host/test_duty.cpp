@@ -0,0 +1,259 @@
+/**
+ * @file test_duty.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the LoRa P2P duty cycle limit with the fake clock
+ * @version 0.1
+ * @date 2022-03-15
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+#include "host_platform.h"
+#include "host_test.h"
+
+/** Channel of the radio */
+static uint32_t test_frequency = 868100000;
+uint32_t api_p2p_frequency(void) { return test_frequency; }
+/** 1ms time on air per byte */
+uint32_t api_p2p_airtime(uint8_t size) { return size * 1000; }
+
+/** Channels of the test, CH_1 and CH_2 are in the same sub-band */
+#define CH_1 868100000
+#define CH_2 868300000
+/** Channel in the 10% sub-band */
+#define CH_10 869525000
+
+/**
+ * @brief Send packets until the limit is reached
+ *
+ * @param size packet size
+ * @return int number of packets sent
+ */
+static int send_burst(uint8_t size)
+{
+	int sent = 0;
+	uint32_t wait_ms;
+	while (p2p_duty_check(size, &wait_ms))
+	{
+		p2p_duty_used(test_frequency, api_p2p_airtime(size));
+		sent++;
+	}
+	return sent;
+}
+
+/**
+ * @brief A full bucket allows the airtime of one window, then it refills with the limit
+ *
+ */
+static void test_burst_refill(void)
+{
+	host_set_time_us(5000000);
+	test_frequency = CH_1;
+	// 1% = 36s airtime per hour
+	CHECK(api_p2p_duty_cycle(10, false));
+	CHECK_EQ(api_p2p_duty_credit(), 36000);
+	CHECK_EQ(send_burst(100), 360);
+	CHECK_EQ(api_p2p_duty_credit(), 0);
+
+	// 100ms of airtime take 10s to come back
+	uint32_t wait_ms;
+	CHECK(!p2p_duty_check(100, &wait_ms));
+	CHECK_EQ(wait_ms, 10000);
+	host_advance_ms(9999);
+	CHECK_EQ(api_p2p_duty_wait(100), 1);
+	host_advance_ms(1);
+	CHECK_EQ(api_p2p_duty_wait(100), 0);
+	CHECK_EQ(api_p2p_duty_credit(), 100);
+
+	// The credit is capped at one window
+	host_advance_ms(2 * API_DUTY_WINDOW);
+	CHECK_EQ(api_p2p_duty_credit(), 36000);
+	host_advance_ms(1);
+	CHECK_EQ(api_p2p_duty_credit(), 36000);
+}
+
+/**
+ * @brief Credit grows with the elapsed time in small steps
+ *
+ */
+static void test_partial_refill(void)
+{
+	host_set_time_us(0);
+	test_frequency = CH_1;
+	CHECK(api_p2p_duty_cycle(10));
+	send_burst(255);
+	uint32_t credit = api_p2p_duty_credit();
+	CHECK(credit < 255);
+	for (int step = 0; step < 100; step++)
+	{
+		host_advance_ms(100);
+		// 10us credit per ms
+		CHECK_EQ(api_p2p_duty_credit(), credit + (step + 1));
+	}
+	// The wait time is rounded up to the next ms
+	p2p_duty_used(CH_1, 3);
+	int64_t missing = 255000 - (int64_t)(credit + 100) * 1000 + 3;
+	CHECK_EQ(api_p2p_duty_wait(255), (missing + 9) / 10);
+}
+
+/**
+ * @brief Every sub-band has its own bucket, all channels of a sub-band share it
+ *
+ */
+static void test_bands(void)
+{
+	host_set_time_us(1000000);
+	CHECK(api_p2p_duty_cycle(1));
+	test_frequency = CH_1;
+	CHECK_EQ(send_burst(200), 18);
+	CHECK(api_p2p_duty_wait(200) > 0);
+
+	// Same sub-band, no credit left
+	test_frequency = CH_2;
+	CHECK(api_p2p_duty_wait(200) > 0);
+	CHECK_EQ(send_burst(200), 0);
+
+	// Other sub-band
+	test_frequency = CH_10;
+	CHECK_EQ(api_p2p_duty_wait(200), 0);
+	CHECK_EQ(api_p2p_duty_credit(), 3600);
+	CHECK_EQ(send_burst(200), 18);
+
+	// Airtime used on another channel than the current one
+	host_advance_ms(API_DUTY_WINDOW);
+	test_frequency = CH_1;
+	CHECK_EQ(api_p2p_duty_credit(), 3600);
+	p2p_duty_used(CH_10, 1000000);
+	p2p_duty_used(CH_2, 2000000);
+	CHECK_EQ(api_p2p_duty_credit(), 1600);
+	test_frequency = CH_10;
+	CHECK_EQ(api_p2p_duty_credit(), 2600);
+
+	// Edges of the sub-bands
+	host_advance_ms(API_DUTY_WINDOW);
+	p2p_duty_used(868000000, 1000000);
+	test_frequency = 867999999;
+	CHECK_EQ(api_p2p_duty_credit(), 3600);
+	test_frequency = 868599999;
+	CHECK_EQ(api_p2p_duty_credit(), 2600);
+	test_frequency = 868600000;
+	CHECK_EQ(api_p2p_duty_credit(), 3600);
+
+	// Frequencies outside of the 863 to 870 MHz sub-bands share one bucket
+	p2p_duty_used(915000000, 1000000);
+	test_frequency = 923200000;
+	CHECK_EQ(api_p2p_duty_credit(), 2600);
+	test_frequency = 433175000;
+	CHECK_EQ(api_p2p_duty_credit(), 2600);
+	test_frequency = 869000000;
+	CHECK_EQ(api_p2p_duty_credit(), 3600);
+}
+
+/**
+ * @brief Hopping over the channels of a sub-band doesn't get more airtime than one channel
+ *
+ */
+static void test_hopping(void)
+{
+	host_set_time_us(0);
+	CHECK(api_p2p_duty_cycle(10));
+	// 8 channels with 200 kHz spacing, 100ms packets, 1% = 360 packets per hour in total
+	int sent = 0;
+	uint32_t wait_ms = 0;
+	for (int packet = 0; packet < 1000; packet++)
+	{
+		test_frequency = 865100000 + (packet % 8) * 200000;
+		if (!p2p_duty_check(100, &wait_ms))
+		{
+			break;
+		}
+		p2p_duty_used(test_frequency, api_p2p_airtime(100));
+		sent++;
+	}
+	CHECK_EQ(sent, 360);
+	CHECK_EQ(wait_ms, 10000);
+	// No other channel of the sub-band has credit left
+	for (uint32_t channel = 0; channel < 8; channel++)
+	{
+		test_frequency = 865100000 + channel * 200000;
+		CHECK_EQ(api_p2p_duty_credit(), 0);
+	}
+
+	// Hopping for one hour with one packet every 10 seconds stays within the limit
+	for (int packet = 0; packet < 360; packet++)
+	{
+		host_advance_ms(10000);
+		test_frequency = 865100000 + (packet % 8) * 200000;
+		CHECK(p2p_duty_check(100, &wait_ms));
+		p2p_duty_used(test_frequency, api_p2p_airtime(100));
+		CHECK(!p2p_duty_check(100, &wait_ms));
+	}
+}
+
+/**
+ * @brief millis() wraps after 49.7 days
+ *
+ */
+static void test_millis_wrap(void)
+{
+	host_set_time_us((0x100000000ULL - 5000) * 1000);
+	test_frequency = CH_1;
+	CHECK(api_p2p_duty_cycle(10));
+	CHECK_EQ(send_burst(100), 360);
+	host_advance_ms(10000);
+	CHECK_EQ((uint32_t)millis(), 5000);
+	CHECK_EQ(api_p2p_duty_credit(), 100);
+	CHECK_EQ(api_p2p_duty_wait(100), 0);
+}
+
+/**
+ * @brief Limit off, 100% and invalid values
+ *
+ */
+static void test_settings(void)
+{
+	host_set_time_us(0);
+	test_frequency = CH_1;
+	uint16_t limit;
+	bool queue;
+	CHECK(api_p2p_duty_cycle(0, true));
+	api_p2p_duty_cycle_get(&limit, &queue);
+	CHECK_EQ(limit, 0);
+	CHECK(queue);
+	CHECK(p2p_duty_queue());
+	CHECK_EQ(api_p2p_duty_wait(255), 0);
+	CHECK_EQ(api_p2p_duty_credit(), 0xFFFFFFFF);
+	p2p_duty_used(CH_1, 0xFFFFFFFF);
+	CHECK_EQ(api_p2p_duty_wait(255), 0);
+
+	CHECK(api_p2p_duty_cycle(1000, false));
+	api_p2p_duty_cycle_get(&limit, &queue);
+	CHECK_EQ(limit, 1000);
+	CHECK(!queue);
+	CHECK(!p2p_duty_queue());
+	CHECK_EQ(api_p2p_duty_credit(), API_DUTY_WINDOW);
+	// Sending all the time is allowed with 100%
+	for (int packet = 0; packet < 1000; packet++)
+	{
+		p2p_duty_used(CH_1, api_p2p_airtime(255));
+		host_advance_ms(255);
+		CHECK_EQ(api_p2p_duty_wait(255), 0);
+	}
+
+	CHECK(!api_p2p_duty_cycle(1001, true));
+	api_p2p_duty_cycle_get(&limit, &queue);
+	CHECK_EQ(limit, 1000);
+	CHECK(!queue);
+}
+
+int main(void)
+{
+	test_burst_refill();
+	test_partial_refill();
+	test_bands();
+	test_hopping();
+	test_millis_wrap();
+	test_settings();
+	return host_report("test_duty");
+}
@@ -0,0 +1,202 @@
+/**
+ * @file test_events.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the event queue, single threaded cases and a
+ *    multi producer stress test
+ * @version 0.1
+ * @date 2022-03-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "WisBlock-API.h"
+#include "host_test.h"
+
+/** Number of producer threads in the stress test */
+#define STRESS_PRODUCERS 4
+/** Events pushed by every producer */
+#define STRESS_EVENTS 50000
+
+/**
+ * @brief Fill the ring and check the overflow counters
+ *
+ */
+static void test_overflow(void)
+{
+	api_event_init();
+	g_event_dropped = 0;
+	g_event_coalesced = 0;
+
+	for (uint32_t idx = 0; idx < API_EVENT_QUEUE_SIZE; idx++)
+	{
+		CHECK(api_event_push(LORA_DATA, idx + 1));
+	}
+
+	// New type with payload, type is delivered, payload is lost
+	CHECK(!api_event_push(AT_CMD, 5));
+	CHECK_EQ(g_event_dropped, 1);
+	CHECK_EQ(g_event_coalesced, 0);
+
+	// Same type again, merged into the pending overflow event, but its payload is lost
+	CHECK(!api_event_push(AT_CMD, 6));
+	CHECK_EQ(g_event_dropped, 2);
+	CHECK_EQ(g_event_coalesced, 0);
+
+	// New type without payload, nothing is lost
+	CHECK(!api_event_push(SCHED_TICK, 0));
+	CHECK_EQ(g_event_dropped, 2);
+	CHECK_EQ(g_event_coalesced, 0);
+
+	// Same type without payload, merged
+	CHECK(!api_event_push(SCHED_TICK, 0));
+	CHECK_EQ(g_event_dropped, 2);
+	CHECK_EQ(g_event_coalesced, 1);
+
+	// Queued records come first and in order
+	s_api_event event;
+	for (uint32_t idx = 0; idx < API_EVENT_QUEUE_SIZE; idx++)
+	{
+		CHECK(api_event_pop(&event));
+		CHECK_EQ(event.type, LORA_DATA);
+		CHECK_EQ(event.data, idx + 1);
+		if (idx == 0)
+		{
+			// A record queued after the overflow is still delivered before the overflowed types
+			CHECK(api_event_push(LORA_TX_FIN, 100));
+		}
+	}
+	CHECK(api_event_pop(&event));
+	CHECK_EQ(event.type, LORA_TX_FIN);
+	CHECK_EQ(event.data, 100);
+
+	// Then the overflowed types in one event without payload
+	CHECK(api_event_pending());
+	CHECK(api_event_pop(&event));
+	CHECK_EQ(event.type, AT_CMD | SCHED_TICK);
+	CHECK_EQ(event.data, 0);
+
+	CHECK(!api_event_pending());
+	CHECK(!api_event_pop(&event));
+}
+
+/**
+ * @brief Several producers push sequence tagged events while the consumer pops them.
+ *    Every record that was accepted must arrive exactly once and in the order
+ *    of its producer. Every rejected push must be accounted in the counters
+ *    and its type must still be delivered.
+ *
+ */
+static void test_stress(void)
+{
+	api_event_init();
+	g_event_dropped = 0;
+	g_event_coalesced = 0;
+
+	static const uint16_t types[STRESS_PRODUCERS] = {LORA_DATA, LORA_TX_FIN, AT_CMD, LORA_JOIN_FIN};
+	std::atomic<uint32_t> accepted[STRESS_PRODUCERS];
+	std::atomic<uint32_t> rejected[STRESS_PRODUCERS];
+	std::atomic<int> running(STRESS_PRODUCERS);
+	std::vector<std::thread> producers;
+
+	for (int prod = 0; prod < STRESS_PRODUCERS; prod++)
+	{
+		accepted[prod] = 0;
+		rejected[prod] = 0;
+		producers.emplace_back([&, prod]()
+							   {
+			for (uint32_t seq = 1; seq <= STRESS_EVENTS; seq++)
+			{
+				// Producer in the upper byte, sequence in the lower bytes, never 0
+				if (api_event_push(types[prod], ((uint32_t)prod << 24) | seq))
+				{
+					accepted[prod]++;
+				}
+				else
+				{
+					rejected[prod]++;
+					// Give the consumer a chance, otherwise nearly every push overflows
+					std::this_thread::yield();
+				}
+			}
+			running--; });
+	}
+
+	uint32_t received[STRESS_PRODUCERS] = {0};
+	uint32_t last_seq[STRESS_PRODUCERS] = {0};
+	uint16_t overflow_seen = 0;
+	uint32_t order_errors = 0;
+	uint32_t type_errors = 0;
+	s_api_event event;
+
+	while (true)
+	{
+		bool done = running == 0;
+		if (api_event_pop(&event))
+		{
+			if (event.data == 0)
+			{
+				// Types that did not fit into the ring
+				overflow_seen |= event.type;
+				continue;
+			}
+			uint32_t prod = event.data >> 24;
+			uint32_t seq = event.data & 0x00FFFFFF;
+			if ((prod >= STRESS_PRODUCERS) || (event.type != types[prod]))
+			{
+				type_errors++;
+				continue;
+			}
+			if (seq <= last_seq[prod])
+			{
+				order_errors++;
+			}
+			last_seq[prod] = seq;
+			received[prod]++;
+		}
+		else if (done)
+		{
+			// Producers finished before the ring was found empty
+			break;
+		}
+		else
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	for (auto &producer : producers)
+	{
+		producer.join();
+	}
+
+	uint32_t total_rejected = 0;
+	CHECK_EQ(type_errors, 0);
+	CHECK_EQ(order_errors, 0);
+	for (int prod = 0; prod < STRESS_PRODUCERS; prod++)
+	{
+		CHECK_EQ(received[prod], accepted[prod]);
+		CHECK_EQ(accepted[prod] + rejected[prod], STRESS_EVENTS);
+		if (rejected[prod] != 0)
+		{
+			CHECK((overflow_seen & types[prod]) == types[prod]);
+		}
+		total_rejected += rejected[prod];
+	}
+	// All pushes carry a payload, each rejected one is lost
+	CHECK_EQ(g_event_dropped, total_rejected);
+	CHECK_EQ(g_event_coalesced, 0);
+	CHECK(!api_event_pending());
+
+	printf("stress: %u events, %u rejected, %u dropped, %u coalesced\n",
+		   STRESS_PRODUCERS * STRESS_EVENTS, total_rejected, (unsigned)g_event_dropped, (unsigned)g_event_coalesced);
+}
+
+int main(void)
+{
+	test_overflow();
+	test_stress();
+	return host_report("test_events");
+}
@@ -0,0 +1,190 @@
+/**
+ * @file test_hop.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the LoRa P2P frequency hopping, sender and receiver must use the same channels
+ * @version 0.1
+ * @date 2022-03-12
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+#include "host_hw.h"
+#include "host_test.h"
+
+// Only needed to link lora_p2p_state.cpp and lora_hop.cpp
+s_lorawan_settings g_lorawan_settings;
+uint8_t g_tx_lora_data[256];
+uint8_t g_tx_data_len = 10;
+uint8_t g_lora_p2p_rx_mode = RX_MODE_RX;
+uint32_t g_lora_p2p_rx_time = 3000;
+uint32_t g_lora_p2p_sniff_period = 1000;
+uint32_t api_p2p_symbol_time(void) { return 1024; }
+uint8_t api_p2p_sf(void) { return 7; }
+
+/** Number of packets exchanged */
+#define PACKETS 200
+/** Channel plan of the test */
+#define CHANNELS 8
+#define SPACING 200000
+#define KEY 0xCAFE1234
+
+/**
+ * @brief Send packets like a sender node, through the state machine
+ *
+ * @param freq set to the frequency of every sent packet
+ */
+static void run_sender(uint32_t *freq)
+{
+	g_lora_p2p_rx_mode = RX_MODE_NONE;
+	CHECK(api_p2p_hop(CHANNELS, SPACING, KEY));
+	for (int packet = 0; packet < PACKETS; packet++)
+	{
+		api_p2p_event(P2P_EV_TX_START);
+		api_p2p_event(P2P_EV_CAD_FREE);
+		CHECK_EQ(g_host_radio.last_call, HOST_RADIO_SEND);
+		freq[packet] = g_host_radio.channel;
+		api_p2p_event(P2P_EV_TX_DONE);
+	}
+}
+
+/**
+ * @brief Receive packets like a receiver node in continuous RX, every 10th packet has a CRC error
+ *
+ * @param freq set to the frequency RX was listening on for every packet
+ */
+static void run_receiver(uint32_t *freq)
+{
+	g_lora_p2p_rx_mode = RX_MODE_RX;
+	CHECK(api_p2p_hop(CHANNELS, SPACING, KEY));
+	for (int packet = 0; packet < PACKETS; packet++)
+	{
+		CHECK_EQ(g_host_radio.last_call, HOST_RADIO_RX);
+		freq[packet] = g_host_radio.channel;
+		api_p2p_event(packet % 10 == 9 ? P2P_EV_RX_ERROR : P2P_EV_RX_DONE);
+	}
+}
+
+/**
+ * @brief Sender and receiver nodes start from the same plan and key
+ *
+ */
+static void test_same_sequence(void)
+{
+	static uint32_t tx_freq[PACKETS];
+	static uint32_t rx_freq[PACKETS];
+
+	// Both roles start from a freshly set plan, the module has no other state
+	run_sender(tx_freq);
+	run_receiver(rx_freq);
+
+	uint32_t mismatch = 0;
+	for (int packet = 0; packet < PACKETS; packet++)
+	{
+		if (tx_freq[packet] != rx_freq[packet])
+		{
+			mismatch++;
+		}
+		CHECK(tx_freq[packet] >= g_lorawan_settings.p2p_frequency);
+		CHECK(tx_freq[packet] <= g_lorawan_settings.p2p_frequency + (CHANNELS - 1) * SPACING);
+		CHECK_EQ((tx_freq[packet] - g_lorawan_settings.p2p_frequency) % SPACING, 0);
+	}
+	CHECK_EQ(mismatch, 0);
+
+	// Every round of CHANNELS packets uses every channel once
+	for (int round = 0; round < PACKETS / CHANNELS; round++)
+	{
+		uint32_t seen = 0;
+		for (int idx = 0; idx < CHANNELS; idx++)
+		{
+			seen |= 1 << ((tx_freq[round * CHANNELS + idx] - g_lorawan_settings.p2p_frequency) / SPACING);
+		}
+		CHECK_EQ(seen, (1 << CHANNELS) - 1);
+	}
+}
+
+/**
+ * @brief The sequence is part of the air interface, it must not change between versions or platforms
+ *
+ */
+static void test_golden_sequence(void)
+{
+	// Calculated with an independent implementation of the shuffle
+	static const uint8_t golden[16] = {6, 7, 0, 2, 5, 4, 1, 3, 7, 6, 1, 4, 3, 2, 0, 5};
+	CHECK(api_p2p_hop(CHANNELS, SPACING, KEY));
+	for (uint32_t idx = 0; idx < 16; idx++)
+	{
+		CHECK_EQ(api_p2p_hop_channel(idx), golden[idx]);
+	}
+
+	// Random access gives the same result as sequential access
+	for (int idx = 199; idx >= 0; idx -= 7)
+	{
+		uint8_t backwards = api_p2p_hop_channel(idx);
+		api_p2p_hop_channel(0);
+		CHECK_EQ(api_p2p_hop_channel(idx), backwards);
+	}
+}
+
+/**
+ * @brief A lost packet shifts the receiver, api_p2p_hop_sync() brings it back
+ *
+ */
+static void test_resync(void)
+{
+	CHECK(api_p2p_hop(CHANNELS, SPACING, KEY));
+	uint8_t same = 0;
+	for (uint32_t idx = 0; idx < 64; idx++)
+	{
+		same += api_p2p_hop_channel(idx) == api_p2p_hop_channel(idx + 1);
+	}
+	// Neighbours are different channels most of the time, so one lost packet is noticed
+	CHECK(same < 16);
+
+	g_lora_p2p_rx_mode = RX_MODE_RX;
+	api_p2p_hop_sync(37);
+	CHECK_EQ(api_p2p_hop_index(), 37);
+	CHECK_EQ(g_host_radio.channel, g_lorawan_settings.p2p_frequency + api_p2p_hop_channel(37) * SPACING);
+}
+
+/**
+ * @brief Other keys give other sequences, invalid plans are rejected
+ *
+ */
+static void test_plans(void)
+{
+	uint8_t first[64];
+	CHECK(api_p2p_hop(CHANNELS, SPACING, KEY));
+	for (uint32_t idx = 0; idx < 64; idx++)
+	{
+		first[idx] = api_p2p_hop_channel(idx);
+	}
+	CHECK(api_p2p_hop(CHANNELS, SPACING, KEY + 1));
+	uint8_t same = 0;
+	for (uint32_t idx = 0; idx < 64; idx++)
+	{
+		same += first[idx] == api_p2p_hop_channel(idx);
+	}
+	CHECK(same < 32);
+
+	CHECK(!api_p2p_hop(API_P2P_HOP_CHANNELS + 1, SPACING, KEY));
+	CHECK(!api_p2p_hop(CHANNELS, 0, KEY));
+	// Last channel above 960 MHz
+	CHECK(!api_p2p_hop(16, 5000000, KEY));
+
+	// Hopping off, always the base frequency
+	CHECK(api_p2p_hop(1, SPACING, KEY));
+	CHECK_EQ(api_p2p_frequency(), g_lorawan_settings.p2p_frequency);
+	p2p_hop_next();
+	CHECK_EQ(api_p2p_hop_index(), 0);
+}
+
+int main(void)
+{
+	g_lorawan_settings.p2p_frequency = 916000000;
+	test_same_sequence();
+	test_golden_sequence();
+	test_resync();
+	test_plans();
+	return host_report("test_hop");
+}
@@ -0,0 +1,79 @@
+/**
+ * @file test_journal.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the files of the uplink journal
+ * @version 0.1
+ * @date 2022-03-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+#include "host_hw.h"
+#include "host_platform.h"
+#include "host_test.h"
+
+/**
+ * @brief Only the journal files are deleted, also the ones of a journal with more segments
+ *
+ */
+static void test_format(void)
+{
+	g_host_files.clear();
+	g_host_files[settings_name] = {1, 2, 3};
+	g_host_files["JOIN"] = {4};
+	g_host_files["JR0"] = {JOURNAL_MARKER};
+	g_host_files["JA0"] = {'A'};
+	g_host_files["JR12"] = {JOURNAL_MARKER};
+	g_host_files["JA12"] = {'A'};
+	api_fs_format(NULL);
+	CHECK_EQ(g_host_files.size(), 2);
+	CHECK_EQ(g_host_files.count(settings_name), 1);
+	CHECK_EQ(g_host_files.count("JOIN"), 1);
+
+	api_fs_format("TEST");
+	CHECK_EQ(g_host_files.count("TEST"), 1);
+	CHECK_EQ(g_host_files["TEST"].size(), 0);
+	CHECK_EQ(g_host_files.size(), 3);
+}
+
+/**
+ * @brief Uplinks larger than API_JOURNAL_PAYLOAD are rejected and counted as dropped
+ *
+ */
+static void test_oversize(void)
+{
+	g_host_files.clear();
+	CHECK(api_journal(true));
+	uint8_t data[API_TX_QUEUE_PAYLOAD] = {0};
+	s_journal_status status;
+
+	CHECK(!api_journal_add(data, API_JOURNAL_PAYLOAD + 1));
+	CHECK(!lorawan_journal_capture(data, API_JOURNAL_PAYLOAD + 1, 2));
+	api_journal_status(&status);
+	CHECK_EQ(status.records, 0);
+	CHECK_EQ(status.dropped, 1);
+	CHECK_EQ(g_host_files.size(), 0);
+
+	CHECK(lorawan_journal_capture(data, API_JOURNAL_PAYLOAD, 2));
+	api_journal_status(&status);
+	CHECK_EQ(status.records, 1);
+	CHECK_EQ(status.dropped, 1);
+	CHECK_EQ(g_host_files.count("JR0"), 1);
+
+	g_host_files[settings_name] = {1, 2, 3};
+	api_journal_clear();
+	api_journal_status(&status);
+	CHECK_EQ(status.records, 0);
+	CHECK_EQ(g_host_files.size(), 1);
+	CHECK(api_journal(false));
+}
+
+int main(void)
+{
+	host_lmh_reset();
+	g_host_lmh.join_status = LMH_RESET;
+	test_format();
+	test_oversize();
+	return host_report("test_journal");
+}
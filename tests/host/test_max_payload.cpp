@@ -0,0 +1,78 @@
+/**
+ * @file test_max_payload.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of api_region_max_payload() for every region and data rate
+ * @version 0.1
+ * @date 2022-03-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+#include "host_test.h"
+
+// Only needed to link lora_frag.cpp
+s_lorawan_settings g_lorawan_settings;
+bool g_lorawan_initialized = false;
+LoRaMacStatus_t LoRaMacQueryTxPossible(uint8_t, LoRaMacTxInfo_t *) { return LORAMAC_STATUS_OK; }
+uint16_t api_tx_enqueue(uint8_t *, uint8_t, uint8_t, uint8_t, uint8_t, tx_done_cb_t) { return 0; }
+uint8_t api_tx_pending(void) { return 0; }
+
+/** Highest data rate that is checked, all above the table must return 0 */
+#define MAX_DR 16
+
+/** Expected max application payload (N) per data rate, LoRaWAN Regional Parameters RP002-1.0.3, no repeater */
+struct s_payload_row
+{
+	uint8_t region;
+	const char *name;
+	uint8_t payload[MAX_DR];
+};
+
+/** Same order as region_names[] in at_cmd.cpp, 0 => DR is not defined or RFU */
+static const s_payload_row expected[] = {
+	// AS923 with uplink dwell time limit
+	{LORAMAC_REGION_AS923, "AS923", {0, 0, 11, 53, 125, 242, 242, 242}},
+	{LORAMAC_REGION_AU915, "AU915", {51, 51, 51, 115, 242, 242, 242, 0, 53, 129, 242, 242, 242, 242}},
+	{LORAMAC_REGION_CN470, "CN470", {51, 51, 51, 115, 222, 222}},
+	{LORAMAC_REGION_CN779, "CN779", {51, 51, 51, 115, 242, 242, 242, 242}},
+	{LORAMAC_REGION_EU433, "EU433", {51, 51, 51, 115, 242, 242, 242, 242}},
+	{LORAMAC_REGION_EU868, "EU868", {51, 51, 51, 115, 242, 242, 242, 242}},
+	{LORAMAC_REGION_KR920, "KR920", {51, 51, 51, 115, 242, 242}},
+	// IN865 DR6 is RFU
+	{LORAMAC_REGION_IN865, "IN865", {51, 51, 51, 115, 242, 242, 0, 242}},
+	// US915 DR5-7 are RFU, DR8-13 are downlink only
+	{LORAMAC_REGION_US915, "US915", {11, 53, 125, 242, 242, 0, 0, 0, 53, 129, 242, 242, 242, 242}},
+	{LORAMAC_REGION_AS923_2, "AS923-2", {0, 0, 11, 53, 125, 242, 242, 242}},
+	{LORAMAC_REGION_AS923_3, "AS923-3", {0, 0, 11, 53, 125, 242, 242, 242}},
+	{LORAMAC_REGION_AS923_4, "AS923-4", {0, 0, 11, 53, 125, 242, 242, 242}},
+	{LORAMAC_REGION_RU864, "RU864", {51, 51, 51, 115, 242, 242, 242, 242}},
+};
+
+int main(void)
+{
+	// Every region of the AT command interface is in the table
+	CHECK_EQ(sizeof(expected) / sizeof(expected[0]), LORAMAC_REGION_RU864 + 1);
+
+	for (const s_payload_row &row : expected)
+	{
+		for (uint8_t datarate = 0; datarate < MAX_DR; datarate++)
+		{
+			uint8_t payload = api_region_max_payload(row.region, datarate);
+			if (payload != row.payload[datarate])
+			{
+				printf("%s DR%d: %d, expected %d\n", row.name, datarate, payload, row.payload[datarate]);
+			}
+			CHECK_EQ(payload, row.payload[datarate]);
+		}
+	}
+
+	// Unknown regions have no data rates
+	for (uint8_t datarate = 0; datarate < MAX_DR; datarate++)
+	{
+		CHECK_EQ(api_region_max_payload(LORAMAC_REGION_RU864 + 1, datarate), 0);
+		CHECK_EQ(api_region_max_payload(255, datarate), 0);
+	}
+
+	return host_report("test_max_payload");
+}
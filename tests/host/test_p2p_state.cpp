@@ -0,0 +1,194 @@
+/**
+ * @file test_p2p_state.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the LoRa P2P radio state machine, every RX mode with every event
+ *    from every state, against the fake radio of host_hw.cpp
+ * @version 0.1
+ * @date 2022-03-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+#include "host_hw.h"
+#include "host_platform.h"
+#include "host_test.h"
+
+// Only needed to link lora_p2p_state.cpp
+uint8_t g_tx_lora_data[256];
+uint8_t g_tx_data_len = 0;
+uint8_t g_lora_p2p_rx_mode = RX_MODE_NONE;
+uint32_t g_lora_p2p_rx_time = 3000;
+uint32_t g_lora_p2p_sniff_period = 1000;
+uint32_t api_p2p_symbol_time(void) { return 1024; }
+uint8_t api_p2p_sf(void) { return 7; }
+
+/** Calls of the hopping functions */
+static uint32_t hop_next_count = 0;
+static uint32_t hop_tune_count = 0;
+void p2p_hop_next(void) { hop_next_count++; }
+void p2p_hop_tune(bool) { hop_tune_count++; }
+
+/** Expected result of an event */
+struct s_expect
+{
+	uint8_t state;		 // State after the event
+	uint8_t call;		 // Last radio call
+	uint32_t rx_timeout; // Timeout of Radio.Rx()
+};
+
+/** Shortcuts for the table */
+#define E_SLEEP {P2P_STATE_SLEEP, HOST_RADIO_SLEEP, 0}
+#define E_RX {P2P_STATE_RX, HOST_RADIO_RX, 0}
+#define E_RX_TIMED {P2P_STATE_RX, HOST_RADIO_RX, 3000}
+#define E_CAD {P2P_STATE_CAD, HOST_RADIO_START_CAD, 0}
+#define E_TX {P2P_STATE_TX, HOST_RADIO_SEND, 0}
+#define E_SNIFF {P2P_STATE_SNIFF, HOST_RADIO_RX_DUTY_CYCLE, 0}
+
+/** Expected result per event and RX mode, written down from the documented behaviour of each mode */
+static const s_expect expected[P2P_EV_NUM][P2P_RX_MODES] = {
+	/*               NONE     RX    RX_TIMED    RX_WAIT  RX_SNIFF */
+	/* MODE       */ {E_SLEEP, E_RX, E_RX_TIMED, E_RX, E_SNIFF},
+	/* TX_START   */ {E_CAD, E_CAD, E_CAD, E_CAD, E_CAD},
+	/* CAD_FREE   */ {E_TX, E_TX, E_TX, E_TX, E_TX},
+	/* CAD_BUSY   */ {E_SLEEP, E_RX, E_SLEEP, E_SLEEP, E_SNIFF},
+	/* TX_DONE    */ {E_SLEEP, E_RX, E_RX_TIMED, E_RX, E_SNIFF},
+	/* TX_TIMEOUT */ {E_SLEEP, E_RX, E_SLEEP, E_SLEEP, E_SNIFF},
+	/* RX_DONE    */ {E_SLEEP, E_RX, E_SLEEP, E_SLEEP, E_SNIFF},
+	/* RX_TIMEOUT */ {E_SLEEP, E_RX, E_SLEEP, E_SLEEP, E_SNIFF},
+	/* RX_ERROR   */ {E_SLEEP, E_RX, E_SLEEP, E_SLEEP, E_SNIFF},
+};
+
+/** Event that brings the state machine into a state, in RX_MODE_SNIFF */
+static const uint8_t enter_event[P2P_STATE_NUM] = {P2P_EV_MODE, P2P_EV_MODE, P2P_EV_TX_START, P2P_EV_CAD_FREE, P2P_EV_MODE};
+/** RX mode used to enter a state */
+static const uint8_t enter_mode[P2P_STATE_NUM] = {RX_MODE_NONE, RX_MODE_RX, RX_MODE_RX, RX_MODE_RX, RX_MODE_RX_SNIFF};
+
+/**
+ * @brief Every RX mode with every event from every state
+ *
+ */
+static void test_transitions(void)
+{
+	for (uint8_t from = 0; from < P2P_STATE_NUM; from++)
+	{
+		for (uint8_t mode = 0; mode < P2P_RX_MODES; mode++)
+		{
+			for (uint8_t event = 0; event < P2P_EV_NUM; event++)
+			{
+				// Bring the state machine into the start state
+				g_lora_p2p_rx_mode = enter_mode[from];
+				if (from == P2P_STATE_TX)
+				{
+					api_p2p_event(P2P_EV_TX_START);
+				}
+				api_p2p_event(enter_event[from]);
+				CHECK_EQ(api_p2p_state(), from);
+
+				g_lora_p2p_rx_mode = mode;
+				host_radio_reset();
+				uint32_t hops = hop_next_count;
+				api_p2p_event(event);
+
+				const s_expect &exp = expected[event][mode];
+				if ((api_p2p_state() != exp.state) || (g_host_radio.last_call != exp.call))
+				{
+					printf("from %s mode %d event %d: state %s call %d\n", p2p_state_names[from], mode, event,
+						   p2p_state_names[api_p2p_state()], g_host_radio.last_call);
+				}
+				CHECK_EQ(api_p2p_state(), exp.state);
+				CHECK_EQ(g_host_radio.last_call, exp.call);
+				if (exp.call == HOST_RADIO_RX)
+				{
+					CHECK_EQ(g_host_radio.rx_timeout, exp.rx_timeout);
+				}
+				if (exp.call == HOST_RADIO_START_CAD)
+				{
+					// Radio must sleep before CAD is configured
+					CHECK_EQ(g_host_radio.calls[HOST_RADIO_SLEEP], 1);
+					CHECK_EQ(g_host_radio.calls[HOST_RADIO_CAD_PARAMS], 1);
+				}
+				// Only a packet on air moves to the next hop channel
+				bool on_air = (event == P2P_EV_TX_DONE) || (event == P2P_EV_RX_DONE) || (event == P2P_EV_RX_ERROR);
+				CHECK_EQ(hop_next_count - hops, on_air ? 1 : 0);
+
+				// The transition is logged
+				s_p2p_transition entry;
+				CHECK_EQ(api_p2p_log(&entry, 1), 1);
+				CHECK_EQ(entry.from, from);
+				CHECK_EQ(entry.event, event);
+				CHECK_EQ(entry.to, exp.state);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Invalid events are ignored, an invalid RX mode acts like RX_MODE_NONE
+ *
+ */
+static void test_invalid(void)
+{
+	g_lora_p2p_rx_mode = RX_MODE_RX;
+	api_p2p_event(P2P_EV_MODE);
+	host_radio_reset();
+	api_p2p_event(P2P_EV_NUM);
+	CHECK_EQ(api_p2p_state(), P2P_STATE_RX);
+	CHECK_EQ(g_host_radio.last_call, HOST_RADIO_NONE);
+
+	g_lora_p2p_rx_mode = P2P_RX_MODES;
+	api_p2p_event(P2P_EV_MODE);
+	CHECK_EQ(api_p2p_state(), P2P_STATE_SLEEP);
+	CHECK_EQ(g_host_radio.last_call, HOST_RADIO_SLEEP);
+}
+
+/**
+ * @brief Time per state and the transition log
+ *
+ */
+static void test_time_and_log(void)
+{
+	g_lora_p2p_rx_mode = RX_MODE_RX;
+	api_p2p_event(P2P_EV_MODE);
+	api_p2p_state_reset();
+
+	// 100 ms RX, 5 ms CAD, 40 ms TX, back to RX for 10 ms
+	host_advance_ms(100);
+	api_p2p_event(P2P_EV_TX_START);
+	host_advance_ms(5);
+	api_p2p_event(P2P_EV_CAD_FREE);
+	host_advance_ms(40);
+	api_p2p_event(P2P_EV_TX_DONE);
+	host_advance_ms(10);
+
+	CHECK_EQ(api_p2p_state_time(P2P_STATE_RX), 110);
+	CHECK_EQ(api_p2p_state_time(P2P_STATE_CAD), 5);
+	CHECK_EQ(api_p2p_state_time(P2P_STATE_TX), 40);
+	CHECK_EQ(api_p2p_state_time(P2P_STATE_SLEEP), 0);
+	CHECK_EQ(api_p2p_state_time(P2P_STATE_NUM), 0);
+
+	s_p2p_transition log[4];
+	CHECK_EQ(api_p2p_log(log, 4), 3);
+	CHECK_EQ(log[0].event, P2P_EV_TX_START);
+	CHECK_EQ(log[1].event, P2P_EV_CAD_FREE);
+	CHECK_EQ(log[2].event, P2P_EV_TX_DONE);
+	CHECK_EQ(log[2].time - log[0].time, 45);
+
+	// Only the last API_P2P_LOG_SIZE transitions are kept, oldest first
+	for (uint8_t idx = 0; idx < API_P2P_LOG_SIZE + 3; idx++)
+	{
+		api_p2p_event(idx & 1 ? P2P_EV_RX_DONE : P2P_EV_RX_TIMEOUT);
+	}
+	s_p2p_transition full[API_P2P_LOG_SIZE + 1];
+	CHECK_EQ(api_p2p_log(full, API_P2P_LOG_SIZE + 1), API_P2P_LOG_SIZE);
+	CHECK_EQ(full[API_P2P_LOG_SIZE - 1].event, P2P_EV_RX_TIMEOUT);
+	CHECK_EQ(full[API_P2P_LOG_SIZE - 2].event, P2P_EV_RX_DONE);
+}
+
+int main(void)
+{
+	test_transitions();
+	test_invalid();
+	test_time_and_log();
+	return host_report("test_p2p_state");
+}
@@ -0,0 +1,88 @@
+/**
+ * @file test_remote_config.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the remote configuration over LoRaWAN, only allowed commands are executed
+ * @version 0.1
+ * @date 2022-03-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <string>
+#include "WisBlock-API.h"
+#include "host_hw.h"
+#include "host_platform.h"
+#include "host_test.h"
+
+/**
+ * @brief Send AT commands in a downlink on the remote configuration port
+ *
+ * @param commands the downlink payload
+ * @return std::string the answer sent in the uplink
+ */
+static std::string remote(const char *commands)
+{
+	g_host_lmh.tx_len = 0;
+	CHECK(api_rx_put((uint8_t *)commands, strlen(commands), -50, 8, API_CONFIG_PORT));
+	CHECK(api_rx_deliver());
+	CHECK(api_rx_dispatch());
+	api_rx_release(g_rx_packet);
+	tx_queue_pump();
+	tx_queue_result(TX_RESULT_SENT);
+	tx_queue_finish();
+	CHECK_EQ(g_host_lmh.tx_port, API_CONFIG_PORT);
+	return std::string((char *)g_host_lmh.tx_data, g_host_lmh.tx_len);
+}
+
+/**
+ * @brief The harmless settings can be queried and set
+ *
+ */
+static void test_allowed(void)
+{
+	CHECK(remote("AT+SENDINT=600;AT+SENDINT=?") == "OK;600");
+	CHECK_EQ(g_lorawan_settings.send_repeat_time, 600000);
+	CHECK(remote("AT+ADR=1;+ADR=?") == "OK;1");
+	CHECK(g_lorawan_settings.adr_enabled);
+	CHECK(remote("AT+ADR=0\nAT+DR=3\r\nAT+DR=?") == "OK;OK;3");
+	CHECK_EQ(g_lorawan_settings.data_rate, 3);
+	CHECK(remote("AT+TXP=5;AT+TXP=?") == "OK;5");
+	CHECK(remote("AT+CFM=1;AT+CFM=?") == "OK;1");
+	CHECK(remote("AT+PORT=10;AT+PORT=?") == "OK;10");
+	CHECK_EQ(g_lorawan_settings.app_port, 10);
+	CHECK(remote("AT+CLASS=?") == "A");
+	// Parameter errors are reported
+	CHECK(remote("AT+PORT=0") == "E:5");
+}
+
+/**
+ * @brief Everything else is rejected and not executed
+ *
+ */
+static void test_denied(void)
+{
+	uint32_t resets = g_host_resets;
+	std::map<std::string, std::vector<uint8_t>> files = g_host_files;
+	CHECK(remote("ATZ;ATR;AT+MASK=0001;AT+MASK=?") == "E:2;E:2;E:2;E:2");
+	CHECK(remote("AT+DEVEUI=?;AT+APPKEY=00112233445566778899AABBCCDDEEFF;AT+BAND=1") == "E:2;E:2;E:2");
+	CHECK(remote("AT+JOIN=1:0:10:8;AT+SEND=2:1234;AT+NWM=0;AT+RCFG=0") == "E:2;E:2;E:2;E:2");
+	// Allowed commands without parameter and unknown commands
+	CHECK(remote("AT+ADR;AT+XYZ=1;AT+ADR?") == "E:2;E:1;E:1");
+	CHECK_EQ(g_host_resets, resets);
+	CHECK(g_host_files == files);
+	CHECK_EQ(api_remote_config_port(), API_CONFIG_PORT);
+}
+
+int main(void)
+{
+	host_lmh_reset();
+	g_host_lmh.join_status = LMH_SET;
+	g_lorawan_settings.lorawan_enable = true;
+	g_lorawan_settings.auto_join = false;
+	g_lorawan_initialized = true;
+	g_lpwan_has_joined = true;
+	CHECK(api_remote_config(true));
+	test_allowed();
+	test_denied();
+	return host_report("test_remote_config");
+}
@@ -0,0 +1,184 @@
+/**
+ * @file test_session.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of saving and restoring the LoRaWAN session
+ * @version 0.1
+ * @date 2022-03-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include <stddef.h>
+#include "WisBlock-API.h"
+#include "host_hw.h"
+#include "host_sched.h"
+#include "host_test.h"
+
+s_lorawan_settings g_lorawan_settings;
+
+// Flash, the session is kept in RAM and the writes are counted
+static s_lorawan_session flash_session;
+static bool flash_valid = false;
+static int flash_writes = 0;
+bool read_session(s_lorawan_session *session)
+{
+	if (flash_valid)
+	{
+		memcpy(session, &flash_session, sizeof(s_lorawan_session));
+	}
+	return flash_valid;
+}
+bool save_session(s_lorawan_session *session)
+{
+	memcpy(&flash_session, session, sizeof(s_lorawan_session));
+	flash_valid = true;
+	flash_writes++;
+	return true;
+}
+void delete_session(void) { flash_valid = false; }
+
+/**
+ * @brief Fill the stack below the caller with a pattern
+ *
+ * @param pattern value of the bytes
+ */
+static void __attribute__((noinline)) dirty_stack(uint8_t pattern)
+{
+	volatile uint8_t stack[4096];
+	for (size_t idx = 0; idx < sizeof(stack); idx++)
+	{
+		stack[idx] = pattern;
+	}
+}
+
+/**
+ * @brief Check that the bytes between two offsets of the saved record are 0
+ *
+ * @param from first byte
+ * @param to byte after the last byte
+ * @return true if all bytes are 0
+ */
+static bool flash_zero(size_t from, size_t to)
+{
+	uint8_t *data = (uint8_t *)&flash_session;
+	for (size_t idx = from; idx < to; idx++)
+	{
+		if (data[idx] != 0)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief The same session is saved only once, independent of the stack content
+ *
+ */
+static void test_unchanged_session(void)
+{
+	host_lmh_reset();
+	g_host_lmh.join_status = LMH_SET;
+	g_host_lmh.uplink_counter = 10;
+	g_lorawan_settings.lora_region = LORAMAC_REGION_EU868;
+	g_lorawan_settings.node_device_eui[0] = 0xAC;
+
+	lorawan_session_joined();
+	dirty_stack(0xA5);
+	host_sched_run_for(10);
+	CHECK_EQ(flash_writes, 1);
+
+	// Padding between the fields and at the end of the record is cleared
+	CHECK(flash_zero(offsetof(s_lorawan_session, app_eui) + 8, offsetof(s_lorawan_session, app_key_hash)));
+	CHECK(flash_zero(offsetof(s_lorawan_session, datarate) + 1, offsetof(s_lorawan_session, checksum)));
+	CHECK(flash_zero(offsetof(s_lorawan_session, checksum) + 2, sizeof(s_lorawan_session)));
+
+	// Join again with the same session, e.g. after a rejoin request was ignored
+	for (int pattern = 0; pattern < 256; pattern += 51)
+	{
+		lorawan_session_joined();
+		dirty_stack(pattern);
+		host_sched_run_for(10);
+	}
+	CHECK_EQ(flash_writes, 1);
+
+	s_lorawan_session session;
+	CHECK(api_lorawan_session_get(&session));
+	CHECK_EQ(session.fcnt_up, 10 + API_SESSION_FCNT_STEP);
+	CHECK_EQ(session.valid_mark_1, 0xAA);
+	CHECK_EQ(session.valid_mark_2, LORAWAN_SESSION_MARKER);
+	CHECK_EQ(session.version, LORAWAN_SESSION_VERSION);
+
+	// A changed session is written
+	g_host_lmh.downlink_counter = 5;
+	lorawan_session_joined();
+	dirty_stack(0x3C);
+	host_sched_run_for(10);
+	CHECK_EQ(flash_writes, 2);
+	CHECK_EQ(flash_session.fcnt_down, 5);
+}
+
+/**
+ * @brief The saved session is restored after a reset
+ *
+ */
+static void test_restore(void)
+{
+	g_host_lmh.uplink_counter = 0;
+	g_host_lmh.downlink_counter = 0;
+	g_host_lmh.join_status = LMH_RESET;
+	CHECK(lorawan_session_restore());
+	CHECK_EQ(g_host_lmh.uplink_counter, 10 + API_SESSION_FCNT_STEP);
+	CHECK_EQ(g_host_lmh.downlink_counter, 5);
+
+	// Wrong checksum
+	flash_session.nwk_skey[3] ^= 1;
+	CHECK(!lorawan_session_restore());
+	flash_session.nwk_skey[3] ^= 1;
+	CHECK(lorawan_session_restore());
+
+	// The AppKey was changed, the device must join again
+	g_lorawan_settings.node_app_key[7] ^= 0x10;
+	CHECK(!lorawan_session_restore());
+	g_lorawan_settings.node_app_key[7] ^= 0x10;
+	CHECK(lorawan_session_restore());
+}
+
+/**
+ * @brief Downlinks without uplinks in between, the downlink counter must not go backwards after a reset
+ *
+ */
+static void test_downlink_counter(void)
+{
+	host_sched_run_for(10);
+	int writes = flash_writes;
+	uint32_t uplinks = g_host_lmh.uplink_counter;
+	for (uint32_t downlink = 1; downlink <= 3; downlink++)
+	{
+		g_host_lmh.downlink_counter = 5 + downlink;
+		lorawan_session_downlink();
+		host_sched_run_for(10);
+	}
+	CHECK_EQ(flash_writes, writes + 3);
+	CHECK_EQ(flash_session.fcnt_down, 8);
+
+	// No new downlink, e.g. TX finished without a downlink, nothing is written
+	lorawan_session_downlink();
+	host_sched_run_for(10);
+	CHECK_EQ(flash_writes, writes + 3);
+
+	// Reset
+	g_host_lmh.uplink_counter = 0;
+	g_host_lmh.downlink_counter = 0;
+	CHECK(lorawan_session_restore());
+	CHECK_EQ(g_host_lmh.downlink_counter, 8);
+	CHECK(g_host_lmh.uplink_counter >= uplinks);
+}
+
+int main(void)
+{
+	test_unchanged_session();
+	test_restore();
+	test_downlink_counter();
+	return host_report("test_session");
+}
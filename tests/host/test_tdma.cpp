@@ -0,0 +1,551 @@
+/**
+ * @file test_tdma.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host simulation of a TDMA network, a coordinator and several nodes on one shared channel
+ * @version 0.1
+ * @date 2022-03-13
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+#include "host_test.h"
+
+/**
+ * Every virtual node has its own copy of lora_tdma.cpp (see tdma_node.h), a clock with its own
+ * error and start value, a scheduler that runs on that clock and a half duplex radio.
+ * All radios share one medium. The simulation runs in steps of 1ms of real time and checks
+ *  - that no two transmissions overlap on the medium
+ *  - that every packet of a node starts and ends inside the TX slot of the node
+ *  - how far the start of a packet is away from the planned start (drift)
+ *  - that the nodes stay in sync, or lose it when the clock error is larger than the guard time
+ */
+
+/** Number of virtual nodes, node 0 is the coordinator */
+#define NODES 6
+/** Frame length and TX slots of the network */
+#define FRAME_MS 10000
+#define SLOTS 10
+/** Size of the packets of the nodes */
+#define APP_LEN 20
+/** Scheduler jobs per node */
+#define SIM_JOBS 8
+
+/**
+ * @brief Time on air, the same for all nodes
+ *
+ * @param size packet size
+ * @return uint32_t time on air in ms
+ */
+static uint32_t sim_time_on_air(RadioModems_t, uint8_t size)
+{
+	return 20 + 2 * size;
+}
+const struct Radio_s Radio = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, sim_time_on_air};
+
+/** Job of the scheduler of a node */
+struct sim_job
+{
+	schedule_cb_t callback;
+	uint32_t at;
+	uint32_t period;
+	bool used;
+};
+
+/** A virtual node */
+struct sim_node
+{
+	// API of the copy of lora_tdma.cpp of this node
+	bool (*tdma)(uint8_t role, uint32_t frame_ms, uint8_t slots);
+	void (*tdma_slot)(uint8_t slot);
+	void (*tdma_status)(s_tdma_status *status);
+	bool (*tdma_rx)(uint8_t *payload, uint16_t size);
+	bool (*tdma_tx_done)(void);
+	bool (*tdma_defer)(void);
+	uint8_t *rx_mode;
+	uint32_t *rx_time;
+	// Clock
+	int32_t ppm;
+	uint32_t offset_ms;
+	sim_job jobs[SIM_JOBS];
+	// Radio
+	uint8_t state;
+	uint8_t tx_buf[256];
+	uint8_t tx_len;
+	bool tx_busy;
+	bool listening;
+	uint64_t listen_until;
+	bool deaf;
+	// Results
+	uint8_t slot;
+	bool synced;
+	uint32_t beacons;
+	uint32_t packets;
+	uint32_t sync_lost;
+};
+
+/** Real time of the simulation in us */
+static uint64_t sim_us = 0;
+
+/**
+ * @brief Local time of a node
+ *
+ * @param node the node
+ * @return uint32_t millis() of the node
+ */
+static uint32_t sim_millis(sim_node *node)
+{
+	return node->offset_ms + (uint32_t)(sim_us * (1000000 + node->ppm) / 1000000000ULL);
+}
+
+static uint8_t sim_schedule(sim_node *node, schedule_cb_t callback, uint32_t delay_ms, uint32_t period_ms)
+{
+	for (uint8_t idx = 0; idx < SIM_JOBS; idx++)
+	{
+		if (!node->jobs[idx].used)
+		{
+			node->jobs[idx] = {callback, sim_millis(node) + delay_ms, period_ms, true};
+			return idx + 1;
+		}
+	}
+	return 0;
+}
+
+static bool sim_cancel(sim_node *node, uint8_t id)
+{
+	if ((id == 0) || (id > SIM_JOBS) || !node->jobs[id - 1].used)
+	{
+		return false;
+	}
+	node->jobs[id - 1].used = false;
+	return true;
+}
+
+/**
+ * @brief Run the jobs of a node that are due on its clock
+ *
+ * @param node the node
+ */
+static void sim_run_jobs(sim_node *node)
+{
+	uint32_t now = sim_millis(node);
+	for (uint8_t idx = 0; idx < SIM_JOBS; idx++)
+	{
+		sim_job *job = &node->jobs[idx];
+		if (job->used && ((int32_t)(now - job->at) >= 0))
+		{
+			schedule_cb_t callback = job->callback;
+			if (job->period != 0)
+			{
+				job->at += job->period;
+			}
+			else
+			{
+				job->used = false;
+			}
+			callback();
+		}
+	}
+}
+
+static uint8_t *sim_tx_acquire(sim_node *node)
+{
+	if (node->tx_busy)
+	{
+		return NULL;
+	}
+	node->tx_busy = true;
+	return node->tx_buf;
+}
+
+static bool sim_tx_start(sim_node *node, uint8_t *, uint8_t size)
+{
+	node->tx_len = size;
+	return true;
+}
+
+/** A transmission on the medium */
+struct sim_tx
+{
+	sim_node *sender;
+	uint64_t start;
+	uint64_t end;
+	uint8_t data[256];
+	uint8_t len;
+	bool collided;
+	bool heard[NODES];
+};
+
+static sim_node *nodes[NODES];
+static sim_tx medium[NODES];
+static uint8_t medium_num = 0;
+
+/** Start of the last beacon in real time */
+static uint64_t beacon_start = 0;
+/** Results of the medium */
+static uint32_t collisions = 0;
+static uint32_t off_slot = 0;
+static uint32_t max_drift_us = 0;
+
+/**
+ * @brief Put the packet of a node on the medium
+ *
+ * @param node the sender
+ */
+static void sim_send(sim_node *node)
+{
+	sim_tx *tx = &medium[medium_num++];
+	tx->sender = node;
+	tx->start = sim_us;
+	tx->end = sim_us + 1000 * sim_time_on_air(MODEM_LORA, node->tx_len);
+	memcpy(tx->data, node->tx_buf, node->tx_len);
+	tx->len = node->tx_len;
+	tx->collided = false;
+	node->state = P2P_STATE_TX;
+	node->listening = false;
+
+	for (uint8_t idx = 0; idx < medium_num - 1; idx++)
+	{
+		medium[idx].collided = true;
+		tx->collided = true;
+		collisions++;
+	}
+	for (uint8_t idx = 0; idx < NODES; idx++)
+	{
+		sim_node *rx = nodes[idx];
+		tx->heard[idx] = (rx != node) && !rx->deaf && rx->listening && (rx->listen_until >= sim_us);
+	}
+
+	if (node == nodes[0])
+	{
+		beacon_start = sim_us;
+		return;
+	}
+	// Packets of the nodes must fit into their slot of the frame of the coordinator
+	uint32_t slot_len = (FRAME_MS - API_TDMA_BEACON_SLOT) / SLOTS;
+	uint64_t slot_start = beacon_start + 1000ULL * (API_TDMA_BEACON_SLOT + node->slot * slot_len);
+	uint64_t slot_end = slot_start + 1000ULL * slot_len;
+	if ((tx->start < slot_start) || (tx->end > slot_end))
+	{
+		printf("Node %d slot %d sent at %lldus of the frame\n", (int)(node - nodes[0]), node->slot, (long long)(tx->start - beacon_start));
+		off_slot++;
+	}
+	int64_t drift = (int64_t)tx->start - (int64_t)(slot_start + 1000 * API_TDMA_GUARD);
+	uint32_t drift_us = drift < 0 ? -drift : drift;
+	if (drift_us > max_drift_us)
+	{
+		max_drift_us = drift_us;
+	}
+}
+
+static void sim_event(sim_node *node, uint8_t event);
+
+/**
+ * @brief Finish the transmissions that are done, deliver them to the listening nodes
+ *
+ */
+static void sim_medium(void)
+{
+	uint8_t idx = 0;
+	while (idx < medium_num)
+	{
+		sim_tx *tx = &medium[idx];
+		if (tx->end > sim_us)
+		{
+			idx++;
+			continue;
+		}
+		sim_node *sender = tx->sender;
+		sender->state = P2P_STATE_SLEEP;
+		if (!sender->tdma_tx_done())
+		{
+			sender->tx_busy = false;
+			sender->packets++;
+		}
+		// After TX the state machine goes back to the RX mode
+		sim_event(sender, P2P_EV_MODE);
+		for (uint8_t rx_idx = 0; rx_idx < NODES; rx_idx++)
+		{
+			sim_node *rx = nodes[rx_idx];
+			if (!tx->heard[rx_idx] || tx->collided || (rx->state == P2P_STATE_TX))
+			{
+				continue;
+			}
+			rx->listening = *rx->rx_mode == RX_MODE_RX;
+			if (rx->tdma_rx(tx->data, tx->len))
+			{
+				rx->beacons++;
+			}
+		}
+		medium[idx] = medium[--medium_num];
+	}
+}
+
+/**
+ * @brief Events of the TDMA module to the P2P state machine
+ *
+ * @param node the node
+ * @param event P2P_EV_MODE, P2P_EV_TX_START or P2P_EV_CAD_FREE
+ */
+static void sim_event(sim_node *node, uint8_t event)
+{
+	switch (event)
+	{
+	case P2P_EV_MODE:
+		node->listening = (*node->rx_mode == RX_MODE_RX) || (*node->rx_mode == RX_MODE_RX_TIMED);
+		node->listen_until = *node->rx_mode == RX_MODE_RX ? UINT64_MAX : sim_us + 1000ULL * *node->rx_time;
+		break;
+	case P2P_EV_TX_START:
+	case P2P_EV_CAD_FREE:
+		sim_send(node);
+		break;
+	}
+}
+
+namespace node0
+{
+#include "tdma_node.h"
+}
+namespace node1
+{
+#include "tdma_node.h"
+}
+namespace node2
+{
+#include "tdma_node.h"
+}
+namespace node3
+{
+#include "tdma_node.h"
+}
+namespace node4
+{
+#include "tdma_node.h"
+}
+namespace node5
+{
+#include "tdma_node.h"
+}
+
+/**
+ * @brief Start a network, the coordinator and the nodes with their slots
+ *
+ * @param ppm clock error of every node
+ * @param offset_ms start value of millis() of every node
+ */
+static void sim_start(const int32_t *ppm, const uint32_t *offset_ms)
+{
+	sim_us = 0;
+	medium_num = 0;
+	beacon_start = 0;
+	collisions = 0;
+	off_slot = 0;
+	max_drift_us = 0;
+	nodes[0] = node0::node_init(ppm[0], offset_ms[0]);
+	nodes[1] = node1::node_init(ppm[1], offset_ms[1]);
+	nodes[2] = node2::node_init(ppm[2], offset_ms[2]);
+	nodes[3] = node3::node_init(ppm[3], offset_ms[3]);
+	nodes[4] = node4::node_init(ppm[4], offset_ms[4]);
+	nodes[5] = node5::node_init(ppm[5], offset_ms[5]);
+
+	for (uint8_t idx = 1; idx < NODES; idx++)
+	{
+		// Every second slot is used, the neighbour slots of a node are free
+		nodes[idx]->slot = 2 * idx - 1;
+		nodes[idx]->tdma_slot(nodes[idx]->slot);
+		CHECK(nodes[idx]->tdma(TDMA_NODE, 0, 0));
+	}
+	CHECK(nodes[0]->tdma(TDMA_COORDINATOR, FRAME_MS, SLOTS));
+}
+
+/**
+ * @brief Run the network, every synced node tries to send one packet per frame
+ *
+ * @param frames number of frames to run
+ */
+static void sim_run(uint32_t frames)
+{
+	uint64_t end = sim_us + 1000ULL * FRAME_MS * frames;
+	while (sim_us < end)
+	{
+		sim_us += 1000;
+		sim_medium();
+		for (uint8_t idx = 0; idx < NODES; idx++)
+		{
+			sim_node *node = nodes[idx];
+			sim_run_jobs(node);
+
+			s_tdma_status status;
+			node->tdma_status(&status);
+			if (node->synced && !status.synced)
+			{
+				node->sync_lost++;
+			}
+			node->synced = status.synced;
+
+			// The application of a node sends at a random time of the frame
+			if ((idx != 0) && status.synced && !node->tx_busy && (random(FRAME_MS) == 0))
+			{
+				node->tx_busy = true;
+				node->tx_len = APP_LEN;
+				memset(node->tx_buf, idx, APP_LEN);
+				if (!node->tdma_defer())
+				{
+					sim_send(node);
+				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief Let the last transmissions finish
+ *
+ */
+static void sim_flush(void)
+{
+	while (medium_num != 0)
+	{
+		sim_us += 1000;
+		sim_medium();
+	}
+}
+
+/**
+ * @brief Switch TDMA off on all nodes
+ *
+ */
+static void sim_stop(void)
+{
+	sim_flush();
+	for (uint8_t idx = 0; idx < NODES; idx++)
+	{
+		nodes[idx]->tdma(TDMA_OFF, 0, 0);
+	}
+}
+
+/**
+ * @brief Clocks with a normal crystal error, one clock wraps during the test
+ *
+ */
+static void test_no_collision(void)
+{
+	const int32_t ppm[NODES] = {20, 40, -40, 100, -100, 0};
+	const uint32_t offset_ms[NODES] = {5000, 0, 0xFFFFFFFF - 200000, 123456, 77, 999999};
+	sim_start(ppm, offset_ms);
+	sim_run(200);
+
+	CHECK_EQ(collisions, 0);
+	CHECK_EQ(off_slot, 0);
+	CHECK(max_drift_us <= 1000 * API_TDMA_GUARD);
+	printf("drift: max %ldus from the planned slot start\n", (long)max_drift_us);
+	for (uint8_t idx = 1; idx < NODES; idx++)
+	{
+		CHECK(nodes[idx]->synced);
+		CHECK_EQ(nodes[idx]->sync_lost, 0);
+		// The first beacon is sent 1ms after the start
+		CHECK_EQ(nodes[idx]->beacons, 200);
+		CHECK(nodes[idx]->packets > 100);
+	}
+	// The last beacon is on air
+	sim_flush();
+	s_tdma_status coordinator;
+	s_tdma_status node;
+	nodes[0]->tdma_status(&coordinator);
+	nodes[1]->tdma_status(&node);
+	CHECK_EQ(node.frame, coordinator.frame);
+	CHECK_EQ(node.slots, SLOTS);
+	CHECK_EQ(node.frame_ms, FRAME_MS);
+	sim_stop();
+}
+
+/**
+ * @brief A node misses beacons, it keeps its slot from its own clock until it gives up
+ *
+ */
+static void test_missed_beacons(void)
+{
+	const int32_t ppm[NODES] = {0, 100, -100, 100, -100, 100};
+	const uint32_t offset_ms[NODES] = {0, 0, 0, 0, 0, 0};
+	sim_start(ppm, offset_ms);
+	sim_run(5);
+
+	// Less than API_TDMA_MAX_MISSED beacons missed, still in sync
+	nodes[2]->deaf = true;
+	sim_run(API_TDMA_MAX_MISSED - 1);
+	nodes[2]->deaf = false;
+	sim_run(5);
+	CHECK_EQ(nodes[2]->sync_lost, 0);
+	CHECK_EQ(nodes[2]->beacons, nodes[1]->beacons - (API_TDMA_MAX_MISSED - 1));
+
+	// API_TDMA_MAX_MISSED beacons missed, the node listens until the next beacon
+	nodes[2]->deaf = true;
+	sim_run(API_TDMA_MAX_MISSED + 1);
+	CHECK(!nodes[2]->synced);
+	CHECK_EQ(nodes[2]->sync_lost, 1);
+	CHECK_EQ(*nodes[2]->rx_mode, RX_MODE_RX);
+	nodes[2]->deaf = false;
+	sim_run(2);
+	CHECK(nodes[2]->synced);
+	sim_run(5);
+
+	CHECK_EQ(collisions, 0);
+	CHECK_EQ(off_slot, 0);
+	CHECK(max_drift_us <= 1000 * API_TDMA_GUARD);
+	for (uint8_t idx = 1; idx < NODES; idx++)
+	{
+		CHECK(nodes[idx]->synced);
+		CHECK_EQ(nodes[idx]->sync_lost, idx == 2 ? 1 : 0);
+	}
+	sim_stop();
+}
+
+/**
+ * @brief A clock that is too slow for the guard time opens the beacon window too late
+ *
+ */
+static void test_drift_beyond_guard(void)
+{
+	// 3000ppm of 10s is 30ms per frame, more than the guard time
+	const int32_t ppm[NODES] = {0, 0, -3000, 0, 0, 0};
+	const uint32_t offset_ms[NODES] = {0, 0, 0, 0, 0, 0};
+	sim_start(ppm, offset_ms);
+	sim_run(50);
+
+	// The node gets a beacon only after it lost sync and listens all the time
+	CHECK(nodes[2]->sync_lost > 5);
+	CHECK(nodes[2]->beacons < 50);
+	CHECK_EQ(nodes[1]->sync_lost, 0);
+	CHECK_EQ(nodes[1]->beacons, 50);
+	// Between the beacons the node still finds its slot
+	CHECK_EQ(collisions, 0);
+	CHECK_EQ(off_slot, 0);
+	sim_stop();
+}
+
+/**
+ * @brief Two nodes with the same slot collide, the simulation must see it
+ *
+ */
+static void test_same_slot(void)
+{
+	const int32_t ppm[NODES] = {0, 0, 0, 0, 0, 0};
+	const uint32_t offset_ms[NODES] = {0, 0, 0, 0, 0, 0};
+	sim_start(ppm, offset_ms);
+	nodes[5]->slot = nodes[1]->slot;
+	nodes[5]->tdma_slot(nodes[5]->slot);
+	sim_run(100);
+
+	CHECK(collisions > 0);
+	CHECK_EQ(off_slot, 0);
+	sim_stop();
+}
+
+int main(void)
+{
+	test_no_collision();
+	test_missed_beacons();
+	test_drift_beyond_guard();
+	test_same_slot();
+	return host_report("test_tdma");
+}
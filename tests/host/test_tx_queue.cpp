@@ -0,0 +1,164 @@
+/**
+ * @file test_tx_queue.cpp
+ * @author Bernd Giesecke (bernd.giesecke@rakwireless.com)
+ * @brief Host test of the TX queue retries and back-off
+ * @version 0.1
+ * @date 2022-03-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+#include "WisBlock-API.h"
+#include "host_platform.h"
+#include "host_sched.h"
+#include "host_test.h"
+
+s_lorawan_settings g_lorawan_settings;
+bool g_lpwan_has_joined = true;
+
+/** Result the fake LoRaWAN stack returns for the next send requests */
+static lmh_error_status send_result = LMH_SUCCESS;
+/** Number of send requests */
+static uint32_t send_count = 0;
+/** Times of the send requests */
+static uint32_t send_time[16];
+
+lmh_error_status send_lora_packet(uint8_t *, uint8_t, uint8_t)
+{
+	if (send_count < 16)
+	{
+		send_time[send_count] = millis();
+	}
+	send_count++;
+	return send_result;
+}
+
+bool send_p2p_packet(uint8_t *, uint8_t) { return send_result == LMH_SUCCESS; }
+
+/** Handle and result reported to the callback */
+static uint16_t done_handle = 0;
+static int done_result = -1;
+
+static void tx_done(uint16_t handle, uint8_t result)
+{
+	done_handle = handle;
+	done_result = result;
+}
+
+/**
+ * @brief A busy stack schedules a retry, the queue waits for it
+ *
+ */
+static void test_busy(void)
+{
+	uint8_t data[4] = {1, 2, 3, 4};
+	send_result = LMH_BUSY;
+	send_count = 0;
+
+	uint16_t handle = api_tx_enqueue(data, 4, 2, 0, 0, tx_done);
+	CHECK(handle != 0);
+	CHECK_EQ(send_count, 1);
+	CHECK_EQ(host_sched_count(), 1);
+	CHECK(host_sched_last_delay() >= API_TX_QUEUE_BACKOFF);
+	CHECK(host_sched_last_delay() <= 2 * API_TX_QUEUE_BACKOFF);
+
+	// The loop wakes up for other reasons, the queue keeps waiting
+	tx_queue_pump();
+	CHECK_EQ(send_count, 1);
+
+	// Back-off is over, the stack is free again
+	send_result = LMH_SUCCESS;
+	host_sched_run_for(2 * API_TX_QUEUE_BACKOFF);
+	CHECK_EQ(send_count, 2);
+	CHECK_EQ(host_sched_count(), 0);
+
+	tx_queue_result(TX_RESULT_SENT);
+	tx_queue_finish();
+	CHECK_EQ(done_handle, handle);
+	CHECK_EQ(done_result, TX_RESULT_SENT);
+	CHECK_EQ(api_tx_pending(), 0);
+}
+
+/**
+ * @brief A NACK is retried after a random back-off, not right away
+ *
+ */
+static void test_nack_retry(void)
+{
+	uint8_t data[4] = {1, 2, 3, 4};
+	send_result = LMH_SUCCESS;
+	send_count = 0;
+	done_result = -1;
+
+	uint16_t handle = api_tx_enqueue(data, 4, 2, 0, 2, tx_done);
+	CHECK_EQ(send_count, 1);
+
+	uint32_t delays[2];
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		tx_queue_result(TX_RESULT_NACKED);
+		tx_queue_finish();
+		CHECK_EQ(done_result, -1);
+		delays[attempt] = host_sched_last_delay();
+		CHECK(delays[attempt] >= API_TX_QUEUE_BACKOFF);
+		CHECK(delays[attempt] <= 2 * API_TX_QUEUE_BACKOFF);
+
+		// Not sent again before the back-off is over
+		tx_queue_pump();
+		CHECK_EQ(send_count, attempt + 1);
+		host_sched_run_for(delays[attempt] - 1);
+		CHECK_EQ(send_count, attempt + 1);
+		host_sched_run_for(1);
+		CHECK_EQ(send_count, attempt + 2);
+	}
+
+	// Retries are used up, the callback gets the last result
+	tx_queue_result(TX_RESULT_NACKED);
+	tx_queue_finish();
+	CHECK_EQ(done_handle, handle);
+	CHECK_EQ(done_result, TX_RESULT_NACKED);
+	CHECK_EQ(host_sched_count(), 0);
+	CHECK_EQ(api_tx_pending(), 0);
+}
+
+/**
+ * @brief The back-off is random, so nodes that failed together do not retry together
+ *
+ */
+static void test_random_backoff(void)
+{
+	uint8_t data[1] = {0};
+	send_result = LMH_BUSY;
+	send_count = 0;
+
+	uint16_t handle = api_tx_enqueue(data, 1);
+	uint32_t first = host_sched_last_delay();
+	bool differs = false;
+	for (int round = 0; round < 8; round++)
+	{
+		// Every busy retry schedules a new back-off
+		host_sched_run_for(host_sched_last_delay());
+		CHECK_EQ(send_count, round + 2);
+		CHECK_EQ(host_sched_count(), 1);
+		if (host_sched_last_delay() != first)
+		{
+			differs = true;
+		}
+	}
+	CHECK(differs);
+
+	CHECK(api_tx_cancel(handle));
+	host_sched_run_for(2 * API_TX_QUEUE_BACKOFF);
+	CHECK_EQ(host_sched_count(), 0);
+	CHECK_EQ(send_count, 9);
+}
+
+int main(void)
+{
+	g_lorawan_settings.lorawan_enable = true;
+	host_random_seed(12345);
+	test_busy();
+	test_nack_retry();
+	test_random_backoff();
+	return host_report("test_tx_queue");
+}